@@ -1,45 +1,424 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <vector>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
 
 #include <ew/external/glad.h>
+#include <ew/profiler.h>
+#include <ew/shader.h>
+#include <ew/model.h>
+#include <ew/asyncModelLoader.h>
+#include <ew/camera.h>
+#include <ew/texture.h>
+#include <ew/textureBake.h>
+#include <ew/headless.h>
+#include <ew/framebuffer.h>
 
 #include <GLFW/glfw3.h>
 #include <imgui.h>
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+//Command line options for running without a window, e.g.
+//	assignment0 --headless --frames 600 --timings timings.csv --screenshot last.ppm
+struct HeadlessSettings {
+	bool enabled = false;
+	int numFrames = 300;
+	const char* timingsPath = nullptr; //CSV of frame, cpu_ms, gpu_ms
+	const char* screenshotPath = nullptr; //PPM of the last frame
+	const char* tracePath = nullptr; //Chrome trace of every frame
+};
+
+//Loads an extra model partway through the run, e.g.
+//	assignment0 --headless --stream big.obj --stream-frame 60 --stream-budget 2048
+struct StreamSettings {
+	const char* filePath = nullptr;
+	int frame = 60; //Frame that requests the model
+	size_t uploadBudget = 4 * 1024 * 1024; //Bytes uploaded per frame
+	bool blocking = false; //Construct an ew::Model on the spot instead, for comparison
+};
+
+//The streamed model, loaded either way
+struct StreamedModel {
+	std::shared_ptr<ew::AsyncModel> model;
+	std::unique_ptr<ew::Model> blockingModel;
+	int requestFrame = -1;
+	int readyFrame = -1;
+};
+
 void framebufferSizeCallback(GLFWwindow* window, int width, int height);
 GLFWwindow* initWindow(const char* title, int width, int height);
+bool parseArgs(int argc, char** argv, HeadlessSettings* settings, StreamSettings* stream);
+int runHeadless(const HeadlessSettings& settings, const StreamSettings& stream);
+ew::Camera orbitCamera(float time);
+unsigned int loadTexturePreferBaked(const char* filePath);
+void renderScene(const ew::Shader& shader, ew::Model& model, unsigned int texture, const ew::Camera& camera, float time);
+void updateStreamed(const StreamSettings& stream, ew::AsyncModelLoader& loader, StreamedModel* streamed, int frame, const ew::Camera& camera);
+void drawStreamed(const ew::Shader& shader, const StreamedModel& streamed);
 void drawUI();
 
 //Global state
+const glm::vec3 STREAMED_POSITION = glm::vec3(2.5f, 0.0f, 0.0f);
 int screenWidth = 1080;
 int screenHeight = 720;
 float prevFrameTime;
 float deltaTime;
 
-int main() {
+int main(int argc, char** argv) {
+	HeadlessSettings headless;
+	StreamSettings stream;
+	if (!parseArgs(argc, argv, &headless, &stream)) {
+		return 1;
+	}
+	if (headless.enabled) {
+		return runHeadless(headless, stream);
+	}
+
 	GLFWwindow* window = initWindow("Assignment 0", screenWidth, screenHeight);
 	glfwSetFramebufferSizeCallback(window, framebufferSizeCallback);
 
-	while (!glfwWindowShouldClose(window)) {
+	ew::Shader shader("assets/lit.vert", "assets/lit.frag");
+	ew::Model model("assets/Suzanne.obj");
+	unsigned int brickTexture = loadTexturePreferBaked("assets/brick_color.jpg");
+	ew::AsyncModelLoader loader(stream.uploadBudget);
+	StreamedModel streamed;
+
+	for (int frame = 0; !glfwWindowShouldClose(window); frame++) {
+		ew::Profiler::global().beginFrame();
 		glfwPollEvents();
 
 		float time = (float)glfwGetTime();
 		deltaTime = time - prevFrameTime;
 		prevFrameTime = time;
+		ew::Camera camera = orbitCamera(time);
+		updateStreamed(stream, loader, &streamed, frame, camera);
 
 		//RENDER
-		glClearColor(0.6f,0.8f,0.92f,1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		{
+			EW_PROFILE_SCOPE("Render");
+			EW_PROFILE_GPU_SCOPE("Render");
+			renderScene(shader, model, brickTexture, camera, time);
+			drawStreamed(shader, streamed);
+		}
 
-		drawUI();
+		{
+			EW_PROFILE_SCOPE("UI");
+			EW_PROFILE_GPU_SCOPE("UI");
+			drawUI();
+		}
 
-		glfwSwapBuffers(window);
+		{
+			EW_PROFILE_SCOPE("Swap");
+			glfwSwapBuffers(window);
+		}
+		ew::Profiler::global().endFrame();
 	}
 	printf("Shutting down...");
 }
 
+/// <summary>
+/// Camera circling the origin. Headless mode drives this with the frame index so every run renders the same frames.
+/// </summary>
+/// <param name="time">Seconds</param>
+ew::Camera orbitCamera(float time) {
+	ew::Camera camera;
+	const float radius = 5.0f;
+	float angle = time * 0.5f;
+	camera.position = glm::vec3(sinf(angle) * radius, 1.5f, cosf(angle) * radius);
+	camera.target = glm::vec3(0.0f);
+	camera.aspectRatio = (float)screenWidth / screenHeight;
+	return camera;
+}
+
+/// <summary>
+/// Loads the .ewtex written by textureBaker next to the image, since it uploads without decoding or generating mips.
+/// Falls back to decoding the image. Freshness is up to the bake step, which rebakes from the source asset on every
+/// build: the copied image gets a new timestamp each build, so comparing against it here would always reject the bake.
+/// </summary>
+/// <param name="filePath">Source image</param>
+/// <returns>Texture handle</returns>
+unsigned int loadTexturePreferBaked(const char* filePath) {
+	std::string bakedPath = ew::getBakedTexturePath(filePath);
+	std::error_code error;
+	if (std::filesystem::exists(bakedPath, error)) {
+		unsigned int texture = ew::loadBakedTexture(bakedPath.c_str());
+		if (texture != 0) {
+			return texture;
+		}
+	}
+	return ew::loadTexture(filePath);
+}
+
+void renderScene(const ew::Shader& shader, ew::Model& model, unsigned int texture, const ew::Camera& camera, float time) {
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_CULL_FACE);
+	glClearColor(0.6f, 0.8f, 0.92f, 1.0f);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	glm::mat4 modelMatrix = glm::rotate(glm::mat4(1.0f), time, glm::vec3(0.0f, 1.0f, 0.0f));
+	shader.use();
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	shader.setInt("_MainTex", 0);
+	shader.setMat4("_Model", modelMatrix);
+	shader.setMat4("_ViewProjection", camera.projectionMatrix() * camera.viewMatrix());
+	shader.setVec3("_EyePos", camera.position);
+	model.draw();
+}
+
+/// <summary>
+/// Requests the streamed model on its frame and advances the loader. Records when the model finished.
+/// </summary>
+void updateStreamed(const StreamSettings& stream, ew::AsyncModelLoader& loader, StreamedModel* streamed, int frame, const ew::Camera& camera) {
+	if (stream.filePath == nullptr) {
+		return;
+	}
+	if (frame == stream.frame) {
+		streamed->requestFrame = frame;
+		if (stream.blocking) {
+			streamed->blockingModel.reset(new ew::Model(stream.filePath));
+			streamed->readyFrame = frame;
+		}
+		else {
+			streamed->model = loader.load(stream.filePath, STREAMED_POSITION);
+		}
+	}
+	loader.update(camera);
+	if (streamed->model && streamed->readyFrame < 0) {
+		ew::ModelLoadState state = streamed->model->getState();
+		if (state == ew::ModelLoadState::READY || state == ew::ModelLoadState::FAILED) {
+			streamed->readyFrame = frame;
+		}
+	}
+}
+
+//Draws whatever part of the streamed model has arrived, next to Suzanne. Expects renderScene's shader state.
+void drawStreamed(const ew::Shader& shader, const StreamedModel& streamed) {
+	shader.setMat4("_Model", glm::translate(glm::mat4(1.0f), STREAMED_POSITION));
+	if (streamed.model) {
+		streamed.model->draw();
+	}
+	if (streamed.blockingModel) {
+		streamed.blockingModel->draw();
+	}
+}
+
+/// <summary>
+/// Renders a fixed number of frames into an offscreen framebuffer with a fixed time step, without a window or vsync.
+/// Each frame records CPU time spent submitting and GPU time from a GL_TIME_ELAPSED query.
+/// </summary>
+/// <param name="settings">Parsed command line</param>
+/// <returns>Process exit code</returns>
+int runHeadless(const HeadlessSettings& settings, const StreamSettings& stream) {
+	ew::HeadlessContext context;
+	if (!context.create()) {
+		return 1;
+	}
+	printf("GL %s, %s\n", (const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_RENDERER));
+	ew::Framebuffer framebuffer;
+	if (!framebuffer.create(screenWidth, screenHeight)) {
+		return 1;
+	}
+	ew::Shader shader("assets/lit.vert", "assets/lit.frag");
+	ew::Model model("assets/Suzanne.obj");
+	unsigned int brickTexture = loadTexturePreferBaked("assets/brick_color.jpg");
+	ew::AsyncModelLoader loader(stream.uploadBudget);
+	StreamedModel streamed;
+
+	int numFrames = settings.numFrames;
+	std::vector<unsigned int> queries(numFrames);
+	glGenQueries(numFrames, queries.data());
+	std::vector<double> cpuMilliseconds(numFrames);
+	//Like a swap chain, keep at most this many frames queued so the CPU can't run arbitrarily far ahead
+	const int MAX_FRAMES_IN_FLIGHT = 2;
+	std::vector<GLsync> fences(MAX_FRAMES_IN_FLIGHT, nullptr);
+
+	if (settings.tracePath != nullptr) {
+		ew::Profiler::global().startCapture();
+	}
+	//Warm up so shader compilation and first use uploads don't land in frame 0
+	framebuffer.bind();
+	renderScene(shader, model, brickTexture, orbitCamera(0.0f), 0.0f);
+	glFinish();
+
+	const float FIXED_DELTA_TIME = 1.0f / 60.0f;
+	auto runStart = std::chrono::steady_clock::now();
+	for (int frame = 0; frame < numFrames; frame++)
+	{
+		GLsync& fence = fences[frame % MAX_FRAMES_IN_FLIGHT];
+		if (fence != nullptr) {
+			glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			glDeleteSync(fence);
+		}
+		ew::Profiler::global().beginFrame();
+		auto frameStart = std::chrono::steady_clock::now();
+		float time = frame * FIXED_DELTA_TIME;
+		ew::Camera camera = orbitCamera(time);
+		updateStreamed(stream, loader, &streamed, frame, camera);
+		{
+			EW_PROFILE_SCOPE("Render");
+			EW_PROFILE_GPU_SCOPE("Render");
+			glBeginQuery(GL_TIME_ELAPSED, queries[frame]);
+			framebuffer.bind();
+			renderScene(shader, model, brickTexture, camera, time);
+			drawStreamed(shader, streamed);
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		glFlush();
+		cpuMilliseconds[frame] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+		ew::Profiler::global().endFrame();
+	}
+	glFinish();
+	double totalMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - runStart).count();
+	for (GLsync fence : fences) {
+		if (fence != nullptr) {
+			glDeleteSync(fence);
+		}
+	}
+
+	std::vector<double> gpuMilliseconds(numFrames);
+	for (int i = 0; i < numFrames; i++)
+	{
+		GLuint64 nanoseconds = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &nanoseconds);
+		gpuMilliseconds[i] = nanoseconds / 1e6;
+	}
+	glDeleteQueries(numFrames, queries.data());
+
+	if (settings.timingsPath != nullptr) {
+		FILE* file = fopen(settings.timingsPath, "w");
+		if (file == NULL) {
+			printf("Failed to open %s for writing\n", settings.timingsPath);
+			return 1;
+		}
+		fprintf(file, "frame,cpu_ms,gpu_ms\n");
+		for (int i = 0; i < numFrames; i++)
+		{
+			fprintf(file, "%d,%.4f,%.4f\n", i, cpuMilliseconds[i], gpuMilliseconds[i]);
+		}
+		fclose(file);
+	}
+	if (settings.screenshotPath != nullptr) {
+		std::vector<unsigned char> pixels;
+		framebuffer.readPixels(pixels);
+		if (!ew::writeImagePPM(settings.screenshotPath, pixels.data(), framebuffer.getWidth(), framebuffer.getHeight())) {
+			return 1;
+		}
+	}
+	if (settings.tracePath != nullptr) {
+		ew::Profiler::global().stopCapture();
+		ew::Profiler::global().writeChromeTrace(settings.tracePath);
+	}
+
+	auto printSummary = [](const char* label, std::vector<double> milliseconds) {
+		std::sort(milliseconds.begin(), milliseconds.end());
+		double sum = 0.0;
+		for (double ms : milliseconds) {
+			sum += ms;
+		}
+		size_t n = milliseconds.size();
+		printf("%s ms: mean %.3f, median %.3f, p95 %.3f, min %.3f, max %.3f\n", label, sum / n,
+			milliseconds[n / 2], milliseconds[std::min(n - 1, n * 95 / 100)], milliseconds.front(), milliseconds.back());
+	};
+	printf("%d frames at %dx%d in %.1f ms (%.1f fps)\n", numFrames, screenWidth, screenHeight, totalMilliseconds, numFrames * 1000.0 / totalMilliseconds);
+	printSummary("CPU", cpuMilliseconds);
+	printSummary("GPU", gpuMilliseconds);
+	if (streamed.requestFrame >= 0) {
+		//Worst frame from the request until the model is complete, against the worst frame outside that window
+		int lastFrame = streamed.readyFrame >= 0 ? streamed.readyFrame : numFrames - 1;
+		double worstDuring = 0.0;
+		double worstOutside = 0.0;
+		for (int i = 0; i < numFrames; i++)
+		{
+			double& worst = i >= streamed.requestFrame && i <= lastFrame ? worstDuring : worstOutside;
+			worst = std::max(worst, cpuMilliseconds[i]);
+		}
+		printf("Loaded %s %s: requested frame %d, ", stream.filePath, stream.blocking ? "blocking" : "streamed", streamed.requestFrame);
+		if (streamed.readyFrame >= 0) {
+			printf("complete frame %d", streamed.readyFrame);
+		}
+		else {
+			printf("not complete");
+		}
+		printf(", worst CPU frame %.3f ms during the load, %.3f ms outside it\n", worstDuring, worstOutside);
+		if (streamed.model) {
+			const ew::ModelLoadStats& stats = streamed.model->getStats();
+			printf("Import %.3f ms on a worker, upload %.3f ms over %d frames (at most %.3f ms per frame), %zu bytes\n",
+				stats.importMs, stats.uploadMs, stats.framesToReady, stats.maxUploadMs, stats.bytes);
+		}
+	}
+	return 0;
+}
+
+/// <summary>
+/// Reads --headless, --frames N, --width N, --height N, --timings path, --screenshot path and --trace path,
+/// and --stream path, --stream-frame N, --stream-budget KB and --stream-blocking
+/// </summary>
+/// <returns>False on unknown or malformed arguments</returns>
+bool parseArgs(int argc, char** argv, HeadlessSettings* settings, StreamSettings* stream) {
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+		if (strcmp(arg, "--headless") == 0) {
+			settings->enabled = true;
+			continue;
+		}
+		if (strcmp(arg, "--stream-blocking") == 0) {
+			stream->blocking = true;
+			continue;
+		}
+		if (value == nullptr) {
+			printf("Unknown or incomplete argument %s\n", arg);
+			return false;
+		}
+		if (strcmp(arg, "--frames") == 0) {
+			settings->numFrames = atoi(value);
+		}
+		else if (strcmp(arg, "--width") == 0) {
+			screenWidth = atoi(value);
+		}
+		else if (strcmp(arg, "--height") == 0) {
+			screenHeight = atoi(value);
+		}
+		else if (strcmp(arg, "--timings") == 0) {
+			settings->timingsPath = value;
+		}
+		else if (strcmp(arg, "--screenshot") == 0) {
+			settings->screenshotPath = value;
+		}
+		else if (strcmp(arg, "--trace") == 0) {
+			settings->tracePath = value;
+		}
+		else if (strcmp(arg, "--stream") == 0) {
+			stream->filePath = value;
+		}
+		else if (strcmp(arg, "--stream-frame") == 0) {
+			stream->frame = atoi(value);
+		}
+		else if (strcmp(arg, "--stream-budget") == 0) {
+			stream->uploadBudget = (size_t)atoi(value) * 1024;
+		}
+		else {
+			printf("Unknown argument %s\n", arg);
+			return false;
+		}
+		i++;
+	}
+	if (settings->numFrames <= 0 || screenWidth <= 0 || screenHeight <= 0) {
+		printf("Frame count and size must be positive\n");
+		return false;
+	}
+	return true;
+}
+
 void drawUI() {
 	ImGui_ImplGlfw_NewFrame();
 	ImGui_ImplOpenGL3_NewFrame();
@@ -49,6 +428,8 @@ void drawUI() {
 	ImGui::Text("Add Controls Here!");
 	ImGui::End();
 
+	ew::Profiler::global().drawUI();
+
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
@@ -94,4 +475,3 @@ GLFWwindow* initWindow(const char* title, int width, int height) {
 
 	return window;
 }
-
@@ -0,0 +1,335 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "assetRegistry.h"
+#include "texture.h"
+#include "external/glad.h"
+#include <stdio.h>
+#include <algorithm>
+#include <filesystem>
+#include <future>
+#include <mutex>
+#include <unordered_map>
+
+namespace ew {
+	//Loaded and loading assets of one type, by key
+	template<typename T>
+	struct AssetTable {
+		struct Entry {
+			std::weak_ptr<T> asset;
+			std::shared_future<std::shared_ptr<T>> pending; //Valid while the first requester is loading
+			const T* object = nullptr; //Identifies which load the entry belongs to
+			size_t bytes = 0;
+		};
+		std::unordered_map<std::string, Entry> entries;
+		AssetStats stats;
+	};
+
+	struct AssetRegistry::State {
+		mutable std::mutex mutex;
+		AssetTable<const TextureAsset> textures;
+		AssetTable<Model> models;
+		AssetTable<AsyncModel> asyncModels; //Reported under AssetType::MODEL
+		AssetTable<const Shader> shaders;
+	};
+
+	/// <summary>
+	/// Returns the asset for key, loading it if nobody holds it. The first request for a key loads outside the lock;
+	/// requests that arrive meanwhile wait on its future. Failed loads are not remembered, so a later request retries.
+	/// </summary>
+	/// <param name="state">Registry state, kept alive by the handle's deleter</param>
+	/// <param name="table">Table of the asset's type</param>
+	/// <param name="key">Normalized path and parameters</param>
+	/// <param name="load">Returns the asset, owning its GL objects, and its size in bytes. nullptr on failure.</param>
+	template<typename T, typename Load>
+	static std::shared_ptr<T> acquire(const std::shared_ptr<AssetRegistry::State>& state, AssetTable<T>* table, const std::string& key, Load load) {
+		std::unique_lock<std::mutex> lock(state->mutex);
+		auto it = table->entries.find(key);
+		if (it != table->entries.end()) {
+			std::shared_ptr<T> asset = it->second.asset.lock();
+			if (asset) {
+				table->stats.hits++;
+				return asset;
+			}
+			if (it->second.pending.valid()) {
+				table->stats.hits++;
+				table->stats.coalesced++;
+				std::shared_future<std::shared_ptr<T>> pending = it->second.pending;
+				lock.unlock();
+				return pending.get();
+			}
+		}
+		table->stats.misses++;
+		std::promise<std::shared_ptr<T>> promise;
+		typename AssetTable<T>::Entry& pendingEntry = table->entries[key];
+		pendingEntry.pending = promise.get_future().share();
+		//The previous asset's deleter may not have run yet, and must leave this entry alone when it does
+		pendingEntry.object = nullptr;
+		lock.unlock();
+
+		std::pair<std::shared_ptr<T>, size_t> loaded = load();
+		size_t bytes = loaded.second;
+		std::shared_ptr<T> asset;
+		if (loaded.first) {
+			//Handles share one count. When it reaches zero the loaded asset is released, freeing its GL objects.
+			std::shared_ptr<T> owner = loaded.first;
+			asset = std::shared_ptr<T>(owner.get(), [state, table, key, bytes, owner](T* object) mutable {
+				{
+					std::lock_guard<std::mutex> lock(state->mutex);
+					table->stats.numLive--;
+					table->stats.bytes -= bytes;
+					table->stats.released++;
+					auto it = table->entries.find(key);
+					//A new load of the same key may have replaced the entry since
+					if (it != table->entries.end() && it->second.object == object) {
+						table->entries.erase(it);
+					}
+				}
+				//Freed after the entry is gone, so a new load cannot reuse the address while the entry still names it
+				owner.reset();
+			});
+		}
+
+		lock.lock();
+		//Entries are only erased by their own asset's deleter, so this one is still here
+		typename AssetTable<T>::Entry& entry = table->entries[key];
+		entry.pending = std::shared_future<std::shared_ptr<T>>();
+		if (asset) {
+			entry.asset = asset;
+			entry.object = asset.get();
+			entry.bytes = bytes;
+			table->stats.numLive++;
+			table->stats.bytes += bytes;
+		}
+		else {
+			table->entries.erase(key);
+		}
+		lock.unlock();
+		promise.set_value(asset);
+		return asset;
+	}
+
+	static int getComponentCount(int internalFormat) {
+		switch (internalFormat) {
+		case GL_RED:
+			return 1;
+		case GL_RG:
+			return 2;
+		case GL_RGB:
+			return 3;
+		default:
+			return 4;
+		}
+	}
+
+	AssetRegistry::AssetRegistry()
+	{
+		m_state = std::make_shared<State>();
+	}
+
+	AssetRegistry::~AssetRegistry()
+	{
+	}
+
+	TextureHandle AssetRegistry::loadTexture(const std::string& filePath)
+	{
+		return loadTexture(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
+	}
+
+	TextureHandle AssetRegistry::loadTexture(const std::string& filePath, int wrapMode, int magFilter, int minFilter, bool mipmap)
+	{
+		std::string key = normalizePath(filePath) + "|" + std::to_string(wrapMode) + "," + std::to_string(magFilter) + ","
+			+ std::to_string(minFilter) + "," + (mipmap ? "mip" : "nomip");
+		return acquire(m_state, &m_state->textures, key, [&]() {
+			unsigned int id = ew::loadTexture(filePath.c_str(), wrapMode, magFilter, minFilter, mipmap);
+			if (id == 0) {
+				return std::make_pair(std::shared_ptr<const TextureAsset>(), (size_t)0);
+			}
+			std::shared_ptr<TextureAsset> texture(new TextureAsset(), [](TextureAsset* texture) {
+				glDeleteTextures(1, &texture->id);
+				delete texture;
+			});
+			texture->id = id;
+			int internalFormat = 0;
+			glBindTexture(GL_TEXTURE_2D, id);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &texture->width);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &texture->height);
+			glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+			glBindTexture(GL_TEXTURE_2D, 0);
+			texture->bytes = (size_t)texture->width * texture->height * getComponentCount(internalFormat);
+			if (mipmap) {
+				//Each level is a quarter of the one above, so the whole chain adds a third
+				texture->bytes += texture->bytes / 3;
+			}
+			return std::make_pair(std::shared_ptr<const TextureAsset>(texture), texture->bytes);
+		});
+	}
+
+	//Every ModelSettings field changes what gets loaded or where it goes
+	static std::string getModelKey(const std::string& filePath, const ModelSettings& settings) {
+		std::string key = AssetRegistry::normalizePath(filePath) + "|" + (settings.useMeshCache ? "cache," : "nocache,") + (settings.optimizeMeshes ? "opt" : "noopt");
+		for (size_t i = 0; i < settings.lodRatios.size(); i++)
+		{
+			key += "," + std::to_string(settings.lodRatios[i]);
+		}
+		if (settings.arena != nullptr) {
+			char arena[32];
+			snprintf(arena, sizeof(arena), ",arena%p", (void*)settings.arena);
+			key += arena;
+		}
+		return key;
+	}
+
+	ModelHandle AssetRegistry::loadModel(const std::string& filePath, const ModelSettings& settings)
+	{
+		return acquire(m_state, &m_state->models, getModelKey(filePath, settings), [&]() {
+			std::shared_ptr<Model> model(new Model(filePath, settings), [](Model* model) {
+				model->unload();
+				delete model;
+			});
+			size_t bytes = model->getMemoryUsage();
+			if (bytes == 0) {
+				//Model reports its own errors and comes back empty
+				model.reset();
+			}
+			return std::make_pair(model, bytes);
+		});
+	}
+
+	/// <summary>
+	/// Handles hold one reference to the loader's model between them. Once the last handle is released, the loader
+	/// is the only owner left and cancels the model if it is still loading.
+	/// Bytes are not known up front, so getStats() measures async models when asked.
+	/// </summary>
+	std::shared_ptr<AsyncModel> AssetRegistry::loadModelAsync(AsyncModelLoader& loader, const std::string& filePath, const glm::vec3& position, const ModelSettings& settings)
+	{
+		return acquire(m_state, &m_state->asyncModels, getModelKey(filePath, settings) + "|async", [&]() {
+			return std::make_pair(loader.load(filePath, position, settings), (size_t)0);
+		});
+	}
+
+	ShaderHandle AssetRegistry::loadShader(const std::string& vertexShader, const std::string& fragmentShader)
+	{
+		std::string key = normalizePath(vertexShader) + "|" + normalizePath(fragmentShader);
+		return acquire(m_state, &m_state->shaders, key, [&]() {
+			std::string vertexShaderSource = loadShaderSourceFromFile(vertexShader);
+			std::string fragmentShaderSource = loadShaderSourceFromFile(fragmentShader);
+			if (vertexShaderSource.empty() || fragmentShaderSource.empty()) {
+				return std::make_pair(std::shared_ptr<const Shader>(), (size_t)0);
+			}
+			std::shared_ptr<const Shader> shader(new Shader(createShaderProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str())), [](const Shader* shader) {
+				glDeleteProgram(shader->getID());
+				delete shader;
+			});
+			//The program binary is the closest thing to the program's driver memory that GL reports
+			int binaryLength = 0;
+			glGetProgramiv(shader->getID(), GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+			return std::make_pair(shader, (size_t)binaryLength);
+		});
+	}
+
+	/// <summary>
+	/// Stats for one asset type. Async models are measured here, since their size grows as meshes upload,
+	/// so call it on the GL context thread.
+	/// </summary>
+	AssetStats AssetRegistry::getStats(AssetType type) const
+	{
+		//Declared before the lock so it is released after it. Dropping what may be the last handle under the lock would deadlock in its deleter.
+		std::vector<std::shared_ptr<AsyncModel>> asyncModels;
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		switch (type) {
+		case AssetType::TEXTURE:
+			return m_state->textures.stats;
+		case AssetType::SHADER:
+			return m_state->shaders.stats;
+		default:
+			break;
+		}
+		AssetStats stats = m_state->models.stats;
+		const AssetStats& asyncStats = m_state->asyncModels.stats;
+		stats.hits += asyncStats.hits;
+		stats.misses += asyncStats.misses;
+		stats.coalesced += asyncStats.coalesced;
+		stats.released += asyncStats.released;
+		stats.numLive += asyncStats.numLive;
+		for (auto it = m_state->asyncModels.entries.begin(); it != m_state->asyncModels.entries.end(); it++)
+		{
+			asyncModels.push_back(it->second.asset.lock());
+			if (asyncModels.back()) {
+				stats.bytes += asyncModels.back()->getStats().bytes;
+			}
+		}
+		return stats;
+	}
+
+	template<typename T>
+	static void addLiveAssets(AssetType type, const AssetTable<T>& table, std::vector<AssetInfo>* assets) {
+		for (auto it = table.entries.begin(); it != table.entries.end(); it++)
+		{
+			long numHandles = it->second.asset.use_count();
+			if (numHandles == 0) {
+				continue;
+			}
+			AssetInfo info;
+			info.type = type;
+			info.key = it->first;
+			info.numHandles = numHandles;
+			info.bytes = it->second.bytes;
+			assets->push_back(info);
+		}
+	}
+
+	std::vector<AssetInfo> AssetRegistry::getLiveAssets() const
+	{
+		std::vector<AssetInfo> assets;
+		std::vector<std::shared_ptr<AsyncModel>> asyncModels; //Released after the lock, see getStats()
+		std::lock_guard<std::mutex> lock(m_state->mutex);
+		addLiveAssets(AssetType::TEXTURE, m_state->textures, &assets);
+		addLiveAssets(AssetType::MODEL, m_state->models, &assets);
+		size_t firstAsync = assets.size();
+		addLiveAssets(AssetType::MODEL, m_state->asyncModels, &assets);
+		for (size_t i = firstAsync; i < assets.size(); i++)
+		{
+			asyncModels.push_back(m_state->asyncModels.entries[assets[i].key].asset.lock());
+			assets[i].bytes = asyncModels.back() ? asyncModels.back()->getStats().bytes : 0;
+		}
+		addLiveAssets(AssetType::SHADER, m_state->shaders, &assets);
+		return assets;
+	}
+
+	void AssetRegistry::printReport() const
+	{
+		const char* typeNames[] = { "Textures", "Models", "Shaders" };
+		for (int i = 0; i < (int)AssetType::COUNT; i++)
+		{
+			AssetStats stats = getStats((AssetType)i);
+			printf("%-8s %4u live, %10.2f MB, %llu hits (%llu coalesced), %llu misses, %llu released\n", typeNames[i], stats.numLive, stats.bytes / (1024.0 * 1024.0),
+				(unsigned long long)stats.hits, (unsigned long long)stats.coalesced, (unsigned long long)stats.misses, (unsigned long long)stats.released);
+		}
+		std::vector<AssetInfo> assets = getLiveAssets();
+		std::sort(assets.begin(), assets.end(), [](const AssetInfo& a, const AssetInfo& b) {
+			return a.bytes > b.bytes;
+		});
+		for (size_t i = 0; i < assets.size(); i++)
+		{
+			printf("  %10zu bytes  %2ld handles  %s\n", assets[i].bytes, assets[i].numHandles, assets[i].key.c_str());
+		}
+	}
+
+	std::string AssetRegistry::normalizePath(const std::string& filePath)
+	{
+		std::error_code error;
+		std::filesystem::path path = std::filesystem::weakly_canonical(std::filesystem::absolute(filePath, error), error);
+		if (error) {
+			path = std::filesystem::path(filePath).lexically_normal();
+		}
+		return path.generic_string();
+	}
+
+	AssetRegistry& AssetRegistry::global()
+	{
+		static AssetRegistry registry;
+		return registry;
+	}
+}
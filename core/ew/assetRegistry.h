@@ -0,0 +1,93 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "model.h"
+#include "shader.h"
+#include "asyncModelLoader.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	enum class AssetType {
+		TEXTURE = 0,
+		MODEL = 1, //Async models included
+		SHADER = 2,
+		COUNT = 3
+	};
+
+	struct AssetStats {
+		uint64_t hits = 0; //Requests served by an asset that was already loaded or loading
+		uint64_t misses = 0; //Requests that had to load
+		uint64_t coalesced = 0; //Hits that waited for another thread's load of the same asset
+		uint64_t released = 0; //Assets freed after their last handle went away
+		unsigned int numLive = 0; //Assets with handles
+		size_t bytes = 0; //Estimated GPU memory of live assets
+	};
+
+	//A texture loaded through the registry. The GL texture is deleted with the last handle.
+	struct TextureAsset {
+		unsigned int id = 0;
+		int width = 0;
+		int height = 0;
+		size_t bytes = 0; //Estimated, mip chain included
+	};
+
+	//One live asset, for auditing
+	struct AssetInfo {
+		AssetType type;
+		std::string key; //Normalized path and load parameters
+		long numHandles = 0;
+		size_t bytes = 0;
+	};
+
+	typedef std::shared_ptr<const TextureAsset> TextureHandle;
+	typedef std::shared_ptr<Model> ModelHandle;
+	typedef std::shared_ptr<const Shader> ShaderHandle;
+
+	//Loads each asset once. Assets are keyed by normalized path plus the parameters that change the loaded result,
+	//and every request for the same key gets a handle to the same object. Requests for a key that another thread
+	//is already loading wait for that load instead of starting their own.
+	//Handles are std::shared_ptr, and the GL objects are freed when the last one is released, so release them on the
+	//GL context thread. The registry itself may be destroyed before its handles.
+	//
+	//	ew::TextureHandle brick = ew::AssetRegistry::global().loadTexture("assets/brick_color.jpg");
+	//	glBindTexture(GL_TEXTURE_2D, brick->id);
+	class AssetRegistry {
+	public:
+		AssetRegistry();
+		~AssetRegistry();
+		AssetRegistry(const AssetRegistry&) = delete;
+		AssetRegistry& operator=(const AssetRegistry&) = delete;
+
+		//Same parameters as ew::loadTexture. Returns nullptr if the image could not be loaded.
+		TextureHandle loadTexture(const std::string& filePath);
+		TextureHandle loadTexture(const std::string& filePath, int wrapMode, int magFilter, int minFilter, bool mipmap);
+		//Returns nullptr if the model could not be loaded. Models sharing an arena share it through the handle too.
+		ModelHandle loadModel(const std::string& filePath, const ModelSettings& settings = ModelSettings());
+		//Streams through loader. Requests for a model that is already streaming or streamed get the same AsyncModel,
+		//so its position and priority are shared too.
+		std::shared_ptr<AsyncModel> loadModelAsync(AsyncModelLoader& loader, const std::string& filePath, const glm::vec3& position = glm::vec3(0.0f), const ModelSettings& settings = ModelSettings());
+		//Returns nullptr if either file could not be read
+		ShaderHandle loadShader(const std::string& vertexShader, const std::string& fragmentShader);
+
+		AssetStats getStats(AssetType type)const;
+		//Every asset that currently has handles
+		std::vector<AssetInfo> getLiveAssets()const;
+		//Prints stats per type and the live assets, largest first
+		void printReport()const;
+
+		//Absolute, with . and .. resolved and separators made uniform, so different spellings of a path share one key
+		static std::string normalizePath(const std::string& filePath);
+		//Shared registry
+		static AssetRegistry& global();
+
+		struct State;
+	private:
+		std::shared_ptr<State> m_state; //Also owned by the handles' deleters
+	};
+}
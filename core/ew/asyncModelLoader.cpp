@@ -0,0 +1,312 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "asyncModelLoader.h"
+#include "jobSystem.h"
+#include "culling.h"
+#include "profiler.h"
+#include "external/glad.h"
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+namespace ew {
+	//One mesh converted into exactly the bytes its GPU buffers will hold
+	struct ImportedMesh {
+		std::vector<Vertex> vertices;
+		std::vector<uint8_t> indices; //16 bit when there are at most 65536 vertices, like Mesh::allocate
+		unsigned int numIndices = 0;
+		Bounds bounds;
+	};
+
+	//Work handed to an import job. Only the job writes the results, and only before it is queued as finished.
+	struct AsyncModel::Import {
+		std::string filePath;
+		ModelSettings settings;
+		std::atomic<bool> cancelled{ false };
+		bool success = false;
+		std::vector<ImportedMesh> meshes;
+		double importMs = 0.0;
+		AsyncModel* model = nullptr; //Only dereferenced on the context thread, and only while not cancelled
+	};
+
+	//Finished imports waiting for the context thread
+	struct AsyncModelLoader::SharedState {
+		std::mutex mutex;
+		std::deque<std::shared_ptr<AsyncModel::Import>> imported;
+	};
+
+	AsyncModel::~AsyncModel()
+	{
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			m_meshes[i].unload();
+		}
+	}
+
+	void AsyncModel::draw() const
+	{
+		for (size_t i = 0; i < m_numReady; i++)
+		{
+			m_meshes[i].draw();
+		}
+	}
+
+	void AsyncModel::draw(const Camera& camera, const glm::mat4& modelMatrix) const
+	{
+		Frustum frustum = extractFrustum(camera);
+		for (size_t i = 0; i < m_numReady; i++)
+		{
+			if (isVisible(frustum, transformBounds(m_meshes[i].getBounds(), modelMatrix))) {
+				m_meshes[i].draw();
+			}
+		}
+	}
+
+	AsyncModelLoader::AsyncModelLoader(size_t uploadBudget, unsigned int maxImports)
+	{
+		m_shared = std::make_shared<SharedState>();
+		m_uploadBudget = uploadBudget;
+		m_maxImports = maxImports > 0 ? maxImports : 1;
+	}
+
+	AsyncModelLoader::~AsyncModelLoader()
+	{
+		//Imports still running finish into the shared state and are freed with it
+		for (size_t i = 0; i < m_pending.size(); i++)
+		{
+			stop(m_pending[i].get(), ModelLoadState::CANCELLED);
+		}
+	}
+
+	/// <summary>
+	/// Queues a model for loading. Nothing is read until the next update() gives it an import slot.
+	/// </summary>
+	/// <param name="filePath">Any format Assimp can read</param>
+	/// <param name="position">World position the model will be drawn at</param>
+	/// <param name="settings">useMeshCache and optimizeMeshes apply as for Model</param>
+	/// <returns>Model handle, drawable immediately</returns>
+	std::shared_ptr<AsyncModel> AsyncModelLoader::load(const std::string& filePath, const glm::vec3& position, const ModelSettings& settings)
+	{
+		std::shared_ptr<AsyncModel> model = std::make_shared<AsyncModel>();
+		model->m_filePath = filePath;
+		model->m_settings = settings;
+		model->m_position = position;
+		model->m_requestFrame = m_frame;
+		m_pending.push_back(model);
+		return model;
+	}
+
+	void AsyncModelLoader::cancel(const std::shared_ptr<AsyncModel>& model)
+	{
+		ModelLoadState state = model->m_state;
+		if (state == ModelLoadState::READY || state == ModelLoadState::FAILED || state == ModelLoadState::CANCELLED) {
+			return;
+		}
+		stop(model.get(), ModelLoadState::CANCELLED);
+		m_pending.erase(std::find(m_pending.begin(), m_pending.end(), model));
+	}
+
+	/// <summary>
+	/// Collects finished imports, then starts new imports and uploads meshes in priority order: highest priority first,
+	/// nearest to the camera within a priority.
+	/// </summary>
+	void AsyncModelLoader::update(const Camera& camera)
+	{
+		EW_PROFILE_SCOPE("AsyncModelLoader::update");
+		auto start = std::chrono::steady_clock::now();
+		m_frame++;
+		{
+			std::lock_guard<std::mutex> lock(m_shared->mutex);
+			while (!m_shared->imported.empty()) {
+				std::shared_ptr<AsyncModel::Import> import = m_shared->imported.front();
+				m_shared->imported.pop_front();
+				if (import->cancelled.load()) {
+					continue;
+				}
+				AsyncModel* model = import->model;
+				m_numImporting--;
+				model->m_stats.importMs = import->importMs;
+				if (!import->success) {
+					//loadModelData has already reported why
+					model->m_state = ModelLoadState::FAILED;
+					model->m_import.reset();
+					continue;
+				}
+				model->m_meshes.resize(import->meshes.size());
+				model->m_state = ModelLoadState::UPLOADING;
+			}
+		}
+
+		//Models only the loader still references are no longer wanted
+		for (size_t i = 0; i < m_pending.size(); i++)
+		{
+			if (m_pending[i].use_count() == 1) {
+				stop(m_pending[i].get(), ModelLoadState::CANCELLED);
+			}
+		}
+		m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [](const std::shared_ptr<AsyncModel>& model) {
+			return model->m_state == ModelLoadState::READY || model->m_state == ModelLoadState::FAILED || model->m_state == ModelLoadState::CANCELLED;
+		}), m_pending.end());
+
+		glm::vec3 eye = camera.position;
+		std::stable_sort(m_pending.begin(), m_pending.end(), [eye](const std::shared_ptr<AsyncModel>& a, const std::shared_ptr<AsyncModel>& b) {
+			if (a->m_priority != b->m_priority) {
+				return a->m_priority > b->m_priority;
+			}
+			glm::vec3 da = a->m_position - eye;
+			glm::vec3 db = b->m_position - eye;
+			return glm::dot(da, da) < glm::dot(db, db);
+		});
+
+		for (size_t i = 0; i < m_pending.size() && m_numImporting < m_maxImports; i++)
+		{
+			if (m_pending[i]->m_state == ModelLoadState::QUEUED) {
+				startImport(m_pending[i].get());
+			}
+		}
+
+		size_t budget = m_uploadBudget > 0 ? m_uploadBudget : 1;
+		for (size_t i = 0; i < m_pending.size() && budget > 0; i++)
+		{
+			AsyncModel* model = m_pending[i].get();
+			if (model->m_state != ModelLoadState::UPLOADING) {
+				continue;
+			}
+			auto modelStart = std::chrono::steady_clock::now();
+			while (budget > 0 && uploadSlice(model, &budget)) {}
+			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - modelStart).count();
+			model->m_stats.uploadMs += ms;
+			model->m_stats.maxUploadMs = std::max(model->m_stats.maxUploadMs, ms);
+		}
+		m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [](const std::shared_ptr<AsyncModel>& model) {
+			return model->m_state == ModelLoadState::READY;
+		}), m_pending.end());
+
+		m_lastUpdateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		m_maxUpdateMs = std::max(m_maxUpdateMs, m_lastUpdateMs);
+	}
+
+	/// <summary>
+	/// Reads and converts the model on the job system. Indices are narrowed there too, so uploads are plain copies.
+	/// </summary>
+	void AsyncModelLoader::startImport(AsyncModel* model)
+	{
+		std::shared_ptr<AsyncModel::Import> import = std::make_shared<AsyncModel::Import>();
+		import->filePath = model->m_filePath;
+		import->settings = model->m_settings;
+		import->model = model;
+		model->m_import = import;
+		model->m_state = ModelLoadState::IMPORTING;
+		m_numImporting++;
+
+		std::shared_ptr<SharedState> shared = m_shared;
+		JobSystem::global().run([shared, import]() {
+			if (import->cancelled.load()) {
+				return;
+			}
+			auto start = std::chrono::steady_clock::now();
+			std::vector<MeshData> meshData;
+			import->success = loadModelData(import->filePath, import->settings, &meshData);
+			import->meshes.resize(meshData.size());
+			for (size_t i = 0; i < meshData.size(); i++)
+			{
+				ImportedMesh& mesh = import->meshes[i];
+				const std::vector<unsigned int>& indices = meshData[i].indices;
+				mesh.bounds = computeBounds(meshData[i].vertices.data(), (unsigned int)meshData[i].vertices.size());
+				mesh.numIndices = (unsigned int)indices.size();
+				if (meshData[i].vertices.size() <= 65536) {
+					mesh.indices.resize(indices.size() * sizeof(uint16_t));
+					uint16_t* shortIndices = (uint16_t*)mesh.indices.data();
+					for (size_t j = 0; j < indices.size(); j++)
+					{
+						shortIndices[j] = (uint16_t)indices[j];
+					}
+				}
+				else {
+					mesh.indices.resize(indices.size() * sizeof(unsigned int));
+					memcpy(mesh.indices.data(), indices.data(), mesh.indices.size());
+				}
+				mesh.vertices = std::move(meshData[i].vertices);
+			}
+			import->importMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::lock_guard<std::mutex> lock(shared->mutex);
+			shared->imported.push_back(import);
+		});
+	}
+
+	/// <summary>
+	/// Uploads as much of the model's next mesh as the budget allows. The mesh becomes drawable once all of its bytes are in.
+	/// </summary>
+	/// <returns>False once the model is fully uploaded</returns>
+	bool AsyncModelLoader::uploadSlice(AsyncModel* model, size_t* budget)
+	{
+		if (model->m_numReady == model->m_meshes.size()) {
+			finish(model);
+			return false;
+		}
+		size_t index = model->m_numReady;
+		ImportedMesh& source = model->m_import->meshes[index];
+		Mesh& mesh = model->m_meshes[index];
+		size_t vertexBytes = source.vertices.size() * sizeof(Vertex);
+		size_t totalBytes = vertexBytes + source.indices.size();
+		if (model->m_uploadOffset == 0) {
+			mesh.allocate(VertexTraits<Vertex>::layout(), (unsigned int)source.vertices.size(), source.numIndices);
+			mesh.setBounds(source.bounds);
+			model->m_stats.bytes += totalBytes;
+		}
+		size_t size = std::min(*budget, totalBytes - model->m_uploadOffset);
+		size_t end = model->m_uploadOffset + size;
+		//The slice may cover the end of the vertices and the start of the indices
+		if (model->m_uploadOffset < vertexBytes) {
+			size_t vertexEnd = std::min(end, vertexBytes);
+			mesh.uploadVertexBytes((const uint8_t*)source.vertices.data() + model->m_uploadOffset, model->m_uploadOffset, vertexEnd - model->m_uploadOffset);
+		}
+		if (end > vertexBytes) {
+			size_t indexStart = std::max(model->m_uploadOffset, vertexBytes) - vertexBytes;
+			mesh.uploadIndexBytes(source.indices.data() + indexStart, indexStart, end - vertexBytes - indexStart);
+		}
+		model->m_uploadOffset = end;
+		*budget -= size;
+		if (end == totalBytes) {
+			//The GPU copy is complete, so the converted data can go
+			std::vector<Vertex>().swap(source.vertices);
+			std::vector<uint8_t>().swap(source.indices);
+			model->m_uploadOffset = 0;
+			model->m_numReady++;
+			if (model->m_stats.framesToFirstMesh < 0) {
+				model->m_stats.framesToFirstMesh = m_frame - model->m_requestFrame;
+			}
+			if (model->m_numReady == model->m_meshes.size()) {
+				finish(model);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void AsyncModelLoader::finish(AsyncModel* model)
+	{
+		model->m_state = ModelLoadState::READY;
+		model->m_stats.framesToReady = m_frame - model->m_requestFrame;
+		model->m_import.reset();
+	}
+
+	//Ends loading without uploading anything further
+	void AsyncModelLoader::stop(AsyncModel* model, ModelLoadState state)
+	{
+		if (model->m_state == ModelLoadState::IMPORTING) {
+			m_numImporting--;
+		}
+		if (model->m_import) {
+			model->m_import->cancelled.store(true);
+			model->m_import.reset();
+		}
+		model->m_uploadOffset = 0;
+		model->m_state = state;
+	}
+}
@@ -0,0 +1,128 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "model.h"
+#include "camera.h"
+#include <glm/glm.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ew {
+	enum class ModelLoadState {
+		QUEUED = 0, //Waiting for an import slot
+		IMPORTING = 1, //Being read and converted on a worker thread
+		UPLOADING = 2, //Meshes are being copied to the GPU, some may already be drawable
+		READY = 3,
+		FAILED = 4,
+		CANCELLED = 5
+	};
+
+	struct ModelLoadStats {
+		double importMs = 0.0; //Worker thread time reading and converting the file
+		double uploadMs = 0.0; //Context thread time spent uploading, summed over frames
+		double maxUploadMs = 0.0; //Most context thread time spent on this model in one update()
+		int framesToFirstMesh = -1; //update() calls between load() and the first mesh becoming drawable
+		int framesToReady = -1; //update() calls between load() and the last mesh becoming drawable
+		size_t bytes = 0; //GPU bytes of vertices and indices
+	};
+
+	//A model whose meshes arrive over several frames. Meshes can be drawn as soon as they are uploaded,
+	//so draw() shows more of the model each frame until it is ready.
+	class AsyncModel {
+	public:
+		AsyncModel() {};
+		//Deletes the uploaded meshes, so the last reference must be dropped on the GL context thread
+		~AsyncModel();
+		AsyncModel(const AsyncModel&) = delete;
+		AsyncModel& operator=(const AsyncModel&) = delete;
+
+		//Draws the meshes uploaded so far
+		void draw()const;
+		//Skips meshes outside the camera's frustum
+		void draw(const Camera& camera, const glm::mat4& modelMatrix)const;
+
+		//Where the model will be drawn. The loader imports and uploads models nearest the camera first.
+		inline void setPosition(const glm::vec3& position) { m_position = position; }
+		inline const glm::vec3& getPosition()const { return m_position; }
+		//Higher priorities load before lower ones regardless of distance. Default 0.
+		inline void setPriority(int priority) { m_priority = priority; }
+		inline int getPriority()const { return m_priority; }
+
+		inline ModelLoadState getState()const { return m_state; }
+		inline bool isReady()const { return m_state == ModelLoadState::READY; }
+		//0 until the import has finished
+		inline size_t getNumMeshes()const { return m_meshes.size(); }
+		inline size_t getNumReadyMeshes()const { return m_numReady; }
+		inline const ModelLoadStats& getStats()const { return m_stats; }
+		inline const std::string& getFilePath()const { return m_filePath; }
+
+		struct Import;
+	private:
+		friend class AsyncModelLoader;
+		std::string m_filePath;
+		ModelSettings m_settings;
+		glm::vec3 m_position = glm::vec3(0.0f);
+		int m_priority = 0;
+		ModelLoadState m_state = ModelLoadState::QUEUED;
+		std::vector<Mesh> m_meshes; //Created when the import finishes, the first m_numReady are drawable
+		size_t m_numReady = 0;
+		size_t m_uploadOffset = 0; //Bytes of the next mesh already uploaded, vertices first, then indices
+		std::shared_ptr<Import> m_import; //Converted meshes, shared with the worker thread
+		ModelLoadStats m_stats;
+		int m_requestFrame = 0;
+	};
+
+	//Loads models without stalling the frame.
+	//Files are read and converted on the job system, a few at a time, and the converted meshes are uploaded from the
+	//context thread at most uploadBudget bytes per update(). Large meshes are split across frames. Models with the
+	//highest priority, then the nearest to the camera, go first.
+	//
+	//	std::shared_ptr<ew::AsyncModel> model = loader.load("assets/Suzanne.obj", position);
+	//	...each frame...
+	//	loader.update(camera);
+	//	model->draw();
+	class AsyncModelLoader {
+	public:
+		AsyncModelLoader(size_t uploadBudget = 4 * 1024 * 1024, unsigned int maxImports = 2);
+		~AsyncModelLoader();
+		AsyncModelLoader(const AsyncModelLoader&) = delete;
+		AsyncModelLoader& operator=(const AsyncModelLoader&) = delete;
+
+		//Returns a model that draws nothing until its first mesh arrives. position is used for prioritizing, see AsyncModel::setPosition.
+		//settings.lodRatios and settings.arena are ignored.
+		std::shared_ptr<AsyncModel> load(const std::string& filePath, const glm::vec3& position = glm::vec3(0.0f), const ModelSettings& settings = ModelSettings());
+		//Stops loading the model. Meshes that were already uploaded stay drawable.
+		//Dropping every other reference to a model that is still loading cancels it as well.
+		void cancel(const std::shared_ptr<AsyncModel>& model);
+		//Call once per frame on the GL context thread. Starts imports and uploads converted meshes.
+		void update(const Camera& camera);
+
+		//Models that are queued, importing or uploading
+		inline size_t getNumPending()const { return m_pending.size(); }
+		inline size_t getUploadBudget()const { return m_uploadBudget; }
+		inline void setUploadBudget(size_t bytes) { m_uploadBudget = bytes; }
+		//Time spent in the last update(), and the most spent in any update()
+		inline double getLastUpdateMs()const { return m_lastUpdateMs; }
+		inline double getMaxUpdateMs()const { return m_maxUpdateMs; }
+
+		struct SharedState;
+	private:
+		void startImport(AsyncModel* model);
+		bool uploadSlice(AsyncModel* model, size_t* budget);
+		void finish(AsyncModel* model);
+		void stop(AsyncModel* model, ModelLoadState state);
+
+		std::shared_ptr<SharedState> m_shared; //Also owned by in-flight import jobs
+		std::vector<std::shared_ptr<AsyncModel>> m_pending; //Highest priority first after each update()
+		size_t m_uploadBudget;
+		unsigned int m_maxImports;
+		unsigned int m_numImporting = 0;
+		int m_frame = 0;
+		double m_lastUpdateMs = 0.0;
+		double m_maxUpdateMs = 0.0;
+	};
+}
@@ -0,0 +1,269 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "asyncTextureLoader.h"
+#include "texture.h"
+#include "jobSystem.h"
+#include "external/glad.h"
+#include "external/stb_image.h"
+#include <stdio.h>
+#include <string.h>
+#include <mutex>
+#include <chrono>
+
+namespace ew {
+	struct AsyncTextureLoader::Request {
+		//Frees the pixels wherever the request ends up, including decodes that finish after the loader is destroyed
+		~Request() {
+			stbi_image_free(pixels);
+		}
+		unsigned int texture = 0;
+		std::string filePath;
+		int wrapMode = 0;
+		int magFilter = 0;
+		int minFilter = 0;
+		bool mipmap = false;
+		TextureCallback callback;
+		int requestFrame = 0;
+		//Filled in by the worker
+		unsigned char* pixels = nullptr;
+		int width = 0;
+		int height = 0;
+		int numComponents = 0;
+		double decodeMs = 0.0;
+		//Upload progress. Rows stream into staging so the handle keeps showing the placeholder until all have landed.
+		unsigned int staging = 0;
+		int nextRow = 0;
+		double uploadMs = 0.0;
+	};
+
+	//Decoded requests waiting for the context thread
+	struct AsyncTextureLoader::SharedState {
+		std::mutex mutex;
+		std::deque<std::unique_ptr<Request>> decoded;
+	};
+
+	AsyncTextureLoader::AsyncTextureLoader(size_t uploadBudget, unsigned int numPixelBuffers)
+	{
+		m_shared = std::make_shared<SharedState>();
+		m_uploadBudget = uploadBudget;
+		m_pixelBuffers.resize(numPixelBuffers > 0 ? numPixelBuffers : 1);
+		m_fences.resize(m_pixelBuffers.size(), nullptr);
+		m_pixelBufferSizes.resize(m_pixelBuffers.size(), 0);
+		glGenBuffers((GLsizei)m_pixelBuffers.size(), m_pixelBuffers.data());
+	}
+
+	AsyncTextureLoader::~AsyncTextureLoader()
+	{
+		for (size_t i = 0; i < m_fences.size(); i++)
+		{
+			if (m_fences[i]) {
+				glDeleteSync((GLsync)m_fences[i]);
+			}
+		}
+		glDeleteBuffers((GLsizei)m_pixelBuffers.size(), m_pixelBuffers.data());
+		if (m_uploading && m_uploading->staging != 0) {
+			glDeleteTextures(1, &m_uploading->staging);
+		}
+		//Decodes still in flight finish into the shared state and are freed with it
+		std::lock_guard<std::mutex> lock(m_shared->mutex);
+		m_shared->decoded.clear();
+	}
+
+	unsigned int AsyncTextureLoader::load(const char* filePath, TextureCallback callback)
+	{
+		return load(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true, callback);
+	}
+
+	/// <summary>
+	/// Queues a texture for loading
+	/// </summary>
+	/// <param name="filePath">Image file</param>
+	/// <param name="wrapMode">Same as loadTexture</param>
+	/// <param name="magFilter">Same as loadTexture</param>
+	/// <param name="minFilter">Same as loadTexture</param>
+	/// <param name="mipmap">Same as loadTexture</param>
+	/// <param name="callback">Optional. Called from update() when the texture is ready or has failed.</param>
+	/// <returns>Texture handle, valid immediately</returns>
+	unsigned int AsyncTextureLoader::load(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap, TextureCallback callback)
+	{
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		const unsigned char placeholder[4] = { 128, 128, 128, 255 };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+		//No mips yet, so sample the placeholder without them
+		setTextureParameters(wrapMode, GL_NEAREST, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		std::unique_ptr<Request> request(new Request());
+		request->texture = texture;
+		request->filePath = filePath;
+		request->wrapMode = wrapMode;
+		request->magFilter = magFilter;
+		request->minFilter = minFilter;
+		request->mipmap = mipmap;
+		request->callback = callback;
+		request->requestFrame = m_frame;
+		m_stats[texture] = TextureLoadStats();
+		m_numPending++;
+
+		std::shared_ptr<SharedState> shared = m_shared;
+		Request* raw = request.release();
+		JobSystem::global().run([shared, raw]() {
+			std::unique_ptr<Request> request(raw);
+			auto start = std::chrono::steady_clock::now();
+			request->pixels = stbi_load(request->filePath.c_str(), &request->width, &request->height, &request->numComponents, 0);
+			request->decodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			std::lock_guard<std::mutex> lock(shared->mutex);
+			shared->decoded.push_back(std::move(request));
+		});
+		return texture;
+	}
+
+	/// <summary>
+	/// Streams decoded images into their textures, at most the upload budget per call
+	/// </summary>
+	void AsyncTextureLoader::update()
+	{
+		m_frame++;
+		size_t budget = m_uploadBudget;
+		while (budget > 0) {
+			if (!m_uploading) {
+				std::lock_guard<std::mutex> lock(m_shared->mutex);
+				if (m_shared->decoded.empty()) {
+					break;
+				}
+				m_uploading = std::move(m_shared->decoded.front());
+				m_shared->decoded.pop_front();
+			}
+			Request* request = m_uploading.get();
+			if (request->pixels == NULL) {
+				printf("Failed to load image %s\n", request->filePath.c_str());
+				finish(request, false);
+				continue;
+			}
+			if (request->staging == 0) {
+				//Allocate full size staging storage, rows are filled in from pixel buffers below
+				auto start = std::chrono::steady_clock::now();
+				int format = getTextureFormat(request->numComponents);
+				glGenTextures(1, &request->staging);
+				glBindTexture(GL_TEXTURE_2D, request->staging);
+				glTexImage2D(GL_TEXTURE_2D, 0, format, request->width, request->height, 0, format, GL_UNSIGNED_BYTE, NULL);
+				//glCopyImageSubData needs a complete texture, and staging never gets mips
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glBindTexture(GL_TEXTURE_2D, 0);
+				request->uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			}
+			if (!uploadRows(request, &budget)) {
+				break;
+			}
+			if (request->nextRow >= request->height) {
+				finish(request, true);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Copies as many rows as fit in the budget into the next pixel buffer and starts a texture upload from it.
+	/// Returns false without doing anything if that pixel buffer is still being read by the GPU.
+	/// </summary>
+	bool AsyncTextureLoader::uploadRows(Request* request, size_t* budget)
+	{
+		unsigned int index = m_nextPixelBuffer;
+		if (m_fences[index]) {
+			GLenum status = glClientWaitSync((GLsync)m_fences[index], 0, 0);
+			if (status == GL_TIMEOUT_EXPIRED) {
+				return false;
+			}
+			glDeleteSync((GLsync)m_fences[index]);
+			m_fences[index] = nullptr;
+		}
+		auto start = std::chrono::steady_clock::now();
+		size_t rowSize = (size_t)request->width * request->numComponents;
+		//Always move at least one row so huge images still make progress
+		size_t numRows = *budget / rowSize;
+		if (numRows == 0) {
+			numRows = 1;
+		}
+		if (numRows > (size_t)(request->height - request->nextRow)) {
+			numRows = request->height - request->nextRow;
+		}
+		size_t size = numRows * rowSize;
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffers[index]);
+		if (m_pixelBufferSizes[index] < size) {
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+			m_pixelBufferSizes[index] = size;
+		}
+		//The fence above guarantees the GPU is done with this buffer, so skip the driver's own synchronization
+		void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		memcpy(dst, request->pixels + rowSize * request->nextRow, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+		glBindTexture(GL_TEXTURE_2D, request->staging);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, request->nextRow, request->width, (GLsizei)numRows, getTextureFormat(request->numComponents), GL_UNSIGNED_BYTE, (const void*)0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_nextPixelBuffer = (index + 1) % m_pixelBuffers.size();
+
+		request->nextRow += (int)numRows;
+		*budget = *budget > size ? *budget - size : 0;
+		request->uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	/// <summary>
+	/// Swaps a fully uploaded image into the request's texture handle, replacing the placeholder in one step.
+	/// The copy stays on the GPU and is ordered after the row uploads, so nothing waits on them.
+	/// </summary>
+	void AsyncTextureLoader::finish(Request* request, bool success)
+	{
+		if (success) {
+			auto start = std::chrono::steady_clock::now();
+			int format = getTextureFormat(request->numComponents);
+			glBindTexture(GL_TEXTURE_2D, request->texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, format, request->width, request->height, 0, format, GL_UNSIGNED_BYTE, NULL);
+			//The handle still samples without mips from load(), so it is complete for the copy
+			glCopyImageSubData(request->staging, GL_TEXTURE_2D, 0, 0, 0, 0, request->texture, GL_TEXTURE_2D, 0, 0, 0, 0, request->width, request->height, 1);
+			setTextureParameters(request->wrapMode, request->magFilter, request->minFilter);
+			if (request->mipmap) {
+				glGenerateMipmap(GL_TEXTURE_2D);
+			}
+			glBindTexture(GL_TEXTURE_2D, 0);
+			request->uploadMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		}
+		TextureLoadStats& stats = m_stats[request->texture];
+		stats.ready = success;
+		stats.failed = !success;
+		stats.decodeMs = request->decodeMs;
+		stats.uploadMs = request->uploadMs;
+		stats.framesToAvailable = m_frame - request->requestFrame;
+		m_numPending--;
+		if (request->staging != 0) {
+			glDeleteTextures(1, &request->staging);
+			request->staging = 0;
+		}
+
+		std::unique_ptr<Request> done = std::move(m_uploading);
+		if (done->callback) {
+			done->callback(done->texture, success);
+		}
+	}
+
+	bool AsyncTextureLoader::isReady(unsigned int texture) const
+	{
+		const TextureLoadStats* stats = getStats(texture);
+		return stats != nullptr && stats->ready;
+	}
+
+	const TextureLoadStats* AsyncTextureLoader::getStats(unsigned int texture) const
+	{
+		auto it = m_stats.find(texture);
+		return it == m_stats.end() ? nullptr : &it->second;
+	}
+}
@@ -0,0 +1,68 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+namespace ew {
+	struct TextureLoadStats {
+		bool ready = false; //Real image is in the texture
+		bool failed = false; //Decode failed, texture keeps the placeholder
+		double decodeMs = 0.0; //Worker thread time in stbi_load
+		double uploadMs = 0.0; //Context thread time spent copying and issuing uploads
+		int framesToAvailable = 0; //update() calls between load() and the texture becoming ready
+	};
+
+	//texture is the handle returned by load(). success is false if the image could not be decoded.
+	typedef std::function<void(unsigned int texture, bool success)> TextureCallback;
+
+	//Loads textures without stalling the frame.
+	//Images are decoded on worker threads, then uploaded from the context thread through a ring of
+	//pixel buffer objects, never more than uploadBudget bytes per update(). Rows go to a staging texture that is
+	//copied into the handle once the last row lands, so a half uploaded image is never shown.
+	class AsyncTextureLoader {
+	public:
+		AsyncTextureLoader(size_t uploadBudget = 4 * 1024 * 1024, unsigned int numPixelBuffers = 3);
+		~AsyncTextureLoader();
+		AsyncTextureLoader(const AsyncTextureLoader&) = delete;
+		AsyncTextureLoader& operator=(const AsyncTextureLoader&) = delete;
+
+		//Returns a usable texture handle right away. It shows a 1x1 grey placeholder until the image arrives,
+		//after which the same handle holds the real image.
+		unsigned int load(const char* filePath, TextureCallback callback = nullptr);
+		unsigned int load(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap, TextureCallback callback = nullptr);
+		//Call once per frame on the GL context thread. Uploads decoded images and runs callbacks.
+		void update();
+
+		bool isReady(unsigned int texture)const;
+		//Stats for a texture returned by load(), or nullptr
+		const TextureLoadStats* getStats(unsigned int texture)const;
+		//Textures that are decoding or uploading
+		inline size_t getNumPending()const { return m_numPending; }
+		inline size_t getUploadBudget()const { return m_uploadBudget; }
+		inline void setUploadBudget(size_t bytes) { m_uploadBudget = bytes; }
+
+		struct Request;
+		struct SharedState;
+	private:
+		bool uploadRows(Request* request, size_t* budget);
+		void finish(Request* request, bool success);
+
+		std::shared_ptr<SharedState> m_shared; //Also owned by in-flight decode tasks
+		std::unique_ptr<Request> m_uploading; //Request currently being streamed
+		std::unordered_map<unsigned int, TextureLoadStats> m_stats;
+		std::vector<unsigned int> m_pixelBuffers;
+		std::vector<void*> m_fences;
+		std::vector<size_t> m_pixelBufferSizes;
+		unsigned int m_nextPixelBuffer = 0;
+		size_t m_uploadBudget;
+		size_t m_numPending = 0;
+		int m_frame = 0;
+	};
+}
@@ -0,0 +1,58 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <glm/glm.hpp>
+#include <stddef.h>
+#include <math.h>
+#include "vertexLayout.h"
+
+namespace ew {
+	//Axis aligned box, plus the smallest sphere centered on the box that contains every vertex
+	struct Bounds {
+		glm::vec3 min = glm::vec3(0.0f);
+		glm::vec3 max = glm::vec3(0.0f);
+		glm::vec3 center = glm::vec3(0.0f);
+		float radius = 0.0f;
+		inline glm::vec3 extents()const { return (max - min) * 0.5f; }
+	};
+
+	//Any vertex struct with a VertexTraits specialization
+	template<typename V>
+	Bounds computeBounds(const V* vertices, size_t numVertices) {
+		Bounds bounds;
+		if (numVertices == 0) {
+			return bounds;
+		}
+		bounds.min = bounds.max = VertexTraits<V>::position(vertices[0]);
+		for (size_t i = 1; i < numVertices; i++)
+		{
+			glm::vec3 position = VertexTraits<V>::position(vertices[i]);
+			bounds.min = glm::min(bounds.min, position);
+			bounds.max = glm::max(bounds.max, position);
+		}
+		bounds.center = (bounds.min + bounds.max) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			glm::vec3 d = VertexTraits<V>::position(vertices[i]) - bounds.center;
+			radiusSquared = glm::max(radiusSquared, glm::dot(d, d));
+		}
+		bounds.radius = sqrtf(radiusSquared);
+		return bounds;
+	}
+
+	//Conservative bounds of the transformed volume. The box stays axis aligned, so it grows under rotation.
+	inline Bounds transformBounds(const Bounds& bounds, const glm::mat4& m) {
+		glm::vec3 extents = bounds.extents();
+		glm::vec3 worldExtents = glm::abs(glm::vec3(m[0])) * extents.x + glm::abs(glm::vec3(m[1])) * extents.y + glm::abs(glm::vec3(m[2])) * extents.z;
+		float scale = glm::max(glm::length(glm::vec3(m[0])), glm::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+		Bounds result;
+		result.center = glm::vec3(m * glm::vec4(bounds.center, 1.0f));
+		result.min = result.center - worldExtents;
+		result.max = result.center + worldExtents;
+		result.radius = bounds.radius * scale;
+		return result;
+	}
+}
@@ -0,0 +1,322 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "culling.h"
+#include "jobSystem.h"
+#include <string.h>
+
+#if defined(__AVX__)
+#define EW_CULLING_AVX 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EW_CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace ew {
+	/// <summary>
+	/// Gribb/Hartmann plane extraction. Each plane is a sum or difference of the matrix's 4th row
+	/// and one of the other rows, which holds for orthographic projections as well as perspective.
+	/// </summary>
+	/// <param name="viewProjection">projection * view</param>
+	/// <returns>Normalized planes</returns>
+	Frustum extractFrustum(const glm::mat4& viewProjection) {
+		const glm::mat4& m = viewProjection;
+		glm::vec4 row0 = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1 = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2 = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3 = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+		Frustum frustum;
+		frustum.planes[0] = row3 + row0;
+		frustum.planes[1] = row3 - row0;
+		frustum.planes[2] = row3 + row1;
+		frustum.planes[3] = row3 - row1;
+		frustum.planes[4] = row3 + row2;
+		frustum.planes[5] = row3 - row2;
+		for (int i = 0; i < 6; i++)
+		{
+			frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+		}
+		return frustum;
+	}
+
+	Frustum extractFrustum(const Camera& camera) {
+		return extractFrustum(camera.projectionMatrix() * camera.viewMatrix());
+	}
+
+	bool isSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius) {
+		for (int i = 0; i < 6; i++)
+		{
+			if (glm::dot(glm::vec3(frustum.planes[i]), center) + frustum.planes[i].w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool isBoxVisible(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extents) {
+		for (int i = 0; i < 6; i++)
+		{
+			glm::vec3 normal = glm::vec3(frustum.planes[i]);
+			//Distance from the center to the box's furthest point along the normal
+			float radius = glm::dot(glm::abs(normal), extents);
+			if (glm::dot(normal, center) + frustum.planes[i].w < -radius) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool isVisible(const Frustum& frustum, const Bounds& bounds) {
+		return isSphereVisible(frustum, bounds.center, bounds.radius) && isBoxVisible(frustum, bounds.center, bounds.extents());
+	}
+
+	void CullingBounds::add(const Bounds& bounds)
+	{
+		resize(size() + 1);
+		set(size() - 1, bounds);
+	}
+
+	void CullingBounds::set(size_t i, const Bounds& bounds)
+	{
+		glm::vec3 extents = bounds.extents();
+		centerX[i] = bounds.center.x;
+		centerY[i] = bounds.center.y;
+		centerZ[i] = bounds.center.z;
+		extentX[i] = extents.x;
+		extentY[i] = extents.y;
+		extentZ[i] = extents.z;
+		radius[i] = bounds.radius;
+	}
+
+	void CullingBounds::resize(size_t count)
+	{
+		centerX.resize(count);
+		centerY.resize(count);
+		centerZ.resize(count);
+		extentX.resize(count);
+		extentY.resize(count);
+		extentZ.resize(count);
+		radius.resize(count);
+	}
+
+	void CullingBounds::clear()
+	{
+		resize(0);
+	}
+
+	size_t cullSpheresScalar(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible) {
+		size_t numVisible = 0;
+		for (size_t i = 0; i < bounds.size(); i++)
+		{
+			glm::vec3 center = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+			if (isSphereVisible(frustum, center, bounds.radius[i])) {
+				visible[numVisible++] = (uint32_t)i;
+			}
+		}
+		return numVisible;
+	}
+
+	size_t cullBoxesScalar(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible) {
+		size_t numVisible = 0;
+		for (size_t i = 0; i < bounds.size(); i++)
+		{
+			glm::vec3 center = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+			glm::vec3 extents = glm::vec3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+			if (isBoxVisible(frustum, center, extents)) {
+				visible[numVisible++] = (uint32_t)i;
+			}
+		}
+		return numVisible;
+	}
+
+	//Appends the index of every set bit in mask, lowest first
+	static inline size_t appendVisible(unsigned int mask, size_t first, uint32_t* visible, size_t numVisible) {
+		while (mask != 0) {
+			unsigned int bit = 0;
+			while (!(mask & (1u << bit))) {
+				bit++;
+			}
+			visible[numVisible++] = (uint32_t)(first + bit);
+			mask &= mask - 1;
+		}
+		return numVisible;
+	}
+
+	//Arithmetic below is ordered like the scalar tests, and each plane test is the same !(distance < -radius), so both
+	//give identical results, NaN included
+
+	/// <summary>
+	/// Tests bounding spheres against all 6 planes, 8 (AVX, see EW_ENABLE_AVX) or 4 (SSE) bounds at a time
+	/// </summary>
+	/// <param name="frustum">Frustum to test against</param>
+	/// <param name="bounds">World space bounds</param>
+	/// <param name="begin">First bound to test</param>
+	/// <param name="end">One past the last bound to test</param>
+	/// <param name="visible">Receives indices of visible bounds</param>
+	/// <returns>Number of visible bounds</returns>
+	static size_t cullSpheresRange(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible) {
+		size_t numVisible = 0;
+		size_t i = begin;
+#if defined(EW_CULLING_AVX)
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&bounds.centerX[i]);
+			__m256 y = _mm256_loadu_ps(&bounds.centerY[i]);
+			__m256 z = _mm256_loadu_ps(&bounds.centerZ[i]);
+			__m256 negRadius = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(&bounds.radius[i]));
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+					_mm256_mul_ps(z, _mm256_set1_ps(plane.z))), _mm256_set1_ps(plane.w));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, negRadius, _CMP_NLT_UQ));
+			}
+			numVisible = appendVisible((unsigned int)_mm256_movemask_ps(inside), i, visible, numVisible);
+		}
+#elif defined(EW_CULLING_SSE)
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+			__m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+			__m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+			__m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[i]));
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_mul_ps(z, _mm_set1_ps(plane.z))), _mm_set1_ps(plane.w));
+				inside = _mm_and_ps(inside, _mm_cmpnlt_ps(distance, negRadius));
+			}
+			numVisible = appendVisible((unsigned int)_mm_movemask_ps(inside), i, visible, numVisible);
+		}
+#endif
+		for (; i < end; i++)
+		{
+			glm::vec3 center = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+			if (isSphereVisible(frustum, center, bounds.radius[i])) {
+				visible[numVisible++] = (uint32_t)i;
+			}
+		}
+		return numVisible;
+	}
+
+	/// <summary>
+	/// Tests axis aligned boxes against all 6 planes, 8 (AVX) or 4 (SSE) bounds at a time
+	/// </summary>
+	/// <param name="frustum">Frustum to test against</param>
+	/// <param name="bounds">World space bounds</param>
+	/// <param name="begin">First bound to test</param>
+	/// <param name="end">One past the last bound to test</param>
+	/// <param name="visible">Receives indices of visible bounds</param>
+	/// <returns>Number of visible bounds</returns>
+	static size_t cullBoxesRange(const Frustum& frustum, const CullingBounds& bounds, size_t begin, size_t end, uint32_t* visible) {
+		size_t numVisible = 0;
+		size_t i = begin;
+#if defined(EW_CULLING_AVX)
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(&bounds.centerX[i]);
+			__m256 y = _mm256_loadu_ps(&bounds.centerY[i]);
+			__m256 z = _mm256_loadu_ps(&bounds.centerZ[i]);
+			__m256 ex = _mm256_loadu_ps(&bounds.extentX[i]);
+			__m256 ey = _mm256_loadu_ps(&bounds.extentY[i]);
+			__m256 ez = _mm256_loadu_ps(&bounds.extentZ[i]);
+			__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_mul_ps(y, _mm256_set1_ps(plane.y))),
+					_mm256_mul_ps(z, _mm256_set1_ps(plane.z))), _mm256_set1_ps(plane.w));
+				__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, _mm256_set1_ps(fabsf(plane.x))), _mm256_mul_ps(ey, _mm256_set1_ps(fabsf(plane.y)))),
+					_mm256_mul_ps(ez, _mm256_set1_ps(fabsf(plane.z))));
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, _mm256_sub_ps(_mm256_setzero_ps(), radius), _CMP_NLT_UQ));
+			}
+			numVisible = appendVisible((unsigned int)_mm256_movemask_ps(inside), i, visible, numVisible);
+		}
+#elif defined(EW_CULLING_SSE)
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&bounds.centerX[i]);
+			__m128 y = _mm_loadu_ps(&bounds.centerY[i]);
+			__m128 z = _mm_loadu_ps(&bounds.centerZ[i]);
+			__m128 ex = _mm_loadu_ps(&bounds.extentX[i]);
+			__m128 ey = _mm_loadu_ps(&bounds.extentY[i]);
+			__m128 ez = _mm_loadu_ps(&bounds.extentZ[i]);
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(plane.x)), _mm_mul_ps(y, _mm_set1_ps(plane.y))),
+					_mm_mul_ps(z, _mm_set1_ps(plane.z))), _mm_set1_ps(plane.w));
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(fabsf(plane.x))), _mm_mul_ps(ey, _mm_set1_ps(fabsf(plane.y)))),
+					_mm_mul_ps(ez, _mm_set1_ps(fabsf(plane.z))));
+				inside = _mm_and_ps(inside, _mm_cmpnlt_ps(distance, _mm_sub_ps(_mm_setzero_ps(), radius)));
+			}
+			numVisible = appendVisible((unsigned int)_mm_movemask_ps(inside), i, visible, numVisible);
+		}
+#endif
+		for (; i < end; i++)
+		{
+			glm::vec3 center = glm::vec3(bounds.centerX[i], bounds.centerY[i], bounds.centerZ[i]);
+			glm::vec3 extents = glm::vec3(bounds.extentX[i], bounds.extentY[i], bounds.extentZ[i]);
+			if (isBoxVisible(frustum, center, extents)) {
+				visible[numVisible++] = (uint32_t)i;
+			}
+		}
+		return numVisible;
+	}
+
+	size_t cullSpheres(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible) {
+		return cullSpheresRange(frustum, bounds, 0, bounds.size(), visible);
+	}
+
+	size_t cullBoxes(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible) {
+		return cullBoxesRange(frustum, bounds, 0, bounds.size(), visible);
+	}
+
+	//Bounds per culling job. Small enough to balance, large enough that the job overhead stays in the noise.
+	static const size_t CULL_GRAIN = 4096;
+
+	/// <summary>
+	/// Culls chunks of the bounds concurrently. Each chunk writes its visible indices to its own part of visible,
+	/// starting at the chunk's first index, and the parts are then packed together in order.
+	/// </summary>
+	/// <param name="cullRange">Range test to run on each chunk</param>
+	static size_t cullParallel(size_t(*cullRange)(const Frustum&, const CullingBounds&, size_t, size_t, uint32_t*),
+		const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible, JobSystem& jobSystem) {
+		size_t count = bounds.size();
+		size_t numChunks = (count + CULL_GRAIN - 1) / CULL_GRAIN;
+		std::vector<size_t> numVisible(numChunks);
+		jobSystem.parallelFor(numChunks, [&](size_t first, size_t last) {
+			for (size_t chunk = first; chunk < last; chunk++)
+			{
+				size_t begin = chunk * CULL_GRAIN;
+				size_t end = begin + CULL_GRAIN < count ? begin + CULL_GRAIN : count;
+				numVisible[chunk] = cullRange(frustum, bounds, begin, end, visible + begin);
+			}
+		});
+		//Every chunk's output starts at or after where it is moved to, so a forward pass never overwrites unread indices
+		size_t total = 0;
+		for (size_t chunk = 0; chunk < numChunks; chunk++)
+		{
+			size_t begin = chunk * CULL_GRAIN;
+			if (total != begin) {
+				memmove(visible + total, visible + begin, numVisible[chunk] * sizeof(uint32_t));
+			}
+			total += numVisible[chunk];
+		}
+		return total;
+	}
+
+	size_t cullSpheres(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible, JobSystem& jobSystem) {
+		return cullParallel(cullSpheresRange, frustum, bounds, visible, jobSystem);
+	}
+
+	size_t cullBoxes(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible, JobSystem& jobSystem) {
+		return cullParallel(cullBoxesRange, frustum, bounds, visible, jobSystem);
+	}
+}
@@ -0,0 +1,52 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "bounds.h"
+#include "camera.h"
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	class JobSystem;
+
+	//Planes are (normal, d) with dot(normal, p) + d >= 0 on the inside.
+	//Order is left, right, bottom, top, near, far. Normals are unit length.
+	struct Frustum {
+		glm::vec4 planes[6];
+	};
+
+	//Works for any projection, perspective or orthographic
+	Frustum extractFrustum(const glm::mat4& viewProjection);
+	Frustum extractFrustum(const Camera& camera);
+
+	bool isSphereVisible(const Frustum& frustum, const glm::vec3& center, float radius);
+	bool isBoxVisible(const Frustum& frustum, const glm::vec3& center, const glm::vec3& extents);
+	//Sphere test first, then the tighter box test
+	bool isVisible(const Frustum& frustum, const Bounds& bounds);
+
+	//World space bounds stored as structure of arrays, for culling many at once
+	struct CullingBounds {
+		std::vector<float> centerX, centerY, centerZ;
+		std::vector<float> extentX, extentY, extentZ;
+		std::vector<float> radius;
+
+		void add(const Bounds& bounds);
+		void set(size_t i, const Bounds& bounds);
+		void resize(size_t count);
+		void clear();
+		inline size_t size()const { return radius.size(); }
+	};
+
+	//Each writes the indices of visible bounds to visible, in increasing order, and returns how many.
+	//visible must have room for bounds.size() indices.
+	size_t cullSpheres(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible);
+	size_t cullBoxes(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible);
+	//Same results, with the bounds split across the job system's workers
+	size_t cullSpheres(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible, JobSystem& jobSystem);
+	size_t cullBoxes(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible, JobSystem& jobSystem);
+	//One at a time, for reference and comparison
+	size_t cullSpheresScalar(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible);
+	size_t cullBoxesScalar(const Frustum& frustum, const CullingBounds& bounds, uint32_t* visible);
+}
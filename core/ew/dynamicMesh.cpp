@@ -0,0 +1,293 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "dynamicMesh.h"
+#include "external/glad.h"
+#include "profiler.h"
+#include <string.h>
+#include <algorithm>
+
+namespace ew {
+	/// <summary>
+	/// Creates the vertex array and, if capacities are given, the buffers. Calling it again recreates the mesh empty.
+	/// </summary>
+	/// <param name="layout">Vertex attributes</param>
+	/// <param name="vertexCapacity">Vertices to allocate up front</param>
+	/// <param name="indexCapacity">Indices to allocate up front</param>
+	/// <param name="mode">How writes reach the GPU without waiting on draws that are still in flight</param>
+	/// <param name="numFrames">Frames the CPU may run ahead of the GPU before beginFrame() waits. PERSISTENT only.</param>
+	void DynamicMesh::create(const VertexLayout& layout, unsigned int vertexCapacity, unsigned int indexCapacity, DynamicMeshMode mode, unsigned int numFrames)
+	{
+		unload();
+		if (mode == DynamicMeshMode::PERSISTENT && glBufferStorage == NULL) {
+			mode = DynamicMeshMode::ORPHAN;
+		}
+		if (numFrames < 1 || mode == DynamicMeshMode::ORPHAN) {
+			numFrames = 1;
+		}
+		m_mode = mode;
+		m_layout = layout;
+		m_fences.assign(numFrames, nullptr);
+		m_vertices.dirty.assign(numFrames, DirtyRange());
+		m_indices.dirty.assign(numFrames, DirtyRange());
+		//First beginFrame() moves to copy 0
+		m_segment = numFrames - 1;
+		glGenVertexArrays(1, &m_vao);
+		reserve(vertexCapacity, indexCapacity);
+	}
+
+	DynamicMesh::~DynamicMesh()
+	{
+		unload();
+	}
+
+	void DynamicMesh::unload()
+	{
+		for (size_t i = 0; i < m_fences.size(); i++)
+		{
+			if (m_fences[i] != nullptr) {
+				glDeleteSync((GLsync)m_fences[i]);
+			}
+		}
+		if (m_vao != 0) {
+			glDeleteVertexArrays(1, &m_vao);
+		}
+		//Deleting a mapped buffer unmaps it
+		Stream* streams[] = { &m_vertices, &m_indices };
+		for (Stream* stream : streams) {
+			if (stream->id != 0) {
+				glDeleteBuffers(1, &stream->id);
+			}
+			*stream = Stream();
+		}
+		m_fences.clear();
+		m_vao = 0;
+		m_numVertices = m_numIndices = 0;
+		m_vertexCapacity = m_indexCapacity = 0;
+		m_segment = 0;
+	}
+
+	void DynamicMesh::beginFrame()
+	{
+		if (m_mode != DynamicMeshMode::PERSISTENT || m_fences.empty()) {
+			return;
+		}
+		m_segment = (m_segment + 1) % m_fences.size();
+		GLsync fence = (GLsync)m_fences[m_segment];
+		if (fence == nullptr) {
+			return;
+		}
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			m_stats.numStalls++;
+			do {
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		m_fences[m_segment] = nullptr;
+	}
+
+	void DynamicMesh::endFrame()
+	{
+		if (m_mode != DynamicMeshMode::PERSISTENT || m_fences.empty()) {
+			return;
+		}
+		if (m_fences[m_segment] != nullptr) {
+			glDeleteSync((GLsync)m_fences[m_segment]);
+		}
+		m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void DynamicMesh::resize(unsigned int numVertices, unsigned int numIndices)
+	{
+		reserve(numVertices, numIndices);
+		m_vertices.data.resize((size_t)numVertices * m_layout.stride);
+		m_indices.data.resize((size_t)numIndices * sizeof(unsigned int));
+		m_numVertices = numVertices;
+		m_numIndices = numIndices;
+	}
+
+	void* DynamicMesh::mapVertices(unsigned int first, unsigned int count)
+	{
+		if ((size_t)first + count > m_numVertices) {
+			return nullptr;
+		}
+		size_t begin = (size_t)first * m_layout.stride;
+		markDirty(&m_vertices, begin, begin + (size_t)count * m_layout.stride);
+		return m_vertices.data.data() + begin;
+	}
+
+	unsigned int* DynamicMesh::mapIndices(unsigned int first, unsigned int count)
+	{
+		if ((size_t)first + count > m_numIndices) {
+			return nullptr;
+		}
+		markDirty(&m_indices, (size_t)first * sizeof(unsigned int), ((size_t)first + count) * sizeof(unsigned int));
+		return (unsigned int*)m_indices.data.data() + first;
+	}
+
+	void DynamicMesh::setVertices(const void* vertices, unsigned int numVertices)
+	{
+		resize(numVertices, m_numIndices);
+		updateVertices(vertices, 0, numVertices);
+	}
+
+	void DynamicMesh::setIndices(const unsigned int* indices, unsigned int numIndices)
+	{
+		resize(m_numVertices, numIndices);
+		updateIndices(indices, 0, numIndices);
+	}
+
+	void DynamicMesh::updateVertices(const void* vertices, unsigned int first, unsigned int count)
+	{
+		void* destination = mapVertices(first, count);
+		if (destination != nullptr && count > 0) {
+			memcpy(destination, vertices, (size_t)count * m_layout.stride);
+		}
+	}
+
+	void DynamicMesh::updateIndices(const unsigned int* indices, unsigned int first, unsigned int count)
+	{
+		unsigned int* destination = mapIndices(first, count);
+		if (destination != nullptr && count > 0) {
+			memcpy(destination, indices, (size_t)count * sizeof(unsigned int));
+		}
+	}
+
+	/// <summary>
+	/// Uploads the ranges written since this frame's copy was last drawn, then draws from that copy.
+	/// Each copy sits at its own offset in the buffers, so switching copies only changes the base vertex and index offset.
+	/// </summary>
+	/// <param name="drawMode">Triangles or points</param>
+	void DynamicMesh::draw(DrawMode drawMode)
+	{
+		if (m_vao == 0) {
+			return;
+		}
+		flush(&m_vertices);
+		flush(&m_indices);
+		glBindVertexArray(m_vao);
+		GLint baseVertex = (GLint)(m_segment * m_vertexCapacity);
+		if (drawMode == DrawMode::TRIANGLES) {
+			const void* indexOffset = (const void*)(m_segment * m_indices.capacity);
+			glDrawElementsBaseVertex(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, indexOffset, baseVertex);
+		}
+		else {
+			glDrawArrays(GL_POINTS, baseVertex, m_numVertices);
+		}
+	}
+
+	//Grows either buffer to at least the given capacity. Existing contents are uploaded again from the CPU copy.
+	void DynamicMesh::reserve(unsigned int vertexCapacity, unsigned int indexCapacity)
+	{
+		bool growVertices = vertexCapacity > m_vertexCapacity;
+		bool growIndices = indexCapacity > m_indexCapacity;
+		if (!growVertices && !growIndices) {
+			return;
+		}
+		EW_PROFILE_SCOPE("DynamicMesh::reserve");
+		glBindVertexArray(m_vao);
+		if (growVertices) {
+			//Doubling means a mesh that grows a little every frame reallocates a logarithmic number of times
+			if (m_vertexCapacity > 0) {
+				vertexCapacity = std::max(vertexCapacity, m_vertexCapacity * 2);
+				m_stats.numGrows++;
+			}
+			m_vertexCapacity = vertexCapacity;
+			allocateStream(&m_vertices, GL_ARRAY_BUFFER, (size_t)vertexCapacity * m_layout.stride);
+			setVertexAttributes(m_layout);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+		if (growIndices) {
+			if (m_indexCapacity > 0) {
+				indexCapacity = std::max(indexCapacity, m_indexCapacity * 2);
+				m_stats.numGrows++;
+			}
+			m_indexCapacity = indexCapacity;
+			//Binding while the VAO is bound attaches it
+			allocateStream(&m_indices, GL_ELEMENT_ARRAY_BUFFER, (size_t)indexCapacity * sizeof(unsigned int));
+		}
+		glBindVertexArray(0);
+	}
+
+	//Replaces the stream's buffer with one holding capacity bytes per frame copy, left bound to target
+	void DynamicMesh::allocateStream(Stream* stream, unsigned int target, size_t capacity)
+	{
+		//Draws already submitted keep the old buffer alive until they finish
+		if (stream->id != 0) {
+			glDeleteBuffers(1, &stream->id);
+		}
+		glGenBuffers(1, &stream->id);
+		glBindBuffer(target, stream->id);
+		stream->capacity = capacity;
+		GLsizeiptr size = (GLsizeiptr)(capacity * m_fences.size());
+		if (m_mode == DynamicMeshMode::PERSISTENT) {
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(target, size, NULL, flags);
+			stream->mapped = (unsigned char*)glMapBufferRange(target, 0, size, flags);
+		}
+		else {
+			glBufferData(target, size, NULL, GL_STREAM_DRAW);
+			stream->mapped = nullptr;
+		}
+		markDirty(stream, 0, stream->data.size());
+	}
+
+	//Every frame copy needs [begin, end) again. Ranges are merged into one per copy, which may cover bytes that did not change.
+	void DynamicMesh::markDirty(Stream* stream, size_t begin, size_t end)
+	{
+		if (begin >= end) {
+			return;
+		}
+		for (size_t i = 0; i < stream->dirty.size(); i++)
+		{
+			DirtyRange& range = stream->dirty[i];
+			if (range.begin >= range.end) {
+				range.begin = begin;
+				range.end = end;
+			}
+			else {
+				range.begin = std::min(range.begin, begin);
+				range.end = std::max(range.end, end);
+			}
+		}
+	}
+
+	/// <summary>
+	/// Copies this frame's dirty range to the GPU. PERSISTENT copies from the CPU copy into the frame's mapped copy, which
+	/// the fence in beginFrame() has already made safe. That second copy is the price of keeping the mapping write only.
+	/// ORPHAN replaces the buffer's storage when at least half of it changed, so the upload does not wait on earlier draws,
+	/// and otherwise updates the range in place.
+	/// </summary>
+	void DynamicMesh::flush(Stream* stream)
+	{
+		DirtyRange& range = stream->dirty[m_segment];
+		//The stream may have shrunk since the range was marked
+		size_t end = std::min(range.end, stream->data.size());
+		if (range.begin < end) {
+			EW_PROFILE_SCOPE("DynamicMesh::flush");
+			size_t size = end - range.begin;
+			if (m_mode == DynamicMeshMode::PERSISTENT) {
+				memcpy(stream->mapped + m_segment * stream->capacity + range.begin, stream->data.data() + range.begin, size);
+			}
+			//The element array binding belongs to the VAO, so both streams go through a non-indexed target
+			else if (size * 2 >= stream->data.size()) {
+				size = stream->data.size();
+				glBindBuffer(GL_COPY_WRITE_BUFFER, stream->id);
+				glBufferData(GL_COPY_WRITE_BUFFER, stream->capacity, NULL, GL_STREAM_DRAW);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, 0, size, stream->data.data());
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+				m_stats.numOrphans++;
+			}
+			else {
+				glBindBuffer(GL_COPY_WRITE_BUFFER, stream->id);
+				glBufferSubData(GL_COPY_WRITE_BUFFER, range.begin, size, stream->data.data() + range.begin);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+			}
+			m_stats.bytesUploaded += size;
+		}
+		range = DirtyRange();
+	}
+}
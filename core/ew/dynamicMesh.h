@@ -0,0 +1,126 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <vector>
+#include <stdint.h>
+#include "mesh.h"
+#include "vertexLayout.h"
+#include "bounds.h"
+
+namespace ew {
+	enum class DynamicMeshMode {
+		PERSISTENT = 0, //numFrames copies in persistently mapped buffers, one written per frame and fenced. Needs GL 4.4, otherwise ORPHAN is used.
+		ORPHAN = 1 //One buffer, orphaned when most of it changes so the driver can hand out fresh storage instead of waiting
+	};
+
+	struct DynamicMeshStats {
+		uint64_t bytesUploaded = 0;
+		unsigned int numGrows = 0; //Times the buffers had to be reallocated for more vertices or indices
+		unsigned int numOrphans = 0;
+		unsigned int numStalls = 0; //beginFrame() calls that had to wait on the GPU
+	};
+
+	//Mesh whose vertices and indices change often, e.g. every frame.
+	//Writes go to a CPU copy and only the changed range is copied to the GPU when the mesh is next drawn. In PERSISTENT
+	//mode each frame draws from its own copy of the buffers, like InstanceBuffer, so writing never waits on draws still
+	//in flight. Capacity doubles when it runs out, so a mesh that keeps changing size reallocates only a few times.
+	//The CPU copy costs one extra memcpy of the changed bytes per frame copy, compared to writing into mapped memory
+	//directly (core_bench gl/dynamicPlane_1M_persistent vs _persistentDirect). It is what lets a partial update reach
+	//the other frames' copies without reading back mapped, often uncached, GPU memory.
+	//Indices are always 32 bit, so growing past 65536 vertices does not change their size.
+	//
+	//	mesh.beginFrame();
+	//	mesh.resize(planeSize.numVertices, planeSize.numIndices);
+	//	ew::writePlane(1.0f, 1.0f, subdivisions, mesh.mapVertices<ew::Vertex>(0, planeSize.numVertices), mesh.mapIndices(0, planeSize.numIndices));
+	//	mesh.draw();
+	//	mesh.endFrame();
+	class DynamicMesh {
+	public:
+		DynamicMesh() {};
+		~DynamicMesh();
+		DynamicMesh(const DynamicMesh&) = delete;
+		DynamicMesh& operator=(const DynamicMesh&) = delete;
+		//Capacities are a starting size in vertices and indices, 0 = allocate on first write
+		void create(const VertexLayout& layout, unsigned int vertexCapacity = 0, unsigned int indexCapacity = 0, DynamicMeshMode mode = DynamicMeshMode::PERSISTENT, unsigned int numFrames = 3);
+		template<typename V>
+		void create(unsigned int vertexCapacity = 0, unsigned int indexCapacity = 0, DynamicMeshMode mode = DynamicMeshMode::PERSISTENT, unsigned int numFrames = 3) {
+			create(VertexTraits<V>::layout(), vertexCapacity, indexCapacity, mode, numFrames);
+		}
+		//Deletes the GL objects and the CPU copy. Safe to call more than once.
+		void unload();
+
+		//Moves to the next copy, waiting only if the GPU is still reading it from numFrames ago. Only needed in PERSISTENT mode.
+		void beginFrame();
+		void endFrame();
+
+		//Sets the number of vertices and indices. Existing contents are kept, new ones are undefined until written.
+		void resize(unsigned int numVertices, unsigned int numIndices);
+		//Writable range of the CPU copy, copied to the GPU at the next draw(). Returns nullptr if the range is past the end.
+		//In PERSISTENT mode, finish writing before the frame's first draw(): later draws read from the same copy.
+		void* mapVertices(unsigned int first, unsigned int count);
+		template<typename V>
+		V* mapVertices(unsigned int first, unsigned int count) {
+			return (V*)mapVertices(first, count);
+		}
+		unsigned int* mapIndices(unsigned int first, unsigned int count);
+		//Replace every vertex or index, resizing to match
+		void setVertices(const void* vertices, unsigned int numVertices);
+		void setIndices(const unsigned int* indices, unsigned int numIndices);
+		template<typename V>
+		void setVertices(const std::vector<V>& vertices) {
+			setVertices(vertices.data(), (unsigned int)vertices.size());
+		}
+		//Partial updates, within the current size
+		void updateVertices(const void* vertices, unsigned int first, unsigned int count);
+		void updateIndices(const unsigned int* indices, unsigned int first, unsigned int count);
+
+		//Uploads whatever changed, then draws all indices, or all vertices as points
+		void draw(DrawMode drawMode = DrawMode::TRIANGLES);
+
+		inline DynamicMeshMode getMode()const { return m_mode; }
+		inline unsigned int getNumVertices()const { return m_numVertices; }
+		inline unsigned int getNumIndices()const { return m_numIndices; }
+		inline unsigned int getVertexCapacity()const { return m_vertexCapacity; }
+		inline unsigned int getIndexCapacity()const { return m_indexCapacity; }
+		//GPU bytes, every frame's copy included
+		inline size_t getMemoryUsage()const { return ((size_t)m_vertexCapacity * m_layout.stride + (size_t)m_indexCapacity * sizeof(unsigned int)) * m_fences.size(); }
+		inline const DynamicMeshStats& getStats()const { return m_stats; }
+		//Not computed from the vertices, since they may change every frame
+		inline const Bounds& getBounds()const { return m_bounds; }
+		inline void setBounds(const Bounds& bounds) { m_bounds = bounds; }
+	private:
+		//Bytes not yet copied into a frame's buffers
+		struct DirtyRange {
+			size_t begin = 0;
+			size_t end = 0;
+		};
+		//Vertices or indices: the CPU copy, and GPU storage for every frame
+		struct Stream {
+			unsigned int id = 0;
+			unsigned char* mapped = nullptr; //PERSISTENT only
+			std::vector<unsigned char> data;
+			size_t capacity = 0; //Bytes per frame
+			std::vector<DirtyRange> dirty; //Per frame
+		};
+		void reserve(unsigned int vertexCapacity, unsigned int indexCapacity);
+		void allocateStream(Stream* stream, unsigned int target, size_t capacity);
+		void markDirty(Stream* stream, size_t begin, size_t end);
+		void flush(Stream* stream);
+
+		DynamicMeshMode m_mode = DynamicMeshMode::PERSISTENT;
+		VertexLayout m_layout = {};
+		unsigned int m_vao = 0;
+		Stream m_vertices;
+		Stream m_indices;
+		unsigned int m_numVertices = 0;
+		unsigned int m_numIndices = 0;
+		unsigned int m_vertexCapacity = 0;
+		unsigned int m_indexCapacity = 0;
+		std::vector<void*> m_fences; //One per frame copy
+		unsigned int m_segment = 0; //Copy being written and drawn this frame
+		DynamicMeshStats m_stats;
+		Bounds m_bounds;
+	};
+}
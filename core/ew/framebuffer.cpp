@@ -0,0 +1,126 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "framebuffer.h"
+#include "external/glad.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace ew {
+	Framebuffer::~Framebuffer()
+	{
+		destroy();
+	}
+
+	/// <summary>
+	/// Allocates immutable color and depth textures and attaches them
+	/// </summary>
+	/// <param name="width">Width in pixels</param>
+	/// <param name="height">Height in pixels</param>
+	/// <returns>False if the framebuffer is incomplete</returns>
+	bool Framebuffer::create(int width, int height)
+	{
+		destroy();
+		m_width = width;
+		m_height = height;
+
+		glGenTextures(1, &m_colorTexture);
+		glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glGenTextures(1, &m_depthTexture);
+		glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenFramebuffers(1, &m_fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+		GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		if (status != GL_FRAMEBUFFER_COMPLETE) {
+			printf("Framebuffer incomplete: 0x%x\n", status);
+			destroy();
+			return false;
+		}
+		return true;
+	}
+
+	void Framebuffer::bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, m_fbo);
+		glViewport(0, 0, m_width, m_height);
+	}
+
+	void Framebuffer::unbind()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	/// <summary>
+	/// Reads the color attachment back. GL rows start at the bottom, so they are flipped to match image files.
+	/// </summary>
+	/// <param name="rgba">Resized to width * height * 4</param>
+	void Framebuffer::readPixels(std::vector<unsigned char>& rgba) const
+	{
+		size_t rowSize = (size_t)m_width * 4;
+		rgba.resize(rowSize * m_height);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, m_fbo);
+		glReadBuffer(GL_COLOR_ATTACHMENT0);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, m_width, m_height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+		std::vector<unsigned char> row(rowSize);
+		for (int y = 0; y < m_height / 2; y++)
+		{
+			unsigned char* top = rgba.data() + y * rowSize;
+			unsigned char* bottom = rgba.data() + (m_height - 1 - y) * rowSize;
+			memcpy(row.data(), top, rowSize);
+			memcpy(top, bottom, rowSize);
+			memcpy(bottom, row.data(), rowSize);
+		}
+	}
+
+	void Framebuffer::destroy()
+	{
+		if (m_fbo != 0) {
+			glDeleteFramebuffers(1, &m_fbo);
+			glDeleteTextures(1, &m_colorTexture);
+			glDeleteTextures(1, &m_depthTexture);
+		}
+		m_fbo = 0;
+		m_colorTexture = 0;
+		m_depthTexture = 0;
+	}
+
+	bool writeImagePPM(const std::string& filePath, const unsigned char* rgba, int width, int height)
+	{
+		FILE* file = fopen(filePath.c_str(), "wb");
+		if (file == NULL) {
+			printf("Failed to open %s for writing\n", filePath.c_str());
+			return false;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		std::vector<unsigned char> rgb((size_t)width * 3);
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char* src = rgba + (size_t)y * width * 4;
+			for (int x = 0; x < width; x++)
+			{
+				rgb[x * 3 + 0] = src[x * 4 + 0];
+				rgb[x * 3 + 1] = src[x * 4 + 1];
+				rgb[x * 3 + 2] = src[x * 4 + 2];
+			}
+			fwrite(rgb.data(), 1, rgb.size(), file);
+		}
+		bool ok = ferror(file) == 0;
+		fclose(file);
+		return ok;
+	}
+}
@@ -0,0 +1,42 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <vector>
+#include <string>
+
+namespace ew {
+	//Offscreen render target with an RGBA8 color texture and a 32 bit float depth texture.
+	//The depth texture can be passed straight to HiZPyramid::build.
+	class Framebuffer {
+	public:
+		Framebuffer() {};
+		~Framebuffer();
+		Framebuffer(const Framebuffer&) = delete;
+		Framebuffer& operator=(const Framebuffer&) = delete;
+		//Can be called again to resize
+		bool create(int width, int height);
+		//Binds for drawing and sets the viewport to cover it
+		void bind()const;
+		//Rebinds the default framebuffer
+		static void unbind();
+		//Tightly packed RGBA8 pixels, top row first. Waits for rendering to finish.
+		void readPixels(std::vector<unsigned char>& rgba)const;
+		inline unsigned int getID()const { return m_fbo; }
+		inline unsigned int getColorTexture()const { return m_colorTexture; }
+		inline unsigned int getDepthTexture()const { return m_depthTexture; }
+		inline int getWidth()const { return m_width; }
+		inline int getHeight()const { return m_height; }
+	private:
+		void destroy();
+		unsigned int m_fbo = 0;
+		unsigned int m_colorTexture = 0;
+		unsigned int m_depthTexture = 0;
+		int m_width = 0;
+		int m_height = 0;
+	};
+
+	//Writes tightly packed RGBA8 pixels (top row first) as a binary PPM. Alpha is dropped.
+	bool writeImagePPM(const std::string& filePath, const unsigned char* rgba, int width, int height);
+}
@@ -0,0 +1,335 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "geometryArena.h"
+#include "instanceBuffer.h"
+#include "external/glad.h"
+#include <algorithm>
+
+namespace ew {
+	void RangeAllocator::reset(size_t capacity)
+	{
+		m_free.clear();
+		if (capacity > 0) {
+			m_free.push_back({ 0, capacity });
+		}
+		m_capacity = capacity;
+		m_freeSize = capacity;
+	}
+
+	void RangeAllocator::grow(size_t capacity)
+	{
+		if (capacity <= m_capacity) {
+			return;
+		}
+		free(m_capacity, capacity - m_capacity);
+		m_capacity = capacity;
+	}
+
+	bool RangeAllocator::allocate(size_t size, size_t* offset)
+	{
+		for (size_t i = 0; i < m_free.size(); i++)
+		{
+			if (m_free[i].size >= size) {
+				*offset = m_free[i].offset;
+				m_free[i].offset += size;
+				m_free[i].size -= size;
+				if (m_free[i].size == 0) {
+					m_free.erase(m_free.begin() + i);
+				}
+				m_freeSize -= size;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void RangeAllocator::free(size_t offset, size_t size)
+	{
+		if (size == 0) {
+			return;
+		}
+		auto it = std::lower_bound(m_free.begin(), m_free.end(), offset, [](const Range& range, size_t value) {
+			return range.offset < value;
+		});
+		it = m_free.insert(it, { offset, size });
+		//Merge with the next range, then the previous one
+		auto next = it + 1;
+		if (next != m_free.end() && it->offset + it->size == next->offset) {
+			it->size += next->size;
+			m_free.erase(next);
+		}
+		if (it != m_free.begin()) {
+			auto previous = it - 1;
+			if (previous->offset + previous->size == it->offset) {
+				previous->size += it->size;
+				m_free.erase(it);
+			}
+		}
+		m_freeSize += size;
+	}
+
+	size_t RangeAllocator::getLargestFreeRange() const
+	{
+		size_t largest = 0;
+		for (size_t i = 0; i < m_free.size(); i++)
+		{
+			largest = std::max(largest, m_free[i].size);
+		}
+		return largest;
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		if (m_vao != 0) {
+			glDeleteVertexArrays(1, &m_vao);
+			glDeleteBuffers(1, &m_vbo);
+			glDeleteBuffers(1, &m_ebo);
+		}
+	}
+
+	/// <summary>
+	/// Creates the shared buffers and sets up the VAO once for every mesh that will live in them
+	/// </summary>
+	/// <param name="layout">Vertex layout shared by all meshes in the arena</param>
+	/// <param name="vertexCapacity">Initial vertex count</param>
+	/// <param name="indexCapacity">Initial index count</param>
+	/// <param name="shortIndices">16 bit indices. Limits each mesh, not the arena, to 65536 vertices.</param>
+	void GeometryArena::create(const VertexLayout& layout, unsigned int vertexCapacity, unsigned int indexCapacity, bool shortIndices)
+	{
+		m_layout = layout;
+		m_indexType = shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		m_indexSize = shortIndices ? sizeof(uint16_t) : sizeof(uint32_t);
+		m_ranges.clear();
+		m_live.clear();
+		m_freeHandles.clear();
+		m_numAllocations = 0;
+		m_instanceGeneration = 0;
+		if (m_vao == 0) {
+			glGenVertexArrays(1, &m_vao);
+		}
+		else {
+			glDeleteBuffers(1, &m_vbo);
+			glDeleteBuffers(1, &m_ebo);
+			m_vbo = m_ebo = 0;
+		}
+		m_vertexAllocator.reset(0);
+		m_indexAllocator.reset(0);
+		resize(std::max(vertexCapacity, 1u), std::max(indexCapacity, 1u), false);
+	}
+
+	/// <summary>
+	/// Moves everything into new buffers of the given size and points the VAO at them.
+	/// With compact set, live ranges are packed to the start in their current order.
+	/// </summary>
+	void GeometryArena::resize(size_t vertexCapacity, size_t indexCapacity, bool compact)
+	{
+		unsigned int buffers[2];
+		glGenBuffers(2, buffers);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * m_layout.stride, NULL, GL_STATIC_DRAW);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+		glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity * m_indexSize, NULL, GL_STATIC_DRAW);
+
+		if (compact) {
+			//Keep the current order so meshes that were adjacent stay adjacent
+			std::vector<GeometryHandle> order;
+			for (GeometryHandle handle = 0; handle < m_ranges.size(); handle++)
+			{
+				if (m_live[handle]) {
+					order.push_back(handle);
+				}
+			}
+			std::sort(order.begin(), order.end(), [&](GeometryHandle a, GeometryHandle b) {
+				return m_ranges[a].baseVertex < m_ranges[b].baseVertex;
+			});
+			unsigned int nextVertex = 0;
+			unsigned int nextIndex = 0;
+			for (GeometryHandle handle : order) {
+				GeometryRange& range = m_ranges[handle];
+				glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)range.baseVertex * m_layout.stride, (GLintptr)nextVertex * m_layout.stride, (GLsizeiptr)range.numVertices * m_layout.stride);
+				glBindBuffer(GL_COPY_READ_BUFFER, m_ebo);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)range.firstIndex * m_indexSize, (GLintptr)nextIndex * m_indexSize, (GLsizeiptr)range.numIndices * m_indexSize);
+				range.baseVertex = nextVertex;
+				range.firstIndex = nextIndex;
+				nextVertex += range.numVertices;
+				nextIndex += range.numIndices;
+			}
+			m_vertexAllocator.reset(vertexCapacity);
+			m_indexAllocator.reset(indexCapacity);
+			size_t offset;
+			m_vertexAllocator.allocate(nextVertex, &offset);
+			m_indexAllocator.allocate(nextIndex, &offset);
+		}
+		else {
+			//Same offsets, more room at the end
+			if (m_vbo != 0) {
+				glBindBuffer(GL_COPY_READ_BUFFER, m_vbo);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[0]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_vertexAllocator.getCapacity() * m_layout.stride);
+				glBindBuffer(GL_COPY_READ_BUFFER, m_ebo);
+				glBindBuffer(GL_COPY_WRITE_BUFFER, buffers[1]);
+				glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, m_indexAllocator.getCapacity() * m_indexSize);
+			}
+			m_vertexAllocator.grow(vertexCapacity);
+			m_indexAllocator.grow(indexCapacity);
+		}
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		if (m_vbo != 0) {
+			glDeleteBuffers(1, &m_vbo);
+			glDeleteBuffers(1, &m_ebo);
+		}
+		m_vbo = buffers[0];
+		m_ebo = buffers[1];
+
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		setVertexAttributes(m_layout);
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	/// <summary>
+	/// Copies a mesh into the arena, growing the buffers by at least 2x if it does not fit
+	/// </summary>
+	/// <param name="vertices">Vertex data in the arena's layout</param>
+	/// <param name="numVertices">Number of vertices</param>
+	/// <param name="indices">Indices relative to the first vertex</param>
+	/// <param name="numIndices">Number of indices</param>
+	/// <returns>Handle for draw()/free(), or INVALID_GEOMETRY</returns>
+	GeometryHandle GeometryArena::allocate(const void* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices)
+	{
+		if (m_vao == 0 || (m_indexType == GL_UNSIGNED_SHORT && numVertices > 65536)) {
+			return INVALID_GEOMETRY;
+		}
+		size_t baseVertex, firstIndex;
+		if (!m_vertexAllocator.allocate(numVertices, &baseVertex)) {
+			resize(std::max(m_vertexAllocator.getCapacity() * 2, m_vertexAllocator.getCapacity() + numVertices), m_indexAllocator.getCapacity(), false);
+			m_numGrows++;
+			m_vertexAllocator.allocate(numVertices, &baseVertex);
+		}
+		if (!m_indexAllocator.allocate(numIndices, &firstIndex)) {
+			resize(m_vertexAllocator.getCapacity(), std::max(m_indexAllocator.getCapacity() * 2, m_indexAllocator.getCapacity() + numIndices), false);
+			m_numGrows++;
+			m_indexAllocator.allocate(numIndices, &firstIndex);
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)baseVertex * m_layout.stride, (GLsizeiptr)numVertices * m_layout.stride, vertices);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		//Not through the VAO, so the element buffer binding of whatever VAO is bound stays untouched
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+		if (m_indexType == GL_UNSIGNED_SHORT) {
+			std::vector<uint16_t> shortIndices(numIndices);
+			for (unsigned int i = 0; i < numIndices; i++)
+			{
+				shortIndices[i] = (uint16_t)indices[i];
+			}
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstIndex * m_indexSize, (GLsizeiptr)numIndices * m_indexSize, shortIndices.data());
+		}
+		else {
+			glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstIndex * m_indexSize, (GLsizeiptr)numIndices * m_indexSize, indices);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+		GeometryHandle handle;
+		if (!m_freeHandles.empty()) {
+			handle = m_freeHandles.back();
+			m_freeHandles.pop_back();
+		}
+		else {
+			handle = (GeometryHandle)m_ranges.size();
+			m_ranges.push_back(GeometryRange());
+			m_live.push_back(0);
+		}
+		GeometryRange& range = m_ranges[handle];
+		range.baseVertex = (unsigned int)baseVertex;
+		range.numVertices = numVertices;
+		range.firstIndex = (unsigned int)firstIndex;
+		range.numIndices = numIndices;
+		m_live[handle] = 1;
+		m_numAllocations++;
+		return handle;
+	}
+
+	GeometryHandle GeometryArena::allocate(const MeshData& meshData)
+	{
+		return allocate(meshData.vertices.data(), (unsigned int)meshData.vertices.size(), meshData.indices.data(), (unsigned int)meshData.indices.size());
+	}
+
+	void GeometryArena::free(GeometryHandle handle)
+	{
+		if (handle >= m_ranges.size() || !m_live[handle]) {
+			return;
+		}
+		const GeometryRange& range = m_ranges[handle];
+		m_vertexAllocator.free(range.baseVertex, range.numVertices);
+		m_indexAllocator.free(range.firstIndex, range.numIndices);
+		m_live[handle] = 0;
+		m_freeHandles.push_back(handle);
+		m_numAllocations--;
+	}
+
+	void GeometryArena::defragment()
+	{
+		resize(m_vertexAllocator.getCapacity(), m_indexAllocator.getCapacity(), true);
+		m_numDefragments++;
+	}
+
+	void GeometryArena::bind() const
+	{
+		glBindVertexArray(m_vao);
+	}
+
+	void GeometryArena::draw(GeometryHandle handle, DrawMode drawMode) const
+	{
+		const GeometryRange& range = m_ranges[handle];
+		if (drawMode == DrawMode::TRIANGLES) {
+			glDrawElementsBaseVertex(GL_TRIANGLES, range.numIndices, m_indexType, (const void*)((size_t)range.firstIndex * m_indexSize), range.baseVertex);
+		}
+		else {
+			glDrawArrays(GL_POINTS, range.baseVertex, range.numVertices);
+		}
+	}
+
+	void GeometryArena::setInstanceBuffer(const InstanceBuffer& instances) const
+	{
+		if (m_instanceGeneration == instances.getGeneration()) {
+			return;
+		}
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, instances.getID());
+		setVertexAttributes(instances.getLayout(), 1);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		m_instanceGeneration = instances.getGeneration();
+	}
+
+	static float getFragmentation(const RangeAllocator& allocator) {
+		if (allocator.getFreeSize() == 0) {
+			return 0.0f;
+		}
+		return 1.0f - (float)allocator.getLargestFreeRange() / (float)allocator.getFreeSize();
+	}
+
+	GeometryArenaStats GeometryArena::getStats() const
+	{
+		GeometryArenaStats stats;
+		stats.vertexBytesCapacity = m_vertexAllocator.getCapacity() * m_layout.stride;
+		stats.vertexBytesUsed = (m_vertexAllocator.getCapacity() - m_vertexAllocator.getFreeSize()) * m_layout.stride;
+		stats.indexBytesCapacity = m_indexAllocator.getCapacity() * m_indexSize;
+		stats.indexBytesUsed = (m_indexAllocator.getCapacity() - m_indexAllocator.getFreeSize()) * m_indexSize;
+		stats.vertexFragmentation = getFragmentation(m_vertexAllocator);
+		stats.indexFragmentation = getFragmentation(m_indexAllocator);
+		stats.numAllocations = m_numAllocations;
+		stats.numGrows = m_numGrows;
+		stats.numDefragments = m_numDefragments;
+		return stats;
+	}
+}
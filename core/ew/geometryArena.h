@@ -0,0 +1,114 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "vertexLayout.h"
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ew {
+	class InstanceBuffer;
+
+	typedef uint32_t GeometryHandle;
+	const GeometryHandle INVALID_GEOMETRY = 0xffffffff;
+
+	//First fit allocator over [0, capacity). Freed ranges are merged with their neighbors.
+	class RangeAllocator {
+	public:
+		void reset(size_t capacity);
+		//Adds [getCapacity(), capacity) to the free list
+		void grow(size_t capacity);
+		bool allocate(size_t size, size_t* offset);
+		void free(size_t offset, size_t size);
+		inline size_t getCapacity()const { return m_capacity; }
+		inline size_t getFreeSize()const { return m_freeSize; }
+		size_t getLargestFreeRange()const;
+	private:
+		struct Range {
+			size_t offset;
+			size_t size;
+		};
+		std::vector<Range> m_free; //Sorted by offset
+		size_t m_capacity = 0;
+		size_t m_freeSize = 0;
+	};
+
+	//Where a mesh lives inside the arena's buffers
+	struct GeometryRange {
+		unsigned int baseVertex = 0;
+		unsigned int numVertices = 0;
+		unsigned int firstIndex = 0;
+		unsigned int numIndices = 0;
+	};
+
+	struct GeometryArenaStats {
+		size_t vertexBytesUsed = 0;
+		size_t vertexBytesCapacity = 0;
+		size_t indexBytesUsed = 0;
+		size_t indexBytesCapacity = 0;
+		//1 - largest free range / total free space. 0 means all free space is contiguous.
+		float vertexFragmentation = 0.0f;
+		float indexFragmentation = 0.0f;
+		unsigned int numAllocations = 0;
+		unsigned int numGrows = 0;
+		unsigned int numDefragments = 0;
+	};
+
+	//Many meshes with the same vertex layout suballocated from one vertex buffer and one index buffer behind a single VAO.
+	//Indices are stored relative to each mesh's first vertex and drawn with glDrawElementsBaseVertex,
+	//so 16 bit indices work for any mesh of up to 65536 vertices regardless of where it lands in the buffer.
+	//
+	//	arena.bind();
+	//	for (...) arena.draw(handle);
+	class GeometryArena {
+	public:
+		GeometryArena() {};
+		~GeometryArena();
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+		//Capacities are initial sizes, the buffers grow when full
+		void create(const VertexLayout& layout, unsigned int vertexCapacity, unsigned int indexCapacity, bool shortIndices = true);
+		template<typename V>
+		void create(unsigned int vertexCapacity, unsigned int indexCapacity, bool shortIndices = true) {
+			create(VertexTraits<V>::layout(), vertexCapacity, indexCapacity, shortIndices);
+		}
+		//vertices must match the arena's layout. Returns INVALID_GEOMETRY if a short index arena is given more than 65536 vertices.
+		GeometryHandle allocate(const void* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices);
+		GeometryHandle allocate(const MeshData& meshData);
+		void free(GeometryHandle handle);
+		//Packs every allocation to the start of fresh buffers. Handles stay valid.
+		void defragment();
+
+		//Binds the arena's VAO. Must be called before draw().
+		void bind()const;
+		void draw(GeometryHandle handle, DrawMode drawMode = DrawMode::TRIANGLES)const;
+		//Points the VAO's per-instance attributes at instances, for instanced and indirect draws. No-op if already set.
+		void setInstanceBuffer(const InstanceBuffer& instances)const;
+		inline const GeometryRange& getRange(GeometryHandle handle)const { return m_ranges[handle]; }
+		GeometryArenaStats getStats()const;
+		inline unsigned int getVAO()const { return m_vao; }
+		inline unsigned int getIndexType()const { return m_indexType; }
+		inline size_t getIndexSize()const { return m_indexSize; }
+	private:
+		void resize(size_t vertexCapacity, size_t indexCapacity, bool compact);
+
+		VertexLayout m_layout = {};
+		unsigned int m_vao = 0;
+		unsigned int m_vbo = 0;
+		unsigned int m_ebo = 0;
+		mutable unsigned int m_instanceGeneration = 0; //InstanceBuffer::getGeneration() of the buffer the VAO's per-instance attributes point at
+		unsigned int m_indexType = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		size_t m_indexSize = 0;
+		RangeAllocator m_vertexAllocator; //In vertices
+		RangeAllocator m_indexAllocator; //In indices
+		std::vector<GeometryRange> m_ranges; //Indexed by handle
+		std::vector<uint8_t> m_live;
+		std::vector<GeometryHandle> m_freeHandles;
+		unsigned int m_numAllocations = 0;
+		unsigned int m_numGrows = 0;
+		unsigned int m_numDefragments = 0;
+	};
+}
@@ -0,0 +1,426 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "gpuCulling.h"
+#include "shader.h"
+#include "external/glad.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <math.h>
+
+namespace ew {
+	static const unsigned int CULL_GROUP_SIZE = 64;
+	static const unsigned int HIZ_GROUP_SIZE = 8;
+
+	//Object bounds as the cull shader reads them (std430)
+	struct CullObject {
+		glm::vec4 centerRadius;
+		glm::vec4 extents;
+		uint32_t numIndices;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t padding;
+	};
+
+	//Matches the command layout glMultiDrawElementsIndirect reads
+	struct DrawElementsIndirectCommand {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	//Same arithmetic as transformBounds and isVisible, so results match cullObjectsReference
+	//except for bounds that touch a plane to within rounding.
+	static const char* CULL_SHADER_SOURCE = R"(#version 450
+layout(local_size_x = 64) in;
+
+struct CullObject {
+	vec4 centerRadius;
+	vec4 extents;
+	uint numIndices;
+	uint firstIndex;
+	int baseVertex;
+	uint padding;
+};
+struct DrawCommand {
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+layout(std430, binding = 0) readonly buffer Objects { CullObject _Objects[]; };
+layout(std430, binding = 1) readonly buffer Instances { vec4 _Instances[]; };
+layout(std430, binding = 2) writeonly buffer Commands { DrawCommand _Commands[]; };
+layout(std430, binding = 3) buffer DrawCount { uint _DrawCount; };
+layout(std430, binding = 4) writeonly buffer Visible { uint _Visible[]; };
+
+uniform vec4 _Planes[6];
+uniform uint _NumObjects;
+uniform uint _BaseInstance;
+uniform uint _InstanceStride; //In vec4s
+uniform bool _UseHiZ;
+uniform mat4 _HiZViewProjection;
+layout(binding = 0) uniform sampler2D _HiZ;
+
+bool isOccluded(vec3 center, vec3 extents) {
+	vec2 uvMin = vec2(1.0);
+	vec2 uvMax = vec2(0.0);
+	float depthMin = 1.0;
+	for (int i = 0; i < 8; i++) {
+		vec3 corner = center + extents * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = _HiZViewProjection * vec4(corner, 1.0);
+		//Crosses the camera plane, can't be projected
+		if (clip.w <= 0.0) {
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		uvMin = min(uvMin, ndc.xy * 0.5 + 0.5);
+		uvMax = max(uvMax, ndc.xy * 0.5 + 0.5);
+		depthMin = min(depthMin, ndc.z * 0.5 + 0.5);
+	}
+	ivec2 size = textureSize(_HiZ, 0);
+	ivec2 pixelMin = clamp(ivec2(clamp(uvMin, 0.0, 1.0) * vec2(size)), ivec2(0), size - 1);
+	ivec2 pixelMax = clamp(ivec2(clamp(uvMax, 0.0, 1.0) * vec2(size)), ivec2(0), size - 1);
+	//Smallest level where the rectangle covers at most 2x2 texels
+	ivec2 span = pixelMax - pixelMin;
+	int level = 0;
+	while ((1 << level) < max(span.x, span.y)) {
+		level++;
+	}
+	level = min(level, textureQueryLevels(_HiZ) - 1);
+	//Level sizes follow from level 0. Asking textureSize for a per-invocation level is miscompiled by some drivers.
+	ivec2 levelMax = max(size >> level, ivec2(1)) - 1;
+	ivec2 a = min(pixelMin >> level, levelMax);
+	ivec2 b = min(pixelMax >> level, levelMax);
+	float depth = max(max(texelFetch(_HiZ, a, level).r, texelFetch(_HiZ, ivec2(b.x, a.y), level).r),
+		max(texelFetch(_HiZ, ivec2(a.x, b.y), level).r, texelFetch(_HiZ, b, level).r));
+	return depthMin > depth;
+}
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= _NumObjects) {
+		return;
+	}
+	CullObject object = _Objects[i];
+	uint instance = (_BaseInstance + i) * _InstanceStride;
+	mat4 m = mat4(_Instances[instance], _Instances[instance + 1], _Instances[instance + 2], _Instances[instance + 3]);
+
+	vec3 extents = object.extents.xyz;
+	vec3 worldExtents = abs(m[0].xyz) * extents.x + abs(m[1].xyz) * extents.y + abs(m[2].xyz) * extents.z;
+	float scale = max(length(m[0].xyz), max(length(m[1].xyz), length(m[2].xyz)));
+	vec3 center = (m * vec4(object.centerRadius.xyz, 1.0)).xyz;
+	float radius = object.centerRadius.w * scale;
+
+	for (int p = 0; p < 6; p++) {
+		vec3 normal = _Planes[p].xyz;
+		if (dot(normal, center) + _Planes[p].w < -radius) {
+			return;
+		}
+	}
+	for (int p = 0; p < 6; p++) {
+		vec3 normal = _Planes[p].xyz;
+		if (dot(normal, center) + _Planes[p].w < -dot(abs(normal), worldExtents)) {
+			return;
+		}
+	}
+	if (_UseHiZ && isOccluded(center, worldExtents)) {
+		return;
+	}
+
+	uint slot = atomicAdd(_DrawCount, 1u);
+	_Commands[slot] = DrawCommand(object.numIndices, 1u, object.firstIndex, object.baseVertex, _BaseInstance + i);
+	_Visible[slot] = i;
+}
+)";
+
+	static const char* HIZ_COPY_SHADER_SOURCE = R"(#version 450
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(binding = 0) uniform sampler2D _Depth;
+layout(r32f, binding = 0) writeonly uniform image2D _Destination;
+
+void main() {
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	if (any(greaterThanEqual(p, imageSize(_Destination)))) {
+		return;
+	}
+	imageStore(_Destination, p, vec4(texelFetch(_Depth, p, 0).r));
+}
+)";
+
+	static const char* HIZ_REDUCE_SHADER_SOURCE = R"(#version 450
+layout(local_size_x = 8, local_size_y = 8) in;
+layout(r32f, binding = 0) readonly uniform image2D _Source;
+layout(r32f, binding = 1) writeonly uniform image2D _Destination;
+
+void main() {
+	ivec2 p = ivec2(gl_GlobalInvocationID.xy);
+	ivec2 size = imageSize(_Destination);
+	if (any(greaterThanEqual(p, size))) {
+		return;
+	}
+	ivec2 sourceSize = imageSize(_Source);
+	ivec2 first = p * 2;
+	//The last row and column also cover the leftover texel of an odd sized source
+	ivec2 last = min(first + 1, sourceSize - 1);
+	if (p.x == size.x - 1) {
+		last.x = sourceSize.x - 1;
+	}
+	if (p.y == size.y - 1) {
+		last.y = sourceSize.y - 1;
+	}
+	float depth = 0.0;
+	for (int y = first.y; y <= last.y; y++) {
+		for (int x = first.x; x <= last.x; x++) {
+			depth = max(depth, imageLoad(_Source, ivec2(x, y)).r);
+		}
+	}
+	imageStore(_Destination, p, vec4(depth));
+}
+)";
+
+	HiZPyramid::~HiZPyramid()
+	{
+		glDeleteTextures(1, &m_texture);
+		glDeleteProgram(m_copyProgram);
+		glDeleteProgram(m_reduceProgram);
+	}
+
+	/// <summary>
+	/// Allocates the full mip chain. Can be called again when the depth buffer is resized.
+	/// </summary>
+	/// <param name="width">Width of the depth buffer in pixels</param>
+	/// <param name="height">Height of the depth buffer in pixels</param>
+	void HiZPyramid::create(int width, int height)
+	{
+		if (m_copyProgram == 0) {
+			m_copyProgram = createComputeShaderProgram(HIZ_COPY_SHADER_SOURCE);
+			m_reduceProgram = createComputeShaderProgram(HIZ_REDUCE_SHADER_SOURCE);
+		}
+		//Texture storage is immutable, so resizing means a new texture
+		if (m_texture != 0) {
+			glDeleteTextures(1, &m_texture);
+		}
+		m_width = std::max(width, 1);
+		m_height = std::max(height, 1);
+		m_numLevels = 1;
+		while ((std::max(m_width, m_height) >> m_numLevels) > 0) {
+			m_numLevels++;
+		}
+		glGenTextures(1, &m_texture);
+		glBindTexture(GL_TEXTURE_2D, m_texture);
+		glTexStorage2D(GL_TEXTURE_2D, m_numLevels, GL_R32F, m_width, m_height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	/// <summary>
+	/// Copies a depth texture into level 0, then reduces each level into the next with one dispatch per level
+	/// </summary>
+	/// <param name="depthTexture">Depth texture the size of the pyramid</param>
+	/// <param name="viewProjection">Matrix the depth was rendered with</param>
+	void HiZPyramid::build(unsigned int depthTexture, const glm::mat4& viewProjection)
+	{
+		m_viewProjection = viewProjection;
+		glUseProgram(m_copyProgram);
+		glBindTextureUnit(0, depthTexture);
+		glBindImageTexture(0, m_texture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((m_width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (m_height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+
+		glUseProgram(m_reduceProgram);
+		for (int level = 1; level < m_numLevels; level++)
+		{
+			int width = std::max(m_width >> level, 1);
+			int height = std::max(m_height >> level, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			glBindImageTexture(0, m_texture, level - 1, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+			glBindImageTexture(1, m_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+			glDispatchCompute((width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+		}
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(1, 0, 0, GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindTextureUnit(0, 0);
+		glUseProgram(0);
+	}
+
+	GpuCuller::~GpuCuller()
+	{
+		unsigned int buffers[] = { m_objectBuffer, m_commandBuffer, m_countBuffer, m_visibleBuffer };
+		glDeleteBuffers(4, buffers);
+		glDeleteProgram(m_program);
+	}
+
+	static unsigned int createStorageBuffer(GLsizeiptr size, GLbitfield flags) {
+		unsigned int buffer;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, size, NULL, flags);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return buffer;
+	}
+
+	/// <summary>
+	/// Builds the cull shader and allocates the object, command and result buffers
+	/// </summary>
+	/// <param name="maxObjects">Most objects setObjects will be given</param>
+	void GpuCuller::create(unsigned int maxObjects)
+	{
+		if (m_program == 0) {
+			m_program = createComputeShaderProgram(CULL_SHADER_SOURCE);
+			m_planesLocation = glGetUniformLocation(m_program, "_Planes");
+			m_numObjectsLocation = glGetUniformLocation(m_program, "_NumObjects");
+			m_baseInstanceLocation = glGetUniformLocation(m_program, "_BaseInstance");
+			m_instanceStrideLocation = glGetUniformLocation(m_program, "_InstanceStride");
+			m_useHiZLocation = glGetUniformLocation(m_program, "_UseHiZ");
+			m_hiZViewProjectionLocation = glGetUniformLocation(m_program, "_HiZViewProjection");
+		}
+		unsigned int buffers[] = { m_objectBuffer, m_commandBuffer, m_countBuffer, m_visibleBuffer };
+		glDeleteBuffers(4, buffers);
+		m_maxObjects = std::max(maxObjects, 1u);
+		m_numObjects = 0;
+		m_objectBuffer = createStorageBuffer((GLsizeiptr)sizeof(CullObject) * m_maxObjects, GL_DYNAMIC_STORAGE_BIT);
+		m_commandBuffer = createStorageBuffer((GLsizeiptr)sizeof(DrawElementsIndirectCommand) * m_maxObjects, 0);
+		m_countBuffer = createStorageBuffer(sizeof(uint32_t), 0);
+		m_visibleBuffer = createStorageBuffer((GLsizeiptr)sizeof(uint32_t) * m_maxObjects, 0);
+	}
+
+	/// <summary>
+	/// Uploads the geometry and object space bounds of every object. Only needs to be called again when objects are added or removed.
+	/// </summary>
+	/// <param name="arena">Arena the geometry was allocated from</param>
+	/// <param name="geometry">Geometry of each object</param>
+	/// <param name="bounds">Object space bounds of each object</param>
+	/// <param name="count">Number of objects, clamped to maxObjects</param>
+	void GpuCuller::setObjects(const GeometryArena& arena, const GeometryHandle* geometry, const Bounds* bounds, unsigned int count)
+	{
+		m_numObjects = std::min(count, m_maxObjects);
+		std::vector<CullObject> objects(m_numObjects);
+		for (unsigned int i = 0; i < m_numObjects; i++)
+		{
+			const GeometryRange& range = arena.getRange(geometry[i]);
+			CullObject& object = objects[i];
+			object.centerRadius = glm::vec4(bounds[i].center, bounds[i].radius);
+			object.extents = glm::vec4(bounds[i].extents(), 0.0f);
+			object.numIndices = range.numIndices;
+			object.firstIndex = range.firstIndex;
+			object.baseVertex = (int32_t)range.baseVertex;
+			object.padding = 0;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(CullObject) * objects.size(), objects.data());
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	/// <summary>
+	/// Dispatches the cull shader, which rebuilds the indirect command buffer for draw()
+	/// </summary>
+	/// <param name="viewProjection">Camera projection * view</param>
+	/// <param name="instances">Per-instance data. The first 64 bytes of each instance are its model matrix.</param>
+	/// <param name="baseInstance">Instance of object 0</param>
+	/// <param name="hiZ">Optional depth pyramid for occlusion culling</param>
+	void GpuCuller::cull(const glm::mat4& viewProjection, const InstanceBuffer& instances, unsigned int baseInstance, const HiZPyramid* hiZ)
+	{
+		Frustum frustum = extractFrustum(viewProjection);
+		uint32_t zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_countBuffer);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		//Without glMultiDrawElementsIndirectCount all m_numObjects commands are drawn, so culled slots must be empty draws
+		if (!GLAD_GL_VERSION_4_6) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer);
+			glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glUseProgram(m_program);
+		glUniform4fv(m_planesLocation, 6, glm::value_ptr(frustum.planes[0]));
+		glUniform1ui(m_numObjectsLocation, m_numObjects);
+		glUniform1ui(m_baseInstanceLocation, baseInstance);
+		glUniform1ui(m_instanceStrideLocation, (unsigned int)(instances.getLayout().stride / sizeof(glm::vec4)));
+		glUniform1i(m_useHiZLocation, hiZ != nullptr);
+		if (hiZ != nullptr) {
+			glUniformMatrix4fv(m_hiZViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(hiZ->getViewProjection()));
+			glBindTextureUnit(0, hiZ->getTexture());
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_objectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instances.getID());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_commandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_countBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_visibleBuffer);
+		glDispatchCompute((m_numObjects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		//Commands are read by the draw, and the count as a draw parameter
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		if (hiZ != nullptr) {
+			glBindTextureUnit(0, 0);
+		}
+		glUseProgram(0);
+	}
+
+	void GpuCuller::cull(const Camera& camera, const InstanceBuffer& instances, unsigned int baseInstance, const HiZPyramid* hiZ)
+	{
+		cull(camera.projectionMatrix() * camera.viewMatrix(), instances, baseInstance, hiZ);
+	}
+
+	/// <summary>
+	/// One multi draw for all visible objects. GL 4.6 reads the draw count from the GPU, older versions
+	/// draw every slot and rely on the empty commands cull() leaves in culled slots.
+	/// </summary>
+	/// <param name="arena">Arena passed to setObjects</param>
+	/// <param name="instances">Instance buffer passed to cull</param>
+	void GpuCuller::draw(const GeometryArena& arena, const InstanceBuffer& instances)const
+	{
+		if (m_numObjects == 0) {
+			return;
+		}
+		arena.bind();
+		arena.setInstanceBuffer(instances);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+		if (GLAD_GL_VERSION_4_6) {
+			glBindBuffer(GL_PARAMETER_BUFFER, m_countBuffer);
+			glMultiDrawElementsIndirectCount(GL_TRIANGLES, arena.getIndexType(), (const void*)0, 0, (GLsizei)m_numObjects, 0);
+			glBindBuffer(GL_PARAMETER_BUFFER, 0);
+		}
+		else {
+			glMultiDrawElementsIndirect(GL_TRIANGLES, arena.getIndexType(), (const void*)0, (GLsizei)m_numObjects, 0);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	size_t GpuCuller::readVisible(std::vector<uint32_t>& visible)const
+	{
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		uint32_t count = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_countBuffer);
+		glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t), &count);
+		count = std::min(count, m_numObjects);
+		visible.resize(count);
+		if (count > 0) {
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_visibleBuffer);
+			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(uint32_t) * count, visible.data());
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		//Slots are handed out in whatever order the invocations finish
+		std::sort(visible.begin(), visible.end());
+		return count;
+	}
+
+	size_t cullObjectsReference(const Frustum& frustum, const Bounds* bounds, const InstanceData* instances, size_t count, uint32_t* visible)
+	{
+		size_t numVisible = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			if (isVisible(frustum, transformBounds(bounds[i], instances[i].modelMatrix))) {
+				visible[numVisible++] = (uint32_t)i;
+			}
+		}
+		return numVisible;
+	}
+}
@@ -0,0 +1,89 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "culling.h"
+#include "geometryArena.h"
+#include "instanceBuffer.h"
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	//Depth pyramid for occlusion culling. Level 0 is a copy of a depth buffer, and each texel of level n
+	//is the furthest depth of the texels it covers in level n-1.
+	class HiZPyramid {
+	public:
+		HiZPyramid() {};
+		~HiZPyramid();
+		HiZPyramid(const HiZPyramid&) = delete;
+		HiZPyramid& operator=(const HiZPyramid&) = delete;
+		//Size should match the depth buffer it is built from
+		void create(int width, int height);
+		//depthTexture is a depth texture of the same size, e.g. the last frame's depth attachment.
+		//viewProjection is the matrix that frame was rendered with.
+		void build(unsigned int depthTexture, const glm::mat4& viewProjection);
+		inline unsigned int getTexture()const { return m_texture; }
+		inline int getWidth()const { return m_width; }
+		inline int getHeight()const { return m_height; }
+		inline int getNumLevels()const { return m_numLevels; }
+		inline const glm::mat4& getViewProjection()const { return m_viewProjection; }
+	private:
+		unsigned int m_texture = 0;
+		unsigned int m_copyProgram = 0;
+		unsigned int m_reduceProgram = 0;
+		int m_width = 0;
+		int m_height = 0;
+		int m_numLevels = 0;
+		glm::mat4 m_viewProjection = glm::mat4(1.0f);
+	};
+
+	//Frustum and occlusion culling in a compute shader. Each visible object gets a draw command in a compacted
+	//indirect buffer, so the CPU never sees which objects survived.
+	//Object i is drawn from its arena geometry with baseInstance + i, so its per-instance data (model matrix first,
+	//as in InstanceData) is both what the compute shader culls with and what the vertex shader draws with.
+	//
+	//	culler.setObjects(arena, geometry, bounds, count);
+	//	...each frame, fill count instances from baseInstance...
+	//	culler.cull(camera, instances, baseInstance, &hiZ);
+	//	shader.use();
+	//	culler.draw(arena, instances);
+	class GpuCuller {
+	public:
+		GpuCuller() {};
+		~GpuCuller();
+		GpuCuller(const GpuCuller&) = delete;
+		GpuCuller& operator=(const GpuCuller&) = delete;
+		void create(unsigned int maxObjects);
+		//bounds are in object space, one per geometry
+		void setObjects(const GeometryArena& arena, const GeometryHandle* geometry, const Bounds* bounds, unsigned int count);
+		//Instance stride must be a multiple of 16 bytes with the model matrix at offset 0.
+		//hiZ is optional and is tested with the view projection it was built with.
+		void cull(const glm::mat4& viewProjection, const InstanceBuffer& instances, unsigned int baseInstance, const HiZPyramid* hiZ = nullptr);
+		void cull(const Camera& camera, const InstanceBuffer& instances, unsigned int baseInstance, const HiZPyramid* hiZ = nullptr);
+		//Draws the commands written by the last cull(). Bind the shader first.
+		void draw(const GeometryArena& arena, const InstanceBuffer& instances)const;
+		//Reads back the indices of objects that passed the last cull(), sorted. Waits for the GPU, so for debugging and tests only.
+		size_t readVisible(std::vector<uint32_t>& visible)const;
+		inline unsigned int getNumObjects()const { return m_numObjects; }
+		inline unsigned int getCommandBuffer()const { return m_commandBuffer; }
+	private:
+		unsigned int m_program = 0;
+		unsigned int m_objectBuffer = 0;
+		unsigned int m_commandBuffer = 0;
+		unsigned int m_countBuffer = 0;
+		unsigned int m_visibleBuffer = 0;
+		unsigned int m_maxObjects = 0;
+		unsigned int m_numObjects = 0;
+		int m_planesLocation = -1;
+		int m_numObjectsLocation = -1;
+		int m_baseInstanceLocation = -1;
+		int m_instanceStrideLocation = -1;
+		int m_useHiZLocation = -1;
+		int m_hiZViewProjectionLocation = -1;
+	};
+
+	//CPU version of the compute shader's frustum test, for checking its results.
+	//Writes indices of visible objects in increasing order and returns how many.
+	size_t cullObjectsReference(const Frustum& frustum, const Bounds* bounds, const InstanceData* instances, size_t count, uint32_t* visible);
+}
@@ -0,0 +1,150 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "headless.h"
+//EGL first, glad's copy of khrplatform.h lacks the calling convention macros EGL needs
+#ifdef EW_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include "external/glad.h"
+#include <stdio.h>
+#include <string.h>
+
+namespace ew {
+	HeadlessContext::~HeadlessContext()
+	{
+		destroy();
+	}
+
+#ifdef EW_HAS_EGL
+	static bool hasEGLExtension(const char* extensions, const char* name) {
+		if (extensions == NULL) {
+			return false;
+		}
+		size_t length = strlen(name);
+		for (const char* s = strstr(extensions, name); s != NULL; s = strstr(s + length, name))
+		{
+			//Whole words only, extensions are space separated
+			if ((s == extensions || s[-1] == ' ') && (s[length] == ' ' || s[length] == '\0')) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	/// <summary>
+	/// Prefers Mesa's surfaceless platform, which needs neither X11 nor Wayland, and falls back to the default display.
+	/// If the driver can't make a context current without a surface, a 1x1 pbuffer is used.
+	/// </summary>
+	/// <param name="major">Minimum GL major version</param>
+	/// <param name="minor">Minimum GL minor version</param>
+	/// <returns>False if EGL or GL could not be initialized</returns>
+	bool HeadlessContext::create(int major, int minor)
+	{
+		destroy();
+		EGLDisplay display = EGL_NO_DISPLAY;
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		if (hasEGLExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+			PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+			if (getPlatformDisplay != NULL) {
+				display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+			}
+		}
+		if (display == EGL_NO_DISPLAY) {
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+		}
+		EGLint eglMajor, eglMinor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &eglMajor, &eglMinor)) {
+			printf("EGL failed to initialize: 0x%x\n", eglGetError());
+			return false;
+		}
+		m_display = display;
+		eglBindAPI(EGL_OPENGL_API);
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_NONE
+		};
+		EGLConfig config = NULL;
+		EGLint numConfigs = 0;
+		eglChooseConfig(display, configAttributes, &config, 1, &numConfigs);
+		const char* displayExtensions = eglQueryString(display, EGL_EXTENSIONS);
+		bool surfaceless = hasEGLExtension(displayExtensions, "EGL_KHR_surfaceless_context");
+		if (numConfigs == 0 && !(surfaceless && hasEGLExtension(displayExtensions, "EGL_KHR_no_config_context"))) {
+			printf("EGL has no usable config\n");
+			destroy();
+			return false;
+		}
+
+		const EGLint contextAttributes[] = {
+			EGL_CONTEXT_MAJOR_VERSION, major,
+			EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE
+		};
+		EGLContext context = eglCreateContext(display, numConfigs > 0 ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT) {
+			printf("EGL failed to create a GL %d.%d core context: 0x%x\n", major, minor, eglGetError());
+			destroy();
+			return false;
+		}
+		m_context = context;
+
+		bool current = surfaceless && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+		if (!current && numConfigs > 0) {
+			const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+			EGLSurface surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+			if (surface != EGL_NO_SURFACE) {
+				m_surface = surface;
+				current = eglMakeCurrent(display, surface, surface, context);
+				//Never block on a swap
+				eglSwapInterval(display, 0);
+			}
+		}
+		if (!current) {
+			printf("EGL failed to make the context current: 0x%x\n", eglGetError());
+			destroy();
+			return false;
+		}
+		if (!gladLoadGL((GLADloadfunc)eglGetProcAddress)) {
+			printf("GLAD Failed to load GL headers");
+			destroy();
+			return false;
+		}
+		return true;
+	}
+
+	void HeadlessContext::destroy()
+	{
+		if (m_display == nullptr) {
+			return;
+		}
+		EGLDisplay display = (EGLDisplay)m_display;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (m_surface != nullptr) {
+			eglDestroySurface(display, (EGLSurface)m_surface);
+		}
+		if (m_context != nullptr) {
+			eglDestroyContext(display, (EGLContext)m_context);
+		}
+		eglTerminate(display);
+		m_display = nullptr;
+		m_context = nullptr;
+		m_surface = nullptr;
+	}
+#else
+	bool HeadlessContext::create(int major, int minor)
+	{
+		printf("Headless rendering needs EGL, which core was built without\n");
+		return false;
+	}
+
+	void HeadlessContext::destroy()
+	{
+	}
+#endif
+}
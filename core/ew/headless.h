@@ -0,0 +1,27 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+
+namespace ew {
+	//GL context with no window or display server, created through EGL. Works with Mesa's software
+	//renderers (llvmpipe, softpipe), e.g. on CI machines without a GPU.
+	//There is no default framebuffer, so render into an ew::Framebuffer.
+	//Only available when core is built with EGL (EW_HAS_EGL). Otherwise create() fails.
+	class HeadlessContext {
+	public:
+		HeadlessContext() {};
+		~HeadlessContext();
+		HeadlessContext(const HeadlessContext&) = delete;
+		HeadlessContext& operator=(const HeadlessContext&) = delete;
+		//Creates a core profile context of at least major.minor, makes it current on this thread and loads GL functions
+		bool create(int major = 4, int minor = 5);
+		void destroy();
+		inline bool isValid()const { return m_context != nullptr; }
+	private:
+		void* m_display = nullptr;
+		void* m_context = nullptr;
+		void* m_surface = nullptr; //Only used if the driver can't make a context current without one
+	};
+}
@@ -0,0 +1,108 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "instanceBuffer.h"
+#include "external/glad.h"
+
+namespace ew {
+	static unsigned int s_nextGeneration = 1;
+
+	InstanceBuffer::~InstanceBuffer()
+	{
+		unload();
+	}
+
+	/// <summary>
+	/// Allocates numFrames segments of maxInstancesPerFrame instances and maps them for the buffer's lifetime
+	/// </summary>
+	/// <param name="layout">Per-instance attributes</param>
+	/// <param name="maxInstancesPerFrame">Instances that can be allocated between beginFrame() and endFrame()</param>
+	/// <param name="numFrames">Frames the CPU may run ahead of the GPU before beginFrame() waits</param>
+	void InstanceBuffer::create(const VertexLayout& layout, unsigned int maxInstancesPerFrame, unsigned int numFrames)
+	{
+		//Buffer storage is immutable, so recreating means a new buffer. Draws already submitted keep the old one alive.
+		unload();
+		if (numFrames < 1) {
+			numFrames = 1;
+		}
+		m_layout = layout;
+		m_capacity = maxInstancesPerFrame;
+		m_fences.assign(numFrames, nullptr);
+		//First beginFrame() moves to segment 0
+		m_segment = numFrames - 1;
+		m_used = 0;
+		m_generation = s_nextGeneration++;
+		glGenBuffers(1, &m_id);
+		GLsizeiptr size = (GLsizeiptr)layout.stride * maxInstancesPerFrame * numFrames;
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBindBuffer(GL_ARRAY_BUFFER, m_id);
+		glBufferStorage(GL_ARRAY_BUFFER, size, NULL, flags);
+		m_data = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	void InstanceBuffer::unload()
+	{
+		for (size_t i = 0; i < m_fences.size(); i++)
+		{
+			if (m_fences[i] != nullptr) {
+				glDeleteSync((GLsync)m_fences[i]);
+			}
+		}
+		m_fences.clear();
+		//Deleting a mapped buffer unmaps it
+		if (m_id != 0) {
+			glDeleteBuffers(1, &m_id);
+		}
+		m_id = 0;
+		m_generation = 0;
+		m_data = nullptr;
+		m_capacity = 0;
+		m_segment = 0;
+		m_used = 0;
+	}
+
+	void InstanceBuffer::beginFrame()
+	{
+		if (m_fences.empty()) {
+			return;
+		}
+		m_segment = (m_segment + 1) % m_fences.size();
+		m_used = 0;
+		GLsync fence = (GLsync)m_fences[m_segment];
+		if (fence == nullptr) {
+			return;
+		}
+		GLenum status = glClientWaitSync(fence, 0, 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			m_numStalls++;
+			do {
+				status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+			} while (status == GL_TIMEOUT_EXPIRED);
+		}
+		glDeleteSync(fence);
+		m_fences[m_segment] = nullptr;
+	}
+
+	void InstanceBuffer::endFrame()
+	{
+		if (m_fences.empty()) {
+			return;
+		}
+		if (m_fences[m_segment] != nullptr) {
+			glDeleteSync((GLsync)m_fences[m_segment]);
+		}
+		m_fences[m_segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	void* InstanceBuffer::allocate(unsigned int count, unsigned int* baseInstance)
+	{
+		if (m_data == nullptr || m_used + count > m_capacity) {
+			return nullptr;
+		}
+		*baseInstance = m_segment * m_capacity + m_used;
+		m_used += count;
+		return m_data + (size_t)*baseInstance * m_layout.stride;
+	}
+}
@@ -0,0 +1,90 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "vertexLayout.h"
+
+namespace ew {
+	//Per-instance attributes start after the vertex attributes of ew::Vertex
+	const unsigned int INSTANCE_ATTRIBUTE_LOCATION = 3;
+
+	//Default per-instance data. Matches:
+	//layout(location = 3) in mat4 _InstanceModel; //Uses locations 3-6
+	//layout(location = 7) in vec4 _InstanceColor;
+	struct InstanceData {
+		glm::mat4 modelMatrix = glm::mat4(1.0f);
+		glm::vec4 color = glm::vec4(1.0f);
+	};
+
+	template<>
+	struct VertexTraits<InstanceData> {
+		static VertexLayout layout() {
+			static const VertexAttribute attributes[] = {
+				{ INSTANCE_ATTRIBUTE_LOCATION + 0, 4, AttributeType::FLOAT, false, offsetof(InstanceData, modelMatrix) },
+				{ INSTANCE_ATTRIBUTE_LOCATION + 1, 4, AttributeType::FLOAT, false, offsetof(InstanceData, modelMatrix) + sizeof(glm::vec4) },
+				{ INSTANCE_ATTRIBUTE_LOCATION + 2, 4, AttributeType::FLOAT, false, offsetof(InstanceData, modelMatrix) + sizeof(glm::vec4) * 2 },
+				{ INSTANCE_ATTRIBUTE_LOCATION + 3, 4, AttributeType::FLOAT, false, offsetof(InstanceData, modelMatrix) + sizeof(glm::vec4) * 3 },
+				{ INSTANCE_ATTRIBUTE_LOCATION + 4, 4, AttributeType::FLOAT, false, offsetof(InstanceData, color) }
+			};
+			return { sizeof(InstanceData), attributes, 5 };
+		}
+	};
+
+	//Ring of per-instance data in a persistently mapped buffer.
+	//The ring is split into one segment per frame in flight. Each frame writes into its own segment, and a fence
+	//placed at endFrame() keeps the CPU from overwriting a segment the GPU may still be reading.
+	//
+	//	instances.beginFrame();
+	//	unsigned int base;
+	//	InstanceData* data = instances.allocate<InstanceData>(count, &base);
+	//	...fill data...
+	//	mesh.drawInstanced(instances, base, count);
+	//	instances.endFrame();
+	class InstanceBuffer {
+	public:
+		InstanceBuffer() {};
+		~InstanceBuffer();
+		InstanceBuffer(const InstanceBuffer&) = delete;
+		InstanceBuffer& operator=(const InstanceBuffer&) = delete;
+		//Per-instance attributes from layout, which must only use locations INSTANCE_ATTRIBUTE_LOCATION and up.
+		//Calling it again replaces the buffer.
+		void create(const VertexLayout& layout, unsigned int maxInstancesPerFrame, unsigned int numFrames = 3);
+		template<typename T>
+		void create(unsigned int maxInstancesPerFrame, unsigned int numFrames = 3) {
+			create(VertexTraits<T>::layout(), maxInstancesPerFrame, numFrames);
+		}
+		//Deletes the buffer and its fences
+		void unload();
+		//Moves to the next segment, waiting only if the GPU is still reading it from numFrames ago
+		void beginFrame();
+		void endFrame();
+		//Space for count instances in this frame's segment. baseInstance is what to pass to Mesh::drawInstanced.
+		//Returns nullptr if the segment is full.
+		void* allocate(unsigned int count, unsigned int* baseInstance);
+		template<typename T>
+		T* allocate(unsigned int count, unsigned int* baseInstance) {
+			return (T*)allocate(count, baseInstance);
+		}
+		inline unsigned int getID()const { return m_id; }
+		//Unique to each create() across all instance buffers, 0 if not created. GL reuses deleted buffer names,
+		//so vertex arrays remember this, not the ID, to know when their instance attributes need pointing again.
+		inline unsigned int getGeneration()const { return m_generation; }
+		inline const VertexLayout& getLayout()const { return m_layout; }
+		inline unsigned int getCapacity()const { return m_capacity; }
+		//Number of beginFrame() calls that had to wait on the GPU
+		inline unsigned int getNumStalls()const { return m_numStalls; }
+	private:
+		unsigned int m_id = 0;
+		unsigned int m_generation = 0;
+		VertexLayout m_layout = {};
+		unsigned char* m_data = nullptr;
+		std::vector<void*> m_fences;
+		unsigned int m_capacity = 0;
+		unsigned int m_segment = 0;
+		unsigned int m_used = 0;
+		unsigned int m_numStalls = 0;
+	};
+}
@@ -0,0 +1,414 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "jobSystem.h"
+
+namespace ew {
+	struct Job {
+		std::function<void()> fn;
+		JobCounter* counter = nullptr;
+		bool mainThread = false;
+	};
+
+	//Chase-Lev work stealing deque of fixed capacity (Le et al. 2013, "Correct and Efficient Work-Stealing for Weak Memory Models").
+	//Only the owning worker calls push() and pop(). Any thread may call steal().
+	class JobDeque {
+	public:
+		static const int64_t CAPACITY = 4096;
+
+		JobDeque() : m_jobs(CAPACITY) {}
+
+		//Returns false if the deque is full
+		bool push(Job* job) {
+			int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+			int64_t top = m_top.load(std::memory_order_acquire);
+			if (bottom - top >= CAPACITY) {
+				return false;
+			}
+			m_jobs[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_release);
+			m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			return true;
+		}
+		//Newest job, or nullptr
+		Job* pop() {
+			int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+			m_bottom.store(bottom, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t top = m_top.load(std::memory_order_relaxed);
+			if (top > bottom) {
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+				return nullptr;
+			}
+			Job* job = m_jobs[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (top == bottom) {
+				//Last job: race thieves for it
+				if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					job = nullptr;
+				}
+				m_bottom.store(bottom + 1, std::memory_order_relaxed);
+			}
+			return job;
+		}
+		//Oldest job, or nullptr if the deque is empty or another thread got there first
+		Job* steal() {
+			int64_t top = m_top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t bottom = m_bottom.load(std::memory_order_acquire);
+			if (top >= bottom) {
+				return nullptr;
+			}
+			Job* job = m_jobs[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+			if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+				return nullptr;
+			}
+			return job;
+		}
+	private:
+		std::atomic<int64_t> m_top{ 0 };
+		std::atomic<int64_t> m_bottom{ 0 };
+		std::vector<std::atomic<Job*>> m_jobs;
+	};
+
+	//Which job system the current thread works for, and its deque
+	static thread_local JobSystem* t_jobSystem = nullptr;
+	static thread_local int t_workerIndex = -1;
+	static thread_local uint32_t t_stealSeed = 0;
+
+	static std::atomic<unsigned int> s_globalThreadCount{ 0 };
+
+	//Spins through the queues this many times before an idle worker goes to sleep
+	static const int IDLE_SPINS = 64;
+
+	JobSystem::JobSystem(unsigned int numThreads)
+		: m_mainThread(std::this_thread::get_id())
+	{
+		if (numThreads == 0) {
+			unsigned int hardwareThreads = std::thread::hardware_concurrency();
+			numThreads = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+		}
+		//Every deque exists before any worker starts stealing
+		for (unsigned int i = 0; i < numThreads; i++)
+		{
+			m_deques.emplace_back(new JobDeque());
+		}
+		m_threads.reserve(numThreads);
+		for (unsigned int i = 0; i < numThreads; i++)
+		{
+			m_threads.emplace_back(&JobSystem::workerLoop, this, (int)i);
+		}
+	}
+
+	JobSystem::~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_sleepMutex);
+			m_stopping.store(true);
+		}
+		m_wake.notify_all();
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			m_threads[i].join();
+		}
+		for (size_t i = 0; i < m_mainThreadJobs.size(); i++)
+		{
+			delete m_mainThreadJobs[i];
+		}
+	}
+
+	bool JobCounter::isDone()
+	{
+		if (m_value.load(std::memory_order_acquire) != 0) {
+			return false;
+		}
+		//The last job may still be releasing dependents. Wait for it to let go of the counter,
+		//so the caller can destroy it right away.
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return true;
+	}
+
+	void JobSystem::run(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+	{
+		Job* newJob = new Job();
+		newJob->fn = std::move(job);
+		newJob->counter = counter;
+		if (counter != nullptr) {
+			counter->m_value.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (dependency != nullptr) {
+			std::lock_guard<std::mutex> lock(dependency->m_mutex);
+			if (dependency->m_value.load(std::memory_order_acquire) != 0) {
+				dependency->m_waiting.push_back(newJob);
+				return;
+			}
+		}
+		schedule(newJob);
+	}
+
+	void JobSystem::runOnMainThread(std::function<void()> job, JobCounter* counter, JobCounter* dependency)
+	{
+		Job* newJob = new Job();
+		newJob->fn = std::move(job);
+		newJob->counter = counter;
+		newJob->mainThread = true;
+		if (counter != nullptr) {
+			counter->m_value.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (dependency != nullptr) {
+			std::lock_guard<std::mutex> lock(dependency->m_mutex);
+			if (dependency->m_value.load(std::memory_order_acquire) != 0) {
+				dependency->m_waiting.push_back(newJob);
+				return;
+			}
+		}
+		schedule(newJob);
+	}
+
+	/// <summary>
+	/// Runs the main thread jobs queued before the call. Jobs they queue in turn wait for the next pump,
+	/// so a job that keeps requeueing itself runs once per frame.
+	/// </summary>
+	/// <returns>Number of jobs run</returns>
+	size_t JobSystem::pumpMainThread()
+	{
+		std::deque<Job*> jobs;
+		{
+			std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+			jobs.swap(m_mainThreadJobs);
+		}
+		for (size_t i = 0; i < jobs.size(); i++)
+		{
+			jobs[i]->fn();
+			finish(jobs[i]->counter);
+			delete jobs[i];
+		}
+		return jobs.size();
+	}
+
+	/// <summary>
+	/// Helps out until counter reaches zero instead of blocking, so waiting from inside a job
+	/// cannot deadlock the workers.
+	/// </summary>
+	void JobSystem::wait(JobCounter& counter)
+	{
+		int workerIndex = t_jobSystem == this ? t_workerIndex : -1;
+		bool mainThread = isMainThread();
+		while (!counter.isDone()) {
+			Job* job = findJob(workerIndex);
+			if (job != nullptr) {
+				execute(job);
+				continue;
+			}
+			if (mainThread) {
+				std::unique_lock<std::mutex> lock(m_mainThreadMutex);
+				if (!m_mainThreadJobs.empty()) {
+					job = m_mainThreadJobs.front();
+					m_mainThreadJobs.pop_front();
+					lock.unlock();
+					job->fn();
+					finish(job->counter);
+					delete job;
+					continue;
+				}
+			}
+			std::this_thread::yield();
+		}
+	}
+
+	/// <summary>
+	/// Runs fn over [0, count) in parallel. Chunks become jobs on the caller's deque when it is a worker,
+	/// so idle workers steal the oldest (largest remaining) share of the range while the caller works through the rest.
+	/// </summary>
+	/// <param name="count">Number of items</param>
+	/// <param name="fn">Called with a [begin, end) item range</param>
+	/// <param name="grainSize">Minimum items per chunk</param>
+	void JobSystem::parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn, size_t grainSize)
+	{
+		if (count == 0) {
+			return;
+		}
+		if (grainSize == 0) {
+			grainSize = 1;
+		}
+		//Aim for a few chunks per thread so a slow chunk does not hold everyone up
+		size_t maxChunks = (size_t)(m_threads.size() + 1) * 4;
+		size_t chunkSize = (count + maxChunks - 1) / maxChunks;
+		if (chunkSize < grainSize) {
+			chunkSize = grainSize;
+		}
+		size_t numChunks = (count + chunkSize - 1) / chunkSize;
+		if (numChunks == 1 || m_threads.empty()) {
+			fn(0, count);
+			return;
+		}
+
+		struct Range {
+			const std::function<void(size_t, size_t)>* fn;
+			size_t count;
+			size_t chunkSize;
+		};
+		Range range = { &fn, count, chunkSize };
+		JobCounter counter;
+		//Pushed last to first, so the caller pops chunk 1 first and thieves start from the far end
+		for (size_t chunk = numChunks - 1; chunk > 0; chunk--)
+		{
+			const Range* shared = &range;
+			run([shared, chunk]() {
+				size_t begin = chunk * shared->chunkSize;
+				size_t end = begin + shared->chunkSize < shared->count ? begin + shared->chunkSize : shared->count;
+				(*shared->fn)(begin, end);
+			}, &counter);
+		}
+		fn(0, chunkSize);
+		wait(counter);
+	}
+
+	JobSystemStats JobSystem::getStats()const
+	{
+		JobSystemStats stats;
+		stats.jobsRun = m_jobsRun.load(std::memory_order_relaxed);
+		stats.jobsStolen = m_jobsStolen.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+	JobSystem& JobSystem::global()
+	{
+		static JobSystem system(s_globalThreadCount.load());
+		return system;
+	}
+
+	void JobSystem::setGlobalThreadCount(unsigned int numThreads)
+	{
+		s_globalThreadCount.store(numThreads);
+	}
+
+	//Sends a job that is ready to run to its queue
+	void JobSystem::schedule(Job* job)
+	{
+		if (job->mainThread) {
+			std::lock_guard<std::mutex> lock(m_mainThreadMutex);
+			m_mainThreadJobs.push_back(job);
+			return;
+		}
+		enqueue(job);
+	}
+
+	void JobSystem::enqueue(Job* job)
+	{
+		//Counted before the job becomes visible, so a worker that sees nothing queued can safely sleep
+		m_numQueued.fetch_add(1, std::memory_order_seq_cst);
+		if (t_jobSystem != this || !m_deques[t_workerIndex]->push(job)) {
+			std::lock_guard<std::mutex> lock(m_injectedMutex);
+			m_injected.push_back(job);
+		}
+		if (m_numSleeping.load(std::memory_order_seq_cst) > 0) {
+			{
+				std::lock_guard<std::mutex> lock(m_sleepMutex);
+			}
+			m_wake.notify_one();
+		}
+	}
+
+	void JobSystem::execute(Job* job)
+	{
+		job->fn();
+		m_jobsRun.fetch_add(1, std::memory_order_relaxed);
+		finish(job->counter);
+		delete job;
+	}
+
+	//Decrements counter and releases the jobs that were waiting for it to reach zero
+	void JobSystem::finish(JobCounter* counter)
+	{
+		if (counter == nullptr) {
+			return;
+		}
+		std::vector<Job*> released;
+		{
+			std::lock_guard<std::mutex> lock(counter->m_mutex);
+			if (counter->m_value.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+				return;
+			}
+			released.swap(counter->m_waiting);
+		}
+		for (size_t i = 0; i < released.size(); i++)
+		{
+			schedule(released[i]);
+		}
+	}
+
+	/// <summary>
+	/// Looks for a job in the worker's own deque first, then the shared queue, then steals from the other
+	/// workers starting at a random one.
+	/// </summary>
+	/// <param name="workerIndex">Deque of the calling worker, or -1 for other threads</param>
+	/// <returns>The job, which the caller now owns, or nullptr</returns>
+	Job* JobSystem::findJob(int workerIndex)
+	{
+		Job* job = nullptr;
+		if (workerIndex >= 0) {
+			job = m_deques[workerIndex]->pop();
+		}
+		if (job == nullptr) {
+			std::lock_guard<std::mutex> lock(m_injectedMutex);
+			if (!m_injected.empty()) {
+				job = m_injected.front();
+				m_injected.pop_front();
+			}
+		}
+		if (job == nullptr) {
+			//xorshift, seeded differently per thread
+			if (t_stealSeed == 0) {
+				t_stealSeed = (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+			}
+			t_stealSeed ^= t_stealSeed << 13;
+			t_stealSeed ^= t_stealSeed >> 17;
+			t_stealSeed ^= t_stealSeed << 5;
+			size_t numDeques = m_deques.size();
+			size_t start = t_stealSeed % numDeques;
+			for (size_t i = 0; i < numDeques && job == nullptr; i++)
+			{
+				size_t victim = (start + i) % numDeques;
+				if ((int)victim == workerIndex) {
+					continue;
+				}
+				job = m_deques[victim]->steal();
+				if (job != nullptr) {
+					m_jobsStolen.fetch_add(1, std::memory_order_relaxed);
+				}
+			}
+		}
+		if (job != nullptr) {
+			m_numQueued.fetch_sub(1, std::memory_order_seq_cst);
+		}
+		return job;
+	}
+
+	void JobSystem::workerLoop(int workerIndex)
+	{
+		t_jobSystem = this;
+		t_workerIndex = workerIndex;
+		int idleSpins = 0;
+		while (true) {
+			Job* job = findJob(workerIndex);
+			if (job != nullptr) {
+				execute(job);
+				idleSpins = 0;
+				continue;
+			}
+			if (m_stopping.load()) {
+				return;
+			}
+			if (++idleSpins < IDLE_SPINS) {
+				std::this_thread::yield();
+				continue;
+			}
+			idleSpins = 0;
+			std::unique_lock<std::mutex> lock(m_sleepMutex);
+			m_numSleeping.fetch_add(1, std::memory_order_seq_cst);
+			m_wake.wait(lock, [this]() { return m_stopping.load() || m_numQueued.load(std::memory_order_seq_cst) > 0; });
+			m_numSleeping.fetch_sub(1, std::memory_order_seq_cst);
+		}
+	}
+}
@@ -0,0 +1,111 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+
+namespace ew {
+	struct Job;
+	class JobDeque;
+
+	//Number of unfinished jobs attached to it. Jobs can be held back until a counter reaches zero,
+	//and JobSystem::wait() runs other jobs until it does. Must outlive the jobs that use it.
+	class JobCounter {
+	public:
+		JobCounter() {};
+		JobCounter(const JobCounter&) = delete;
+		JobCounter& operator=(const JobCounter&) = delete;
+		//Once true, the counter can be destroyed
+		bool isDone();
+	private:
+		friend class JobSystem;
+		std::atomic<int> m_value{ 0 };
+		std::mutex m_mutex;
+		std::vector<Job*> m_waiting; //Jobs that depend on this counter
+	};
+
+	struct JobSystemStats {
+		uint64_t jobsRun = 0; //By workers and helping threads, main thread jobs excluded
+		uint64_t jobsStolen = 0; //Taken from another worker's deque
+	};
+
+	//Work stealing scheduler.
+	//Every worker owns a Chase-Lev deque: it pushes and pops its own jobs at the bottom (newest first, so nested work
+	//stays in cache) while idle workers steal the oldest jobs from the top. Jobs submitted from other threads go through
+	//a shared queue. Jobs meant for the GL context go to a separate queue that only runs inside pumpMainThread().
+	//
+	//	ew::JobCounter decoded;
+	//	jobs.run([&]() { decode(); }, &decoded);
+	//	jobs.runOnMainThread([&]() { upload(); }, nullptr, &decoded);
+	//	...each frame on the context thread...
+	//	jobs.pumpMainThread();
+	class JobSystem {
+	public:
+		//0 = one worker per hardware thread, minus the calling thread.
+		//The thread that creates the job system is its main thread.
+		JobSystem(unsigned int numThreads = 0);
+		~JobSystem();
+		JobSystem(const JobSystem&) = delete;
+		JobSystem& operator=(const JobSystem&) = delete;
+
+		//Runs job on a worker. counter is incremented now and decremented once job returns.
+		//If dependency is given, job does not start before it reaches zero.
+		void run(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+		//Same as run(), but job runs on the main thread from pumpMainThread(). Use it for GL work that follows worker jobs.
+		void runOnMainThread(std::function<void()> job, JobCounter* counter = nullptr, JobCounter* dependency = nullptr);
+		//Runs the main thread jobs that are ready. Call once per frame on the GL context thread.
+		//Returns the number of jobs run.
+		size_t pumpMainThread();
+		//Runs other jobs until counter reaches zero. On the main thread this includes main thread jobs.
+		void wait(JobCounter& counter);
+		//Splits [0, count) into chunks of at least grainSize and runs fn(begin, end) on each.
+		//The calling thread helps and the call returns once every chunk has finished. Safe to nest.
+		void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn, size_t grainSize = 1);
+
+		inline unsigned int getNumThreads()const { return (unsigned int)m_threads.size(); }
+		inline bool isMainThread()const { return std::this_thread::get_id() == m_mainThread; }
+		JobSystemStats getStats()const;
+
+		//Shared job system used by core loaders
+		static JobSystem& global();
+		//Number of workers global() starts. Only has an effect before the first call to global().
+		static void setGlobalThreadCount(unsigned int numThreads);
+	private:
+		void schedule(Job* job);
+		void enqueue(Job* job);
+		void execute(Job* job);
+		void finish(JobCounter* counter);
+		Job* findJob(int workerIndex);
+		void workerLoop(int workerIndex);
+
+		std::vector<std::thread> m_threads;
+		std::vector<std::unique_ptr<JobDeque>> m_deques; //One per worker
+		std::thread::id m_mainThread;
+
+		//Jobs submitted from threads that are not workers of this system
+		std::deque<Job*> m_injected;
+		std::mutex m_injectedMutex;
+
+		std::deque<Job*> m_mainThreadJobs;
+		std::mutex m_mainThreadMutex;
+
+		//Idle workers sleep until a job is queued
+		std::atomic<int64_t> m_numQueued{ 0 };
+		std::atomic<int> m_numSleeping{ 0 };
+		std::mutex m_sleepMutex;
+		std::condition_variable m_wake;
+		std::atomic<bool> m_stopping{ false };
+
+		std::atomic<uint64_t> m_jobsRun{ 0 };
+		std::atomic<uint64_t> m_jobsStolen{ 0 };
+	};
+}
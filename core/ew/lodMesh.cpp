@@ -0,0 +1,90 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "lodMesh.h"
+#include <math.h>
+
+namespace ew {
+	LODMesh::LODMesh(const MeshData& meshData, const std::vector<float>& ratios)
+	{
+		load(meshData, ratios);
+	}
+
+	void LODMesh::load(const MeshData& meshData, const std::vector<float>& ratios)
+	{
+		load(meshData, generateLODs(meshData, ratios));
+	}
+
+	void LODMesh::load(const MeshData& meshData, const std::vector<LODLevel>& levels)
+	{
+		m_levels.resize(levels.size() + 1);
+		m_errors.resize(levels.size() + 1);
+		m_levels[0].load(meshData);
+		m_errors[0] = 0.0f;
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			m_levels[i + 1].load(levels[i].meshData);
+			m_errors[i + 1] = levels[i].error;
+		}
+	}
+
+	/// <summary>
+	/// Picks a level by projecting each level's error bound to pixels at the mesh's distance from the camera
+	/// </summary>
+	/// <param name="camera">Camera the mesh will be drawn with</param>
+	/// <param name="modelMatrix">Mesh to world transform</param>
+	/// <param name="screenHeight">Viewport height in pixels</param>
+	/// <param name="maxPixelError">Largest acceptable error in pixels</param>
+	/// <returns>Level index to pass to draw()</returns>
+	int LODMesh::selectLevel(const Camera& camera, const glm::mat4& modelMatrix, float screenHeight, float maxPixelError) const
+	{
+		if (m_levels.empty()) {
+			return 0;
+		}
+		float scale = glm::max(glm::length(glm::vec3(modelMatrix[0])), glm::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		//World space size of one pixel at the closest point of the bounding sphere
+		float pixelSize;
+		if (camera.orthographic) {
+			pixelSize = camera.orthoHeight / screenHeight;
+		}
+		else {
+			const Bounds& bounds = m_levels[0].getBounds();
+			glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(bounds.center, 1.0f));
+			float distance = glm::max(glm::distance(camera.position, center) - bounds.radius * scale, camera.nearPlane);
+			pixelSize = 2.0f * distance * tanf(glm::radians(camera.fov) * 0.5f) / screenHeight;
+		}
+		int level = 0;
+		for (int i = 1; i < (int)m_levels.size(); i++)
+		{
+			if (m_errors[i] * scale > maxPixelError * pixelSize) {
+				break;
+			}
+			level = i;
+		}
+		return level;
+	}
+
+	void LODMesh::draw(int level, DrawMode drawMode) const
+	{
+		m_levels[level].draw(drawMode);
+	}
+
+	void LODMesh::unload()
+	{
+		for (size_t i = 0; i < m_levels.size(); i++)
+		{
+			m_levels[i].unload();
+		}
+	}
+
+	size_t LODMesh::getMemoryUsage() const
+	{
+		size_t bytes = 0;
+		for (size_t i = 0; i < m_levels.size(); i++)
+		{
+			bytes += m_levels[i].getMemoryUsage();
+		}
+		return bytes;
+	}
+}
@@ -0,0 +1,37 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "camera.h"
+#include "meshSimplifier.h"
+#include <vector>
+
+namespace ew {
+	//Chain of progressively simplified meshes. Level 0 is the original.
+	class LODMesh {
+	public:
+		LODMesh() {};
+		//Simplifies meshData to each ratio of its triangle count, e.g. { 0.5f, 0.25f, 0.125f }
+		LODMesh(const MeshData& meshData, const std::vector<float>& ratios);
+		void load(const MeshData& meshData, const std::vector<float>& ratios);
+		//Uploads already generated levels
+		void load(const MeshData& meshData, const std::vector<LODLevel>& levels);
+		//Coarsest level whose error projects to at most maxPixelError pixels on screen
+		int selectLevel(const Camera& camera, const glm::mat4& modelMatrix, float screenHeight, float maxPixelError = 1.0f)const;
+		void draw(int level, DrawMode drawMode = DrawMode::TRIANGLES)const;
+		//Deletes every level's GL objects
+		void unload();
+		//GPU bytes of vertices and indices over all levels
+		size_t getMemoryUsage()const;
+		inline int getNumLevels()const { return (int)m_levels.size(); }
+		inline const Mesh& getLevel(int level)const { return m_levels[level]; }
+		inline float getError(int level)const { return m_errors[level]; }
+		//Bounds of the original mesh. Every level lies within them.
+		inline const Bounds& getBounds()const { return m_levels[0].getBounds(); }
+	private:
+		std::vector<Mesh> m_levels;
+		std::vector<float> m_errors;
+	};
+}
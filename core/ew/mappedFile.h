@@ -0,0 +1,33 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <string>
+#include <stddef.h>
+
+namespace ew {
+	//Read-only memory mapping of an entire file.
+	//The mapping stays valid until close() is called or the object is destroyed.
+	class MappedFile {
+	public:
+		MappedFile() {};
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		bool open(const std::string& filePath);
+		void close();
+		inline bool isOpen()const { return m_data != nullptr; }
+		inline const void* getData()const { return m_data; }
+		inline size_t getSize()const { return m_size; }
+	private:
+		const void* m_data = nullptr;
+		size_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#else
+		int m_fd = -1;
+#endif
+	};
+}
@@ -6,7 +6,10 @@
 */
 
 #include "mesh.h"
+#include "instanceBuffer.h"
 #include "external/glad.h"
+#include "profiler.h"
+#include <stdint.h>
 
 namespace ew {
 	Mesh::Mesh(const MeshData& meshData)
@@ -14,28 +17,64 @@ namespace ew {
 		load(meshData);
 	}
 	void Mesh::load(const MeshData& meshData)
+	{
+		load(meshData.vertices.data(), meshData.vertices.size(), meshData.indices.data(), meshData.indices.size());
+	}
+	void Mesh::load(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices)
+	{
+		m_bounds = computeBounds(vertices, numVertices);
+		loadVertices(VertexTraits<Vertex>::layout(), vertices, numVertices, indices, numIndices);
+	}
+	void Mesh::loadVertices(const VertexLayout& layout, const void* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices)
+	{
+		EW_PROFILE_SCOPE("Mesh::load");
+		bindLayout(layout);
+
+		if (numVertices > 0) {
+			glBufferData(GL_ARRAY_BUFFER, layout.stride * numVertices, vertices, GL_STATIC_DRAW);
+		}
+		//Without indices draw() falls back to non-indexed draws, but keep the type valid
+		m_indexType = GL_UNSIGNED_INT;
+		m_indexSize = sizeof(unsigned int);
+		if (numIndices > 0) {
+			bool narrowed = false;
+			if (numVertices <= 65536) {
+				//Narrow straight into the buffer instead of through a temporary array
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * numIndices, NULL, GL_STATIC_DRAW);
+				uint16_t* shortIndices = (uint16_t*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uint16_t) * numIndices, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+				if (shortIndices != NULL) {
+					for (unsigned int i = 0; i < numIndices; i++)
+					{
+						shortIndices[i] = (uint16_t)indices[i];
+					}
+					//False if the contents were lost while mapped
+					narrowed = glUnmapBuffer(GL_ELEMENT_ARRAY_BUFFER) == GL_TRUE;
+				}
+			}
+			if (narrowed) {
+				m_indexType = GL_UNSIGNED_SHORT;
+				m_indexSize = sizeof(uint16_t);
+			}
+			//Too many vertices for 16 bit indices, or the buffer could not be mapped
+			else {
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * numIndices, indices, GL_STATIC_DRAW);
+			}
+		}
+		m_numVertices = numVertices;
+		m_numIndices = numIndices;
+		m_vertexSize = layout.stride;
+
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	//Creates the GL objects on first use, binds them and points the VAO's attributes at layout
+	void Mesh::bindLayout(const VertexLayout& layout)
 	{
 		if (!m_initialized) {
 			glGenVertexArrays(1, &m_vao);
-			glBindVertexArray(m_vao);
-
 			glGenBuffers(1, &m_vbo);
-			glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-
 			glGenBuffers(1, &m_ebo);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
-			//Position attribute
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, pos));
-			glEnableVertexAttribArray(0);
-
-			//Normal attribute
-			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)offsetof(Vertex, normal));
-			glEnableVertexAttribArray(1);
-
-			//UV attribute
-			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, uv)));
-			glEnableVertexAttribArray(2);
-
 			m_initialized = true;
 		}
 
@@ -43,28 +82,95 @@ namespace ew {
 		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
 
-		if (meshData.vertices.size() > 0) {
-			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * meshData.vertices.size(), meshData.vertices.data(), GL_STATIC_DRAW);
-		}
-		if (meshData.indices.size() > 0) {
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * meshData.indices.size(), meshData.indices.data(), GL_STATIC_DRAW);
+		//Attributes come from the layout, so they are set on every load in case it changed
+		unsigned int enabledAttributes = setVertexAttributes(layout);
+		for (unsigned int location = 0; location < 32; location++)
+		{
+			if ((m_enabledAttributes & ~enabledAttributes) & (1u << location)) {
+				glDisableVertexAttribArray(location);
+			}
 		}
-		m_numVertices = meshData.vertices.size();
-		m_numIndices = meshData.indices.size();
+		m_enabledAttributes = enabledAttributes;
+	}
+	void Mesh::allocate(const VertexLayout& layout, unsigned int numVertices, unsigned int numIndices)
+	{
+		EW_PROFILE_SCOPE("Mesh::allocate");
+		bindLayout(layout);
+		m_indexType = numVertices <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		m_indexSize = numVertices <= 65536 ? sizeof(uint16_t) : sizeof(unsigned int);
+		glBufferData(GL_ARRAY_BUFFER, layout.stride * numVertices, NULL, GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexSize * numIndices, NULL, GL_STATIC_DRAW);
+		m_numVertices = numVertices;
+		m_numIndices = numIndices;
+		m_vertexSize = layout.stride;
 
 		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 	}
+	void Mesh::uploadVertexBytes(const void* data, size_t offset, size_t size)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBufferSubData(GL_ARRAY_BUFFER, offset, size, data);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	void Mesh::uploadIndexBytes(const void* data, size_t offset, size_t size)
+	{
+		//The element array binding is VAO state, so go through a non-indexed target
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_ebo);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	void Mesh::unload()
+	{
+		if (!m_initialized) {
+			return;
+		}
+		glDeleteVertexArrays(1, &m_vao);
+		glDeleteBuffers(1, &m_vbo);
+		glDeleteBuffers(1, &m_ebo);
+		m_vao = m_vbo = m_ebo = 0;
+		m_initialized = false;
+		m_numVertices = m_numIndices = 0;
+		m_indexType = 0;
+		m_indexSize = 0;
+		m_enabledAttributes = 0;
+		m_instanceGeneration = 0;
+	}
 	void Mesh::draw(ew::DrawMode drawMode) const
 	{
 		glBindVertexArray(m_vao);
-		if (drawMode == DrawMode::TRIANGLES) {
-			glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, NULL);
+		if (drawMode == DrawMode::TRIANGLES && m_numIndices > 0) {
+			glDrawElements(GL_TRIANGLES, m_numIndices, m_indexType, NULL);
 		}
+		//Without indices every 3 vertices are a triangle
 		else {
-			glDrawArrays(GL_POINTS, 0, m_numVertices);
+			glDrawArrays(drawMode == DrawMode::TRIANGLES ? GL_TRIANGLES : GL_POINTS, 0, m_numVertices);
 		}
 		
 	}
-}
\ No newline at end of file
+	/// <summary>
+	/// Instanced draw. baseInstance selects where in the instance buffer this draw reads from,
+	/// so the attribute pointers only change when a different instance buffer is used.
+	/// </summary>
+	/// <param name="instances">Buffer holding per-instance attributes</param>
+	/// <param name="baseInstance">First instance, as returned by InstanceBuffer::allocate</param>
+	/// <param name="numInstances">Number of instances to draw</param>
+	/// <param name="drawMode">Triangles or points</param>
+	void Mesh::drawInstanced(const InstanceBuffer& instances, unsigned int baseInstance, unsigned int numInstances, DrawMode drawMode) const
+	{
+		glBindVertexArray(m_vao);
+		if (m_instanceGeneration != instances.getGeneration()) {
+			glBindBuffer(GL_ARRAY_BUFFER, instances.getID());
+			setVertexAttributes(instances.getLayout(), 1);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			m_instanceGeneration = instances.getGeneration();
+		}
+		if (drawMode == DrawMode::TRIANGLES && m_numIndices > 0) {
+			glDrawElementsInstancedBaseInstance(GL_TRIANGLES, m_numIndices, m_indexType, NULL, numInstances, baseInstance);
+		}
+		else {
+			glDrawArraysInstancedBaseInstance(drawMode == DrawMode::TRIANGLES ? GL_TRIANGLES : GL_POINTS, 0, m_numVertices, numInstances, baseInstance);
+		}
+	}
+}
@@ -5,14 +5,33 @@
 #pragma once
 #include <glm/glm.hpp>
 #include <vector>
+#include "vertexLayout.h"
+#include "bounds.h"
 
 namespace ew {
+	class InstanceBuffer;
+
 	struct Vertex {
 		glm::vec3 pos;
 		glm::vec3 normal;
 		glm::vec2 uv;
 	};
 
+	template<>
+	struct VertexTraits<Vertex> {
+		static VertexLayout layout() {
+			static const VertexAttribute attributes[] = {
+				{ 0, 3, AttributeType::FLOAT, false, offsetof(Vertex, pos) },
+				{ 1, 3, AttributeType::FLOAT, false, offsetof(Vertex, normal) },
+				{ 2, 2, AttributeType::FLOAT, false, offsetof(Vertex, uv) }
+			};
+			return { sizeof(Vertex), attributes, 3 };
+		}
+		static glm::vec3 position(const Vertex& vertex) {
+			return vertex.pos;
+		}
+	};
+
 	struct MeshData {
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
@@ -28,15 +47,56 @@ namespace ew {
 		Mesh() {};
 		Mesh(const MeshData& meshData);
 		void load(const MeshData& meshData);
+		//Uploads directly from caller owned arrays, e.g. a memory mapped mesh cache
+		void load(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices);
+		//Any vertex struct with a VertexTraits specialization, e.g. QuantizedVertex
+		template<typename V>
+		void load(const V* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices) {
+			m_bounds = computeBounds(vertices, numVertices);
+			loadVertices(VertexTraits<V>::layout(), vertices, numVertices, indices, numIndices);
+		}
+		template<typename V>
+		void load(const std::vector<V>& vertices, const std::vector<unsigned int>& indices) {
+			load(vertices.data(), (unsigned int)vertices.size(), indices.data(), (unsigned int)indices.size());
+		}
+		//Indices are stored as 16 bit when every vertex can be addressed with them.
+		//Does not know where positions are in the layout, so bounds are left to setBounds().
+		void loadVertices(const VertexLayout& layout, const void* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices);
+		//Creates empty buffers to be filled in pieces with uploadVertexBytes/uploadIndexBytes, e.g. to spread a large upload
+		//over several frames. Indices are 16 bit when numVertices <= 65536, see getIndexSize().
+		void allocate(const VertexLayout& layout, unsigned int numVertices, unsigned int numIndices);
+		//Copy into buffers made by allocate(). Offsets and sizes are in bytes, and indices must already be getIndexSize() bytes each.
+		void uploadVertexBytes(const void* data, size_t offset, size_t size);
+		void uploadIndexBytes(const void* data, size_t offset, size_t size);
+		//Deletes the GL objects. The mesh can be loaded again afterwards.
+		void unload();
+		//Meshes loaded without indices draw their vertices in order
 		void draw(DrawMode drawMode = DrawMode::TRIANGLES)const;
+		//Draws numInstances copies in one call, reading per-instance attributes from instances starting at baseInstance
+		void drawInstanced(const InstanceBuffer& instances, unsigned int baseInstance, unsigned int numInstances, DrawMode drawMode = DrawMode::TRIANGLES)const;
 		inline int getNumVertices()const { return m_numVertices; }
 		inline int getNumIndices()const { return m_numIndices; }
+		inline size_t getVertexSize()const { return m_vertexSize; }
+		inline size_t getIndexSize()const { return m_indexSize; }
+		//GPU bytes of vertices and indices
+		inline size_t getMemoryUsage()const { return m_vertexSize * m_numVertices + m_indexSize * m_numIndices; }
+		//Object space bounds of the last loaded vertices
+		inline const Bounds& getBounds()const { return m_bounds; }
+		inline void setBounds(const Bounds& bounds) { m_bounds = bounds; }
 	private:
+		void bindLayout(const VertexLayout& layout);
+
 		bool m_initialized = false;
 		unsigned int m_vao = 0;
 		unsigned int m_vbo = 0;
 		unsigned int m_ebo = 0;
 		unsigned int m_numVertices = 0;
 		unsigned int m_numIndices = 0;
+		unsigned int m_indexType = 0; //GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, set with m_indexSize by every load. 0 before load() and after unload(), when draws never read it.
+		unsigned int m_enabledAttributes = 0; //Bit per attribute location
+		mutable unsigned int m_instanceGeneration = 0; //InstanceBuffer::getGeneration() of the buffer the VAO's per-instance attributes point at
+		size_t m_vertexSize = 0;
+		size_t m_indexSize = 0;
+		Bounds m_bounds;
 	};
-}
\ No newline at end of file
+}
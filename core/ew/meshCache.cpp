@@ -0,0 +1,181 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "meshCache.h"
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+
+namespace ew {
+	static const char MESH_CACHE_MAGIC[4] = { 'E','W','M','C' };
+	static const uint32_t MESH_CACHE_VERSION = 1;
+	//Vertex and index arrays are aligned so they can be handed to GL straight from the mapping
+	static const uint64_t MESH_CACHE_ALIGNMENT = 16;
+
+	struct MeshCacheHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t vertexSize;
+		uint32_t settingsKey;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		uint32_t numMeshes;
+		uint32_t reserved;
+	};
+
+	/// <summary>
+	/// Size and modification time of the source asset. A cache is only valid if both match.
+	/// </summary>
+	static bool getSourceStamp(const std::string& sourcePath, uint64_t* size, int64_t* time) {
+		std::error_code ec;
+		uintmax_t fileSize = std::filesystem::file_size(sourcePath, ec);
+		if (ec) {
+			return false;
+		}
+		std::filesystem::file_time_type writeTime = std::filesystem::last_write_time(sourcePath, ec);
+		if (ec) {
+			return false;
+		}
+		*size = (uint64_t)fileSize;
+		*time = (int64_t)writeTime.time_since_epoch().count();
+		return true;
+	}
+
+	static uint64_t alignOffset(uint64_t offset) {
+		return (offset + MESH_CACHE_ALIGNMENT - 1) & ~(MESH_CACHE_ALIGNMENT - 1);
+	}
+
+	std::string getMeshCachePath(const std::string& sourcePath) {
+		return sourcePath + ".ewcache";
+	}
+
+	/// <summary>
+	/// Writes converted meshes to a binary cache file. Written to a temporary file first so a
+	/// partially written cache is never picked up by a later load.
+	/// </summary>
+	/// <param name="cachePath">Output file</param>
+	/// <param name="sourcePath">Asset the meshes were imported from. Used to validate the cache later.</param>
+	/// <param name="settingsKey">Any value derived from import settings that affect the output</param>
+	/// <param name="meshes">Converted meshes</param>
+	/// <returns>False on failure</returns>
+	bool writeMeshCache(const std::string& cachePath, const std::string& sourcePath, uint32_t settingsKey, const std::vector<MeshData>& meshes) {
+		MeshCacheHeader header = {};
+		memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+		header.version = MESH_CACHE_VERSION;
+		header.vertexSize = sizeof(Vertex);
+		header.settingsKey = settingsKey;
+		header.numMeshes = (uint32_t)meshes.size();
+		if (!getSourceStamp(sourcePath, &header.sourceSize, &header.sourceTime)) {
+			return false;
+		}
+
+		//Lay out the data section after the header and entry table
+		std::vector<MeshCacheEntry> entries(meshes.size());
+		uint64_t offset = sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry) * meshes.size();
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			entries[i].numVertices = (uint32_t)meshes[i].vertices.size();
+			entries[i].numIndices = (uint32_t)meshes[i].indices.size();
+			entries[i].vertexOffset = alignOffset(offset);
+			offset = entries[i].vertexOffset + sizeof(Vertex) * entries[i].numVertices;
+			entries[i].indexOffset = alignOffset(offset);
+			offset = entries[i].indexOffset + sizeof(unsigned int) * entries[i].numIndices;
+		}
+
+		std::string tempPath = cachePath + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if (file == NULL) {
+			return false;
+		}
+		static const char padding[MESH_CACHE_ALIGNMENT] = {};
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		if (ok && !entries.empty()) {
+			ok = fwrite(entries.data(), sizeof(MeshCacheEntry), entries.size(), file) == entries.size();
+		}
+		uint64_t written = sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry) * meshes.size();
+		for (size_t i = 0; i < meshes.size() && ok; i++)
+		{
+			ok = fwrite(padding, 1, entries[i].vertexOffset - written, file) == entries[i].vertexOffset - written;
+			ok = ok && fwrite(meshes[i].vertices.data(), sizeof(Vertex), meshes[i].vertices.size(), file) == meshes[i].vertices.size();
+			written = entries[i].vertexOffset + sizeof(Vertex) * entries[i].numVertices;
+			ok = ok && fwrite(padding, 1, entries[i].indexOffset - written, file) == entries[i].indexOffset - written;
+			ok = ok && fwrite(meshes[i].indices.data(), sizeof(unsigned int), meshes[i].indices.size(), file) == meshes[i].indices.size();
+			written = entries[i].indexOffset + sizeof(unsigned int) * entries[i].numIndices;
+		}
+		ok = (fclose(file) == 0) && ok;
+
+		std::error_code ec;
+		if (ok) {
+			std::filesystem::rename(tempPath, cachePath, ec);
+			ok = !ec;
+		}
+		if (!ok) {
+			printf("Failed to write mesh cache %s\n", cachePath.c_str());
+			std::filesystem::remove(tempPath, ec);
+		}
+		return ok;
+	}
+
+	bool MeshCache::open(const std::string& cachePath, const std::string& sourcePath, uint32_t settingsKey)
+	{
+		close();
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		if (!getSourceStamp(sourcePath, &sourceSize, &sourceTime)) {
+			return false;
+		}
+		if (!m_file.open(cachePath)) {
+			return false;
+		}
+		const char* bytes = (const char*)m_file.getData();
+		size_t fileSize = m_file.getSize();
+		if (fileSize < sizeof(MeshCacheHeader)) {
+			close();
+			return false;
+		}
+		MeshCacheHeader header;
+		memcpy(&header, bytes, sizeof(header));
+		bool valid = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.version == MESH_CACHE_VERSION
+			&& header.vertexSize == sizeof(Vertex)
+			&& header.settingsKey == settingsKey
+			&& header.sourceSize == sourceSize
+			&& header.sourceTime == sourceTime
+			&& fileSize >= sizeof(MeshCacheHeader) + sizeof(MeshCacheEntry) * (uint64_t)header.numMeshes;
+		if (!valid) {
+			close();
+			return false;
+		}
+		m_entries = (const MeshCacheEntry*)(bytes + sizeof(MeshCacheHeader));
+		m_numMeshes = header.numMeshes;
+		//Reject truncated files before anyone reads through the entry offsets
+		for (size_t i = 0; i < m_numMeshes; i++)
+		{
+			const MeshCacheEntry& entry = m_entries[i];
+			if (entry.vertexOffset + sizeof(Vertex) * (uint64_t)entry.numVertices > fileSize ||
+				entry.indexOffset + sizeof(unsigned int) * (uint64_t)entry.numIndices > fileSize) {
+				close();
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void MeshCache::close()
+	{
+		m_file.close();
+		m_entries = nullptr;
+		m_numMeshes = 0;
+	}
+
+	const Vertex* MeshCache::getVertices(size_t i) const
+	{
+		return (const Vertex*)((const char*)m_file.getData() + m_entries[i].vertexOffset);
+	}
+
+	const unsigned int* MeshCache::getIndices(size_t i) const
+	{
+		return (const unsigned int*)((const char*)m_file.getData() + m_entries[i].indexOffset);
+	}
+}
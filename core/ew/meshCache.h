@@ -0,0 +1,42 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "mappedFile.h"
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	//Per-mesh table entry in a mesh cache file. Offsets are from the start of the file.
+	struct MeshCacheEntry {
+		uint64_t vertexOffset;
+		uint64_t indexOffset;
+		uint32_t numVertices;
+		uint32_t numIndices;
+	};
+
+	//Path of the cache file written for a given source asset
+	std::string getMeshCachePath(const std::string& sourcePath);
+	bool writeMeshCache(const std::string& cachePath, const std::string& sourcePath, uint32_t settingsKey, const std::vector<MeshData>& meshes);
+
+	//Memory mapped view of a mesh cache file.
+	//Vertex and index pointers point directly into the mapping and are valid while the cache is open.
+	class MeshCache {
+	public:
+		//Returns false if the cache is missing, corrupt, or stale relative to sourcePath/settingsKey
+		bool open(const std::string& cachePath, const std::string& sourcePath, uint32_t settingsKey);
+		void close();
+		inline size_t getNumMeshes()const { return m_numMeshes; }
+		inline unsigned int getNumVertices(size_t i)const { return m_entries[i].numVertices; }
+		inline unsigned int getNumIndices(size_t i)const { return m_entries[i].numIndices; }
+		const Vertex* getVertices(size_t i)const;
+		const unsigned int* getIndices(size_t i)const;
+	private:
+		MappedFile m_file;
+		const MeshCacheEntry* m_entries = nullptr;
+		size_t m_numMeshes = 0;
+	};
+}
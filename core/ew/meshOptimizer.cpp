@@ -0,0 +1,365 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "meshOptimizer.h"
+#include <string.h>
+#include <stdint.h>
+#include <algorithm>
+#include <glm/glm.hpp>
+
+namespace ew {
+	/// <summary>
+	/// Simulates a FIFO post-transform cache over the index buffer
+	/// </summary>
+	/// <param name="mesh">Triangle list to analyze</param>
+	/// <param name="cacheSize">Number of cache entries</param>
+	/// <returns>ACMR/ATVR of the current triangle order</returns>
+	VertexCacheStats analyzeVertexCache(const MeshData& mesh, unsigned int cacheSize) {
+		VertexCacheStats stats;
+		size_t numTriangles = mesh.indices.size() / 3;
+		if (numTriangles == 0) {
+			return stats;
+		}
+		//A vertex is in the cache if it was pushed within the last cacheSize misses
+		std::vector<unsigned int> cacheTime(mesh.vertices.size(), 0);
+		std::vector<bool> referenced(mesh.vertices.size(), false);
+		unsigned int time = cacheSize + 1;
+		unsigned int numUnique = 0;
+		for (size_t i = 0; i < numTriangles * 3; i++)
+		{
+			unsigned int v = mesh.indices[i];
+			if (time - cacheTime[v] > cacheSize) {
+				cacheTime[v] = time++;
+				stats.verticesTransformed++;
+			}
+			if (!referenced[v]) {
+				referenced[v] = true;
+				numUnique++;
+			}
+		}
+		stats.acmr = (float)stats.verticesTransformed / numTriangles;
+		stats.atvr = (float)stats.verticesTransformed / numUnique;
+		return stats;
+	}
+
+	static uint32_t hashVertex(const Vertex& v) {
+		//FNV-1a over the raw bytes. Vertex is tightly packed floats, so equal bytes == equal vertex.
+		const unsigned char* bytes = (const unsigned char*)&v;
+		uint32_t hash = 2166136261u;
+		for (size_t i = 0; i < sizeof(Vertex); i++)
+		{
+			hash = (hash ^ bytes[i]) * 16777619u;
+		}
+		return hash;
+	}
+
+	void weldVertices(MeshData* mesh) {
+		static_assert(sizeof(Vertex) == sizeof(float) * 8, "Vertex must not contain padding");
+		size_t numVertices = mesh->vertices.size();
+		if (numVertices == 0) {
+			return;
+		}
+		//Open addressing table of indices into the welded vertex array, sized to a power of two at <= 50% load
+		size_t tableSize = 1;
+		while (tableSize < numVertices * 2) {
+			tableSize *= 2;
+		}
+		const unsigned int EMPTY = ~0u;
+		std::vector<unsigned int> table(tableSize, EMPTY);
+		std::vector<unsigned int> remap(numVertices);
+		std::vector<Vertex> welded;
+		welded.reserve(numVertices);
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			const Vertex& v = mesh->vertices[i];
+			size_t slot = hashVertex(v) & (tableSize - 1);
+			while (table[slot] != EMPTY && memcmp(&welded[table[slot]], &v, sizeof(Vertex)) != 0) {
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if (table[slot] == EMPTY) {
+				table[slot] = (unsigned int)welded.size();
+				welded.push_back(v);
+			}
+			remap[i] = table[slot];
+		}
+		for (size_t i = 0; i < mesh->indices.size(); i++)
+		{
+			mesh->indices[i] = remap[mesh->indices[i]];
+		}
+		mesh->vertices.swap(welded);
+	}
+
+	//Vertex -> triangle adjacency in compressed row form
+	struct TriangleAdjacency {
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+		std::vector<unsigned int> counts;
+	};
+
+	static void buildAdjacency(const MeshData& mesh, TriangleAdjacency* adjacency) {
+		size_t numVertices = mesh.vertices.size();
+		size_t numTriangles = mesh.indices.size() / 3;
+		adjacency->counts.assign(numVertices, 0);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+		{
+			adjacency->counts[mesh.indices[i]]++;
+		}
+		adjacency->offsets.resize(numVertices + 1);
+		adjacency->offsets[0] = 0;
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			adjacency->offsets[v + 1] = adjacency->offsets[v] + adjacency->counts[v];
+		}
+		adjacency->triangles.resize(numTriangles * 3);
+		std::vector<unsigned int> fill(adjacency->offsets.begin(), adjacency->offsets.end() - 1);
+		for (size_t i = 0; i < numTriangles * 3; i++)
+		{
+			adjacency->triangles[fill[mesh.indices[i]]++] = (unsigned int)(i / 3);
+		}
+	}
+
+	/// <summary>
+	/// Tipsify: "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak 2007).
+	/// Fans around a vertex, then moves to the neighbouring vertex that is still in cache and has the most
+	/// remaining triangles. Runs in linear time.
+	/// </summary>
+	void optimizeVertexCache(MeshData* mesh, unsigned int cacheSize) {
+		size_t numVertices = mesh->vertices.size();
+		size_t numTriangles = mesh->indices.size() / 3;
+		if (numTriangles == 0) {
+			return;
+		}
+		TriangleAdjacency adjacency;
+		buildAdjacency(*mesh, &adjacency);
+		std::vector<unsigned int>& liveTriangles = adjacency.counts;
+
+		std::vector<unsigned int> cacheTime(numVertices, 0);
+		std::vector<bool> emitted(numTriangles, false);
+		std::vector<unsigned int> deadEnd;
+		std::vector<unsigned int> candidates;
+		deadEnd.reserve(numTriangles * 3);
+		std::vector<unsigned int> output;
+		output.reserve(numTriangles * 3);
+
+		unsigned int time = cacheSize + 1;
+		size_t cursor = 0; //Next vertex to try when the dead end stack runs dry
+		int fanning = 0;
+		while (cursor < numVertices && liveTriangles[cursor] == 0) {
+			cursor++;
+		}
+		fanning = cursor < numVertices ? (int)cursor : -1;
+
+		while (fanning >= 0) {
+			candidates.clear();
+			for (unsigned int a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; a++)
+			{
+				unsigned int t = adjacency.triangles[a];
+				if (emitted[t]) {
+					continue;
+				}
+				emitted[t] = true;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = mesh->indices[t * 3 + k];
+					output.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					liveTriangles[v]--;
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time++;
+					}
+				}
+			}
+
+			//Pick the candidate that will still be in cache after its remaining triangles are emitted
+			int best = -1;
+			int bestPriority = -1;
+			for (size_t c = 0; c < candidates.size(); c++)
+			{
+				unsigned int v = candidates[c];
+				if (liveTriangles[v] == 0) {
+					continue;
+				}
+				int priority = 0;
+				if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority) {
+					bestPriority = priority;
+					best = (int)v;
+				}
+			}
+			if (best < 0) {
+				//Dead end: fall back to recently used vertices, then to a linear scan
+				while (!deadEnd.empty() && best < 0) {
+					unsigned int v = deadEnd.back();
+					deadEnd.pop_back();
+					if (liveTriangles[v] > 0) {
+						best = (int)v;
+					}
+				}
+				while (best < 0 && cursor < numVertices) {
+					if (liveTriangles[cursor] > 0) {
+						best = (int)cursor;
+					}
+					cursor++;
+				}
+			}
+			fanning = best;
+		}
+		mesh->indices.swap(output);
+	}
+
+	/// <summary>
+	/// Splits the (already cache optimized) index buffer into clusters, then sorts clusters so that
+	/// ones facing away from the mesh center are drawn first. Those are the most likely to occlude
+	/// the rest of the mesh, so later clusters fail the depth test instead of being shaded.
+	/// </summary>
+	void optimizeOverdraw(MeshData* mesh, float threshold, unsigned int cacheSize) {
+		size_t numTriangles = mesh->indices.size() / 3;
+		if (numTriangles == 0) {
+			return;
+		}
+		const std::vector<unsigned int>& indices = mesh->indices;
+
+		//Hard boundaries: the cache simulation misses on all three vertices, i.e. the optimizer restarted
+		std::vector<unsigned int> cacheTime(mesh->vertices.size(), 0);
+		unsigned int time = cacheSize + 1;
+		std::vector<size_t> hardClusters;
+		std::vector<unsigned int> hardClusterMisses;
+		for (size_t t = 0; t < numTriangles; t++)
+		{
+			int misses = 0;
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+					misses++;
+				}
+			}
+			if (t == 0 || misses == 3) {
+				hardClusters.push_back(t);
+				hardClusterMisses.push_back(0);
+			}
+			hardClusterMisses.back() += misses;
+		}
+		hardClusters.push_back(numTriangles);
+
+		//Soft boundaries: split each hard cluster wherever the running ACMR is already within threshold
+		//of the whole cluster's ACMR, since starting a new cluster there costs little cache efficiency
+		std::vector<size_t> clusters;
+		for (size_t h = 0; h + 1 < hardClusters.size(); h++)
+		{
+			size_t start = hardClusters[h];
+			size_t end = hardClusters[h + 1];
+			float clusterAcmr = (float)hardClusterMisses[h] / (end - start);
+
+			//Advancing time past every cached entry empties the cache without touching the whole array
+			time += cacheSize + 1;
+			clusters.push_back(start);
+			size_t clusterStart = start;
+			unsigned int clusterMisses = 0;
+			for (size_t t = start; t < end; t++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int v = indices[t * 3 + k];
+					if (time - cacheTime[v] > cacheSize) {
+						cacheTime[v] = time++;
+						clusterMisses++;
+					}
+				}
+				size_t clusterTriangles = t + 1 - clusterStart;
+				if (t + 1 < end && clusterTriangles >= 8 && (float)clusterMisses / clusterTriangles <= clusterAcmr * threshold) {
+					clusters.push_back(t + 1);
+					clusterStart = t + 1;
+					clusterMisses = 0;
+					time += cacheSize + 1;
+				}
+			}
+		}
+		size_t numClusters = clusters.size();
+		clusters.push_back(numTriangles);
+
+		//Sort key: how far the cluster's average normal points away from the mesh centroid
+		glm::vec3 meshCentroid = glm::vec3(0.0f);
+		for (size_t i = 0; i < mesh->vertices.size(); i++)
+		{
+			meshCentroid += mesh->vertices[i].pos;
+		}
+		meshCentroid /= (float)glm::max(mesh->vertices.size(), (size_t)1);
+
+		std::vector<float> sortKey(numClusters);
+		std::vector<unsigned int> order(numClusters);
+		for (size_t c = 0; c < numClusters; c++)
+		{
+			glm::vec3 centroid = glm::vec3(0.0f);
+			glm::vec3 normal = glm::vec3(0.0f);
+			float totalArea = 0.0f;
+			for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+			{
+				const glm::vec3& p0 = mesh->vertices[indices[t * 3 + 0]].pos;
+				const glm::vec3& p1 = mesh->vertices[indices[t * 3 + 1]].pos;
+				const glm::vec3& p2 = mesh->vertices[indices[t * 3 + 2]].pos;
+				glm::vec3 areaNormal = glm::cross(p1 - p0, p2 - p0);
+				float area = glm::length(areaNormal);
+				centroid += (p0 + p1 + p2) * (area / 3.0f);
+				normal += areaNormal;
+				totalArea += area;
+			}
+			centroid /= (totalArea > 0.0f ? totalArea : 1.0f);
+			float normalLength = glm::length(normal);
+			normal /= (normalLength > 0.0f ? normalLength : 1.0f);
+			sortKey[c] = glm::dot(centroid - meshCentroid, normal);
+			order[c] = (unsigned int)c;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return sortKey[a] > sortKey[b]; });
+
+		std::vector<unsigned int> output;
+		output.reserve(indices.size());
+		for (size_t i = 0; i < numClusters; i++)
+		{
+			unsigned int c = order[i];
+			output.insert(output.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+		}
+		mesh->indices.swap(output);
+	}
+
+	void optimizeVertexFetch(MeshData* mesh) {
+		const unsigned int UNUSED = ~0u;
+		std::vector<unsigned int> remap(mesh->vertices.size(), UNUSED);
+		std::vector<Vertex> vertices;
+		vertices.reserve(mesh->vertices.size());
+		for (size_t i = 0; i < mesh->indices.size(); i++)
+		{
+			unsigned int& index = mesh->indices[i];
+			if (remap[index] == UNUSED) {
+				remap[index] = (unsigned int)vertices.size();
+				vertices.push_back(mesh->vertices[index]);
+			}
+			index = remap[index];
+		}
+		mesh->vertices.swap(vertices);
+	}
+
+	/// <summary>
+	/// Welds, reorders for vertex cache, reduces overdraw, then reorders vertex fetches.
+	/// Only triangle lists are supported.
+	/// </summary>
+	/// <param name="mesh">Mesh to optimize in place</param>
+	/// <returns>Vertex count and cache statistics before and after</returns>
+	MeshOptimizationStats optimizeMesh(MeshData* mesh) {
+		MeshOptimizationStats stats;
+		stats.before = analyzeVertexCache(*mesh);
+		stats.verticesBefore = (unsigned int)mesh->vertices.size();
+		weldVertices(mesh);
+		optimizeVertexCache(mesh);
+		optimizeOverdraw(mesh);
+		optimizeVertexFetch(mesh);
+		stats.after = analyzeVertexCache(*mesh);
+		stats.verticesAfter = (unsigned int)mesh->vertices.size();
+		return stats;
+	}
+}
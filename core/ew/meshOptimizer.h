@@ -0,0 +1,39 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+
+namespace ew {
+	//Post-transform vertex cache efficiency of an index buffer, simulated with a FIFO cache
+	struct VertexCacheStats {
+		unsigned int verticesTransformed = 0;
+		float acmr = 0.0f; //Average cache miss ratio: vertex shader invocations per triangle. 0.5 is ideal for a grid, 3.0 is worst case.
+		float atvr = 0.0f; //Average transform to vertex ratio: vertex shader invocations per unique vertex. 1.0 is ideal.
+	};
+
+	struct MeshOptimizationStats {
+		VertexCacheStats before;
+		VertexCacheStats after;
+		unsigned int verticesBefore = 0;
+		unsigned int verticesAfter = 0;
+	};
+
+	const unsigned int DEFAULT_VERTEX_CACHE_SIZE = 16;
+
+	VertexCacheStats analyzeVertexCache(const MeshData& mesh, unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+
+	//Merges bitwise identical vertices and remaps indices
+	void weldVertices(MeshData* mesh);
+	//Reorders triangles for post-transform cache locality (Tipsify)
+	void optimizeVertexCache(MeshData* mesh, unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+	//Reorders clusters of a cache optimized index buffer so outward facing clusters draw first.
+	//threshold is how much ACMR may degrade to allow finer clusters (1.05 = 5%).
+	void optimizeOverdraw(MeshData* mesh, float threshold = 1.05f, unsigned int cacheSize = DEFAULT_VERTEX_CACHE_SIZE);
+	//Reorders vertices by first use so vertex fetches walk memory linearly. Unreferenced vertices are dropped.
+	void optimizeVertexFetch(MeshData* mesh);
+
+	//Runs every pass above in order
+	MeshOptimizationStats optimizeMesh(MeshData* mesh);
+}
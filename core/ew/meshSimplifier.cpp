@@ -0,0 +1,419 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "meshSimplifier.h"
+#include "meshOptimizer.h"
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <glm/glm.hpp>
+
+namespace ew {
+	namespace {
+		//Symmetric 4x4 matrix. Evaluating it at a point gives the sum of squared distances to every plane added to it.
+		struct Quadric {
+			double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+			double a11 = 0, a12 = 0, a13 = 0;
+			double a22 = 0, a23 = 0;
+			double a33 = 0;
+
+			void addPlane(const glm::vec3& n, float d) {
+				a00 += n.x * n.x; a01 += n.x * n.y; a02 += n.x * n.z; a03 += n.x * d;
+				a11 += n.y * n.y; a12 += n.y * n.z; a13 += n.y * d;
+				a22 += n.z * n.z; a23 += n.z * d;
+				a33 += (double)d * d;
+			}
+			void add(const Quadric& q) {
+				a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+				a11 += q.a11; a12 += q.a12; a13 += q.a13;
+				a22 += q.a22; a23 += q.a23;
+				a33 += q.a33;
+			}
+			double evaluate(const glm::vec3& p) const {
+				double x = p.x, y = p.y, z = p.z;
+				double result = a00 * x * x + 2 * a01 * x * y + 2 * a02 * x * z + 2 * a03 * x
+					+ a11 * y * y + 2 * a12 * y * z + 2 * a13 * y
+					+ a22 * z * z + 2 * a23 * z
+					+ a33;
+				return result > 0.0 ? result : 0.0;
+			}
+		};
+
+		enum VertexKind {
+			KIND_MANIFOLD, //Interior vertex with a single set of attributes
+			KIND_BORDER, //On an open edge. Can only slide along the border.
+			KIND_SEAM, //Two attribute sets (UV or normal seam). Can only slide along the seam.
+			KIND_LOCKED //Corners, seam junctions and other cases that are never collapsed
+		};
+
+		struct Collapse {
+			unsigned int from; //Position group
+			unsigned int to;
+			unsigned int fromVertex; //Attribute vertex the edge was found on
+			unsigned int toVertex;
+			float cost;
+		};
+
+		struct PositionHash {
+			size_t operator()(const glm::vec3& p) const {
+				uint32_t bits[3];
+				memcpy(bits, &p, sizeof(bits));
+				return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+			}
+		};
+
+		inline uint64_t edgeKey(unsigned int a, unsigned int b) {
+			return ((uint64_t)a << 32) | b;
+		}
+	}
+
+	/// <summary>
+	/// Iterative edge collapse driven by quadric error (Garland and Heckbert 1997).
+	/// Each pass scores every edge, then applies the cheapest collapses whose neighbourhoods do not overlap.
+	/// </summary>
+	/// <param name="meshData">Triangle list to simplify</param>
+	/// <param name="targetRatio">Fraction of triangles to keep, 0-1</param>
+	/// <param name="maxError">Collapses whose error bound exceeds this are not performed</param>
+	/// <param name="resultError">Optional. Receives the largest error bound of any performed collapse.</param>
+	/// <returns>Simplified mesh with unused vertices removed</returns>
+	MeshData simplifyMesh(const MeshData& meshData, float targetRatio, float maxError, float* resultError) {
+		//Unwelded input (e.g. straight from Assimp) would make every edge a border
+		MeshData result = meshData;
+		weldVertices(&result);
+		float error = 0.0f;
+		size_t numVertices = result.vertices.size();
+		size_t numTriangles = result.indices.size() / 3;
+		size_t targetTriangles = (size_t)ceilf(glm::clamp(targetRatio, 0.0f, 1.0f) * numTriangles);
+		result.indices.resize(numTriangles * 3);
+
+		//Attribute vertices sharing a position form a group. Wedges of a group are linked in a ring.
+		std::vector<unsigned int> group(numVertices);
+		std::vector<unsigned int> wedgeNext(numVertices);
+		std::vector<unsigned int> wedgeCount(numVertices, 0);
+		{
+			std::unordered_map<glm::vec3, unsigned int, PositionHash> positions;
+			positions.reserve(numVertices);
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				auto inserted = positions.emplace(result.vertices[v].pos, (unsigned int)v);
+				unsigned int g = inserted.first->second;
+				group[v] = g;
+				wedgeCount[g]++;
+				if (inserted.second) {
+					wedgeNext[v] = (unsigned int)v;
+				}
+				else {
+					wedgeNext[v] = wedgeNext[g];
+					wedgeNext[g] = (unsigned int)v;
+				}
+			}
+		}
+
+		std::unordered_set<uint64_t> vertexEdges;
+		std::unordered_set<uint64_t> groupEdges;
+		auto buildEdges = [&]() {
+			vertexEdges.clear();
+			groupEdges.clear();
+			for (size_t i = 0; i < result.indices.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int a = result.indices[i + k];
+					unsigned int b = result.indices[i + (k + 1) % 3];
+					vertexEdges.insert(edgeKey(a, b));
+					groupEdges.insert(edgeKey(group[a], group[b]));
+				}
+			}
+		};
+		//Edge with no twin in either space is an open border. No twin between the same attribute vertices, but a twin
+		//between the same positions, is a seam.
+		auto isBorderEdge = [&](unsigned int ga, unsigned int gb) {
+			return groupEdges.count(edgeKey(ga, gb)) + groupEdges.count(edgeKey(gb, ga)) < 2;
+		};
+		auto isSeamEdge = [&](unsigned int a, unsigned int b) {
+			return vertexEdges.count(edgeKey(a, b)) + vertexEdges.count(edgeKey(b, a)) < 2 && !isBorderEdge(group[a], group[b]);
+		};
+		auto hasVertexEdge = [&](unsigned int a, unsigned int b) {
+			return vertexEdges.count(edgeKey(a, b)) > 0 || vertexEdges.count(edgeKey(b, a)) > 0;
+		};
+
+		//Classify each group from the original topology
+		buildEdges();
+		std::vector<unsigned char> kind(numVertices, KIND_MANIFOLD);
+		{
+			std::vector<unsigned int> borderEdges(numVertices, 0);
+			std::vector<unsigned int> seamEdges(numVertices, 0);
+			for (uint64_t key : vertexEdges)
+			{
+				unsigned int a = (unsigned int)(key >> 32);
+				unsigned int b = (unsigned int)(key & 0xffffffffu);
+				if (vertexEdges.count(edgeKey(b, a))) {
+					continue;
+				}
+				if (isBorderEdge(group[a], group[b])) {
+					borderEdges[group[a]]++;
+					borderEdges[group[b]]++;
+				}
+				else {
+					seamEdges[group[a]]++;
+					seamEdges[group[b]]++;
+				}
+			}
+			for (size_t v = 0; v < numVertices; v++)
+			{
+				if (group[v] != v) {
+					continue;
+				}
+				if (wedgeCount[v] == 1 && seamEdges[v] == 0) {
+					kind[v] = borderEdges[v] == 0 ? KIND_MANIFOLD : (borderEdges[v] == 2 ? KIND_BORDER : KIND_LOCKED);
+				}
+				else if (wedgeCount[v] == 2 && borderEdges[v] == 0 && seamEdges[v] == 4) {
+					kind[v] = KIND_SEAM;
+				}
+				else {
+					kind[v] = KIND_LOCKED;
+				}
+			}
+		}
+
+		//Plane quadrics per group. Border and seam edges also get a plane perpendicular to their face so they keep their shape.
+		std::vector<Quadric> quadrics(numVertices);
+		for (size_t i = 0; i < result.indices.size(); i += 3)
+		{
+			unsigned int v[3] = { result.indices[i], result.indices[i + 1], result.indices[i + 2] };
+			const glm::vec3& p0 = result.vertices[v[0]].pos;
+			const glm::vec3& p1 = result.vertices[v[1]].pos;
+			const glm::vec3& p2 = result.vertices[v[2]].pos;
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float length = glm::length(normal);
+			if (length <= 0.0f) {
+				continue;
+			}
+			normal /= length;
+			Quadric q;
+			q.addPlane(normal, -glm::dot(normal, p0));
+			for (int k = 0; k < 3; k++)
+			{
+				quadrics[group[v[k]]].add(q);
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = v[k];
+				unsigned int b = v[(k + 1) % 3];
+				if (vertexEdges.count(edgeKey(b, a))) {
+					continue;
+				}
+				const glm::vec3& pa = result.vertices[a].pos;
+				glm::vec3 edge = result.vertices[b].pos - pa;
+				glm::vec3 edgeNormal = glm::cross(edge, normal);
+				float edgeNormalLength = glm::length(edgeNormal);
+				if (edgeNormalLength <= 0.0f) {
+					continue;
+				}
+				edgeNormal /= edgeNormalLength;
+				Quadric edgeQuadric;
+				edgeQuadric.addPlane(edgeNormal, -glm::dot(edgeNormal, pa));
+				quadrics[group[a]].add(edgeQuadric);
+				quadrics[group[b]].add(edgeQuadric);
+			}
+		}
+
+		std::vector<unsigned int> remap(numVertices);
+		for (size_t v = 0; v < numVertices; v++)
+		{
+			remap[v] = (unsigned int)v;
+		}
+		std::vector<unsigned int> adjacencyOffsets(numVertices + 1);
+		std::vector<unsigned int> adjacency;
+		std::vector<Collapse> collapses;
+		std::vector<bool> touched(numVertices);
+		const double maxCost = (double)maxError * maxError;
+
+		while (numTriangles > targetTriangles) {
+			//Group -> triangle adjacency for the current index buffer
+			std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+			for (size_t i = 0; i < result.indices.size(); i++)
+			{
+				adjacencyOffsets[group[result.indices[i]] + 1]++;
+			}
+			for (size_t g = 0; g < numVertices; g++)
+			{
+				adjacencyOffsets[g + 1] += adjacencyOffsets[g];
+			}
+			adjacency.resize(result.indices.size());
+			{
+				std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+				for (size_t i = 0; i < result.indices.size(); i++)
+				{
+					adjacency[fill[group[result.indices[i]]]++] = (unsigned int)(i / 3);
+				}
+			}
+			buildEdges();
+
+			//Score both directions of every edge that is allowed to collapse
+			collapses.clear();
+			for (size_t i = 0; i < result.indices.size(); i += 3)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					for (int dir = 0; dir < 2; dir++)
+					{
+						unsigned int a = result.indices[i + (dir == 0 ? k : (k + 1) % 3)];
+						unsigned int b = result.indices[i + (dir == 0 ? (k + 1) % 3 : k)];
+						unsigned int u = group[a];
+						unsigned int v = group[b];
+						bool allowed = false;
+						switch (kind[u]) {
+						case KIND_MANIFOLD:
+							allowed = true;
+							break;
+						case KIND_BORDER:
+							allowed = kind[v] != KIND_MANIFOLD && isBorderEdge(u, v);
+							break;
+						case KIND_SEAM:
+							allowed = kind[v] != KIND_MANIFOLD && isSeamEdge(a, b);
+							break;
+						default:
+							break;
+						}
+						if (!allowed) {
+							continue;
+						}
+						Quadric q = quadrics[u];
+						q.add(quadrics[v]);
+						double cost = q.evaluate(result.vertices[v].pos);
+						if (cost > maxCost) {
+							continue;
+						}
+						collapses.push_back({ u, v, a, b, (float)cost });
+					}
+				}
+			}
+			std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+
+			std::fill(touched.begin(), touched.end(), false);
+			size_t numCollapsed = 0;
+			size_t estimatedTriangles = numTriangles;
+			for (size_t c = 0; c < collapses.size() && estimatedTriangles > targetTriangles; c++)
+			{
+				const Collapse& collapse = collapses[c];
+				unsigned int u = collapse.from;
+				unsigned int v = collapse.to;
+				if (touched[u] || touched[v]) {
+					continue;
+				}
+
+				//Pair each wedge of u with a wedge of v it shares an edge with
+				unsigned int wedgeTargets[2] = { collapse.toVertex, collapse.toVertex };
+				unsigned int wedges[2] = { collapse.fromVertex, wedgeNext[collapse.fromVertex] };
+				if (kind[u] == KIND_SEAM) {
+					bool found = false;
+					unsigned int w = v;
+					do {
+						if (w != collapse.toVertex && hasVertexEdge(wedges[1], w)) {
+							wedgeTargets[1] = w;
+							found = true;
+						}
+						w = wedgeNext[w];
+					} while (w != v && !found);
+					if (!found && !hasVertexEdge(wedges[1], collapse.toVertex)) {
+						continue;
+					}
+				}
+
+				//Reject collapses that would flip a neighbouring triangle
+				const glm::vec3& target = result.vertices[v].pos;
+				bool flipped = false;
+				size_t removed = 0;
+				for (unsigned int t = adjacencyOffsets[u]; t < adjacencyOffsets[u + 1] && !flipped; t++)
+				{
+					const unsigned int* tri = &result.indices[adjacency[t] * 3];
+					glm::vec3 before[3];
+					glm::vec3 after[3];
+					bool hasV = false;
+					for (int k = 0; k < 3; k++)
+					{
+						before[k] = result.vertices[tri[k]].pos;
+						after[k] = group[tri[k]] == u ? target : before[k];
+						hasV = hasV || group[tri[k]] == v;
+					}
+					if (hasV) {
+						removed++;
+						continue;
+					}
+					glm::vec3 n0 = glm::cross(before[1] - before[0], before[2] - before[0]);
+					glm::vec3 n1 = glm::cross(after[1] - after[0], after[2] - after[0]);
+					flipped = glm::dot(n0, n1) <= 0.25f * glm::length(n0) * glm::length(n1);
+				}
+				if (flipped) {
+					continue;
+				}
+
+				remap[wedges[0]] = wedgeTargets[0];
+				if (kind[u] == KIND_SEAM) {
+					remap[wedges[1]] = wedgeTargets[1];
+				}
+				quadrics[v].add(quadrics[u]);
+				error = glm::max(error, sqrtf(collapse.cost));
+				//Lock the whole one ring, the adjacency and flip tests above are only valid for untouched neighbourhoods
+				for (unsigned int t = adjacencyOffsets[u]; t < adjacencyOffsets[u + 1]; t++)
+				{
+					const unsigned int* tri = &result.indices[adjacency[t] * 3];
+					touched[group[tri[0]]] = touched[group[tri[1]]] = touched[group[tri[2]]] = true;
+				}
+				estimatedTriangles -= glm::min(removed, estimatedTriangles);
+				numCollapsed++;
+			}
+			if (numCollapsed == 0) {
+				break;
+			}
+
+			//Apply the remap and drop triangles that became degenerate
+			size_t write = 0;
+			for (size_t i = 0; i < result.indices.size(); i += 3)
+			{
+				unsigned int a = remap[result.indices[i]];
+				unsigned int b = remap[result.indices[i + 1]];
+				unsigned int c = remap[result.indices[i + 2]];
+				if (group[a] == group[b] || group[b] == group[c] || group[a] == group[c]) {
+					continue;
+				}
+				result.indices[write++] = a;
+				result.indices[write++] = b;
+				result.indices[write++] = c;
+			}
+			result.indices.resize(write);
+			numTriangles = write / 3;
+		}
+
+		optimizeVertexFetch(&result);
+		if (resultError) {
+			*resultError = error;
+		}
+		return result;
+	}
+
+	std::vector<LODLevel> generateLODs(const MeshData& meshData, const std::vector<float>& ratios) {
+		std::vector<LODLevel> levels(ratios.size());
+		const MeshData* source = &meshData;
+		size_t sourceTriangles = meshData.indices.size() / 3;
+		float previousError = 0.0f;
+		for (size_t i = 0; i < ratios.size(); i++)
+		{
+			//Ratios are relative to the original mesh, but each level starts from the previous one
+			size_t currentTriangles = source->indices.size() / 3;
+			float ratio = currentTriangles > 0 ? (ratios[i] * sourceTriangles) / currentTriangles : 1.0f;
+			float levelError = 0.0f;
+			levels[i].meshData = simplifyMesh(*source, ratio, 1e30f, &levelError);
+			//Errors compound across levels, keep the bound conservative
+			levels[i].error = previousError + levelError;
+			previousError = levels[i].error;
+			source = &levels[i].meshData;
+		}
+		return levels;
+	}
+}
@@ -0,0 +1,22 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include <vector>
+
+namespace ew {
+	struct LODLevel {
+		MeshData meshData;
+		float error = 0.0f; //Conservative bound on how far the surface moved, in mesh units
+	};
+
+	//Quadric error metric simplification by half edge collapse. Vertices keep their original attributes,
+	//and UV/normal seams and open borders can only collapse along themselves, so seams and silhouettes survive.
+	//targetRatio is the fraction of triangles to keep. Stops early if the next collapse would exceed maxError.
+	MeshData simplifyMesh(const MeshData& meshData, float targetRatio, float maxError = 1e30f, float* resultError = nullptr);
+
+	//Generates one level per ratio, each simplified from the previous level. Level 0 is not included.
+	std::vector<LODLevel> generateLODs(const MeshData& meshData, const std::vector<float>& ratios);
+}
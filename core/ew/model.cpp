@@ -3,62 +3,332 @@
 */
 
 #include "model.h"
+#include "meshCache.h"
+#include "jobSystem.h"
+#include "culling.h"
+#include "profiler.h"
+#include <stdio.h>
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
 #include <assimp/scene.h>
 #include <glm/glm.hpp>
+#include <string.h>
 
 namespace ew {
-	ew::Mesh processAiMesh(aiMesh* aiMesh);
+	void processAiMesh(const aiMesh* aiMesh, ew::MeshData* meshData);
 
-	Model::Model(const std::string& filePath)
+	//Import settings that change the converted output. Stored in the mesh cache so that
+	//changing them invalidates previously written caches.
+	static uint32_t getCacheSettingsKey(const ModelSettings& settings) {
+		uint32_t key = aiProcess_Triangulate;
+		if (settings.optimizeMeshes) {
+			key |= 1u << 31;
+		}
+		return key;
+	}
+
+	Model::Model(const std::string& filePath, const ModelSettings& settings)
+	{
+		EW_PROFILE_SCOPE("Model::Model");
+		if (settings.lodRatios.empty()) {
+			m_arena = settings.arena;
+		}
+		std::string cachePath = getMeshCachePath(filePath);
+		uint32_t settingsKey = getCacheSettingsKey(settings);
+		if (settings.useMeshCache) {
+			//Warm start: upload straight from the mapped cache without touching Assimp
+			MeshCache cache;
+			if (cache.open(cachePath, filePath, settingsKey)) {
+				if (settings.lodRatios.empty()) {
+					for (size_t i = 0; i < cache.getNumMeshes(); i++)
+					{
+						loadMesh(cache.getVertices(i), cache.getNumVertices(i), cache.getIndices(i), cache.getNumIndices(i));
+					}
+				}
+				else {
+					//The simplifier needs owned MeshData, so LOD models copy out of the mapping
+					std::vector<ew::MeshData> meshData(cache.getNumMeshes());
+					for (size_t i = 0; i < cache.getNumMeshes(); i++)
+					{
+						meshData[i].vertices.assign(cache.getVertices(i), cache.getVertices(i) + cache.getNumVertices(i));
+						meshData[i].indices.assign(cache.getIndices(i), cache.getIndices(i) + cache.getNumIndices(i));
+					}
+					loadMeshes(meshData, settings);
+				}
+				return;
+			}
+		}
+
+		std::vector<ew::MeshData> meshData;
+		if (!importModel(filePath, &meshData, settings.optimizeMeshes, &m_optimizationStats)) {
+			return;
+		}
+		loadMeshes(meshData, settings);
+		if (settings.useMeshCache) {
+			EW_PROFILE_SCOPE("writeMeshCache");
+			writeMeshCache(cachePath, filePath, settingsKey, meshData);
+		}
+	}
+
+	/// <summary>
+	/// Reads a model file with Assimp and converts every mesh concurrently. Only the GL upload has to stay on the context thread.
+	/// </summary>
+	/// <param name="filePath">Any format Assimp can read</param>
+	/// <param name="meshData">One entry per mesh in the file</param>
+	/// <param name="optimize">Run optimizeMesh on each mesh</param>
+	/// <param name="optimizationStats">If not null and optimize is set, receives the stats of each mesh</param>
+	/// <returns>False if Assimp failed to read the file</returns>
+	bool importModel(const std::string& filePath, std::vector<MeshData>* meshData, bool optimize, std::vector<MeshOptimizationStats>* optimizationStats)
 	{
 		Assimp::Importer importer;
-		const aiScene* aiScene = importer.ReadFile(filePath, aiProcess_Triangulate);
-		for (size_t i = 0; i < aiScene->mNumMeshes; i++)
+		const aiScene* aiScene = nullptr;
+		{
+			EW_PROFILE_SCOPE("Assimp::ReadFile");
+			aiScene = importer.ReadFile(filePath, aiProcess_Triangulate);
+		}
+		if (aiScene == NULL) {
+			printf("Failed to load model %s: %s\n", filePath.c_str(), importer.GetErrorString());
+			return false;
+		}
+		meshData->assign(aiScene->mNumMeshes, MeshData());
+		if (optimize && optimizationStats != nullptr) {
+			optimizationStats->resize(aiScene->mNumMeshes);
+		}
+		JobSystem::global().parallelFor(aiScene->mNumMeshes, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				processAiMesh(aiScene->mMeshes[i], &(*meshData)[i]);
+				if (optimize) {
+					MeshOptimizationStats stats = optimizeMesh(&(*meshData)[i]);
+					if (optimizationStats != nullptr) {
+						(*optimizationStats)[i] = stats;
+					}
+				}
+			}
+		});
+		return true;
+	}
+
+	bool loadModelData(const std::string& filePath, const ModelSettings& settings, std::vector<MeshData>* meshData)
+	{
+		EW_PROFILE_SCOPE("loadModelData");
+		std::string cachePath = getMeshCachePath(filePath);
+		uint32_t settingsKey = getCacheSettingsKey(settings);
+		if (settings.useMeshCache) {
+			MeshCache cache;
+			if (cache.open(cachePath, filePath, settingsKey)) {
+				meshData->assign(cache.getNumMeshes(), MeshData());
+				for (size_t i = 0; i < cache.getNumMeshes(); i++)
+				{
+					(*meshData)[i].vertices.assign(cache.getVertices(i), cache.getVertices(i) + cache.getNumVertices(i));
+					(*meshData)[i].indices.assign(cache.getIndices(i), cache.getIndices(i) + cache.getNumIndices(i));
+				}
+				return true;
+			}
+		}
+		if (!importModel(filePath, meshData, settings.optimizeMeshes)) {
+			return false;
+		}
+		if (settings.useMeshCache) {
+			EW_PROFILE_SCOPE("writeMeshCache");
+			writeMeshCache(cachePath, filePath, settingsKey, *meshData);
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Uploads converted meshes. With LODs enabled, levels are simplified in parallel before uploading.
+	/// </summary>
+	void Model::loadMeshes(const std::vector<MeshData>& meshData, const ModelSettings& settings)
+	{
+		if (settings.lodRatios.empty()) {
+			for (size_t i = 0; i < meshData.size(); i++)
+			{
+				loadMesh(meshData[i].vertices.data(), (unsigned int)meshData[i].vertices.size(), meshData[i].indices.data(), (unsigned int)meshData[i].indices.size());
+			}
+			return;
+		}
+		std::vector<std::vector<LODLevel>> levels(meshData.size());
+		JobSystem::global().parallelFor(meshData.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				levels[i] = generateLODs(meshData[i], settings.lodRatios);
+			}
+		});
+		m_lodMeshes.resize(meshData.size());
+		for (size_t i = 0; i < meshData.size(); i++)
+		{
+			m_lodMeshes[i].load(meshData[i], levels[i]);
+		}
+	}
+
+	//Uploads one mesh of a model without LODs, into the arena if there is one.
+	//Meshes the arena can't take (too many vertices for 16 bit indices) get their own buffers.
+	void Model::loadMesh(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices)
+	{
+		if (m_arena != nullptr) {
+			GeometryHandle handle = m_arena->allocate(vertices, numVertices, indices, numIndices);
+			if (handle != INVALID_GEOMETRY) {
+				m_arenaMeshes.push_back(handle);
+				m_arenaBounds.push_back(computeBounds(vertices, numVertices));
+				return;
+			}
+		}
+		m_meshes.emplace_back();
+		m_meshes.back().load(vertices, numVertices, indices, numIndices);
+	}
+
+	void Model::unload()
+	{
+		for (size_t i = 0; i < m_arenaMeshes.size(); i++)
+		{
+			m_arena->free(m_arenaMeshes[i]);
+		}
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			m_meshes[i].unload();
+		}
+		for (size_t i = 0; i < m_lodMeshes.size(); i++)
+		{
+			m_lodMeshes[i].unload();
+		}
+		m_arenaMeshes.clear();
+		m_arenaBounds.clear();
+		m_meshes.clear();
+		m_lodMeshes.clear();
+	}
+
+	size_t Model::getMemoryUsage() const
+	{
+		size_t bytes = 0;
+		for (size_t i = 0; i < m_arenaMeshes.size(); i++)
 		{
-			aiMesh* aiMesh = aiScene->mMeshes[i];
-			m_meshes.push_back(processAiMesh(aiMesh));
+			const GeometryRange& range = m_arena->getRange(m_arenaMeshes[i]);
+			bytes += range.numVertices * sizeof(Vertex) + range.numIndices * m_arena->getIndexSize();
 		}
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			bytes += m_meshes[i].getMemoryUsage();
+		}
+		for (size_t i = 0; i < m_lodMeshes.size(); i++)
+		{
+			bytes += m_lodMeshes[i].getMemoryUsage();
+		}
+		return bytes;
 	}
 
 	void Model::draw()
 	{
+		if (!m_arenaMeshes.empty()) {
+			m_arena->bind();
+			for (size_t i = 0; i < m_arenaMeshes.size(); i++)
+			{
+				m_arena->draw(m_arenaMeshes[i]);
+			}
+		}
 		for (size_t i = 0; i < m_meshes.size(); i++)
 		{
 			m_meshes[i].draw();
 		}
+		for (size_t i = 0; i < m_lodMeshes.size(); i++)
+		{
+			m_lodMeshes[i].draw(0);
+		}
 	}
 
-	glm::vec3 convertAIVec3(const aiVector3D& v) {
-		return glm::vec3(v.x, v.y, v.z);
+	void Model::draw(const Camera& camera, const glm::mat4& modelMatrix, float screenHeight, float maxPixelError)
+	{
+		Frustum frustum = extractFrustum(camera);
+		if (!m_arenaMeshes.empty()) {
+			m_arena->bind();
+			for (size_t i = 0; i < m_arenaMeshes.size(); i++)
+			{
+				if (isVisible(frustum, transformBounds(m_arenaBounds[i], modelMatrix))) {
+					m_arena->draw(m_arenaMeshes[i]);
+				}
+			}
+		}
+		for (size_t i = 0; i < m_meshes.size(); i++)
+		{
+			if (!isVisible(frustum, transformBounds(m_meshes[i].getBounds(), modelMatrix))) {
+				continue;
+			}
+			m_meshes[i].draw();
+		}
+		for (size_t i = 0; i < m_lodMeshes.size(); i++)
+		{
+			if (!isVisible(frustum, transformBounds(m_lodMeshes[i].getBounds(), modelMatrix))) {
+				continue;
+			}
+			m_lodMeshes[i].draw(m_lodMeshes[i].selectLevel(camera, modelMatrix, screenHeight, maxPixelError));
+		}
 	}
 
-	//Utility functions local to this file
-	ew::Mesh processAiMesh(aiMesh* aiMesh) {
-		ew::MeshData meshData;
-		for (size_t i = 0; i < aiMesh->mNumVertices; i++)
+	/// <summary>
+	/// Interleaves Assimp's separate position/normal/uv arrays into ew::Vertex.
+	/// Attribute checks are resolved at compile time so the loop body is straight copies.
+	/// </summary>
+	template<bool HasNormals, bool HasUVs>
+	static void copyAiVertices(const aiMesh* aiMesh, ew::Vertex* vertices) {
+		const aiVector3D* positions = aiMesh->mVertices;
+		const aiVector3D* normals = aiMesh->mNormals;
+		const aiVector3D* uvs = aiMesh->mTextureCoords[0];
+		const size_t numVertices = aiMesh->mNumVertices;
+		for (size_t i = 0; i < numVertices; i++)
 		{
-			ew::Vertex vertex;
-			vertex.pos = convertAIVec3(aiMesh->mVertices[i]);
-			if (aiMesh->HasNormals()) {
-				vertex.normal = convertAIVec3(aiMesh->mNormals[i]);
+			vertices[i].pos = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+			if (HasNormals) {
+				vertices[i].normal = glm::vec3(normals[i].x, normals[i].y, normals[i].z);
+			}
+			else {
+				vertices[i].normal = glm::vec3(0.0f);
 			}
+			if (HasUVs) {
+				vertices[i].uv = glm::vec2(uvs[i].x, uvs[i].y);
+			}
+			else {
+				vertices[i].uv = glm::vec2(0.0f);
+			}
+		}
+	}
+
+	//Utility functions local to this file
+	void processAiMesh(const aiMesh* aiMesh, ew::MeshData* meshData) {
+		EW_PROFILE_SCOPE("processAiMesh");
+		meshData->vertices.resize(aiMesh->mNumVertices);
+		ew::Vertex* vertices = meshData->vertices.data();
+		if (aiMesh->HasNormals()) {
 			if (aiMesh->HasTextureCoords(0)) {
-				vertex.uv = glm::vec2(convertAIVec3(aiMesh->mTextureCoords[0][i]));
+				copyAiVertices<true, true>(aiMesh, vertices);
+			}
+			else {
+				copyAiVertices<true, false>(aiMesh, vertices);
+			}
+		}
+		else {
+			if (aiMesh->HasTextureCoords(0)) {
+				copyAiVertices<false, true>(aiMesh, vertices);
+			}
+			else {
+				copyAiVertices<false, false>(aiMesh, vertices);
 			}
-			meshData.vertices.push_back(vertex);
 		}
-		//Convert faces to indices
+
+		//Convert faces to indices. Count first so the index array is allocated exactly once.
+		size_t numIndices = 0;
 		for (size_t i = 0; i < aiMesh->mNumFaces; i++)
 		{
-			for (size_t j = 0; j < aiMesh->mFaces[i].mNumIndices; j++)
-			{
-				meshData.indices.push_back(aiMesh->mFaces[i].mIndices[j]);
-			}
+			numIndices += aiMesh->mFaces[i].mNumIndices;
+		}
+		meshData->indices.resize(numIndices);
+		unsigned int* indices = meshData->indices.data();
+		for (size_t i = 0; i < aiMesh->mNumFaces; i++)
+		{
+			const aiFace& face = aiMesh->mFaces[i];
+			memcpy(indices, face.mIndices, sizeof(unsigned int) * face.mNumIndices);
+			indices += face.mNumIndices;
 		}
-		return ew::Mesh(meshData);
 	}
 
 }
@@ -5,14 +5,46 @@
 #pragma once
 #include "mesh.h"
 #include "shader.h"
+#include "meshOptimizer.h"
+#include "lodMesh.h"
+#include "camera.h"
+#include "geometryArena.h"
 #include <vector>
 
 namespace ew {
+	struct ModelSettings {
+		bool useMeshCache = true; //Read/write a binary cache of converted meshes next to the source file
+		bool optimizeMeshes = false; //Weld vertices and reorder for vertex cache/overdraw/fetch. See meshOptimizer.h
+		std::vector<float> lodRatios; //If not empty, each mesh gets an LOD chain simplified to these triangle ratios, e.g. { 0.5f, 0.25f }
+		GeometryArena* arena = nullptr; //If set, meshes are suballocated from this arena instead of getting their own buffers. Ignored with lodRatios.
+	};
+
+	//Assimp import and conversion only, no GL calls. Model uses this before uploading.
+	bool importModel(const std::string& filePath, std::vector<MeshData>* meshData, bool optimize = false, std::vector<MeshOptimizationStats>* optimizationStats = nullptr);
+	//Meshes as Model would upload them: from the mesh cache if it is current, otherwise through importModel, writing the cache
+	//afterwards when settings.useMeshCache is on. No GL calls, so it can run on a worker thread. Ignores lodRatios and arena.
+	bool loadModelData(const std::string& filePath, const ModelSettings& settings, std::vector<MeshData>* meshData);
+
 	class Model {
 	public:
-		Model(const std::string& filePath);
+		Model(const std::string& filePath, const ModelSettings& settings = ModelSettings());
 		void draw();
+		//Skips meshes outside the camera's frustum and draws the rest at the LOD level selected for this camera
+		void draw(const Camera& camera, const glm::mat4& modelMatrix, float screenHeight, float maxPixelError = 1.0f);
+		//Per mesh ACMR/ATVR before and after optimization. Empty if optimizeMeshes is off or the model came from the mesh cache.
+		inline const std::vector<MeshOptimizationStats>& getOptimizationStats()const { return m_optimizationStats; }
+		//Deletes the model's GL objects and frees its arena allocations. Models are copyable, so this is never done implicitly.
+		void unload();
+		//GPU bytes of vertices and indices, LOD levels included
+		size_t getMemoryUsage()const;
 	private:
+		void loadMeshes(const std::vector<MeshData>& meshData, const ModelSettings& settings);
+		void loadMesh(const Vertex* vertices, unsigned int numVertices, const unsigned int* indices, unsigned int numIndices);
 		std::vector<ew::Mesh> m_meshes;
+		GeometryArena* m_arena = nullptr; //Owned by the caller
+		std::vector<GeometryHandle> m_arenaMeshes; //Meshes that went into m_arena
+		std::vector<Bounds> m_arenaBounds;
+		std::vector<ew::LODMesh> m_lodMeshes; //Used instead of m_meshes when lodRatios is set
+		std::vector<MeshOptimizationStats> m_optimizationStats;
 	};
-}
\ No newline at end of file
+}
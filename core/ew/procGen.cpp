@@ -3,7 +3,10 @@
 */
 
 #include "procGen.h"
+#include "meshOptimizer.h"
+#include "jobSystem.h"
 #include <stdlib.h>
+#include <algorithm>
 #include <glm/glm.hpp>
 #include <glm/gtc/constants.hpp>
 
@@ -48,7 +51,8 @@ namespace ew {
 	/// </summary>
 	/// <param name="size">Total width, height, depth</param>
 	/// <param name="mesh">MeshData struct to fill. Will be cleared.</param>
-	MeshData createCube(float size) {
+	/// <param name="optimize">Run ew::optimizeMesh on the result</param>
+	MeshData createCube(float size, bool optimize) {
 		MeshData mesh;
 		mesh.vertices.reserve(24); //6 x 4 vertices
 		mesh.indices.reserve(36); //6 x 6 indices
@@ -58,101 +62,213 @@ namespace ew {
 		createCubeFace(vec3{ -1.0f,+0.0f,+0.0f }, size, &mesh); //Left
 		createCubeFace(vec3{ +0.0f,-1.0f,+0.0f }, size, &mesh); //Bottom
 		createCubeFace(vec3{ +0.0f,+0.0f,-1.0f }, size, &mesh); //Back
+		if (optimize) {
+			optimizeMesh(&mesh);
+		}
 		return mesh;
 	}
-	MeshData createPlane(float width, float height, int subdivisions)
+	/// <summary>
+	/// Creates a flat grid on the XZ plane facing +Y
+	/// </summary>
+	/// <param name="width">Size along X</param>
+	/// <param name="height">Size along Z</param>
+	/// <param name="subdivisions">Quads per side</param>
+	/// <param name="optimize">Run ew::optimizeMesh on the result</param>
+	MeshData createPlane(float width, float height, int subdivisions, bool optimize)
 	{
-		//VERTICES
 		MeshData mesh;
-		int columns = subdivisions + 1;
-		for (size_t row = 0; row <= subdivisions; row++)
+		MeshSize size = getPlaneSize(subdivisions);
+		mesh.vertices.resize(size.numVertices);
+		mesh.indices.resize(size.numIndices);
+		writePlane(width, height, subdivisions, mesh.vertices.data(), mesh.indices.data());
+		if (optimize) {
+			optimizeMesh(&mesh);
+		}
+		return mesh;
+	}
+	/// <summary>
+	/// Creates a UV sphere with poles on the Y axis
+	/// </summary>
+	/// <param name="radius">Sphere radius</param>
+	/// <param name="subdivisions">Number of rows and columns</param>
+	/// <param name="optimize">Run ew::optimizeMesh on the result</param>
+	MeshData createSphere(float radius, int subdivisions, bool optimize)
+	{
+		MeshData mesh;
+		MeshSize size = getSphereSize(subdivisions);
+		mesh.vertices.resize(size.numVertices);
+		mesh.indices.resize(size.numIndices);
+		writeSphere(radius, subdivisions, mesh.vertices.data(), mesh.indices.data());
+		if (optimize) {
+			optimizeMesh(&mesh);
+		}
+		return mesh;
+	}
+
+	//Vertices per parallelFor chunk. Smaller grids are generated on the calling thread.
+	static const size_t ROW_GRAIN_VERTICES = 8192;
+	static size_t getRowGrain(unsigned int columns) {
+		return std::max<size_t>(1, ROW_GRAIN_VERTICES / columns);
+	}
+
+	MeshSize getPlaneSize(int subdivisions)
+	{
+		unsigned int columns = subdivisions + 1;
+		return { columns * columns, (unsigned int)subdivisions * subdivisions * 6 };
+	}
+
+	MeshSize getSphereSize(int subdivisions)
+	{
+		unsigned int columns = subdivisions + 1;
+		unsigned int sideRows = subdivisions > 2 ? subdivisions - 2 : 0;
+		//Two caps of one triangle per column, plus two triangles per side quad
+		return { columns * columns, (unsigned int)subdivisions * 6 + sideRows * subdivisions * 6 };
+	}
+
+	/// <summary>
+	/// Writes the same vertices and indices as createPlane, without allocating the mesh
+	/// </summary>
+	/// <param name="vertices">getPlaneSize(subdivisions).numVertices vertices</param>
+	/// <param name="indices">getPlaneSize(subdivisions).numIndices indices</param>
+	/// <param name="baseVertex">Added to every index</param>
+	void writePlane(float width, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex)
+	{
+		unsigned int columns = subdivisions + 1;
+		//Every row shares the same u and x
+		std::vector<float> u(columns);
+		std::vector<float> x(columns);
+		for (unsigned int col = 0; col < columns; col++)
 		{
-			for (size_t col = 0; col <= subdivisions; col++)
+			u[col] = (float)col / subdivisions;
+			x[col] = -width / 2 + width * u[col];
+		}
+		size_t rowGrain = getRowGrain(columns);
+		JobSystem::global().parallelFor(columns, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++)
 			{
-				Vertex v;                                                                                                                                                                                                                                                                                                                                                                                                    
-				v.uv.x = ((float)col / subdivisions);
-				v.uv.y = ((float)row / subdivisions);
-				v.pos.x = -width/2 + width * v.uv.x;
-				v.pos.y = 0;
-				v.pos.z = height/2 -height * v.uv.y;
-				v.normal = vec3(0, 1, 0);
-				mesh.vertices.push_back(v);
+				float v = (float)row / subdivisions;
+				float z = height / 2 - height * v;
+				Vertex* out = vertices + row * columns;
+				for (unsigned int col = 0; col < columns; col++)
+				{
+					Vertex vertex;
+					vertex.pos = vec3(x[col], 0.0f, z);
+					vertex.normal = vec3(0.0f, 1.0f, 0.0f);
+					vertex.uv = vec2(u[col], v);
+					out[col] = vertex;
+				}
 			}
-		}
-		//INDICES
-		for (size_t row = 0; row < subdivisions; row++)
-		{
-			for (size_t col = 0; col < subdivisions; col++)
+		}, rowGrain);
+		JobSystem::global().parallelFor(subdivisions, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++)
 			{
-				int start = row * columns + col;
-				mesh.indices.push_back(start);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns + 1);
-				mesh.indices.push_back(start + columns + 1);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start);
+				unsigned int* out = indices + row * subdivisions * 6;
+				for (unsigned int col = 0; col < (unsigned int)subdivisions; col++)
+				{
+					unsigned int start = baseVertex + (unsigned int)row * columns + col;
+					out[0] = start;
+					out[1] = start + 1;
+					out[2] = start + columns + 1;
+					out[3] = start + columns + 1;
+					out[4] = start + columns;
+					out[5] = start;
+					out += 6;
+				}
 			}
-		}
-		return mesh;
+		}, rowGrain);
 	}
-	MeshData createSphere(float radius, int subdivisions)
+
+	/// <summary>
+	/// Writes the same vertices and indices as createSphere, without allocating the mesh.
+	/// sin/cos are computed once per row and column instead of per vertex.
+	/// </summary>
+	/// <param name="vertices">getSphereSize(subdivisions).numVertices vertices</param>
+	/// <param name="indices">getSphereSize(subdivisions).numIndices indices</param>
+	/// <param name="baseVertex">Added to every index</param>
+	void writeSphere(float radius, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex)
 	{
-		MeshData mesh;
-		//VERTICES
+		unsigned int columns = subdivisions + 1;
 		float thetaStep = glm::two_pi<float>() / subdivisions;
 		float phiStep = glm::pi<float>() / subdivisions;
-		for (size_t row = 0; row <= subdivisions; row++)
+		std::vector<float> cosTheta(columns);
+		std::vector<float> sinTheta(columns);
+		std::vector<float> cosPhi(columns);
+		std::vector<float> sinPhi(columns);
+		std::vector<float> u(columns);
+		for (unsigned int i = 0; i < columns; i++)
 		{
-			float phi = row * phiStep;
-			for (size_t col = 0; col <= subdivisions; col++)
+			float theta = thetaStep * i;
+			float phi = i * phiStep;
+			cosTheta[i] = cosf(theta);
+			sinTheta[i] = sinf(theta);
+			cosPhi[i] = cosf(phi);
+			sinPhi[i] = sinf(phi);
+			u[i] = (float)i / subdivisions;
+		}
+
+		//VERTICES
+		size_t rowGrain = getRowGrain(columns);
+		JobSystem::global().parallelFor(columns, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; row++)
 			{
-				float theta = thetaStep * col;
-				Vertex v;
-				v.normal.x = cosf(theta) * sinf(phi);
-				v.normal.y = cosf(phi);
-				v.normal.z = sinf(theta) * sinf(phi);
-				v.pos = v.normal * radius;
-				v.uv.x = (float)col / subdivisions;
-				v.uv.y = 1.0 - ((float)row / subdivisions);
-				mesh.vertices.push_back(v);
+				float v = 1.0 - ((float)row / subdivisions);
+				Vertex* out = vertices + row * columns;
+				for (unsigned int col = 0; col < columns; col++)
+				{
+					Vertex vertex;
+					vertex.normal.x = cosTheta[col] * sinPhi[row];
+					vertex.normal.y = cosPhi[row];
+					vertex.normal.z = sinTheta[col] * sinPhi[row];
+					vertex.pos = vertex.normal * radius;
+					vertex.uv = vec2(u[col], v);
+					out[col] = vertex;
+				}
 			}
-		}
-		
+		}, rowGrain);
+
 		//INDICES
-		unsigned int columns = subdivisions + 1;
-		unsigned int sideStart = columns;
-		unsigned int poleStart = 0;
+		unsigned int* out = indices;
+		unsigned int sideStart = baseVertex + columns;
+		unsigned int poleStart = baseVertex;
 		//Top cap
-		for (size_t i = 0; i < subdivisions; i++)
+		for (unsigned int i = 0; i < (unsigned int)subdivisions; i++)
 		{
-			mesh.indices.push_back(sideStart + i);
-			mesh.indices.push_back(poleStart + i);
-			mesh.indices.push_back(sideStart +i+1);
+			out[0] = sideStart + i;
+			out[1] = poleStart + i;
+			out[2] = sideStart + i + 1;
+			out += 3;
 		}
 		//Rows of quads for sides
-		for (size_t row = 1; row < subdivisions - 1; row++)
-		{
-			for (size_t col = 0; col < subdivisions; col++)
+		unsigned int sideRows = subdivisions > 2 ? subdivisions - 2 : 0;
+		JobSystem::global().parallelFor(sideRows, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
 			{
-				unsigned int start = row * columns + col;
-				mesh.indices.push_back(start);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + columns);
-				mesh.indices.push_back(start + 1);
-				mesh.indices.push_back(start + columns + 1);
+				unsigned int row = (unsigned int)i + 1;
+				unsigned int* rowOut = out + i * subdivisions * 6;
+				for (unsigned int col = 0; col < (unsigned int)subdivisions; col++)
+				{
+					unsigned int start = baseVertex + row * columns + col;
+					rowOut[0] = start;
+					rowOut[1] = start + 1;
+					rowOut[2] = start + columns;
+					rowOut[3] = start + columns;
+					rowOut[4] = start + 1;
+					rowOut[5] = start + columns + 1;
+					rowOut += 6;
+				}
 			}
-		}
+		}, rowGrain);
+		out += (size_t)sideRows * subdivisions * 6;
 		//Bottom cap
-		poleStart = (columns * columns) - columns;
+		poleStart = baseVertex + (columns * columns) - columns;
 		sideStart = poleStart - columns;
-		for (size_t i = 0; i < subdivisions; i++)
+		for (unsigned int i = 0; i < (unsigned int)subdivisions; i++)
 		{
-			mesh.indices.push_back(sideStart + i);
-			mesh.indices.push_back(sideStart + i + 1);
-			mesh.indices.push_back(poleStart + i);
+			out[0] = sideStart + i;
+			out[1] = sideStart + i + 1;
+			out[2] = poleStart + i;
+			out += 3;
 		}
-		return mesh;
 	}
 	void createCylinderRing(MeshData* meshData, float radius, int subdivisions, float y, bool sideFacing) {
 		float thetaStep = two_pi<float>() / subdivisions;
@@ -175,9 +291,12 @@ namespace ew {
 			meshData->vertices.push_back(v);
 		}
 	}
-	MeshData createCylinder(float radius, float height, int subdivisions)
+	MeshData createCylinder(float radius, float height, int subdivisions, bool optimize)
 	{
 		MeshData mesh;
+		unsigned int columns = subdivisions + 1;
+		mesh.vertices.reserve(columns * 4 + 2); //4 rings + 2 cap centers
+		mesh.indices.reserve(columns * 12); //2 caps + side quads
 
 		//VERTICES
 		{
@@ -205,7 +324,6 @@ namespace ew {
 
 		//INDICES
 		{
-			int columns = subdivisions + 1;
 			//Top cap
 			for (size_t i = 0; i < columns; i++)
 			{
@@ -235,6 +353,9 @@ namespace ew {
 				mesh.indices.push_back(sideStart + i + 1);
 			}
 		}
+		if (optimize) {
+			optimizeMesh(&mesh);
+		}
 		return mesh;
 	}
 }
\ No newline at end of file
@@ -6,8 +6,23 @@
 #include "mesh.h"
 
 namespace ew {
-	MeshData createCube(float size);
-	MeshData createPlane(float width, float height, int subdivisions);
-	MeshData createSphere(float radius, int subdivisions);
-	MeshData createCylinder(float radius, float height, int subdivisions);
+	//optimize runs ew::optimizeMesh on the result (vertex cache, overdraw and fetch order)
+	MeshData createCube(float size, bool optimize = false);
+	MeshData createPlane(float width, float height, int subdivisions, bool optimize = false);
+	MeshData createSphere(float radius, int subdivisions, bool optimize = false);
+	MeshData createCylinder(float radius, float height, int subdivisions, bool optimize = false);
+
+	struct MeshSize {
+		unsigned int numVertices;
+		unsigned int numIndices;
+	};
+	//Exact vertex/index counts, for sizing caller owned buffers
+	MeshSize getPlaneSize(int subdivisions);
+	MeshSize getSphereSize(int subdivisions);
+
+	//Generate straight into caller owned buffers (e.g. a mapped GPU buffer) sized by getPlaneSize/getSphereSize.
+	//Rows are filled in parallel on the global job system. Each vertex is written once, whole, in order,
+	//which suits write-combined memory. baseVertex is added to every index.
+	void writePlane(float width, float height, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex = 0);
+	void writeSphere(float radius, int subdivisions, Vertex* vertices, unsigned int* indices, unsigned int baseVertex = 0);
 }
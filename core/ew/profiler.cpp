@@ -0,0 +1,488 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "profiler.h"
+#include "external/glad.h"
+#include <imgui.h>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+
+namespace ew {
+	static const uint32_t THREAD_BUFFER_CAPACITY = 1 << 14; //Events per thread between endFrame() calls
+	static const uint32_t MAX_ZONE_DEPTH = 64;
+	static const size_t NUM_GPU_FRAMES = 4; //Frames a GPU query may take before its results are dropped
+	static const size_t HISTORY_LENGTH = 240;
+	static const size_t MAX_CAPTURED_EVENTS = 1 << 22;
+	static const double AVERAGE_WEIGHT = 0.05;
+
+	uint64_t getProfilerTime() {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//Single producer ring. The owning thread writes events and publishes them with head,
+	//endFrame() reads up to head and hands the space back with tail.
+	struct Profiler::ThreadBuffer {
+		ProfileEvent events[THREAD_BUFFER_CAPACITY];
+		std::atomic<uint64_t> head{ 0 };
+		std::atomic<uint64_t> tail{ 0 };
+		std::atomic<uint64_t> dropped{ 0 };
+		std::thread::id threadId;
+		uint32_t thread = 0;
+		//Open zones, only touched by the owning thread. nullptr names were opened while disabled.
+		const char* names[MAX_ZONE_DEPTH];
+		uint64_t starts[MAX_ZONE_DEPTH];
+		uint32_t depth = 0;
+	};
+
+	struct Profiler::GpuFrame {
+		struct Zone {
+			const char* name;
+			unsigned int beginQuery;
+			unsigned int endQuery;
+			uint32_t depth;
+		};
+		std::vector<unsigned int> queries; //Timestamp query pool, grows as needed
+		unsigned int numQueries = 0;
+		std::vector<Zone> zones;
+		std::vector<int> open; //Index into zones of each open zone, -1 if opened while disabled
+		bool pending = false;
+	};
+
+	//Per thread cache of the last profiler that thread recorded to
+	static thread_local Profiler* t_profiler = nullptr;
+	static thread_local void* t_buffer = nullptr;
+
+	Profiler::~Profiler()
+	{
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			delete m_threads[i];
+		}
+		for (size_t i = 0; i < m_gpuFrames.size(); i++)
+		{
+			if (!m_gpuFrames[i]->queries.empty()) {
+				glDeleteQueries((GLsizei)m_gpuFrames[i]->queries.size(), m_gpuFrames[i]->queries.data());
+			}
+			delete m_gpuFrames[i];
+		}
+		if (t_profiler == this) {
+			t_profiler = nullptr;
+		}
+	}
+
+	Profiler& Profiler::global()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	Profiler::ThreadBuffer* Profiler::getThreadBuffer()
+	{
+		if (t_profiler == this) {
+			return (ThreadBuffer*)t_buffer;
+		}
+		std::thread::id threadId = std::this_thread::get_id();
+		std::lock_guard<std::mutex> lock(m_threadMutex);
+		ThreadBuffer* buffer = nullptr;
+		for (size_t i = 0; i < m_threads.size(); i++)
+		{
+			if (m_threads[i]->threadId == threadId) {
+				buffer = m_threads[i];
+				break;
+			}
+		}
+		if (buffer == nullptr) {
+			buffer = new ThreadBuffer();
+			buffer->threadId = threadId;
+			buffer->thread = (uint32_t)m_threads.size();
+			m_threads.push_back(buffer);
+		}
+		t_profiler = this;
+		t_buffer = buffer;
+		return buffer;
+	}
+
+	void Profiler::beginZone(const char* name)
+	{
+		ThreadBuffer* buffer = getThreadBuffer();
+		if (buffer->depth < MAX_ZONE_DEPTH) {
+			buffer->names[buffer->depth] = m_enabled.load(std::memory_order_relaxed) ? name : nullptr;
+			buffer->starts[buffer->depth] = getProfilerTime();
+		}
+		buffer->depth++;
+	}
+
+	void Profiler::endZone()
+	{
+		ThreadBuffer* buffer = getThreadBuffer();
+		if (buffer->depth == 0) {
+			return;
+		}
+		buffer->depth--;
+		uint32_t depth = buffer->depth;
+		if (depth >= MAX_ZONE_DEPTH || buffer->names[depth] == nullptr) {
+			return;
+		}
+		uint64_t head = buffer->head.load(std::memory_order_relaxed);
+		if (head - buffer->tail.load(std::memory_order_acquire) >= THREAD_BUFFER_CAPACITY) {
+			buffer->dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		ProfileEvent& event = buffer->events[head % THREAD_BUFFER_CAPACITY];
+		event.name = buffer->names[depth];
+		event.start = buffer->starts[depth];
+		event.end = getProfilerTime();
+		event.depth = depth;
+		event.thread = buffer->thread;
+		buffer->head.store(head + 1, std::memory_order_release);
+	}
+
+	void Profiler::beginGpuZone(const char* name)
+	{
+		if (m_gpuFrames.empty()) {
+			for (size_t i = 0; i < NUM_GPU_FRAMES; i++)
+			{
+				m_gpuFrames.push_back(new GpuFrame());
+			}
+		}
+		GpuFrame& frame = *m_gpuFrames[m_gpuFrameIndex];
+		if (!m_enabled) {
+			frame.open.push_back(-1);
+			return;
+		}
+		if (!m_gpuClockSynced) {
+			//Line GPU timestamps up with the CPU clock for the trace. Returns once earlier commands are submitted, without waiting for them.
+			GLint64 gpuTime = 0;
+			glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+			m_gpuClockOffset = (int64_t)getProfilerTime() - (int64_t)gpuTime;
+			m_gpuClockSynced = true;
+		}
+		if (frame.numQueries + 2 > frame.queries.size()) {
+			size_t oldSize = frame.queries.size();
+			frame.queries.resize(oldSize + 32);
+			glGenQueries(32, frame.queries.data() + oldSize);
+		}
+		GpuFrame::Zone zone;
+		zone.name = name;
+		zone.beginQuery = frame.numQueries++;
+		zone.endQuery = frame.numQueries++;
+		zone.depth = (uint32_t)frame.open.size();
+		glQueryCounter(frame.queries[zone.beginQuery], GL_TIMESTAMP);
+		frame.open.push_back((int)frame.zones.size());
+		frame.zones.push_back(zone);
+		frame.pending = true;
+	}
+
+	void Profiler::endGpuZone()
+	{
+		if (m_gpuFrames.empty()) {
+			return;
+		}
+		GpuFrame& frame = *m_gpuFrames[m_gpuFrameIndex];
+		if (frame.open.empty()) {
+			return;
+		}
+		int zone = frame.open.back();
+		frame.open.pop_back();
+		if (zone >= 0) {
+			glQueryCounter(frame.queries[frame.zones[zone].endQuery], GL_TIMESTAMP);
+		}
+	}
+
+	/// <summary>
+	/// Starts timing a frame. GPU zones from now on go into the next query set.
+	/// </summary>
+	void Profiler::beginFrame()
+	{
+		m_frameStart = getProfilerTime();
+		if (m_gpuFrames.empty()) {
+			return;
+		}
+		m_gpuFrameIndex = (m_gpuFrameIndex + 1) % m_gpuFrames.size();
+		GpuFrame& frame = *m_gpuFrames[m_gpuFrameIndex];
+		if (frame.pending) {
+			//Still not finished after NUM_GPU_FRAMES frames. Drop it rather than wait.
+			int available = 0;
+			glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				readGpuFrame(frame);
+			}
+			else {
+				m_numDropped += frame.zones.size();
+			}
+		}
+		frame.numQueries = 0;
+		frame.zones.clear();
+		frame.open.clear();
+		frame.pending = false;
+	}
+
+	/// <summary>
+	/// Collects every thread's events for the frame and reads back any GPU frames that have finished
+	/// </summary>
+	void Profiler::endFrame()
+	{
+		uint64_t frameEnd = getProfilerTime();
+		if (m_frameStart != 0) {
+			m_cpuHistory.push_back((float)((frameEnd - m_frameStart) * 1e-6));
+			if (m_cpuHistory.size() > HISTORY_LENGTH) {
+				m_cpuHistory.erase(m_cpuHistory.begin());
+			}
+		}
+
+		std::vector<ThreadBuffer*> threads;
+		{
+			std::lock_guard<std::mutex> lock(m_threadMutex);
+			threads = m_threads;
+		}
+		std::vector<ProfileEvent> events;
+		for (size_t t = 0; t < threads.size(); t++)
+		{
+			ThreadBuffer* buffer = threads[t];
+			uint64_t tail = buffer->tail.load(std::memory_order_relaxed);
+			uint64_t head = buffer->head.load(std::memory_order_acquire);
+			for (uint64_t i = tail; i < head; i++)
+			{
+				events.push_back(buffer->events[i % THREAD_BUFFER_CAPACITY]);
+			}
+			buffer->tail.store(head, std::memory_order_release);
+			m_numDropped += buffer->dropped.exchange(0, std::memory_order_relaxed);
+		}
+		addEvents(events.data(), events.size(), false);
+
+		//Oldest first, skipping the frame that was just recorded
+		for (size_t i = 1; i < m_gpuFrames.size(); i++)
+		{
+			GpuFrame& frame = *m_gpuFrames[(m_gpuFrameIndex + i) % m_gpuFrames.size()];
+			if (!frame.pending) {
+				continue;
+			}
+			int available = 0;
+			glGetQueryObjectiv(frame.queries[frame.numQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				break;
+			}
+			readGpuFrame(frame);
+		}
+	}
+
+	void Profiler::readGpuFrame(GpuFrame& frame)
+	{
+		std::vector<ProfileEvent> events(frame.zones.size());
+		uint64_t first = UINT64_MAX;
+		uint64_t last = 0;
+		for (size_t i = 0; i < frame.zones.size(); i++)
+		{
+			GLuint64 begin = 0;
+			GLuint64 end = 0;
+			glGetQueryObjectui64v(frame.queries[frame.zones[i].beginQuery], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame.queries[frame.zones[i].endQuery], GL_QUERY_RESULT, &end);
+			events[i].name = frame.zones[i].name;
+			events[i].start = (uint64_t)((int64_t)begin + m_gpuClockOffset);
+			events[i].end = (uint64_t)((int64_t)end + m_gpuClockOffset);
+			events[i].depth = frame.zones[i].depth;
+			events[i].thread = PROFILER_GPU_THREAD;
+			first = std::min(first, events[i].start);
+			last = std::max(last, events[i].end);
+		}
+		frame.pending = false;
+		if (events.empty()) {
+			return;
+		}
+		//Time from the first GPU zone starting to the last one ending
+		m_gpuHistory.push_back((float)((last - first) * 1e-6));
+		if (m_gpuHistory.size() > HISTORY_LENGTH) {
+			m_gpuHistory.erase(m_gpuHistory.begin());
+		}
+		addEvents(events.data(), events.size(), true);
+	}
+
+	//Replaces the last frame's totals for CPU or GPU zones and appends to the capture
+	void Profiler::addEvents(const ProfileEvent* events, size_t count, bool gpu)
+	{
+		for (size_t i = 0; i < m_zoneStats.size(); i++)
+		{
+			if (m_zoneStats[i].gpu == gpu) {
+				m_zoneStats[i].calls = 0;
+				m_zoneStats[i].milliseconds = 0.0;
+			}
+		}
+		//Events arrive in the order zones ended. Sorting by start lists parents before their children.
+		std::vector<const ProfileEvent*> sorted(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			sorted[i] = &events[i];
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const ProfileEvent* a, const ProfileEvent* b) {
+			return a->start < b->start;
+		});
+		for (size_t i = 0; i < count; i++)
+		{
+			const ProfileEvent& event = *sorted[i];
+			ProfileZoneStats* zone = nullptr;
+			for (size_t z = 0; z < m_zoneStats.size(); z++)
+			{
+				if (m_zoneStats[z].gpu == gpu && (m_zoneStats[z].name == event.name || strcmp(m_zoneStats[z].name, event.name) == 0)) {
+					zone = &m_zoneStats[z];
+					break;
+				}
+			}
+			if (zone == nullptr) {
+				m_zoneStats.push_back({ event.name, event.depth, 0, 0.0, 0.0, gpu });
+				zone = &m_zoneStats.back();
+			}
+			zone->calls++;
+			zone->milliseconds += (event.end - event.start) * 1e-6;
+		}
+		for (size_t i = 0; i < m_zoneStats.size(); i++)
+		{
+			if (m_zoneStats[i].gpu == gpu) {
+				m_zoneStats[i].averageMilliseconds += (m_zoneStats[i].milliseconds - m_zoneStats[i].averageMilliseconds) * AVERAGE_WEIGHT;
+			}
+		}
+		if (m_capturing) {
+			size_t n = std::min(count, MAX_CAPTURED_EVENTS - std::min(m_captured.size(), MAX_CAPTURED_EVENTS));
+			m_captured.insert(m_captured.end(), events, events + n);
+			m_numDropped += count - n;
+		}
+	}
+
+	void Profiler::startCapture()
+	{
+		m_captured.clear();
+		m_capturing = true;
+	}
+
+	void Profiler::stopCapture()
+	{
+		m_capturing = false;
+	}
+
+	static void writeJsonString(FILE* file, const char* s) {
+		fputc('"', file);
+		for (; *s; s++)
+		{
+			if (*s == '"' || *s == '\\') {
+				fputc('\\', file);
+			}
+			fputc(*s, file);
+		}
+		fputc('"', file);
+	}
+
+	/// <summary>
+	/// Writes captured events as complete ("X") events, one trace row per thread plus one for the GPU
+	/// </summary>
+	/// <param name="filePath">Output .json file</param>
+	/// <returns>False if the file could not be written</returns>
+	bool Profiler::writeChromeTrace(const std::string& filePath) const
+	{
+		FILE* file = fopen(filePath.c_str(), "wb");
+		if (file == NULL) {
+			printf("Failed to write profile %s\n", filePath.c_str());
+			return false;
+		}
+		uint64_t origin = UINT64_MAX;
+		for (size_t i = 0; i < m_captured.size(); i++)
+		{
+			origin = std::min(origin, m_captured[i].start);
+		}
+		fprintf(file, "{\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", PROFILER_GPU_THREAD);
+		for (size_t i = 0; i < m_captured.size(); i++)
+		{
+			const ProfileEvent& event = m_captured[i];
+			fprintf(file, ",\n{\"name\":");
+			writeJsonString(file, event.name);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", event.thread,
+				(event.start - origin) * 1e-3, (event.end - event.start) * 1e-3);
+		}
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		return true;
+	}
+
+	void Profiler::getFrameHistory(std::vector<float>& cpuMilliseconds, std::vector<float>& gpuMilliseconds) const
+	{
+		cpuMilliseconds = m_cpuHistory;
+		gpuMilliseconds = m_gpuHistory;
+	}
+
+	static void drawFrameGraph(const char* label, const std::vector<float>& history) {
+		float sum = 0.0f;
+		float maxTime = 0.0f;
+		for (size_t i = 0; i < history.size(); i++)
+		{
+			sum += history[i];
+			maxTime = std::max(maxTime, history[i]);
+		}
+		float average = sum / (float)history.size();
+		ImGui::Text("%s %.2f ms (avg %.2f, max %.2f)", label, history.back(), average, maxTime);
+		ImGui::PlotLines(label, history.data(), (int)history.size(), 0, NULL, 0.0f, std::max(maxTime, 1.0f), ImVec2(0, 60));
+	}
+
+	void Profiler::drawUI()
+	{
+		ImGui::Begin("Profiler");
+		bool enabled = m_enabled;
+		if (ImGui::Checkbox("Enabled", &enabled)) {
+			m_enabled = enabled;
+		}
+		ImGui::SameLine();
+		if (ImGui::Button(m_capturing ? "Stop capture" : "Start capture")) {
+			if (m_capturing) {
+				stopCapture();
+				writeChromeTrace("profile.json");
+			}
+			else {
+				startCapture();
+			}
+		}
+		if (m_capturing) {
+			ImGui::SameLine();
+			ImGui::Text("%u events", (unsigned int)m_captured.size());
+		}
+		if (!m_cpuHistory.empty()) {
+			drawFrameGraph("CPU", m_cpuHistory);
+		}
+		if (!m_gpuHistory.empty()) {
+			drawFrameGraph("GPU", m_gpuHistory);
+		}
+		if (m_numDropped > 0) {
+			ImGui::Text("Dropped events: %llu", (unsigned long long)m_numDropped);
+		}
+		if (ImGui::BeginTable("Zones", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersInnerV)) {
+			ImGui::TableSetupColumn("Zone");
+			ImGui::TableSetupColumn("Calls");
+			ImGui::TableSetupColumn("ms");
+			ImGui::TableSetupColumn("Avg ms");
+			ImGui::TableHeadersRow();
+			for (int gpu = 0; gpu < 2; gpu++)
+			{
+				for (size_t i = 0; i < m_zoneStats.size(); i++)
+				{
+					const ProfileZoneStats& zone = m_zoneStats[i];
+					if (zone.gpu != (gpu == 1)) {
+						continue;
+					}
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn();
+					ImGui::Text("%*s%s%s", (int)zone.depth * 2, "", zone.gpu ? "[GPU] " : "", zone.name);
+					ImGui::TableNextColumn();
+					ImGui::Text("%u", zone.calls);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", zone.milliseconds);
+					ImGui::TableNextColumn();
+					ImGui::Text("%.3f", zone.averageMilliseconds);
+				}
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+}
@@ -0,0 +1,142 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+namespace ew {
+	//Nanoseconds on a steady clock
+	uint64_t getProfilerTime();
+
+	struct ProfileEvent {
+		const char* name; //Must outlive the profiler, e.g. a string literal
+		uint64_t start;
+		uint64_t end;
+		uint32_t depth; //Number of enclosing zones on the same thread
+		uint32_t thread; //0 is the first thread that recorded anything, 0xffffffff is the GPU
+	};
+
+	//Totals for one zone name over the last completed frame
+	struct ProfileZoneStats {
+		const char* name;
+		uint32_t depth; //Depth of the first occurrence
+		uint32_t calls;
+		double milliseconds;
+		double averageMilliseconds; //Smoothed over recent frames
+		bool gpu;
+	};
+
+	const uint32_t PROFILER_GPU_THREAD = 0xffffffff;
+
+	//Collects CPU zones from any thread and GPU zones from the context thread.
+	//Each thread writes into its own fixed size ring with no locking. endFrame() drains every ring on the
+	//main thread. GL timestamp queries are kept for a few frames and only read once their results are available,
+	//so the CPU never waits on the GPU.
+	//
+	//	profiler.beginFrame();
+	//	{
+	//		EW_PROFILE_SCOPE("Update");
+	//		...
+	//	}
+	//	{
+	//		EW_PROFILE_GPU_SCOPE("Draw");
+	//		...
+	//	}
+	//	profiler.endFrame();
+	class Profiler {
+	public:
+		Profiler() {};
+		~Profiler();
+		Profiler(const Profiler&) = delete;
+		Profiler& operator=(const Profiler&) = delete;
+
+		void beginFrame();
+		void endFrame();
+
+		//CPU zones. Must be properly nested per thread, which ProfileScope does for you.
+		void beginZone(const char* name);
+		void endZone();
+		//GPU zones, from the thread that owns the GL context
+		void beginGpuZone(const char* name);
+		void endGpuZone();
+
+		//Keeps every event until stopCapture() so it can be written with writeChromeTrace()
+		void startCapture();
+		void stopCapture();
+		inline bool isCapturing()const { return m_capturing; }
+		//Writes captured events in Chrome trace event format, for chrome://tracing or ui.perfetto.dev
+		bool writeChromeTrace(const std::string& filePath)const;
+
+		//Frame times of recent frames in milliseconds, oldest first. GPU times lag by a few frames.
+		void getFrameHistory(std::vector<float>& cpuMilliseconds, std::vector<float>& gpuMilliseconds)const;
+		inline const std::vector<ProfileZoneStats>& getZoneStats()const { return m_zoneStats; }
+		//Events lost because a thread's ring was full
+		inline uint64_t getNumDropped()const { return m_numDropped; }
+		//ImGui window with frame time graphs and a per-zone breakdown. Call between ImGui::NewFrame and ImGui::Render.
+		void drawUI();
+
+		inline void setEnabled(bool enabled) { m_enabled = enabled; }
+		inline bool isEnabled()const { return m_enabled; }
+
+		//Shared profiler used by core instrumentation
+		static Profiler& global();
+
+	private:
+		struct ThreadBuffer;
+		struct GpuFrame;
+		ThreadBuffer* getThreadBuffer();
+		void addEvents(const ProfileEvent* events, size_t count, bool gpu);
+		void readGpuFrame(GpuFrame& frame);
+
+		std::atomic<bool> m_enabled{ true };
+		std::mutex m_threadMutex; //Only taken the first time a thread records
+		std::vector<ThreadBuffer*> m_threads;
+
+		uint64_t m_frameStart = 0;
+		std::vector<float> m_cpuHistory;
+		std::vector<float> m_gpuHistory;
+		std::vector<ProfileZoneStats> m_zoneStats;
+
+		std::vector<GpuFrame*> m_gpuFrames;
+		size_t m_gpuFrameIndex = 0;
+		int64_t m_gpuClockOffset = 0; //CPU time - GPU timestamp
+		bool m_gpuClockSynced = false;
+
+		std::vector<ProfileEvent> m_captured;
+		bool m_capturing = false;
+		uint64_t m_numDropped = 0;
+	};
+
+	//Records a CPU zone on the global profiler for the lifetime of the object
+	class ProfileScope {
+	public:
+		inline ProfileScope(const char* name) { Profiler::global().beginZone(name); }
+		inline ~ProfileScope() { Profiler::global().endZone(); }
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+	};
+
+	class ProfileGpuScope {
+	public:
+		inline ProfileGpuScope(const char* name) { Profiler::global().beginGpuZone(name); }
+		inline ~ProfileGpuScope() { Profiler::global().endGpuZone(); }
+		ProfileGpuScope(const ProfileGpuScope&) = delete;
+		ProfileGpuScope& operator=(const ProfileGpuScope&) = delete;
+	};
+}
+
+//Define EW_DISABLE_PROFILER to compile instrumentation out entirely
+#define EW_PROFILE_CONCAT_INNER(a, b) a##b
+#define EW_PROFILE_CONCAT(a, b) EW_PROFILE_CONCAT_INNER(a, b)
+#ifndef EW_DISABLE_PROFILER
+#define EW_PROFILE_SCOPE(name) ew::ProfileScope EW_PROFILE_CONCAT(_profileScope, __LINE__)(name)
+#define EW_PROFILE_GPU_SCOPE(name) ew::ProfileGpuScope EW_PROFILE_CONCAT(_profileGpuScope, __LINE__)(name)
+#else
+#define EW_PROFILE_SCOPE(name)
+#define EW_PROFILE_GPU_SCOPE(name)
+#endif
@@ -0,0 +1,137 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "quantize.h"
+#include <string.h>
+#include <math.h>
+
+namespace ew {
+	/// <summary>
+	/// Converts a float to IEEE 754 half precision, rounding to nearest even
+	/// </summary>
+	uint16_t encodeHalf(float v) {
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		uint32_t sign = (bits >> 16) & 0x8000;
+		uint32_t magnitude = bits & 0x7fffffff;
+		//Infinity and NaN
+		if (magnitude >= 0x7f800000) {
+			return (uint16_t)(sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x200 : 0));
+		}
+		//Rounds to infinity (>= 65520)
+		if (magnitude >= 0x477ff000) {
+			return (uint16_t)(sign | 0x7c00);
+		}
+		//Subnormal half (< 2^-14). Scale so one unit is the smallest subnormal and let the FPU round.
+		if (magnitude < 0x38800000) {
+			float f;
+			memcpy(&f, &magnitude, sizeof(f));
+			return (uint16_t)(sign | (uint32_t)lrintf(f * 16777216.0f));
+		}
+		//Rebias the exponent from 127 to 15 and round the 13 dropped mantissa bits to nearest even
+		magnitude += 0xc8000fffu + ((magnitude >> 13) & 1);
+		return (uint16_t)(sign | (magnitude >> 13));
+	}
+
+	float decodeHalf(uint16_t h) {
+		uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+		uint32_t exponent = (h >> 10) & 0x1f;
+		uint32_t mantissa = h & 0x3ff;
+		uint32_t bits;
+		if (exponent == 0) {
+			float f = mantissa * (1.0f / 16777216.0f);
+			memcpy(&bits, &f, sizeof(bits));
+			bits |= sign;
+		}
+		else if (exponent == 31) {
+			bits = sign | 0x7f800000 | (mantissa << 13);
+		}
+		else {
+			bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+		}
+		float result;
+		memcpy(&result, &bits, sizeof(result));
+		return result;
+	}
+
+	static float signNotZero(float v) {
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	/// <summary>
+	/// Octahedral normal encoding (Meyer et al. 2010). Projects the unit sphere onto an octahedron and
+	/// unfolds the lower half over the corners of the square.
+	/// </summary>
+	glm::vec2 encodeOctahedral(const glm::vec3& n) {
+		float sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+		if (sum <= 0.0f) {
+			return glm::vec2(0.0f);
+		}
+		glm::vec2 p = glm::vec2(n.x / sum, n.y / sum);
+		if (n.z < 0.0f) {
+			p = glm::vec2((1.0f - fabsf(p.y)) * signNotZero(p.x), (1.0f - fabsf(p.x)) * signNotZero(p.y));
+		}
+		return p;
+	}
+
+	glm::vec3 decodeOctahedral(const glm::vec2& e) {
+		glm::vec3 v = glm::vec3(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+		if (v.z < 0.0f) {
+			v = glm::vec3((1.0f - fabsf(e.y)) * signNotZero(e.x), (1.0f - fabsf(e.x)) * signNotZero(e.y), v.z);
+		}
+		return glm::normalize(v);
+	}
+
+	int16_t encodeSnorm16(float v) {
+		v = v < -1.0f ? -1.0f : (v > 1.0f ? 1.0f : v);
+		return (int16_t)lrintf(v * 32767.0f);
+	}
+
+	//Matches GL's conversion for normalized signed integers
+	float decodeSnorm16(int16_t v) {
+		float f = v / 32767.0f;
+		return f < -1.0f ? -1.0f : f;
+	}
+
+	QuantizedVertex quantizeVertex(const Vertex& vertex) {
+		QuantizedVertex q;
+		q.pos[0] = encodeHalf(vertex.pos.x);
+		q.pos[1] = encodeHalf(vertex.pos.y);
+		q.pos[2] = encodeHalf(vertex.pos.z);
+		q.padding = 0;
+		glm::vec2 octahedral = encodeOctahedral(vertex.normal);
+		q.normal[0] = encodeSnorm16(octahedral.x);
+		q.normal[1] = encodeSnorm16(octahedral.y);
+		q.uv[0] = encodeHalf(vertex.uv.x);
+		q.uv[1] = encodeHalf(vertex.uv.y);
+		return q;
+	}
+
+	Vertex dequantizeVertex(const QuantizedVertex& vertex) {
+		Vertex v;
+		v.pos = VertexTraits<QuantizedVertex>::position(vertex);
+		v.normal = decodeOctahedral(glm::vec2(decodeSnorm16(vertex.normal[0]), decodeSnorm16(vertex.normal[1])));
+		v.uv = glm::vec2(decodeHalf(vertex.uv[0]), decodeHalf(vertex.uv[1]));
+		return v;
+	}
+
+	std::vector<QuantizedVertex> quantizeVertices(const std::vector<Vertex>& vertices) {
+		std::vector<QuantizedVertex> result(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			result[i] = quantizeVertex(vertices[i]);
+		}
+		return result;
+	}
+
+	const char* glslDecodeOctahedral = R"(
+vec3 ew_decodeOctahedral(vec2 e) {
+	vec3 v = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (v.z < 0.0) {
+		v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(v);
+}
+)";
+}
@@ -0,0 +1,51 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include <stdint.h>
+
+namespace ew {
+	//16 byte vertex, half the size of ew::Vertex.
+	//Position and UV are half floats. The normal is octahedral encoded into two normalized shorts,
+	//so shaders read it as a vec2 at location 1 and decode it with glslDecodeOctahedral.
+	struct QuantizedVertex {
+		uint16_t pos[3];
+		uint16_t padding; //Keeps normal 4 byte aligned
+		int16_t normal[2];
+		uint16_t uv[2];
+	};
+
+	uint16_t encodeHalf(float v);
+	float decodeHalf(uint16_t h);
+	//Maps a unit vector to [-1,1]^2
+	glm::vec2 encodeOctahedral(const glm::vec3& n);
+	glm::vec3 decodeOctahedral(const glm::vec2& e);
+	int16_t encodeSnorm16(float v);
+	float decodeSnorm16(int16_t v);
+
+	QuantizedVertex quantizeVertex(const Vertex& vertex);
+	Vertex dequantizeVertex(const QuantizedVertex& vertex);
+	std::vector<QuantizedVertex> quantizeVertices(const std::vector<Vertex>& vertices);
+
+	//GLSL function for vertex shaders using QuantizedVertex:
+	//	layout(location = 1) in vec2 vOctNormal;
+	//	vec3 normal = ew_decodeOctahedral(vOctNormal);
+	extern const char* glslDecodeOctahedral;
+
+	template<>
+	struct VertexTraits<QuantizedVertex> {
+		static VertexLayout layout() {
+			static const VertexAttribute attributes[] = {
+				{ 0, 3, AttributeType::HALF_FLOAT, false, offsetof(QuantizedVertex, pos) },
+				{ 1, 2, AttributeType::SHORT, true, offsetof(QuantizedVertex, normal) },
+				{ 2, 2, AttributeType::HALF_FLOAT, false, offsetof(QuantizedVertex, uv) }
+			};
+			return { sizeof(QuantizedVertex), attributes, 3 };
+		}
+		static glm::vec3 position(const QuantizedVertex& vertex) {
+			return glm::vec3(decodeHalf(vertex.pos[0]), decodeHalf(vertex.pos[1]), decodeHalf(vertex.pos[2]));
+		}
+	};
+}
@@ -0,0 +1,263 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "renderQueue.h"
+#include "external/glad.h"
+#include <string.h>
+#include <algorithm>
+
+namespace ew {
+	//Key layout, most significant first: pass 4 | shader 12 | material 16 | geometry 12 | depth 20
+	static const int PASS_SHIFT = 60;
+	static const int SHADER_SHIFT = 48;
+	static const int MATERIAL_SHIFT = 32;
+	static const int GEOMETRY_SHIFT = 20;
+	static const uint64_t DEPTH_MASK = (1u << 20) - 1;
+
+	//Matches the command layout glMultiDrawElementsIndirect reads
+	struct DrawElementsIndirectCommand {
+		uint32_t count;
+		uint32_t instanceCount;
+		uint32_t firstIndex;
+		int32_t baseVertex;
+		uint32_t baseInstance;
+	};
+
+	static const VertexLayout INDIRECT_COMMAND_LAYOUT = { sizeof(DrawElementsIndirectCommand), nullptr, 0 };
+
+	void radixSortKeys(const uint64_t* keys, size_t count, uint32_t* order, uint32_t* scratch) {
+		for (size_t i = 0; i < count; i++)
+		{
+			order[i] = (uint32_t)i;
+		}
+		uint32_t* src = order;
+		uint32_t* dst = scratch;
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			size_t histogram[256] = {};
+			for (size_t i = 0; i < count; i++)
+			{
+				histogram[(keys[i] >> shift) & 0xff]++;
+			}
+			//Every key has the same byte here, nothing would move
+			if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count) {
+				continue;
+			}
+			size_t offset = 0;
+			for (int b = 0; b < 256; b++)
+			{
+				size_t n = histogram[b];
+				histogram[b] = offset;
+				offset += n;
+			}
+			for (size_t i = 0; i < count; i++)
+			{
+				uint32_t index = src[i];
+				dst[histogram[(keys[index] >> shift) & 0xff]++] = index;
+			}
+			std::swap(src, dst);
+		}
+		if (src != order) {
+			memcpy(order, src, count * sizeof(uint32_t));
+		}
+	}
+
+	static uint64_t hashTextures(const unsigned int* textures) {
+		uint64_t hash = 14695981039346656037ull;
+		for (int i = 0; i < MAX_DRAW_TEXTURES; i++)
+		{
+			hash = (hash ^ textures[i]) * 1099511628211ull;
+		}
+		return hash;
+	}
+
+	template<typename K>
+	static uint32_t getId(std::unordered_map<K, uint32_t>& ids, const K& value) {
+		auto it = ids.find(value);
+		if (it != ids.end()) {
+			return it->second;
+		}
+		uint32_t id = (uint32_t)ids.size();
+		ids[value] = id;
+		return id;
+	}
+
+	void RenderQueue::create(unsigned int maxDrawsPerFrame, unsigned int numFrames)
+	{
+		m_numFrames = numFrames;
+		m_instances.create<InstanceData>(maxDrawsPerFrame, numFrames);
+		m_commands.create(INDIRECT_COMMAND_LAYOUT, maxDrawsPerFrame, numFrames);
+	}
+
+	void RenderQueue::submit(const DrawPacket& packet)
+	{
+		m_packets.push_back(packet);
+		m_keys.push_back(makeKey(packet));
+	}
+
+	/// <summary>
+	/// Packs the sort key. Ids wider than their field wrap around, which only costs grouping, never correctness,
+	/// since execute() compares the real state.
+	/// </summary>
+	uint64_t RenderQueue::makeKey(const DrawPacket& packet)
+	{
+		uint64_t shader = getId(m_shaderIds, packet.shader) & 0xfff;
+		uint64_t material = getId(m_materialIds, hashTextures(packet.textures)) & 0xffff;
+		const void* geometryContainer = packet.arena != nullptr ? (const void*)packet.arena : (const void*)packet.mesh;
+		uint64_t geometry = getId(m_geometryIds, geometryContainer) & 0xfff;
+		float depth = std::min(std::max(packet.depth, 0.0f), 1.0f);
+		uint64_t depthBits = (uint64_t)(depth * DEPTH_MASK);
+		return ((uint64_t)(packet.pass & 0xf) << PASS_SHIFT) | (shader << SHADER_SHIFT) | (material << MATERIAL_SHIFT) | (geometry << GEOMETRY_SHIFT) | depthBits;
+	}
+
+	static bool sameTextures(const DrawPacket& a, const DrawPacket& b) {
+		return memcmp(a.textures, b.textures, sizeof(a.textures)) == 0;
+	}
+
+	static int countTextures(const DrawPacket& packet) {
+		int count = 0;
+		for (int i = 0; i < MAX_DRAW_TEXTURES; i++)
+		{
+			count += packet.textures[i] != 0;
+		}
+		return count;
+	}
+
+	/// <summary>
+	/// What the usual per-object loop would cost for the same packets: use the shader, glActiveTexture + glBindTexture
+	/// per texture, bind the VAO, upload the model matrix and draw, skipping only redundant state
+	/// </summary>
+	RenderQueueCounters RenderQueue::countUnsorted() const
+	{
+		RenderQueueCounters counters;
+		for (size_t i = 0; i < m_packets.size(); i++)
+		{
+			const DrawPacket& packet = m_packets[i];
+			const DrawPacket* previous = i > 0 ? &m_packets[i - 1] : nullptr;
+			if (previous == nullptr || previous->shader != packet.shader) {
+				counters.numShaderChanges++;
+				counters.numGLCalls++;
+			}
+			if (previous == nullptr || !sameTextures(*previous, packet)) {
+				counters.numMaterialChanges++;
+				counters.numGLCalls += 2 * countTextures(packet);
+			}
+			if (previous == nullptr || previous->mesh != packet.mesh || previous->arena != packet.arena) {
+				counters.numGeometryChanges++;
+				counters.numGLCalls++;
+			}
+			counters.numDrawCalls++;
+			counters.numGLCalls += 2;
+		}
+		return counters;
+	}
+
+	void RenderQueue::execute()
+	{
+		size_t count = m_packets.size();
+		m_stats = RenderQueueStats();
+		m_stats.numPackets = (unsigned int)count;
+		if (count == 0) {
+			return;
+		}
+		m_stats.before = countUnsorted();
+		RenderQueueCounters& counters = m_stats.after;
+
+		m_order.resize(count);
+		m_scratch.resize(count);
+		radixSortKeys(m_keys.data(), count, m_order.data(), m_scratch.data());
+
+		//Worst case is one instance and one command per packet. Growing replaces both rings: create() deletes the old
+		//buffers and their fences, and the new buffers' generations make meshes and arenas re-point their instance attributes.
+		if (m_instances.getCapacity() < count) {
+			create((unsigned int)count * 2, m_numFrames);
+		}
+		m_instances.beginFrame();
+		m_commands.beginFrame();
+		unsigned int baseInstance, baseCommand;
+		InstanceData* instances = m_instances.allocate<InstanceData>((unsigned int)count, &baseInstance);
+		DrawElementsIndirectCommand* commands = m_commands.allocate<DrawElementsIndirectCommand>((unsigned int)count, &baseCommand);
+		for (size_t i = 0; i < count; i++)
+		{
+			instances[i] = m_packets[m_order[i]].instance;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commands.getID());
+		counters.numGLCalls++;
+
+		const DrawPacket* state = nullptr;
+		size_t numCommands = 0;
+		size_t i = 0;
+		while (i < count) {
+			const DrawPacket& packet = m_packets[m_order[i]];
+			if (state == nullptr || state->shader != packet.shader) {
+				glUseProgram(packet.shader);
+				counters.numShaderChanges++;
+				counters.numGLCalls++;
+			}
+			if (state == nullptr || !sameTextures(*state, packet)) {
+				glBindTextures(0, MAX_DRAW_TEXTURES, packet.textures);
+				counters.numMaterialChanges++;
+				counters.numGLCalls++;
+			}
+			if (state == nullptr || state->mesh != packet.mesh || state->arena != packet.arena) {
+				counters.numGeometryChanges++;
+				if (packet.arena != nullptr) {
+					packet.arena->setInstanceBuffer(m_instances);
+					packet.arena->bind();
+					counters.numGLCalls++;
+				}
+			}
+			state = &packet;
+
+			//Run of packets that can go out in one call: same shader, textures and geometry container
+			size_t end = i + 1;
+			while (end < count) {
+				const DrawPacket& next = m_packets[m_order[end]];
+				if (next.shader != packet.shader || !sameTextures(next, packet) || next.mesh != packet.mesh || next.arena != packet.arena) {
+					break;
+				}
+				end++;
+			}
+
+			if (packet.arena != nullptr) {
+				//One command per distinct range. Repeats of the same range become extra instances.
+				size_t firstCommand = numCommands;
+				for (size_t j = i; j < end; j++)
+				{
+					const DrawPacket& item = m_packets[m_order[j]];
+					if (j > i && item.geometry == m_packets[m_order[j - 1]].geometry) {
+						commands[numCommands - 1].instanceCount++;
+						continue;
+					}
+					const GeometryRange& range = item.arena->getRange(item.geometry);
+					DrawElementsIndirectCommand& command = commands[numCommands++];
+					command.count = range.numIndices;
+					command.instanceCount = 1;
+					command.firstIndex = range.firstIndex;
+					command.baseVertex = (int32_t)range.baseVertex;
+					command.baseInstance = baseInstance + (uint32_t)j;
+				}
+				glMultiDrawElementsIndirect(GL_TRIANGLES, packet.arena->getIndexType(),
+					(const void*)((size_t)(baseCommand + firstCommand) * sizeof(DrawElementsIndirectCommand)), (GLsizei)(numCommands - firstCommand), 0);
+				counters.numDrawCalls++;
+				counters.numGLCalls++;
+			}
+			else if (packet.mesh != nullptr) {
+				//Same mesh throughout the run, so it is a single instanced draw
+				packet.mesh->drawInstanced(m_instances, baseInstance + (unsigned int)i, (unsigned int)(end - i));
+				counters.numDrawCalls++;
+				counters.numGLCalls += 2;
+			}
+			i = end;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindVertexArray(0);
+		counters.numGLCalls += 2;
+
+		m_instances.endFrame();
+		m_commands.endFrame();
+		m_packets.clear();
+		m_keys.clear();
+	}
+}
@@ -0,0 +1,80 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "geometryArena.h"
+#include "instanceBuffer.h"
+#include <vector>
+#include <unordered_map>
+#include <stdint.h>
+
+namespace ew {
+	const int MAX_DRAW_TEXTURES = 4;
+
+	//Everything needed for one draw. Geometry is either a Mesh or a range in a GeometryArena.
+	//Per-draw data is read from instance attributes (see InstanceData), not uniforms, so draws can be merged.
+	struct DrawPacket {
+		unsigned int shader = 0; //Program, e.g. Shader::getID()
+		unsigned int textures[MAX_DRAW_TEXTURES] = {}; //Bound to units 0 and up. 0 = none.
+		const Mesh* mesh = nullptr;
+		const GeometryArena* arena = nullptr;
+		GeometryHandle geometry = INVALID_GEOMETRY;
+		InstanceData instance;
+		uint8_t pass = 0; //Lower passes draw first. 0-15.
+		float depth = 0.0f; //0-1, lower draws first among draws of the same mesh
+	};
+
+	struct RenderQueueCounters {
+		unsigned int numDrawCalls = 0;
+		unsigned int numShaderChanges = 0;
+		unsigned int numMaterialChanges = 0;
+		unsigned int numGeometryChanges = 0;
+		unsigned int numGLCalls = 0;
+	};
+
+	struct RenderQueueStats {
+		unsigned int numPackets = 0;
+		//Estimate for issuing the packets in submission order, one draw and one uniform upload each
+		RenderQueueCounters before;
+		//What execute() actually issued
+		RenderQueueCounters after;
+	};
+
+	//Sorts 64 bit keys with an LSD radix sort, 8 bits per pass. Passes where every key has the same byte are skipped.
+	//order receives indices into keys, scratch must have room for count indices.
+	void radixSortKeys(const uint64_t* keys, size_t count, uint32_t* order, uint32_t* scratch);
+
+	//Collects draw packets for a frame, sorts them by (pass, shader, material, geometry, depth)
+	//and submits them with as few state changes and draw calls as possible.
+	//Arena packets that share shader and textures are merged into one glMultiDrawElementsIndirect call.
+	class RenderQueue {
+	public:
+		RenderQueue() {};
+		//Initial capacity, grows as needed
+		void create(unsigned int maxDrawsPerFrame = 1024, unsigned int numFrames = 3);
+		void submit(const DrawPacket& packet);
+		//Sorts, draws and clears the queue. Must be called on the GL context thread.
+		void execute();
+		inline size_t size()const { return m_packets.size(); }
+		//Stats from the last execute()
+		inline const RenderQueueStats& getStats()const { return m_stats; }
+	private:
+		uint64_t makeKey(const DrawPacket& packet);
+		RenderQueueCounters countUnsorted()const;
+
+		std::vector<DrawPacket> m_packets;
+		std::vector<uint64_t> m_keys;
+		std::vector<uint32_t> m_order;
+		std::vector<uint32_t> m_scratch;
+		InstanceBuffer m_instances;
+		InstanceBuffer m_commands; //Indirect commands, same ring with no attributes
+		unsigned int m_numFrames = 3;
+		//Small ids that fit in the sort key, assigned on first sight and kept across frames
+		std::unordered_map<unsigned int, uint32_t> m_shaderIds;
+		std::unordered_map<uint64_t, uint32_t> m_materialIds;
+		std::unordered_map<const void*, uint32_t> m_geometryIds;
+		RenderQueueStats m_stats;
+	};
+}
@@ -8,6 +8,17 @@
 #include "external/glad.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <string.h>
+#include "shaderCache.h"
+#include "profiler.h"
+
+//GL_KHR_parallel_shader_compile is not part of the generated loader
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
 
 namespace ew {
 	/// <summary>
@@ -27,7 +38,8 @@ namespace ew {
 	}
 
 	/// <summary>
-	/// Creates and compiles a shader object of a given type
+	/// Creates a shader object of a given type and starts compiling it. Status is checked later by
+	/// checkShaderCompiled so the driver can compile several shaders at once.
 	/// </summary>
 	/// <param name="shaderType">Expects GL_VERTEX_SHADER, GL_FRAGMENT_SHADER, etc.</param>
 	/// <param name="sourceCode">GLSL source code for the shader stage</param>
@@ -39,6 +51,10 @@ namespace ew {
 		glShaderSource(shader, 1, &sourceCode, NULL);
 		//Compile the shader object
 		glCompileShader(shader);
+		return shader;
+	}
+
+	static void checkShaderCompiled(unsigned int shader) {
 		int success;
 		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 		if (!success) {
@@ -47,7 +63,24 @@ namespace ew {
 			glGetShaderInfoLog(shader, 512, NULL, infoLog);
 			printf("Failed to compile shader: %s", infoLog);
 		}
-		return shader;
+	}
+
+	static bool hasParallelShaderCompile() {
+		static int supported = -1;
+		if (supported < 0) {
+			supported = 0;
+			int numExtensions = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+			for (int i = 0; i < numExtensions; i++)
+			{
+				const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+				if (extension && (strcmp(extension, "GL_KHR_parallel_shader_compile") == 0 || strcmp(extension, "GL_ARB_parallel_shader_compile") == 0)) {
+					supported = 1;
+					break;
+				}
+			}
+		}
+		return supported == 1;
 	}
 
 	/// <summary>
@@ -57,14 +90,19 @@ namespace ew {
 	/// <param name="fragmentShaderSource">GLSL source code for the fragment shader</param>
 	/// <returns></returns>
 	unsigned int createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource) {
-		unsigned int vertexShader = createShader(GL_VERTEX_SHADER, vertexShaderSource);
-		unsigned int fragmentShader = createShader(GL_FRAGMENT_SHADER, fragmentShaderSource);
+		return createShaderPrograms({ { vertexShaderSource, fragmentShaderSource } })[0];
+	}
 
+	/// <summary>
+	/// Creates a shader program with a single compute stage. Compute programs are not put in the binary cache.
+	/// </summary>
+	/// <param name="computeShaderSource">GLSL source code for the compute shader</param>
+	/// <returns></returns>
+	unsigned int createComputeShaderProgram(const char* computeShaderSource) {
+		unsigned int computeShader = createShader(GL_COMPUTE_SHADER, computeShaderSource);
+		checkShaderCompiled(computeShader);
 		unsigned int shaderProgram = glCreateProgram();
-		//Attach each stage
-		glAttachShader(shaderProgram, vertexShader);
-		glAttachShader(shaderProgram, fragmentShader);
-		//Link all the stages together
+		glAttachShader(shaderProgram, computeShader);
 		glLinkProgram(shaderProgram);
 		int success;
 		glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
@@ -73,11 +111,102 @@ namespace ew {
 			glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
 			printf("Failed to link shader program: %s", infoLog);
 		}
-		//The linked program now contains our compiled code, so we can delete these intermediate objects
-		glDeleteShader(vertexShader);
-		glDeleteShader(fragmentShader);
+		glDeleteShader(computeShader);
 		return shaderProgram;
 	}
+
+	/// <summary>
+	/// Creates many shader programs at once. Programs are restored from the binary cache where possible.
+	/// The rest are all submitted for compile and link before any status is queried, so drivers with
+	/// GL_KHR_parallel_shader_compile can build them concurrently.
+	/// </summary>
+	/// <param name="sources">GLSL source for each program</param>
+	/// <returns>Program handles in the same order as sources</returns>
+	std::vector<unsigned int> createShaderPrograms(const std::vector<ShaderSource>& sources) {
+		EW_PROFILE_SCOPE("createShaderPrograms");
+		auto startTime = std::chrono::steady_clock::now();
+		size_t numPrograms = sources.size();
+		std::vector<unsigned int> programs(numPrograms);
+		std::vector<unsigned int> vertexShaders(numPrograms, 0);
+		std::vector<unsigned int> fragmentShaders(numPrograms, 0);
+		std::vector<uint64_t> keys(numPrograms, 0);
+		std::vector<size_t> pending;
+		bool cacheEnabled = isShaderCacheEnabled();
+
+		for (size_t i = 0; i < numPrograms; i++)
+		{
+			programs[i] = glCreateProgram();
+			if (cacheEnabled) {
+				keys[i] = getShaderCacheKey(sources[i].vertexShaderSource, sources[i].fragmentShaderSource);
+				if (loadCachedProgram(keys[i], programs[i])) {
+					continue;
+				}
+				//Start over with a clean program object if a stale binary was rejected
+				glDeleteProgram(programs[i]);
+				programs[i] = glCreateProgram();
+			}
+			vertexShaders[i] = createShader(GL_VERTEX_SHADER, sources[i].vertexShaderSource);
+			fragmentShaders[i] = createShader(GL_FRAGMENT_SHADER, sources[i].fragmentShaderSource);
+			pending.push_back(i);
+		}
+		size_t numMisses = pending.size();
+		for (size_t p = 0; p < pending.size(); p++)
+		{
+			size_t i = pending[p];
+			unsigned int shaderProgram = programs[i];
+			//Attach each stage
+			glAttachShader(shaderProgram, vertexShaders[i]);
+			glAttachShader(shaderProgram, fragmentShaders[i]);
+			if (cacheEnabled) {
+				glProgramParameteri(shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			}
+			//Link all the stages together
+			glLinkProgram(shaderProgram);
+		}
+
+		bool parallel = hasParallelShaderCompile();
+		while (!pending.empty()) {
+			//With parallel compile, finish programs in whatever order the driver completes them.
+			//Otherwise the status query below blocks on each one in turn.
+			size_t p = 0;
+			if (parallel) {
+				for (p = 0; p < pending.size(); p++)
+				{
+					int complete = 0;
+					glGetProgramiv(programs[pending[p]], GL_COMPLETION_STATUS_KHR, &complete);
+					if (complete) {
+						break;
+					}
+				}
+				if (p == pending.size()) {
+					std::this_thread::yield();
+					continue;
+				}
+			}
+			size_t i = pending[p];
+			pending.erase(pending.begin() + p);
+
+			unsigned int shaderProgram = programs[i];
+			checkShaderCompiled(vertexShaders[i]);
+			checkShaderCompiled(fragmentShaders[i]);
+			int success;
+			glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
+			if (!success) {
+				char infoLog[512];
+				glGetProgramInfoLog(shaderProgram, 512, NULL, infoLog);
+				printf("Failed to link shader program: %s", infoLog);
+			}
+			else if (cacheEnabled) {
+				saveCachedProgram(keys[i], shaderProgram);
+			}
+			//The linked program now contains our compiled code, so we can delete these intermediate objects
+			glDeleteShader(vertexShaders[i]);
+			glDeleteShader(fragmentShaders[i]);
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		addShaderCacheStats((unsigned int)(numPrograms - numMisses), (unsigned int)numMisses, seconds);
+		return programs;
+	}
 	/// <summary>
 	/// Creates a shader instance with vertex + fragment stages
 	/// </summary>
@@ -88,6 +217,98 @@ namespace ew {
 		std::string vertexShaderSource = ew::loadShaderSourceFromFile(vertexShader.c_str());
 		std::string fragmentShaderSource = ew::loadShaderSourceFromFile(fragmentShader.c_str());
 		m_id = ew::createShaderProgram(vertexShaderSource.c_str(), fragmentShaderSource.c_str());
+		cacheUniformLocations();
+	}
+	/// <summary>
+	/// Wraps an already linked program, e.g. one returned by createShaderPrograms
+	/// </summary>
+	/// <param name="program">Shader program handle</param>
+	Shader::Shader(unsigned int program)
+	{
+		m_id = program;
+		cacheUniformLocations();
+	}
+	/// <summary>
+	/// Loads and builds several shaders in one batch. See createShaderPrograms.
+	/// </summary>
+	/// <param name="files">Vertex and fragment shader file path for each shader</param>
+	std::vector<Shader> loadShaders(const std::vector<std::pair<std::string, std::string>>& files) {
+		std::vector<std::string> sourceText(files.size() * 2);
+		std::vector<ShaderSource> sources(files.size());
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			sourceText[i * 2] = loadShaderSourceFromFile(files[i].first);
+			sourceText[i * 2 + 1] = loadShaderSourceFromFile(files[i].second);
+			sources[i] = { sourceText[i * 2].c_str(), sourceText[i * 2 + 1].c_str() };
+		}
+		std::vector<unsigned int> programs = createShaderPrograms(sources);
+		std::vector<Shader> shaders;
+		shaders.reserve(programs.size());
+		for (size_t i = 0; i < programs.size(); i++)
+		{
+			shaders.emplace_back(programs[i]);
+		}
+		return shaders;
+	}
+	/// <summary>
+	/// Builds a sorted name -> location table of every active uniform so setters never call glGetUniformLocation.
+	/// Arrays are also stored under their base name ("lights" as well as "lights[0]"), and by every element ("lights[2]").
+	/// </summary>
+	void Shader::cacheUniformLocations()
+	{
+		m_uniformLocations.clear();
+		int numUniforms = 0;
+		int maxNameLength = 0;
+		glGetProgramiv(m_id, GL_ACTIVE_UNIFORMS, &numUniforms);
+		glGetProgramiv(m_id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+		std::vector<char> nameBuffer(maxNameLength > 0 ? maxNameLength : 1);
+		for (int i = 0; i < numUniforms; i++)
+		{
+			int size;
+			GLenum type;
+			GLsizei nameLength = 0;
+			glGetActiveUniform(m_id, (GLuint)i, (GLsizei)nameBuffer.size(), &nameLength, &size, &type, nameBuffer.data());
+			std::string name(nameBuffer.data(), nameLength);
+			//Members of uniform blocks have no location
+			int location = glGetUniformLocation(m_id, name.c_str());
+			if (location < 0) {
+				continue;
+			}
+			m_uniformLocations.emplace_back(name, location);
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0) {
+				std::string baseName = name.substr(0, name.size() - 3);
+				m_uniformLocations.emplace_back(baseName, location);
+				//Arrays of basic types are one active uniform, so every element after [0] is added here
+				for (int element = 1; element < size; element++)
+				{
+					std::string elementName = baseName + "[" + std::to_string(element) + "]";
+					int elementLocation = glGetUniformLocation(m_id, elementName.c_str());
+					if (elementLocation >= 0) {
+						m_uniformLocations.emplace_back(elementName, elementLocation);
+					}
+				}
+			}
+		}
+		std::sort(m_uniformLocations.begin(), m_uniformLocations.end());
+	}
+	int Shader::getUniformLocation(std::string_view name) const
+	{
+		auto it = std::lower_bound(m_uniformLocations.begin(), m_uniformLocations.end(), name, [](const std::pair<std::string, int>& entry, std::string_view key) {
+			return std::string_view(entry.first) < key;
+		});
+		if (it == m_uniformLocations.end() || it->first != name) {
+			return -1;
+		}
+		return it->second;
+	}
+	void Shader::bindUniformBlock(const std::string& blockName, unsigned int bindingPoint) const
+	{
+		unsigned int blockIndex = glGetUniformBlockIndex(m_id, blockName.c_str());
+		if (blockIndex == GL_INVALID_INDEX) {
+			printf("Uniform block %s not found", blockName.c_str());
+			return;
+		}
+		glUniformBlockBinding(m_id, blockIndex, bindingPoint);
 	}
 	void Shader::use()const
 	{
@@ -95,15 +316,15 @@ namespace ew {
 	}
 	void Shader::setInt(const std::string& name, int v) const
 	{
-		glUniform1i(glGetUniformLocation(m_id, name.c_str()), v);
+		glUniform1i(getUniformLocation(name), v);
 	}
 	void Shader::setFloat(const std::string& name, float v) const
 	{
-		glUniform1f(glGetUniformLocation(m_id, name.c_str()), v);
+		glUniform1f(getUniformLocation(name), v);
 	}
 	void Shader::setVec2(const std::string& name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(m_id, name.c_str()), x, y);
+		glUniform2f(getUniformLocation(name), x, y);
 	}
 	void Shader::setVec2(const std::string& name, const glm::vec2& v) const
 	{
@@ -111,7 +332,7 @@ namespace ew {
 	}
 	void Shader::setVec3(const std::string& name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(m_id, name.c_str()), x, y, z);
+		glUniform3f(getUniformLocation(name), x, y, z);
 	}
 	void Shader::setVec3(const std::string& name, const glm::vec3& v) const
 	{
@@ -119,7 +340,7 @@ namespace ew {
 	}
 	void Shader::setVec4(const std::string& name, float x, float y, float z, float w) const
 	{
-		glUniform4f(glGetUniformLocation(m_id, name.c_str()), x, y, z, w);
+		glUniform4f(getUniformLocation(name), x, y, z, w);
 	}
 	void Shader::setVec4(const std::string& name, const glm::vec4& v) const
 	{
@@ -127,7 +348,31 @@ namespace ew {
 	}
 	void Shader::setMat4(const std::string& name, const glm::mat4& m) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(m_id, name.c_str()), 1, GL_FALSE, glm::value_ptr(m));
+		glUniformMatrix4fv(getUniformLocation(name), 1, GL_FALSE, glm::value_ptr(m));
+	}
+	void Shader::setInt(int location, int v) const
+	{
+		glUniform1i(location, v);
+	}
+	void Shader::setFloat(int location, float v) const
+	{
+		glUniform1f(location, v);
+	}
+	void Shader::setVec2(int location, const glm::vec2& v) const
+	{
+		glUniform2f(location, v.x, v.y);
+	}
+	void Shader::setVec3(int location, const glm::vec3& v) const
+	{
+		glUniform3f(location, v.x, v.y, v.z);
+	}
+	void Shader::setVec4(int location, const glm::vec4& v) const
+	{
+		glUniform4f(location, v.x, v.y, v.z, v.w);
+	}
+	void Shader::setMat4(int location, const glm::mat4& m) const
+	{
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(m));
 	}
 }
 
@@ -4,15 +4,32 @@
 
 #pragma once
 #include <string>
+#include <string_view>
+#include <vector>
+#include <utility>
 #include <glm/glm.hpp>
 
 namespace ew {
 	std::string loadShaderSourceFromFile(const std::string& filePath);
 	unsigned int createShaderProgram(const char* vertexShaderSource, const char* fragmentShaderSource);
+	unsigned int createComputeShaderProgram(const char* computeShaderSource);
+	struct ShaderSource {
+		const char* vertexShaderSource;
+		const char* fragmentShaderSource;
+	};
+	//Builds all programs in one batch so the driver can compile them in parallel. Uses the program binary cache (shaderCache.h).
+	std::vector<unsigned int> createShaderPrograms(const std::vector<ShaderSource>& sources);
 	class Shader {
 	public:
 		Shader(const std::string& vertexShader, const std::string& fragmentShader);
+		explicit Shader(unsigned int program);
 		void use()const;
+		inline unsigned int getID()const { return m_id; }
+		//Location of an active uniform, or -1. Looked up in a table built after linking, no GL call.
+		//Store the result to skip the lookup entirely on hot paths.
+		int getUniformLocation(std::string_view name) const;
+		//Assigns a uniform block (e.g. layout(std140) uniform Camera) to a binding point used by UniformBuffer::bind
+		void bindUniformBlock(const std::string& blockName, unsigned int bindingPoint) const;
 		void setInt(const std::string& name, int v) const;
 		void setFloat(const std::string& name, float v) const;
 		void setVec2(const std::string& name, float x, float y) const;
@@ -22,7 +39,18 @@ namespace ew {
 		void setVec4(const std::string& name, float x, float y, float z, float w) const;
 		void setVec4(const std::string& name, const glm::vec4& v) const;
 		void setMat4(const std::string& name, const glm::mat4& m) const;
+		//Setters by location from getUniformLocation
+		void setInt(int location, int v) const;
+		void setFloat(int location, float v) const;
+		void setVec2(int location, const glm::vec2& v) const;
+		void setVec3(int location, const glm::vec3& v) const;
+		void setVec4(int location, const glm::vec4& v) const;
+		void setMat4(int location, const glm::mat4& m) const;
 	private:
+		void cacheUniformLocations();
 		unsigned int m_id; //Shader program handle
+		std::vector<std::pair<std::string, int>> m_uniformLocations; //Sorted by name
 	};
+	//Batch version of the Shader constructor. Each pair is vertex shader path, fragment shader path.
+	std::vector<Shader> loadShaders(const std::vector<std::pair<std::string, std::string>>& files);
 }
\ No newline at end of file
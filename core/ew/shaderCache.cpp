@@ -0,0 +1,155 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "shaderCache.h"
+#include "external/glad.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <filesystem>
+
+namespace ew {
+	static const char SHADER_CACHE_MAGIC[4] = { 'E','W','S','C' };
+
+	struct ShaderCacheHeader {
+		char magic[4];
+		uint32_t format; //Driver specific binary format from glGetProgramBinary
+		uint64_t key;
+		uint32_t length;
+		uint32_t reserved;
+	};
+
+	static std::string s_cacheDirectory = "shaderCache";
+	static ShaderCacheStats s_stats;
+
+	void setShaderCacheDirectory(const std::string& directory) {
+		s_cacheDirectory = directory;
+	}
+
+	const std::string& getShaderCacheDirectory() {
+		return s_cacheDirectory;
+	}
+
+	ShaderCacheStats getShaderCacheStats() {
+		return s_stats;
+	}
+
+	void resetShaderCacheStats() {
+		s_stats = ShaderCacheStats();
+	}
+
+	void addShaderCacheStats(unsigned int hits, unsigned int misses, double seconds) {
+		s_stats.hits += hits;
+		s_stats.misses += misses;
+		s_stats.seconds += seconds;
+	}
+
+	bool isShaderCacheEnabled() {
+		if (s_cacheDirectory.empty()) {
+			return false;
+		}
+		//Drivers without any binary formats cannot restore programs
+		int numFormats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		return numFormats > 0;
+	}
+
+	static uint64_t hashBytes(uint64_t hash, const char* bytes) {
+		//FNV-1a. Include the terminator so "ab"+"c" and "a"+"bc" differ.
+		if (bytes == NULL) {
+			bytes = "";
+		}
+		do {
+			hash = (hash ^ (unsigned char)*bytes) * 1099511628211ull;
+		} while (*bytes++ != '\0');
+		return hash;
+	}
+
+	/// <summary>
+	/// Key for a program binary. Binaries are only valid for the driver that produced them, so the
+	/// vendor, renderer and version strings are part of the key along with the source.
+	/// </summary>
+	uint64_t getShaderCacheKey(const char* vertexShaderSource, const char* fragmentShaderSource) {
+		uint64_t hash = 14695981039346656037ull;
+		hash = hashBytes(hash, vertexShaderSource);
+		hash = hashBytes(hash, fragmentShaderSource);
+		hash = hashBytes(hash, (const char*)glGetString(GL_VENDOR));
+		hash = hashBytes(hash, (const char*)glGetString(GL_RENDERER));
+		hash = hashBytes(hash, (const char*)glGetString(GL_VERSION));
+		return hash;
+	}
+
+	static std::string getCachePath(uint64_t key) {
+		char name[32];
+		snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+		return s_cacheDirectory + "/" + name;
+	}
+
+	bool loadCachedProgram(uint64_t key, unsigned int program) {
+		std::string path = getCachePath(key);
+		FILE* file = fopen(path.c_str(), "rb");
+		if (file == NULL) {
+			return false;
+		}
+		ShaderCacheHeader header;
+		std::vector<char> binary;
+		bool ok = fread(&header, sizeof(header), 1, file) == 1
+			&& memcmp(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic)) == 0
+			&& header.key == key;
+		if (ok) {
+			binary.resize(header.length);
+			ok = fread(binary.data(), 1, binary.size(), file) == binary.size();
+		}
+		fclose(file);
+		if (!ok) {
+			return false;
+		}
+		glProgramBinary(program, (GLenum)header.format, binary.data(), (GLsizei)binary.size());
+		int success = 0;
+		glGetProgramiv(program, GL_LINK_STATUS, &success);
+		if (!success) {
+			//Driver update or format mismatch. Drop it so it gets rewritten.
+			std::error_code ec;
+			std::filesystem::remove(path, ec);
+		}
+		return success != 0;
+	}
+
+	void saveCachedProgram(uint64_t key, unsigned int program) {
+		int length = 0;
+		glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length <= 0) {
+			return;
+		}
+		ShaderCacheHeader header = {};
+		memcpy(header.magic, SHADER_CACHE_MAGIC, sizeof(header.magic));
+		header.key = key;
+		std::vector<char> binary(length);
+		GLenum format = 0;
+		GLsizei written = 0;
+		glGetProgramBinary(program, length, &written, &format, binary.data());
+		if (written <= 0) {
+			return;
+		}
+		header.format = format;
+		header.length = (uint32_t)written;
+
+		std::error_code ec;
+		std::filesystem::create_directories(s_cacheDirectory, ec);
+		std::string path = getCachePath(key);
+		std::string tempPath = path + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if (file == NULL) {
+			return;
+		}
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, written, file) == (size_t)written;
+		ok = (fclose(file) == 0) && ok;
+		if (ok) {
+			std::filesystem::rename(tempPath, path, ec);
+		}
+		else {
+			std::filesystem::remove(tempPath, ec);
+		}
+	}
+}
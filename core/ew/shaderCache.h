@@ -0,0 +1,30 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <string>
+#include <stdint.h>
+
+namespace ew {
+	struct ShaderCacheStats {
+		unsigned int hits = 0; //Programs restored from a cached binary
+		unsigned int misses = 0; //Programs compiled from source
+		double seconds = 0.0; //Total time spent creating programs
+	};
+
+	//Linked program binaries are stored here, keyed by source text and driver. Empty disables the cache.
+	//Defaults to "shaderCache" in the working directory.
+	void setShaderCacheDirectory(const std::string& directory);
+	const std::string& getShaderCacheDirectory();
+	ShaderCacheStats getShaderCacheStats();
+	void resetShaderCacheStats();
+
+	//Used by createShaderPrograms. Require a current GL context.
+	bool isShaderCacheEnabled();
+	uint64_t getShaderCacheKey(const char* vertexShaderSource, const char* fragmentShaderSource);
+	//Restores a program with glProgramBinary. False if missing, stale, or rejected by the driver.
+	bool loadCachedProgram(uint64_t key, unsigned int program);
+	void saveCachedProgram(uint64_t key, unsigned int program);
+	void addShaderCacheStats(unsigned int hits, unsigned int misses, double seconds);
+}
@@ -0,0 +1,308 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "staticBatch.h"
+#include "culling.h"
+#include "jobSystem.h"
+#include "profiler.h"
+#include "external/glad.h"
+#include <math.h>
+#include <algorithm>
+#include <unordered_map>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EW_BATCH_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace ew {
+	//Objects per parallelFor chunk. Most objects are a few thousand vertices at most.
+	static const size_t TRANSFORM_GRAIN = 16;
+
+	/// <summary>
+	/// Writes vertices moved into world space. Normals go through the inverse transpose and are renormalized,
+	/// so non-uniform scale keeps them perpendicular to the surface.
+	/// </summary>
+	/// <param name="vertices">Object space vertices</param>
+	/// <param name="numVertices">Number of vertices</param>
+	/// <param name="modelMatrix">Object to world</param>
+	/// <param name="out">numVertices vertices to write</param>
+	static void transformVertices(const Vertex* vertices, size_t numVertices, const glm::mat4& modelMatrix, Vertex* out) {
+		glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(modelMatrix)));
+#ifdef EW_BATCH_SSE
+		static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertices are loaded as two halves of 4 floats");
+		__m128 m0 = _mm_loadu_ps(&modelMatrix[0][0]);
+		__m128 m1 = _mm_loadu_ps(&modelMatrix[1][0]);
+		__m128 m2 = _mm_loadu_ps(&modelMatrix[2][0]);
+		__m128 m3 = _mm_loadu_ps(&modelMatrix[3][0]);
+		__m128 n0 = _mm_setr_ps(normalMatrix[0][0], normalMatrix[0][1], normalMatrix[0][2], 0.0f);
+		__m128 n1 = _mm_setr_ps(normalMatrix[1][0], normalMatrix[1][1], normalMatrix[1][2], 0.0f);
+		__m128 n2 = _mm_setr_ps(normalMatrix[2][0], normalMatrix[2][1], normalMatrix[2][2], 0.0f);
+		__m128 minLengthSquared = _mm_set1_ps(1e-30f);
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			const float* in = (const float*)(vertices + i);
+			__m128 a = _mm_loadu_ps(in); //pos.xyz, normal.x
+			__m128 b = _mm_loadu_ps(in + 4); //normal.yz, uv
+			__m128 position = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(m0, _mm_shuffle_ps(a, a, _MM_SHUFFLE(0, 0, 0, 0))), _mm_mul_ps(m1, _mm_shuffle_ps(a, a, _MM_SHUFFLE(1, 1, 1, 1)))),
+				_mm_add_ps(_mm_mul_ps(m2, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2))), m3));
+			__m128 normal = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(n0, _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3))), _mm_mul_ps(n1, _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)))),
+				_mm_mul_ps(n2, _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+			//Length squared in every lane, w is 0
+			__m128 squared = _mm_mul_ps(normal, normal);
+			__m128 sum = _mm_add_ps(squared, _mm_shuffle_ps(squared, squared, _MM_SHUFFLE(2, 3, 0, 1)));
+			sum = _mm_add_ps(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 0, 3, 2)));
+			normal = _mm_div_ps(normal, _mm_sqrt_ps(_mm_max_ps(sum, minLengthSquared)));
+			//Pack back into pos.xyz, normal.x | normal.yz, uv
+			__m128 t = _mm_shuffle_ps(position, normal, _MM_SHUFFLE(0, 0, 2, 2));
+			float* o = (float*)(out + i);
+			_mm_storeu_ps(o, _mm_shuffle_ps(position, t, _MM_SHUFFLE(2, 0, 1, 0)));
+			_mm_storeu_ps(o + 4, _mm_shuffle_ps(normal, b, _MM_SHUFFLE(3, 2, 2, 1)));
+		}
+#else
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			out[i].pos = glm::vec3(modelMatrix * glm::vec4(vertices[i].pos, 1.0f));
+			glm::vec3 normal = normalMatrix * vertices[i].normal;
+			float length = glm::length(normal);
+			out[i].normal = length > 0.0f ? normal / length : normal;
+			out[i].uv = vertices[i].uv;
+		}
+#endif
+	}
+
+	//Box around both. Sphere radius is left to growRadius().
+	static void growBox(Bounds* bounds, const Bounds& other, bool first) {
+		bounds->min = first ? other.min : glm::min(bounds->min, other.min);
+		bounds->max = first ? other.max : glm::max(bounds->max, other.max);
+		bounds->center = (bounds->min + bounds->max) * 0.5f;
+	}
+
+	//Grows the radius around the box's center to contain other's sphere
+	static void growRadius(Bounds* bounds, const Bounds& other) {
+		bounds->radius = std::max(bounds->radius, glm::length(other.center - bounds->center) + other.radius);
+	}
+
+	StaticBatch::~StaticBatch()
+	{
+		unload();
+	}
+
+	/// <summary>
+	/// Places every object in world space and merges them into one vertex and one index buffer.
+	/// Objects are sorted by grid cell, then split into batches at cell boundaries and whenever a batch would pass
+	/// maxVerticesPerBatch. Vertices are transformed in parallel on the global job system.
+	/// </summary>
+	/// <param name="objects">Meshes and where to put them. Objects without triangles are kept with an empty range.</param>
+	/// <param name="numObjects">Number of objects</param>
+	/// <param name="settings">Batch grouping</param>
+	/// <returns>False if there was nothing to draw</returns>
+	bool StaticBatch::build(const StaticObject* objects, size_t numObjects, const StaticBatchSettings& settings)
+	{
+		EW_PROFILE_SCOPE("StaticBatch::build");
+		unload();
+		m_objects.assign(numObjects, StaticBatchRange());
+
+		//Object space bounds once per distinct mesh, then moved into world space to find each object's cell
+		struct Placement {
+			glm::mat4 modelMatrix;
+			int cell[3];
+			uint32_t object;
+		};
+		std::unordered_map<const MeshData*, Bounds> localBounds;
+		std::vector<Placement> placements;
+		placements.reserve(numObjects);
+		for (size_t i = 0; i < numObjects; i++)
+		{
+			const MeshData* mesh = objects[i].mesh;
+			if (mesh == nullptr || mesh->indices.empty()) {
+				continue;
+			}
+			auto it = localBounds.find(mesh);
+			if (it == localBounds.end()) {
+				it = localBounds.emplace(mesh, computeBounds(mesh->vertices.data(), mesh->vertices.size())).first;
+			}
+			Placement placement;
+			placement.modelMatrix = objects[i].transform.modelMatrix();
+			placement.object = (uint32_t)i;
+			glm::vec3 center = transformBounds(it->second, placement.modelMatrix).center;
+			for (int axis = 0; axis < 3; axis++)
+			{
+				placement.cell[axis] = settings.cellSize > 0.0f ? (int)floorf(center[axis] / settings.cellSize) : 0;
+			}
+			placements.push_back(placement);
+		}
+		std::stable_sort(placements.begin(), placements.end(), [](const Placement& a, const Placement& b) {
+			return std::lexicographical_compare(a.cell, a.cell + 3, b.cell, b.cell + 3);
+		});
+
+		//Objects are laid out in placement order, so every batch is one contiguous range
+		unsigned int numVertices = 0;
+		unsigned int numIndices = 0;
+		for (size_t i = 0; i < placements.size(); i++)
+		{
+			const MeshData& mesh = *objects[placements[i].object].mesh;
+			unsigned int meshVertices = (unsigned int)mesh.vertices.size();
+			bool newCell = i == 0 || !std::equal(placements[i].cell, placements[i].cell + 3, placements[i - 1].cell);
+			if (newCell || m_batches.back().numVertices + meshVertices > settings.maxVerticesPerBatch) {
+				StaticBatchRange batch;
+				batch.firstVertex = numVertices;
+				batch.firstIndex = numIndices;
+				batch.numObjects = 0;
+				m_batches.push_back(batch);
+			}
+			StaticBatchRange& batch = m_batches.back();
+			StaticBatchRange& object = m_objects[placements[i].object];
+			object.firstVertex = numVertices;
+			object.numVertices = meshVertices;
+			object.firstIndex = numIndices;
+			object.numIndices = (unsigned int)mesh.indices.size();
+			object.batch = (unsigned int)(m_batches.size() - 1);
+			batch.numVertices += object.numVertices;
+			batch.numIndices += object.numIndices;
+			batch.numObjects++;
+			numVertices += object.numVertices;
+			numIndices += object.numIndices;
+		}
+		if (numIndices == 0) {
+			m_objects.clear();
+			m_batches.clear();
+			return false;
+		}
+
+		std::vector<Vertex> vertices(numVertices);
+		std::vector<unsigned int> indices(numIndices);
+		JobSystem::global().parallelFor(placements.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				const MeshData& mesh = *objects[placements[i].object].mesh;
+				StaticBatchRange& object = m_objects[placements[i].object];
+				transformVertices(mesh.vertices.data(), mesh.vertices.size(), placements[i].modelMatrix, vertices.data() + object.firstVertex);
+				unsigned int* objectIndices = indices.data() + object.firstIndex;
+				for (size_t j = 0; j < mesh.indices.size(); j++)
+				{
+					objectIndices[j] = mesh.indices[j] + object.firstVertex;
+				}
+				//Exact, from the transformed vertices, rather than transformBounds' conservative box
+				object.bounds = computeBounds(vertices.data() + object.firstVertex, object.numVertices);
+			}
+		}, TRANSFORM_GRAIN);
+
+		for (size_t pass = 0; pass < 2; pass++)
+		{
+			for (size_t i = 0; i < placements.size(); i++)
+			{
+				const StaticBatchRange& object = m_objects[placements[i].object];
+				StaticBatchRange& batch = m_batches[object.batch];
+				if (pass == 0) {
+					growBox(&batch.bounds, object.bounds, object.firstVertex == batch.firstVertex);
+				}
+				else {
+					growRadius(&batch.bounds, object.bounds);
+				}
+			}
+		}
+		for (size_t i = 0; i < m_batches.size(); i++)
+		{
+			growBox(&m_bounds, m_batches[i].bounds, i == 0);
+		}
+		for (size_t i = 0; i < m_batches.size(); i++)
+		{
+			growRadius(&m_bounds, m_batches[i].bounds);
+		}
+
+		//Indices stay 32 bit, since the merged buffers are usually far past 65536 vertices
+		glGenVertexArrays(1, &m_vao);
+		glGenBuffers(1, &m_vbo);
+		glGenBuffers(1, &m_ebo);
+		glBindVertexArray(m_vao);
+		glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ebo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), indices.data(), GL_STATIC_DRAW);
+		setVertexAttributes(VertexTraits<Vertex>::layout());
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		m_numVertices = numVertices;
+		m_numIndices = numIndices;
+		return true;
+	}
+
+	void StaticBatch::unload()
+	{
+		if (m_vao != 0) {
+			glDeleteVertexArrays(1, &m_vao);
+			glDeleteBuffers(1, &m_vbo);
+			glDeleteBuffers(1, &m_ebo);
+		}
+		m_vao = m_vbo = m_ebo = 0;
+		m_numVertices = m_numIndices = 0;
+		m_batches.clear();
+		m_objects.clear();
+		m_bounds = Bounds();
+	}
+
+	//Batches are back to back in the index buffer, so drawing all of them is a single draw
+	unsigned int StaticBatch::draw() const
+	{
+		if (m_vao == 0) {
+			return 0;
+		}
+		glBindVertexArray(m_vao);
+		glDrawElements(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, NULL);
+		return 1;
+	}
+
+	/// <summary>
+	/// Draws the batches that intersect the frustum. Each run of consecutive visible batches is drawn with one call.
+	/// </summary>
+	/// <returns>Number of draw calls</returns>
+	unsigned int StaticBatch::draw(const Frustum& frustum) const
+	{
+		if (m_vao == 0) {
+			return 0;
+		}
+		glBindVertexArray(m_vao);
+		unsigned int numDraws = 0;
+		size_t runStart = 0;
+		size_t runLength = 0;
+		for (size_t i = 0; i <= m_batches.size(); i++)
+		{
+			if (i < m_batches.size() && isVisible(frustum, m_batches[i].bounds)) {
+				if (runLength == 0) {
+					runStart = i;
+				}
+				runLength++;
+				continue;
+			}
+			if (runLength > 0) {
+				const StaticBatchRange& first = m_batches[runStart];
+				const StaticBatchRange& last = m_batches[runStart + runLength - 1];
+				unsigned int count = last.firstIndex + last.numIndices - first.firstIndex;
+				glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (const void*)(sizeof(unsigned int) * first.firstIndex));
+				numDraws++;
+				runLength = 0;
+			}
+		}
+		return numDraws;
+	}
+
+	unsigned int StaticBatch::draw(const Camera& camera) const
+	{
+		return draw(extractFrustum(camera));
+	}
+
+	void StaticBatch::drawObject(size_t object) const
+	{
+		const StaticBatchRange& range = m_objects[object];
+		if (m_vao == 0 || range.numIndices == 0) {
+			return;
+		}
+		glBindVertexArray(m_vao);
+		glDrawElements(GL_TRIANGLES, range.numIndices, GL_UNSIGNED_INT, (const void*)(sizeof(unsigned int) * range.firstIndex));
+	}
+}
@@ -0,0 +1,93 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "transform.h"
+#include "bounds.h"
+#include "camera.h"
+#include <vector>
+#include <stddef.h>
+
+namespace ew {
+	struct Frustum;
+
+	//An object to merge into a StaticBatch. The same MeshData can be placed many times.
+	struct StaticObject {
+		const MeshData* mesh = nullptr; //Only read during build()
+		Transform transform;
+	};
+
+	struct StaticBatchSettings {
+		//Objects are grouped by the grid cell their bounds center falls in, so each batch covers a compact area that
+		//can be culled. 0 = no grouping, batches are only split by maxVerticesPerBatch.
+		float cellSize = 0.0f;
+		unsigned int maxVerticesPerBatch = 1 << 20;
+	};
+
+	//A contiguous range of the merged index buffer, with its world space bounds
+	struct StaticBatchRange {
+		unsigned int firstIndex = 0;
+		unsigned int numIndices = 0;
+		unsigned int firstVertex = 0;
+		unsigned int numVertices = 0;
+		unsigned int numObjects = 1; //Objects merged into the range
+		unsigned int batch = 0; //Objects only: the batch holding the object
+		Bounds bounds;
+	};
+
+	//Static objects pre-transformed into world space and merged into one vertex and one index buffer, so the whole set
+	//is one draw instead of one per object and sub-mesh. Batches are the units of culling: draw(frustum) skips batches
+	//outside it and draws each run of neighbouring visible batches with one call, since their indices are contiguous.
+	//All objects share one shader. Vertices are in world space, so draw with an identity model matrix.
+	//
+	//	std::vector<ew::StaticObject> objects = ...;
+	//	ew::StaticBatchSettings settings;
+	//	settings.cellSize = 20.0f;
+	//	batch.build(objects, settings);
+	//	...each frame...
+	//	shader.setMat4("_Model", glm::mat4(1.0f));
+	//	batch.draw(camera);
+	class StaticBatch {
+	public:
+		StaticBatch() {};
+		~StaticBatch();
+		StaticBatch(const StaticBatch&) = delete;
+		StaticBatch& operator=(const StaticBatch&) = delete;
+		//Replaces the current contents. Returns false if the objects have no triangles.
+		bool build(const StaticObject* objects, size_t numObjects, const StaticBatchSettings& settings = StaticBatchSettings());
+		bool build(const std::vector<StaticObject>& objects, const StaticBatchSettings& settings = StaticBatchSettings()) {
+			return build(objects.data(), objects.size(), settings);
+		}
+		//Deletes the GL objects
+		void unload();
+
+		//Each function returns the number of draw calls made
+		unsigned int draw()const;
+		//Skips batches outside the frustum
+		unsigned int draw(const Frustum& frustum)const;
+		unsigned int draw(const Camera& camera)const;
+		//One object on its own, e.g. for highlighting. object is the index passed to build().
+		void drawObject(size_t object)const;
+
+		inline size_t getNumBatches()const { return m_batches.size(); }
+		inline const StaticBatchRange& getBatch(size_t batch)const { return m_batches[batch]; }
+		//Where an object ended up, by its index in build()
+		inline size_t getNumObjects()const { return m_objects.size(); }
+		inline const StaticBatchRange& getObject(size_t object)const { return m_objects[object]; }
+		inline unsigned int getNumVertices()const { return m_numVertices; }
+		inline unsigned int getNumIndices()const { return m_numIndices; }
+		//World space bounds of everything
+		inline const Bounds& getBounds()const { return m_bounds; }
+	private:
+		unsigned int m_vao = 0;
+		unsigned int m_vbo = 0;
+		unsigned int m_ebo = 0;
+		unsigned int m_numVertices = 0;
+		unsigned int m_numIndices = 0;
+		std::vector<StaticBatchRange> m_batches;
+		std::vector<StaticBatchRange> m_objects;
+		Bounds m_bounds;
+	};
+}
@@ -0,0 +1,522 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "terrain.h"
+#include "procGen.h"
+#include "culling.h"
+#include "jobSystem.h"
+#include "profiler.h"
+#include "external/stb_image.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+
+namespace ew {
+	struct Terrain::GeneratedChunk {
+		int x = 0;
+		int z = 0;
+		int lod = 0;
+		MeshData mesh;
+		double generationMs = 0.0;
+		std::chrono::steady_clock::time_point requestTime;
+	};
+
+	//Read by generation tasks, which may outlive the terrain
+	struct Terrain::SharedState {
+		TerrainSettings settings;
+		HeightFunction heights;
+		std::atomic<bool> cancelled{ false };
+		std::mutex mutex;
+		std::deque<GeneratedChunk> generated;
+	};
+
+	static uint64_t getChunkKey(int x, int z) {
+		return ((uint64_t)(uint32_t)x << 32) | (uint32_t)z;
+	}
+
+	//Distance on XZ from eye to the nearest point of the chunk
+	static float getChunkDistance(const glm::vec2& eye, int x, int z, float chunkSize) {
+		glm::vec2 min = glm::vec2((float)x, (float)z) * chunkSize;
+		glm::vec2 max = min + chunkSize;
+		glm::vec2 d = glm::max(glm::max(min - eye, eye - max), glm::vec2(0.0f));
+		return glm::length(d);
+	}
+
+	static float hashLattice(int x, int z, uint32_t seed) {
+		uint32_t h = (uint32_t)x * 374761393u + (uint32_t)z * 668265263u + seed * 2246822519u;
+		h = (h ^ (h >> 13)) * 1274126177u;
+		h ^= h >> 16;
+		return (float)h / 4294967295.0f * 2.0f - 1.0f;
+	}
+
+	static float valueNoise(float x, float z, uint32_t seed) {
+		float fx = floorf(x);
+		float fz = floorf(z);
+		int ix = (int)fx;
+		int iz = (int)fz;
+		float tx = x - fx;
+		float tz = z - fz;
+		//Smoothstep so the surface has no creases at lattice lines
+		tx = tx * tx * (3.0f - 2.0f * tx);
+		tz = tz * tz * (3.0f - 2.0f * tz);
+		float a = hashLattice(ix, iz, seed);
+		float b = hashLattice(ix + 1, iz, seed);
+		float c = hashLattice(ix, iz + 1, seed);
+		float d = hashLattice(ix + 1, iz + 1, seed);
+		return glm::mix(glm::mix(a, b, tx), glm::mix(c, d, tx), tz);
+	}
+
+	HeightFunction createNoiseHeights(float amplitude, float frequency, int octaves, uint32_t seed)
+	{
+		return [=](float x, float z) {
+			float sum = 0.0f;
+			float weight = 1.0f;
+			float totalWeight = 0.0f;
+			float f = frequency;
+			for (int i = 0; i < octaves; i++)
+			{
+				sum += valueNoise(x * f, z * f, seed + i) * weight;
+				totalWeight += weight;
+				weight *= 0.5f;
+				f *= 2.0f;
+			}
+			return totalWeight > 0.0f ? sum / totalWeight * amplitude : 0.0f;
+		};
+	}
+
+	HeightFunction createHeightmapHeights(const std::vector<float>& heights, int width, int depth, const glm::vec2& worldSize, float heightScale)
+	{
+		std::shared_ptr<const std::vector<float>> data = std::make_shared<const std::vector<float>>(heights);
+		return [=](float x, float z) {
+			if (width <= 0 || depth <= 0) {
+				return 0.0f;
+			}
+			//Texel centers span the whole world size
+			float u = glm::clamp((x / worldSize.x + 0.5f) * (width - 1), 0.0f, (float)(width - 1));
+			float v = glm::clamp((z / worldSize.y + 0.5f) * (depth - 1), 0.0f, (float)(depth - 1));
+			int x0 = std::min((int)u, width - 1);
+			int z0 = std::min((int)v, depth - 1);
+			int x1 = std::min(x0 + 1, width - 1);
+			int z1 = std::min(z0 + 1, depth - 1);
+			float tx = u - x0;
+			float tz = v - z0;
+			const float* row0 = data->data() + (size_t)z0 * width;
+			const float* row1 = data->data() + (size_t)z1 * width;
+			float h = glm::mix(glm::mix(row0[x0], row0[x1], tx), glm::mix(row1[x0], row1[x1], tx), tz);
+			return h * heightScale;
+		};
+	}
+
+	bool loadHeightmap(const std::string& filePath, std::vector<float>* heights, int* width, int* depth)
+	{
+		int numComponents;
+		//16 bit so heightmaps exported at full precision keep it. 8 bit images are widened.
+		unsigned short* pixels = stbi_load_16(filePath.c_str(), width, depth, &numComponents, 1);
+		if (pixels == NULL) {
+			printf("Failed to load heightmap %s\n", filePath.c_str());
+			return false;
+		}
+		size_t count = (size_t)*width * *depth;
+		heights->resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			(*heights)[i] = pixels[i] / 65535.0f;
+		}
+		stbi_image_free(pixels);
+		return true;
+	}
+
+	/// <summary>
+	/// Skirt depth that covers the gap between this chunk's edge and a neighbor's at any LOD.
+	/// Every LOD's edge vertices are LOD 0 edge vertices, so the widest gap is the largest distance
+	/// between LOD 0's edge samples and a coarser LOD's interpolation of them.
+	/// </summary>
+	static float computeSkirtDepth(const TerrainSettings& settings, const HeightFunction& heights, int chunkX, int chunkZ) {
+		int resolution = settings.chunkResolution;
+		float size = settings.chunkSize;
+		std::vector<float> samples(resolution + 1);
+		float maxError = 0.0f;
+		for (int edge = 0; edge < 4; edge++)
+		{
+			for (int i = 0; i <= resolution; i++)
+			{
+				float t = (float)i / resolution;
+				float x = edge < 2 ? t : (float)(edge - 2);
+				float z = edge < 2 ? (float)edge : t;
+				samples[i] = heights((chunkX + x) * size, (chunkZ + z) * size);
+			}
+			for (int lod = 1; lod < settings.numLods; lod++)
+			{
+				int step = std::min(1 << lod, resolution);
+				for (int i = 0; i <= resolution; i++)
+				{
+					int i0 = i / step * step;
+					int i1 = std::min(i0 + step, resolution);
+					float t = i1 > i0 ? (float)(i - i0) / (i1 - i0) : 0.0f;
+					float interpolated = glm::mix(samples[i0], samples[i1], t);
+					maxError = std::max(maxError, fabsf(interpolated - samples[i]));
+				}
+			}
+		}
+		//Never zero, so float differences between neighbors are covered too
+		return maxError + size / resolution * 0.1f;
+	}
+
+	//Grid index of the i-th vertex along an edge of a chunk with the given resolution
+	static unsigned int getEdgeVertex(unsigned int edge, unsigned int i, unsigned int resolution) {
+		unsigned int columns = resolution + 1;
+		switch (edge) {
+		case 0: return i; //+Z edge, toward +X
+		case 1: return i * columns + resolution; //+X edge, toward -Z
+		case 2: return resolution * columns + (resolution - i); //-Z edge, toward -X
+		default: return (resolution - i) * columns; //-X edge, toward +Z
+		}
+	}
+
+	/// <summary>
+	/// Builds one chunk on the calling thread
+	/// </summary>
+	/// <param name="settings">Terrain settings. chunkResolution >> lod is the grid resolution.</param>
+	/// <param name="heights">Height function</param>
+	/// <param name="chunkX">Chunk coordinate on X</param>
+	/// <param name="chunkZ">Chunk coordinate on Z</param>
+	/// <param name="lod">LOD level, 0 is the finest</param>
+	/// <returns>Grid vertices first, then 4 rows of skirt vertices</returns>
+	MeshData generateTerrainChunk(const TerrainSettings& settings, const HeightFunction& heights, int chunkX, int chunkZ, int lod)
+	{
+		int resolution = std::max(1, settings.chunkResolution >> lod);
+		unsigned int columns = resolution + 1;
+		float size = settings.chunkSize;
+		MeshSize gridSize = getPlaneSize(resolution);
+		MeshData mesh;
+		mesh.vertices.resize(gridSize.numVertices + columns * 4);
+		mesh.indices.resize(gridSize.numIndices + resolution * 4 * 6);
+		//Grid indices and UVs come from the plane, positions and normals are replaced below
+		writePlane(size, size, resolution, mesh.vertices.data(), mesh.indices.data());
+
+		//Heights with a one sample border so edge normals see the slope of the neighboring chunk.
+		//Positions are computed from the chunk coordinate and the fraction along it, so vertices shared with
+		//a neighbor at any LOD come out bit identical.
+		unsigned int border = columns + 2;
+		std::vector<float> grid((size_t)border * border);
+		for (unsigned int row = 0; row < border; row++)
+		{
+			float z = (chunkZ + 1.0f - ((float)row - 1.0f) / resolution) * size;
+			for (unsigned int col = 0; col < border; col++)
+			{
+				float x = (chunkX + ((float)col - 1.0f) / resolution) * size;
+				grid[row * border + col] = heights(x, z);
+			}
+		}
+		float spacing = size / resolution;
+		for (unsigned int row = 0; row < columns; row++)
+		{
+			float z = (chunkZ + 1.0f - (float)row / resolution) * size;
+			//Rows go toward -Z, so the row above is further along +Z
+			const float* above = grid.data() + row * border;
+			const float* center = above + border;
+			const float* below = center + border;
+			for (unsigned int col = 0; col < columns; col++)
+			{
+				Vertex& vertex = mesh.vertices[row * columns + col];
+				vertex.pos = glm::vec3((chunkX + (float)col / resolution) * size, center[col + 1], z);
+				float dx = center[col + 2] - center[col];
+				float dz = above[col + 1] - below[col + 1];
+				vertex.normal = glm::normalize(glm::vec3(-dx, 2.0f * spacing, -dz));
+			}
+		}
+
+		//SKIRTS
+		//Each edge is walked so that (edge, skirt, next edge) winds counter clockwise seen from outside the chunk
+		float skirtDepth = settings.skirtDepth > 0.0f ? settings.skirtDepth : computeSkirtDepth(settings, heights, chunkX, chunkZ);
+		unsigned int skirtStart = gridSize.numVertices;
+		unsigned int* out = mesh.indices.data() + gridSize.numIndices;
+		for (unsigned int edge = 0; edge < 4; edge++)
+		{
+			for (unsigned int i = 0; i < columns; i++)
+			{
+				Vertex skirt = mesh.vertices[getEdgeVertex(edge, i, resolution)];
+				skirt.pos.y -= skirtDepth;
+				mesh.vertices[skirtStart + edge * columns + i] = skirt;
+			}
+			for (unsigned int i = 0; i < (unsigned int)resolution; i++)
+			{
+				unsigned int e0 = getEdgeVertex(edge, i, resolution);
+				unsigned int e1 = getEdgeVertex(edge, i + 1, resolution);
+				unsigned int s0 = skirtStart + edge * columns + i;
+				unsigned int s1 = s0 + 1;
+				out[0] = e0;
+				out[1] = s0;
+				out[2] = e1;
+				out[3] = e1;
+				out[4] = s0;
+				out[5] = s1;
+				out += 6;
+			}
+		}
+		return mesh;
+	}
+
+	Terrain::~Terrain()
+	{
+		if (m_shared) {
+			//Queued tasks skip their work, running ones finish into the shared state and are freed with it
+			m_shared->cancelled = true;
+		}
+	}
+
+	/// <summary>
+	/// Sets up the arena. Chunks start streaming on the first update().
+	/// </summary>
+	/// <param name="settings">Chunk size, LODs, distances and budget</param>
+	/// <param name="heights">Height function, called from worker threads</param>
+	void Terrain::create(const TerrainSettings& settings, HeightFunction heights)
+	{
+		if (m_shared) {
+			m_shared->cancelled = true;
+		}
+		m_settings = settings;
+		m_settings.chunkResolution = std::max(1, m_settings.chunkResolution);
+		m_settings.numLods = std::max(1, m_settings.numLods);
+		//Every LOD needs at least one quad
+		while (m_settings.numLods > 1 && (m_settings.chunkResolution >> (m_settings.numLods - 1)) == 0) {
+			m_settings.numLods--;
+		}
+		m_settings.maxPendingChunks = std::max(1u, m_settings.maxPendingChunks);
+		m_shared = std::make_shared<SharedState>();
+		m_shared->settings = m_settings;
+		m_shared->heights = heights;
+
+		unsigned int columns = m_settings.chunkResolution + 1;
+		unsigned int maxChunkVertices = columns * columns + columns * 4;
+		unsigned int maxChunkIndices = m_settings.chunkResolution * m_settings.chunkResolution * 6 + m_settings.chunkResolution * 24;
+		//Room for a handful of full detail chunks, the arena grows from there
+		m_arena.create<Vertex>(maxChunkVertices * 16, maxChunkIndices * 16, maxChunkVertices <= 65536);
+		m_chunks.clear();
+		m_drawOrder.clear();
+		m_stats = TerrainStats();
+	}
+
+	int Terrain::selectLod(float distance) const
+	{
+		int lod = 0;
+		float limit = m_settings.lodDistance;
+		while (distance >= limit && lod < m_settings.numLods - 1) {
+			lod++;
+			limit *= 2.0f;
+		}
+		return lod;
+	}
+
+	float Terrain::getHeight(float x, float z) const
+	{
+		return m_shared ? m_shared->heights(x, z) : 0.0f;
+	}
+
+	/// <summary>
+	/// Uploads finished chunks, queues generation for chunks that are missing or at the wrong LOD (missing first, then nearest),
+	/// and evicts chunks outside the view distance while over the memory budget
+	/// </summary>
+	/// <param name="camera">Chunks are streamed around its position</param>
+	void Terrain::update(const Camera& camera)
+	{
+		if (!m_shared) {
+			return;
+		}
+		EW_PROFILE_SCOPE("Terrain::update");
+		//UPLOAD
+		{
+			std::deque<GeneratedChunk> ready;
+			{
+				std::lock_guard<std::mutex> lock(m_shared->mutex);
+				while (!m_shared->generated.empty() && ready.size() < m_settings.maxUploadsPerUpdate) {
+					ready.push_back(std::move(m_shared->generated.front()));
+					m_shared->generated.pop_front();
+				}
+			}
+			for (GeneratedChunk& generated : ready) {
+				upload(generated);
+			}
+		}
+
+		//REQUEST
+		glm::vec2 eye = glm::vec2(camera.position.x, camera.position.z);
+		float chunkSize = m_settings.chunkSize;
+		float viewDistance = m_settings.viewDistance;
+		int minX = (int)floorf((eye.x - viewDistance) / chunkSize);
+		int maxX = (int)floorf((eye.x + viewDistance) / chunkSize);
+		int minZ = (int)floorf((eye.y - viewDistance) / chunkSize);
+		int maxZ = (int)floorf((eye.y + viewDistance) / chunkSize);
+		struct Request {
+			TerrainChunk* chunk;
+			int lod;
+			bool missing;
+		};
+		std::vector<Request> requests;
+		for (int z = minZ; z <= maxZ; z++)
+		{
+			for (int x = minX; x <= maxX; x++)
+			{
+				float distance = getChunkDistance(eye, x, z, chunkSize);
+				if (distance > viewDistance) {
+					continue;
+				}
+				TerrainChunk& chunk = m_chunks[getChunkKey(x, z)];
+				chunk.x = x;
+				chunk.z = z;
+				int lod = selectLod(distance);
+				if (chunk.lod != lod && chunk.pendingLod < 0 && chunk.failedLod != lod) {
+					requests.push_back({ &chunk, lod, chunk.geometry == INVALID_GEOMETRY });
+				}
+			}
+		}
+		for (auto& it : m_chunks) {
+			it.second.distance = getChunkDistance(eye, it.second.x, it.second.z, chunkSize);
+		}
+		//Holes first, then LOD changes, nearest first within each
+		std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) {
+			if (a.missing != b.missing) {
+				return a.missing;
+			}
+			return a.chunk->distance < b.chunk->distance;
+		});
+		std::shared_ptr<SharedState> shared = m_shared;
+		auto now = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < requests.size() && m_stats.chunksPending < m_settings.maxPendingChunks; i++)
+		{
+			TerrainChunk* chunk = requests[i].chunk;
+			int x = chunk->x;
+			int z = chunk->z;
+			int lod = requests[i].lod;
+			chunk->pendingLod = lod;
+			m_stats.chunksPending++;
+			JobSystem::global().run([shared, x, z, lod, now]() {
+				if (shared->cancelled) {
+					return;
+				}
+				GeneratedChunk generated;
+				generated.x = x;
+				generated.z = z;
+				generated.lod = lod;
+				generated.requestTime = now;
+				auto start = std::chrono::steady_clock::now();
+				generated.mesh = generateTerrainChunk(shared->settings, shared->heights, x, z, lod);
+				generated.generationMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+				std::lock_guard<std::mutex> lock(shared->mutex);
+				shared->generated.push_back(std::move(generated));
+			});
+		}
+
+		//EVICT
+		std::vector<TerrainChunk*> evictable;
+		for (auto it = m_chunks.begin(); it != m_chunks.end();) {
+			TerrainChunk& chunk = it->second;
+			if (chunk.distance > viewDistance && chunk.pendingLod < 0) {
+				chunk.failedLod = -1;
+				if (chunk.geometry == INVALID_GEOMETRY) {
+					it = m_chunks.erase(it);
+					continue;
+				}
+				evictable.push_back(&chunk);
+			}
+			++it;
+		}
+		if (m_stats.residentBytes > m_settings.memoryBudget) {
+			std::sort(evictable.begin(), evictable.end(), [](const TerrainChunk* a, const TerrainChunk* b) {
+				return a->distance > b->distance;
+			});
+			for (size_t i = 0; i < evictable.size() && m_stats.residentBytes > m_settings.memoryBudget; i++)
+			{
+				evict(*evictable[i]);
+				m_chunks.erase(getChunkKey(evictable[i]->x, evictable[i]->z));
+			}
+		}
+
+		//Nearest first so the depth test rejects hidden chunks early
+		m_drawOrder.clear();
+		for (const auto& it : m_chunks) {
+			if (it.second.geometry != INVALID_GEOMETRY) {
+				m_drawOrder.push_back(&it.second);
+			}
+		}
+		std::sort(m_drawOrder.begin(), m_drawOrder.end(), [](const TerrainChunk* a, const TerrainChunk* b) {
+			return a->distance < b->distance;
+		});
+	}
+
+	void Terrain::upload(GeneratedChunk& generated)
+	{
+		m_stats.chunksPending--;
+		auto it = m_chunks.find(getChunkKey(generated.x, generated.z));
+		if (it == m_chunks.end() || it->second.pendingLod != generated.lod) {
+			return;
+		}
+		TerrainChunk& chunk = it->second;
+		chunk.pendingLod = -1;
+		GeometryHandle geometry = m_arena.allocate(generated.mesh);
+		//The arena grows on its own, so this is not a full buffer but a chunk it can never hold, e.g. too many vertices
+		//for 16 bit indices. Requesting it again would regenerate the same chunk every update.
+		if (geometry == INVALID_GEOMETRY) {
+			chunk.failedLod = generated.lod;
+			m_stats.chunksFailed++;
+			return;
+		}
+		if (chunk.geometry != INVALID_GEOMETRY) {
+			m_arena.free(chunk.geometry);
+			m_stats.residentBytes -= chunk.bytes;
+		}
+		else {
+			m_stats.chunksResident++;
+		}
+		chunk.geometry = geometry;
+		chunk.lod = generated.lod;
+		chunk.bounds = computeBounds(generated.mesh.vertices.data(), generated.mesh.vertices.size());
+		chunk.numIndices = (unsigned int)generated.mesh.indices.size();
+		chunk.bytes = generated.mesh.vertices.size() * sizeof(Vertex) + generated.mesh.indices.size() * m_arena.getIndexSize();
+		m_stats.residentBytes += chunk.bytes;
+
+		double latencyMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - generated.requestTime).count();
+		m_stats.chunksGenerated++;
+		m_stats.lastGenerationMs = generated.generationMs;
+		//Smoothed like the profiler's zone averages
+		bool first = m_stats.chunksGenerated == 1;
+		m_stats.averageGenerationMs = first ? generated.generationMs : m_stats.averageGenerationMs * 0.9 + generated.generationMs * 0.1;
+		m_stats.averageLatencyMs = first ? latencyMs : m_stats.averageLatencyMs * 0.9 + latencyMs * 0.1;
+		m_stats.maxLatencyMs = std::max(m_stats.maxLatencyMs, latencyMs);
+	}
+
+	void Terrain::evict(TerrainChunk& chunk)
+	{
+		m_arena.free(chunk.geometry);
+		m_stats.residentBytes -= chunk.bytes;
+		m_stats.chunksResident--;
+		m_stats.chunksEvicted++;
+		chunk.geometry = INVALID_GEOMETRY;
+		chunk.lod = -1;
+		chunk.bytes = 0;
+	}
+
+	void Terrain::draw(const Camera& camera)
+	{
+		m_stats.chunksDrawn = 0;
+		m_stats.trianglesDrawn = 0;
+		if (m_drawOrder.empty()) {
+			return;
+		}
+		Frustum frustum = extractFrustum(camera);
+		m_arena.bind();
+		for (const TerrainChunk* chunk : m_drawOrder) {
+			if (!isVisible(frustum, chunk->bounds)) {
+				continue;
+			}
+			m_arena.draw(chunk->geometry);
+			m_stats.chunksDrawn++;
+			m_stats.trianglesDrawn += chunk->numIndices / 3;
+		}
+	}
+}
@@ -0,0 +1,119 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "mesh.h"
+#include "camera.h"
+#include "bounds.h"
+#include "geometryArena.h"
+#include <glm/glm.hpp>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	//World space height at (x, z). Called from worker threads, so it must be safe to call concurrently.
+	typedef std::function<float(float x, float z)> HeightFunction;
+
+	//Fractal value noise in [-amplitude, amplitude]. frequency is in cycles per world unit for the first octave.
+	HeightFunction createNoiseHeights(float amplitude, float frequency, int octaves, uint32_t seed = 0);
+	//Bilinear lookup into a width x depth grid of heights (row major, row 0 at -Z), stretched over worldSize
+	//and centered on the origin. Positions outside the grid are clamped to its edge.
+	HeightFunction createHeightmapHeights(const std::vector<float>& heights, int width, int depth, const glm::vec2& worldSize, float heightScale = 1.0f);
+	//Reads a greyscale image (8 or 16 bit) into heights in [0, 1]
+	bool loadHeightmap(const std::string& filePath, std::vector<float>* heights, int* width, int* depth);
+
+	struct TerrainSettings {
+		float chunkSize = 64.0f; //World units per chunk side
+		int chunkResolution = 64; //Quads per chunk side at LOD 0. Use a power of two so every LOD's vertices lie on LOD 0's.
+		int numLods = 4; //LOD n has chunkResolution >> n quads per side
+		float lodDistance = 96.0f; //Chunks closer than this use LOD 0. Each further LOD starts at twice the distance of the previous one.
+		float viewDistance = 512.0f; //Chunks within this distance of the camera (on XZ) are loaded
+		size_t memoryBudget = 64 * 1024 * 1024; //GPU bytes of vertices and indices. Chunks outside the view distance are evicted, farthest first, to stay under it.
+		float skirtDepth = 0.0f; //How far skirts hang below chunk edges to cover cracks between LODs. 0 picks a depth per chunk from how far coarser LODs stray from LOD 0 along its edges.
+		unsigned int maxPendingChunks = 8; //Generation tasks in flight at once
+		unsigned int maxUploadsPerUpdate = 4; //Generated chunks uploaded per update()
+	};
+
+	struct TerrainStats {
+		unsigned int chunksResident = 0;
+		unsigned int chunksPending = 0; //Being generated
+		unsigned int chunksDrawn = 0; //In the last draw()
+		size_t trianglesDrawn = 0; //In the last draw(), skirts included
+		size_t residentBytes = 0;
+		unsigned int chunksGenerated = 0; //Since create()
+		unsigned int chunksEvicted = 0;
+		unsigned int chunksFailed = 0; //Generated but did not fit the geometry arena. That LOD is not requested again.
+		double lastGenerationMs = 0.0; //Worker time for the last uploaded chunk
+		double averageGenerationMs = 0.0; //Smoothed
+		double averageLatencyMs = 0.0; //From request to drawable, smoothed
+		double maxLatencyMs = 0.0;
+	};
+
+	//One chunk's slot in the terrain. Slots for chunks being generated have no geometry yet.
+	struct TerrainChunk {
+		int x = 0;
+		int z = 0;
+		int lod = -1; //Resident level, -1 if nothing is resident
+		int pendingLod = -1; //Level being generated, -1 if none
+		int failedLod = -1; //Level that could not be uploaded, -1 if none. Cleared when the chunk leaves the view distance.
+		GeometryHandle geometry = INVALID_GEOMETRY;
+		Bounds bounds; //World space, skirts included
+		unsigned int numIndices = 0;
+		size_t bytes = 0;
+		float distance = 0.0f; //From the camera on XZ at the last update()
+	};
+
+	//Streams a world of square chunks in around the camera.
+	//Chunks are generated on worker threads from the procGen grid, displaced by a height function, and uploaded into
+	//one geometry arena. Each chunk picks a geomipmap level from its distance to the camera. Levels share their edge
+	//vertices, and skirts hanging below every edge hide the T-junction cracks where neighbors differ.
+	//Positions are in world space, so draw with an identity model matrix.
+	//
+	//	terrain.create(settings, ew::createNoiseHeights(40.0f, 1.0f / 300.0f, 5));
+	//	...each frame...
+	//	terrain.update(camera);
+	//	shader.use();
+	//	terrain.draw(camera);
+	class Terrain {
+	public:
+		Terrain() {};
+		~Terrain();
+		Terrain(const Terrain&) = delete;
+		Terrain& operator=(const Terrain&) = delete;
+		void create(const TerrainSettings& settings, HeightFunction heights);
+		//Call once per frame on the GL thread. Requests chunks around the camera, uploads finished ones and evicts over budget.
+		void update(const Camera& camera);
+		//Draws resident chunks inside the camera's frustum, nearest first, with the currently bound shader
+		void draw(const Camera& camera);
+		//Exact height from the height function, not the mesh
+		float getHeight(float x, float z)const;
+		//LOD level for a chunk whose nearest point is distance away from the camera
+		int selectLod(float distance)const;
+		inline const TerrainSettings& getSettings()const { return m_settings; }
+		inline const TerrainStats& getStats()const { return m_stats; }
+		inline const GeometryArena& getArena()const { return m_arena; }
+
+		struct GeneratedChunk;
+		struct SharedState;
+	private:
+		void upload(GeneratedChunk& generated);
+		void evict(TerrainChunk& chunk);
+
+		TerrainSettings m_settings;
+		std::shared_ptr<SharedState> m_shared; //Also owned by in-flight generation tasks
+		GeometryArena m_arena;
+		std::unordered_map<uint64_t, TerrainChunk> m_chunks;
+		std::vector<const TerrainChunk*> m_drawOrder; //Resident chunks, nearest first
+		TerrainStats m_stats;
+	};
+
+	//Chunk (chunkX, chunkZ) covers [chunkX, chunkX + 1) * chunkSize on X and the same on Z.
+	//Vertices are the grid followed by skirt vertices, in world space. Normals come from the height function,
+	//so they match across chunk edges.
+	MeshData generateTerrainChunk(const TerrainSettings& settings, const HeightFunction& heights, int chunkX, int chunkZ, int lod);
+}
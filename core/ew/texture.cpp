@@ -5,36 +5,23 @@
 #include "texture.h"
 #include "external/glad.h"
 #include "external/stb_image.h"
+#include "profiler.h"
+#include "jobSystem.h"
 
-static int getTextureFormat(int numComponents) {
-	switch (numComponents) {
-	default:
-		return GL_RGBA;
-	case 3:
-		return GL_RGB;
-	case 2:
-		return GL_RG;
-	case 1:
-		return GL_RED;
-	}
-}
 namespace ew {
-	unsigned int loadTexture(const char* filePath) {
-		return loadTexture(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
-	}
-	unsigned int loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap) {
-		int width, height, numComponents;
-		unsigned char* data = stbi_load(filePath, &width, &height, &numComponents, 0);
-		if (data == NULL) {
-			printf("Failed to load image %s", filePath);
-			stbi_image_free(data);
-			return 0;
+	int getTextureFormat(int numComponents) {
+		switch (numComponents) {
+		default:
+			return GL_RGBA;
+		case 3:
+			return GL_RGB;
+		case 2:
+			return GL_RG;
+		case 1:
+			return GL_RED;
 		}
-		unsigned int texture;
-		glGenTextures(1, &texture);
-		glBindTexture(GL_TEXTURE_2D, texture);
-		int format = getTextureFormat(numComponents);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+	}
+	void setTextureParameters(int wrapMode, int magFilter, int minFilter) {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrapMode);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrapMode);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, minFilter);
@@ -43,14 +30,73 @@ namespace ew {
 		//Black border by default
 		float borderColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
 		glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+	}
+	unsigned int loadTexture(const char* filePath) {
+		return loadTexture(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
+	}
+	//Creates a texture from decoded pixels. Frees nothing.
+	static unsigned int uploadTexture(const unsigned char* data, int width, int height, int numComponents, int wrapMode, int magFilter, int minFilter, bool mipmap) {
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		int format = getTextureFormat(numComponents);
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+		setTextureParameters(wrapMode, magFilter, minFilter);
 
 		if (mipmap) {
 			glGenerateMipmap(GL_TEXTURE_2D);
 		}
 
 		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+	unsigned int loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap) {
+		EW_PROFILE_SCOPE("loadTexture");
+		int width, height, numComponents;
+		unsigned char* data = stbi_load(filePath, &width, &height, &numComponents, 0);
+		if (data == NULL) {
+			printf("Failed to load image %s", filePath);
+			stbi_image_free(data);
+			return 0;
+		}
+		unsigned int texture = uploadTexture(data, width, height, numComponents, wrapMode, magFilter, minFilter, mipmap);
 		stbi_image_free(data);
 		return texture;
 	}
+	void loadTextures(const std::vector<std::string>& filePaths, std::vector<unsigned int>* textures) {
+		loadTextures(filePaths, textures, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR, true);
+	}
+	/// <summary>
+	/// stbi_load is the slow part of loading a texture and needs no context, so every image is decoded on its own job.
+	/// Uploads stay on the calling thread, which must have the context current.
+	/// </summary>
+	/// <param name="filePaths">Images to load</param>
+	/// <param name="textures">Receives one handle per path, 0 for images that failed to load</param>
+	void loadTextures(const std::vector<std::string>& filePaths, std::vector<unsigned int>* textures, int wrapMode, int magFilter, int minFilter, bool mipmap) {
+		EW_PROFILE_SCOPE("loadTextures");
+		struct DecodedImage {
+			unsigned char* data = nullptr;
+			int width = 0;
+			int height = 0;
+			int numComponents = 0;
+		};
+		std::vector<DecodedImage> images(filePaths.size());
+		JobSystem::global().parallelFor(filePaths.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; i++)
+			{
+				images[i].data = stbi_load(filePaths[i].c_str(), &images[i].width, &images[i].height, &images[i].numComponents, 0);
+			}
+		});
+		textures->assign(filePaths.size(), 0);
+		for (size_t i = 0; i < images.size(); i++)
+		{
+			if (images[i].data == NULL) {
+				printf("Failed to load image %s", filePaths[i].c_str());
+				continue;
+			}
+			(*textures)[i] = uploadTexture(images[i].data, images[i].width, images[i].height, images[i].numComponents, wrapMode, magFilter, minFilter, mipmap);
+			stbi_image_free(images[i].data);
+		}
+	}
 }
 
@@ -3,8 +3,18 @@
 */
 
 #pragma once
+#include <string>
+#include <vector>
 
 namespace ew {
 	unsigned int loadTexture(const char* filePath);
 	unsigned int loadTexture(const char* filePath, int wrapMode, int magFilter, int minFilter, bool mipmap);
+	//Decodes the images in parallel on the global job system, then uploads them in order from the calling thread.
+	//textures receives one handle per path, 0 where the image failed to load.
+	void loadTextures(const std::vector<std::string>& filePaths, std::vector<unsigned int>* textures);
+	void loadTextures(const std::vector<std::string>& filePaths, std::vector<unsigned int>* textures, int wrapMode, int magFilter, int minFilter, bool mipmap);
+	//GL_RED/GL_RG/GL_RGB/GL_RGBA for a decoded image with this many channels
+	int getTextureFormat(int numComponents);
+	//Wrap, filter and border settings for the currently bound GL_TEXTURE_2D
+	void setTextureParameters(int wrapMode, int magFilter, int minFilter);
 }
@@ -0,0 +1,651 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "textureBake.h"
+#include "texture.h"
+#include "mappedFile.h"
+#include "jobSystem.h"
+#include "external/glad.h"
+#include "external/stb_image.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <filesystem>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EW_TEXTURE_SSE 1
+#include <emmintrin.h>
+#endif
+
+//S3TC is an extension, so the loader does not define these
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace ew {
+	static const char BAKED_TEXTURE_MAGIC[4] = { 'E','W','T','X' };
+	static const uint32_t BAKED_TEXTURE_VERSION = 1;
+	//Level data is aligned so it can be handed to GL straight from the mapping
+	static const uint64_t BAKED_TEXTURE_ALIGNMENT = 16;
+	static const uint32_t BAKED_TEXTURE_FLAG_SRGB = 1;
+
+	struct BakedTextureHeader {
+		char magic[4];
+		uint32_t version;
+		uint32_t encoding;
+		uint32_t numComponents;
+		uint32_t width;
+		uint32_t height;
+		uint32_t numLevels;
+		uint32_t flags;
+	};
+
+	//Per-level table entry. Offsets are from the start of the file.
+	struct BakedTextureLevel {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t width;
+		uint32_t height;
+	};
+
+	//Linear values are looked up with 16 bits of precision, well below the smallest sRGB step
+	static const int SRGB_TABLE_SIZE = 65536;
+
+	struct SrgbTables {
+		float toLinear[256];
+		uint8_t toSrgb[SRGB_TABLE_SIZE];
+		SrgbTables() {
+			for (int i = 0; i < 256; i++)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < SRGB_TABLE_SIZE; i++)
+			{
+				float l = i / (float)(SRGB_TABLE_SIZE - 1);
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (uint8_t)(c * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	static const SrgbTables& getSrgbTables() {
+		static SrgbTables tables;
+		return tables;
+	}
+
+	//Alpha is never gamma encoded. stb_image puts alpha last for 2 and 4 channel images.
+	static bool isColorChannel(int channel, int numComponents) {
+		if (numComponents == 2 || numComponents == 4) {
+			return channel < numComponents - 1;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Expands 8 bit texels to 4 floats each, converting color channels to linear
+	/// </summary>
+	static void toLinear(const TextureLevel& level, int numComponents, bool srgb, float* dst) {
+		const SrgbTables& tables = getSrgbTables();
+		size_t numTexels = (size_t)level.width * level.height;
+		for (size_t i = 0; i < numTexels; i++)
+		{
+			const uint8_t* texel = &level.data[i * numComponents];
+			for (int c = 0; c < 4; c++)
+			{
+				float v = 0.0f;
+				if (c < numComponents) {
+					v = srgb && isColorChannel(c, numComponents) ? tables.toLinear[texel[c]] : texel[c] / 255.0f;
+				}
+				dst[i * 4 + c] = v;
+			}
+		}
+	}
+
+	static void fromLinear(const float* src, int numComponents, bool srgb, TextureLevel* level) {
+		const SrgbTables& tables = getSrgbTables();
+		size_t numTexels = (size_t)level->width * level->height;
+		level->data.resize(numTexels * numComponents);
+		for (size_t i = 0; i < numTexels; i++)
+		{
+			for (int c = 0; c < numComponents; c++)
+			{
+				float v = std::min(std::max(src[i * 4 + c], 0.0f), 1.0f);
+				level->data[i * numComponents + c] = srgb && isColorChannel(c, numComponents) ?
+					tables.toSrgb[(int)(v * (SRGB_TABLE_SIZE - 1) + 0.5f)] : (uint8_t)(v * 255.0f + 0.5f);
+			}
+		}
+	}
+
+	/// <summary>
+	/// 2x2 box filter over 4 float texels. Odd edges are clamped.
+	/// </summary>
+	static void downsample(const float* src, int srcWidth, int srcHeight, float* dst, int dstWidth, int dstHeight) {
+		JobSystem::global().parallelFor(dstHeight, [&](size_t begin, size_t end) {
+			for (size_t y = begin; y < end; y++)
+			{
+				const float* row0 = src + (size_t)std::min((int)y * 2, srcHeight - 1) * srcWidth * 4;
+				const float* row1 = src + (size_t)std::min((int)y * 2 + 1, srcHeight - 1) * srcWidth * 4;
+				float* out = dst + y * dstWidth * 4;
+				for (int x = 0; x < dstWidth; x++)
+				{
+					int x0 = std::min(x * 2, srcWidth - 1) * 4;
+					int x1 = std::min(x * 2 + 1, srcWidth - 1) * 4;
+#ifdef EW_TEXTURE_SSE
+					__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+						_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+					_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+					for (int c = 0; c < 4; c++)
+					{
+						out[x * 4 + c] = (row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c]) * 0.25f;
+					}
+#endif
+				}
+			}
+		}, 16);
+	}
+
+	/// <summary>
+	/// Generates a full mip chain. Filtering happens on linear floats and each level is
+	/// produced from the previous unquantized level, so error does not build up down the chain.
+	/// </summary>
+	/// <param name="pixels">Source image as returned by stb_image</param>
+	/// <param name="width">Source width</param>
+	/// <param name="height">Source height</param>
+	/// <param name="numComponents">Channels per texel, 1-4</param>
+	/// <param name="srgb">Treat color channels as sRGB encoded</param>
+	/// <returns>Levels from largest to 1x1</returns>
+	std::vector<TextureLevel> generateMipChain(const uint8_t* pixels, int width, int height, int numComponents, bool srgb) {
+		std::vector<TextureLevel> levels(1);
+		levels[0].width = width;
+		levels[0].height = height;
+		levels[0].data.assign(pixels, pixels + (size_t)width * height * numComponents);
+
+		std::vector<float> current((size_t)width * height * 4);
+		std::vector<float> next;
+		toLinear(levels[0], numComponents, srgb, current.data());
+		while (width > 1 || height > 1) {
+			int nextWidth = std::max(width / 2, 1);
+			int nextHeight = std::max(height / 2, 1);
+			next.resize((size_t)nextWidth * nextHeight * 4);
+			downsample(current.data(), width, height, next.data(), nextWidth, nextHeight);
+
+			TextureLevel level;
+			level.width = nextWidth;
+			level.height = nextHeight;
+			fromLinear(next.data(), numComponents, srgb, &level);
+			levels.push_back(std::move(level));
+
+			current.swap(next);
+			width = nextWidth;
+			height = nextHeight;
+		}
+		return levels;
+	}
+
+	static uint16_t packColor565(const float color[3]) {
+		int r = std::min(std::max((int)(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+		int g = std::min(std::max((int)(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+		int b = std::min(std::max((int)(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	static void unpackColor565(uint16_t color, int out[3]) {
+		int r = (color >> 11) & 31;
+		int g = (color >> 5) & 63;
+		int b = color & 31;
+		out[0] = (r << 3) | (r >> 2);
+		out[1] = (g << 2) | (g >> 4);
+		out[2] = (b << 3) | (b >> 2);
+	}
+
+	/// <summary>
+	/// Encodes RGB as a BC1 block. Endpoints are picked along the principal axis of the block's colors
+	/// and always use 4 color mode, so the same block is valid inside BC3.
+	/// </summary>
+	/// <param name="rgba">16 RGBA texels. Alpha is ignored.</param>
+	/// <param name="out">8 byte block</param>
+	void encodeBC1Block(const uint8_t rgba[64], uint8_t out[8]) {
+		float mean[3] = { 0,0,0 };
+		float minColor[3] = { 255,255,255 };
+		float maxColor[3] = { 0,0,0 };
+		for (int i = 0; i < 16; i++)
+		{
+			for (int c = 0; c < 3; c++)
+			{
+				mean[c] += rgba[i * 4 + c];
+				minColor[c] = std::min(minColor[c], (float)rgba[i * 4 + c]);
+				maxColor[c] = std::max(maxColor[c], (float)rgba[i * 4 + c]);
+			}
+		}
+		for (int c = 0; c < 3; c++)
+		{
+			mean[c] /= 16.0f;
+		}
+		//Covariance matrix, upper triangle
+		float cov[6] = { 0,0,0,0,0,0 };
+		for (int i = 0; i < 16; i++)
+		{
+			float d[3] = { rgba[i * 4] - mean[0], rgba[i * 4 + 1] - mean[1], rgba[i * 4 + 2] - mean[2] };
+			cov[0] += d[0] * d[0];
+			cov[1] += d[0] * d[1];
+			cov[2] += d[0] * d[2];
+			cov[3] += d[1] * d[1];
+			cov[4] += d[1] * d[2];
+			cov[5] += d[2] * d[2];
+		}
+		//Power iteration for the principal axis, seeded with the bounding box diagonal
+		float axis[3] = { maxColor[0] - minColor[0], maxColor[1] - minColor[1], maxColor[2] - minColor[2] };
+		for (int iteration = 0; iteration < 8; iteration++)
+		{
+			float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			float length = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+			if (length <= 0.0f) {
+				break;
+			}
+			axis[0] = x / length;
+			axis[1] = y / length;
+			axis[2] = z / length;
+		}
+		float axisLength = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+
+		uint16_t color0 = packColor565(mean);
+		uint16_t color1 = color0;
+		if (axisLength > 0.0f) {
+			float minT = 1e30f, maxT = -1e30f;
+			for (int i = 0; i < 16; i++)
+			{
+				float t = ((rgba[i * 4] - mean[0]) * axis[0] + (rgba[i * 4 + 1] - mean[1]) * axis[1] + (rgba[i * 4 + 2] - mean[2]) * axis[2]) / axisLength;
+				minT = std::min(minT, t);
+				maxT = std::max(maxT, t);
+			}
+			//Pull the endpoints in slightly, the extremes are rarely worth a full palette entry
+			float inset = (maxT - minT) / 16.0f;
+			minT += inset;
+			maxT -= inset;
+			float end0[3], end1[3];
+			for (int c = 0; c < 3; c++)
+			{
+				end0[c] = mean[c] + axis[c] * maxT;
+				end1[c] = mean[c] + axis[c] * minT;
+			}
+			color0 = packColor565(end0);
+			color1 = packColor565(end1);
+			if (color0 < color1) {
+				std::swap(color0, color1);
+			}
+		}
+
+		uint32_t indices = 0;
+		if (color0 != color1) {
+			int palette[4][3];
+			unpackColor565(color0, palette[0]);
+			unpackColor565(color1, palette[1]);
+			for (int c = 0; c < 3; c++)
+			{
+				palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+				palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 0x7fffffff;
+				for (int p = 0; p < 4; p++)
+				{
+					int dr = rgba[i * 4] - palette[p][0];
+					int dg = rgba[i * 4 + 1] - palette[p][1];
+					int db = rgba[i * 4 + 2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (uint32_t)best << (i * 2);
+			}
+		}
+		out[0] = (uint8_t)(color0 & 0xff);
+		out[1] = (uint8_t)(color0 >> 8);
+		out[2] = (uint8_t)(color1 & 0xff);
+		out[3] = (uint8_t)(color1 >> 8);
+		for (int i = 0; i < 4; i++)
+		{
+			out[4 + i] = (uint8_t)(indices >> (i * 8));
+		}
+	}
+
+	/// <summary>
+	/// Encodes a single channel as a BC4 block using the 8 value mode between the block's min and max
+	/// </summary>
+	/// <param name="values">16 values</param>
+	/// <param name="out">8 byte block</param>
+	void encodeBC4Block(const uint8_t values[16], uint8_t out[8]) {
+		int minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; i++)
+		{
+			minValue = std::min(minValue, (int)values[i]);
+			maxValue = std::max(maxValue, (int)values[i]);
+		}
+		out[0] = (uint8_t)maxValue;
+		out[1] = (uint8_t)minValue;
+		uint64_t indices = 0;
+		if (maxValue != minValue) {
+			int palette[8];
+			palette[0] = maxValue;
+			palette[1] = minValue;
+			for (int i = 2; i < 8; i++)
+			{
+				palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+			}
+			for (int i = 0; i < 16; i++)
+			{
+				int best = 0;
+				int bestDistance = 256;
+				for (int p = 0; p < 8; p++)
+				{
+					int distance = abs(values[i] - palette[p]);
+					if (distance < bestDistance) {
+						bestDistance = distance;
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+		for (int i = 0; i < 6; i++)
+		{
+			out[2 + i] = (uint8_t)(indices >> (i * 8));
+		}
+	}
+
+	void encodeBC3Block(const uint8_t rgba[64], uint8_t out[16]) {
+		uint8_t alpha[16];
+		for (int i = 0; i < 16; i++)
+		{
+			alpha[i] = rgba[i * 4 + 3];
+		}
+		encodeBC4Block(alpha, out);
+		encodeBC1Block(rgba, out + 8);
+	}
+
+	void encodeBC5Block(const uint8_t red[16], const uint8_t green[16], uint8_t out[16]) {
+		encodeBC4Block(red, out);
+		encodeBC4Block(green, out + 8);
+	}
+
+	static TextureEncoding resolveEncoding(TextureEncoding encoding, int numComponents) {
+		if (encoding != TextureEncoding::AUTO) {
+			return encoding;
+		}
+		switch (numComponents) {
+		case 1:
+			return TextureEncoding::RAW;
+		case 2:
+			return TextureEncoding::BC5;
+		case 3:
+			return TextureEncoding::BC1;
+		default:
+			return TextureEncoding::BC3;
+		}
+	}
+
+	/// <summary>
+	/// Block compresses a level. Partial blocks at the edges repeat the last row/column.
+	/// </summary>
+	/// <param name="level">Level to encode</param>
+	/// <param name="numComponents">Channels per texel in level</param>
+	/// <param name="encoding">Output encoding. AUTO picks one from numComponents.</param>
+	/// <returns>Encoded texels, in the layout glCompressedTexImage2D expects</returns>
+	std::vector<uint8_t> encodeTextureLevel(const TextureLevel& level, int numComponents, TextureEncoding encoding) {
+		encoding = resolveEncoding(encoding, numComponents);
+		if (encoding == TextureEncoding::RAW) {
+			return level.data;
+		}
+		int blocksX = (level.width + 3) / 4;
+		int blocksY = (level.height + 3) / 4;
+		size_t blockSize = encoding == TextureEncoding::BC1 ? 8 : 16;
+		std::vector<uint8_t> out(blockSize * blocksX * blocksY);
+		JobSystem::global().parallelFor(blocksY, [&](size_t begin, size_t end) {
+			uint8_t rgba[64];
+			uint8_t red[16];
+			uint8_t green[16];
+			for (size_t by = begin; by < end; by++)
+			{
+				for (int bx = 0; bx < blocksX; bx++)
+				{
+					for (int i = 0; i < 16; i++)
+					{
+						int x = std::min(bx * 4 + (i & 3), level.width - 1);
+						int y = std::min((int)by * 4 + (i >> 2), level.height - 1);
+						const uint8_t* texel = &level.data[((size_t)y * level.width + x) * numComponents];
+						//Same expansion GL applies to luminance images
+						bool grey = numComponents < 3;
+						rgba[i * 4] = texel[0];
+						rgba[i * 4 + 1] = grey ? texel[0] : texel[1];
+						rgba[i * 4 + 2] = grey ? texel[0] : texel[2];
+						rgba[i * 4 + 3] = numComponents == 2 || numComponents == 4 ? texel[numComponents - 1] : 255;
+						red[i] = texel[0];
+						green[i] = numComponents > 1 ? texel[1] : 0;
+					}
+					uint8_t* block = &out[(by * blocksX + bx) * blockSize];
+					switch (encoding) {
+					case TextureEncoding::BC1:
+						encodeBC1Block(rgba, block);
+						break;
+					case TextureEncoding::BC3:
+						encodeBC3Block(rgba, block);
+						break;
+					default:
+						encodeBC5Block(red, green, block);
+						break;
+					}
+				}
+			}
+		}, 4);
+		return out;
+	}
+
+	std::string getBakedTexturePath(const std::string& sourcePath) {
+		return std::filesystem::path(sourcePath).replace_extension(".ewtex").string();
+	}
+
+	static uint64_t alignOffset(uint64_t offset) {
+		return (offset + BAKED_TEXTURE_ALIGNMENT - 1) & ~(BAKED_TEXTURE_ALIGNMENT - 1);
+	}
+
+	/// <summary>
+	/// Decodes an image, generates its mips, encodes every level and writes a .ewtex file.
+	/// Written to a temporary file first so a partially written texture is never picked up.
+	/// </summary>
+	/// <param name="sourcePath">Any image stb_image can read</param>
+	/// <param name="outputPath">Output file</param>
+	/// <param name="settings">Encoding and filtering options</param>
+	/// <returns>False on failure</returns>
+	bool bakeTexture(const std::string& sourcePath, const std::string& outputPath, const TextureBakeSettings& settings) {
+		int width, height, numComponents;
+		unsigned char* pixels = stbi_load(sourcePath.c_str(), &width, &height, &numComponents, 0);
+		if (pixels == NULL) {
+			printf("Failed to load image %s\n", sourcePath.c_str());
+			return false;
+		}
+		std::vector<TextureLevel> levels;
+		if (settings.mipmap) {
+			levels = generateMipChain(pixels, width, height, numComponents, settings.srgb);
+		}
+		else {
+			levels.resize(1);
+			levels[0].width = width;
+			levels[0].height = height;
+			levels[0].data.assign(pixels, pixels + (size_t)width * height * numComponents);
+		}
+		stbi_image_free(pixels);
+
+		TextureEncoding encoding = resolveEncoding(settings.encoding, numComponents);
+		std::vector<std::vector<uint8_t>> encoded(levels.size());
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			encoded[i] = encodeTextureLevel(levels[i], numComponents, encoding);
+		}
+
+		BakedTextureHeader header = {};
+		memcpy(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic));
+		header.version = BAKED_TEXTURE_VERSION;
+		header.encoding = (uint32_t)encoding;
+		header.numComponents = (uint32_t)numComponents;
+		header.width = (uint32_t)width;
+		header.height = (uint32_t)height;
+		header.numLevels = (uint32_t)levels.size();
+		header.flags = settings.srgb ? BAKED_TEXTURE_FLAG_SRGB : 0;
+
+		std::vector<BakedTextureLevel> entries(levels.size());
+		uint64_t offset = sizeof(BakedTextureHeader) + sizeof(BakedTextureLevel) * levels.size();
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			entries[i].offset = alignOffset(offset);
+			entries[i].size = encoded[i].size();
+			entries[i].width = (uint32_t)levels[i].width;
+			entries[i].height = (uint32_t)levels[i].height;
+			offset = entries[i].offset + entries[i].size;
+		}
+
+		std::string tempPath = outputPath + ".tmp";
+		FILE* file = fopen(tempPath.c_str(), "wb");
+		if (file == NULL) {
+			printf("Failed to write baked texture %s\n", outputPath.c_str());
+			return false;
+		}
+		static const char padding[BAKED_TEXTURE_ALIGNMENT] = {};
+		bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+		ok = ok && fwrite(entries.data(), sizeof(BakedTextureLevel), entries.size(), file) == entries.size();
+		uint64_t written = sizeof(BakedTextureHeader) + sizeof(BakedTextureLevel) * levels.size();
+		for (size_t i = 0; i < levels.size() && ok; i++)
+		{
+			ok = fwrite(padding, 1, entries[i].offset - written, file) == entries[i].offset - written;
+			ok = ok && fwrite(encoded[i].data(), 1, encoded[i].size(), file) == encoded[i].size();
+			written = entries[i].offset + entries[i].size;
+		}
+		ok = (fclose(file) == 0) && ok;
+
+		std::error_code ec;
+		if (ok) {
+			std::filesystem::rename(tempPath, outputPath, ec);
+			ok = !ec;
+		}
+		if (!ok) {
+			printf("Failed to write baked texture %s\n", outputPath.c_str());
+			std::filesystem::remove(tempPath, ec);
+		}
+		return ok;
+	}
+
+	static bool hasS3TC() {
+		static int supported = -1;
+		if (supported < 0) {
+			supported = 0;
+			int numExtensions = 0;
+			glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+			for (int i = 0; i < numExtensions; i++)
+			{
+				const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+				if (extension && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0) {
+					supported = 1;
+					break;
+				}
+			}
+		}
+		return supported == 1;
+	}
+
+	unsigned int loadBakedTexture(const char* filePath) {
+		return loadBakedTexture(filePath, GL_REPEAT, GL_LINEAR, GL_LINEAR_MIPMAP_LINEAR);
+	}
+
+	/// <summary>
+	/// Loads a texture written by bakeTexture. Levels are uploaded straight from the file mapping,
+	/// with no decoding and no mip generation on the CPU or GPU.
+	/// Texels keep the encoding of the source image and use the same (non sRGB) formats as loadTexture,
+	/// so shaders see the same values either way.
+	/// </summary>
+	/// <param name="filePath">.ewtex file</param>
+	/// <param name="wrapMode">Same as loadTexture</param>
+	/// <param name="magFilter">Same as loadTexture</param>
+	/// <param name="minFilter">Same as loadTexture</param>
+	/// <returns>Texture handle, or 0 on failure</returns>
+	unsigned int loadBakedTexture(const char* filePath, int wrapMode, int magFilter, int minFilter) {
+		MappedFile file;
+		if (!file.open(filePath)) {
+			printf("Failed to load baked texture %s\n", filePath);
+			return 0;
+		}
+		const char* bytes = (const char*)file.getData();
+		size_t fileSize = file.getSize();
+		BakedTextureHeader header;
+		bool valid = fileSize >= sizeof(BakedTextureHeader);
+		if (valid) {
+			memcpy(&header, bytes, sizeof(header));
+			valid = memcmp(header.magic, BAKED_TEXTURE_MAGIC, sizeof(header.magic)) == 0
+				&& header.version == BAKED_TEXTURE_VERSION
+				&& header.numLevels > 0
+				&& fileSize >= sizeof(BakedTextureHeader) + sizeof(BakedTextureLevel) * (uint64_t)header.numLevels;
+		}
+		const BakedTextureLevel* levels = (const BakedTextureLevel*)(bytes + sizeof(BakedTextureHeader));
+		for (uint32_t i = 0; valid && i < header.numLevels; i++)
+		{
+			valid = levels[i].offset + levels[i].size <= fileSize;
+		}
+		if (!valid) {
+			printf("Invalid baked texture %s\n", filePath);
+			return 0;
+		}
+
+		TextureEncoding encoding = (TextureEncoding)header.encoding;
+		int format;
+		switch (encoding) {
+		case TextureEncoding::BC1:
+			format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+			break;
+		case TextureEncoding::BC3:
+			format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+			break;
+		case TextureEncoding::BC5:
+			format = GL_COMPRESSED_RG_RGTC2;
+			break;
+		default:
+			format = getTextureFormat(header.numComponents);
+			break;
+		}
+		if ((encoding == TextureEncoding::BC1 || encoding == TextureEncoding::BC3) && !hasS3TC()) {
+			printf("Failed to load baked texture %s: S3TC compression not supported\n", filePath);
+			return 0;
+		}
+
+		unsigned int texture;
+		glGenTextures(1, &texture);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (uint32_t i = 0; i < header.numLevels; i++)
+		{
+			const void* data = bytes + levels[i].offset;
+			if (encoding == TextureEncoding::RAW) {
+				glTexImage2D(GL_TEXTURE_2D, i, format, levels[i].width, levels[i].height, 0, format, GL_UNSIGNED_BYTE, data);
+			}
+			else {
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, format, levels[i].width, levels[i].height, 0, (GLsizei)levels[i].size, data);
+			}
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		//Without this a texture baked without mips would be incomplete with a mipmapped min filter
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header.numLevels - 1);
+		setTextureParameters(wrapMode, magFilter, minFilter);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return texture;
+	}
+}
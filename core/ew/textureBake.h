@@ -0,0 +1,52 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	enum class TextureEncoding : uint32_t {
+		AUTO = 0, //BC1 for RGB, BC3 for RGBA, BC5 for two channels, RAW for single channel
+		RAW = 1, //Uncompressed, same channels as the source image
+		BC1 = 2, //RGB, 4 bits per texel
+		BC3 = 3, //RGBA, 8 bits per texel
+		BC5 = 4 //Two channels, 8 bits per texel. For normal maps and masks.
+	};
+
+	struct TextureBakeSettings {
+		TextureEncoding encoding = TextureEncoding::AUTO;
+		//Color channels are sRGB encoded and mips are filtered in linear space.
+		//Turn off for normal maps and other data textures.
+		bool srgb = true;
+		bool mipmap = true;
+	};
+
+	//One level of a mip chain. numComponents 8 bit channels per texel, rows tightly packed.
+	struct TextureLevel {
+		int width = 0;
+		int height = 0;
+		std::vector<uint8_t> data;
+	};
+
+	//Full mip chain down to 1x1. Level 0 is a copy of pixels. Uses the same channel layout as stb_image.
+	std::vector<TextureLevel> generateMipChain(const uint8_t* pixels, int width, int height, int numComponents, bool srgb);
+
+	//Block encoders. Input is a 4x4 block in row order.
+	void encodeBC1Block(const uint8_t rgba[64], uint8_t out[8]);
+	void encodeBC3Block(const uint8_t rgba[64], uint8_t out[16]);
+	void encodeBC4Block(const uint8_t values[16], uint8_t out[8]);
+	void encodeBC5Block(const uint8_t red[16], const uint8_t green[16], uint8_t out[16]);
+	//Compresses a whole level. RAW returns a copy.
+	std::vector<uint8_t> encodeTextureLevel(const TextureLevel& level, int numComponents, TextureEncoding encoding);
+
+	//Source path with its extension replaced by .ewtex
+	std::string getBakedTexturePath(const std::string& sourcePath);
+	bool bakeTexture(const std::string& sourcePath, const std::string& outputPath, const TextureBakeSettings& settings = TextureBakeSettings());
+
+	//Maps a baked texture and uploads every level as stored. Returns 0 on failure.
+	unsigned int loadBakedTexture(const char* filePath);
+	unsigned int loadBakedTexture(const char* filePath, int wrapMode, int magFilter, int minFilter);
+}
@@ -0,0 +1,446 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "transformSystem.h"
+#include "jobSystem.h"
+#include <atomic>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define EW_TRANSFORM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace ew {
+	//Levels smaller than this are not worth handing to other threads
+	static const size_t PARALLEL_LEVEL_SIZE = 4096;
+
+	template<typename T>
+	static void permute(std::vector<T>& values, const std::vector<uint32_t>& order) {
+		std::vector<T> permuted(order.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			permuted[i] = values[order[i]];
+		}
+		values.swap(permuted);
+	}
+
+	TransformHandle TransformSystem::create(TransformHandle parent)
+	{
+		return create(Transform(), parent);
+	}
+
+	TransformHandle TransformSystem::create(const Transform& local, TransformHandle parent)
+	{
+		uint32_t index = (uint32_t)m_parent.size();
+		uint32_t parentIndex = parent == INVALID_TRANSFORM ? INVALID_TRANSFORM : m_handleToIndex[parent];
+		uint32_t depth = parentIndex == INVALID_TRANSFORM ? 0 : m_depth[parentIndex] + 1;
+
+		m_positionX.push_back(local.position.x);
+		m_positionY.push_back(local.position.y);
+		m_positionZ.push_back(local.position.z);
+		m_rotationX.push_back(local.rotation.x);
+		m_rotationY.push_back(local.rotation.y);
+		m_rotationZ.push_back(local.rotation.z);
+		m_rotationW.push_back(local.rotation.w);
+		m_scaleX.push_back(local.scale.x);
+		m_scaleY.push_back(local.scale.y);
+		m_scaleZ.push_back(local.scale.z);
+		m_parent.push_back(parentIndex);
+		m_depth.push_back(depth);
+		m_dirty.push_back(1);
+		m_changed.push_back(0);
+		m_world.push_back(glm::mat4(1.0f));
+
+		TransformHandle handle;
+		if (!m_freeHandles.empty()) {
+			handle = m_freeHandles.back();
+			m_freeHandles.pop_back();
+			m_handleToIndex[handle] = index;
+		}
+		else {
+			handle = (TransformHandle)m_handleToIndex.size();
+			m_handleToIndex.push_back(index);
+		}
+		m_indexToHandle.push_back(handle);
+
+		//Appending keeps the depth order as long as the node is on the deepest or a new level
+		if (!m_orderDirty) {
+			size_t numLevels = m_levelStart.empty() ? 0 : m_levelStart.size() - 1;
+			if (numLevels == 0) {
+				m_levelStart = { 0, 1 };
+			}
+			else if (depth == numLevels - 1) {
+				m_levelStart.back()++;
+			}
+			else if (depth == numLevels) {
+				m_levelStart.push_back(m_levelStart.back() + 1);
+			}
+			else {
+				m_orderDirty = true;
+			}
+		}
+		return handle;
+	}
+
+	/// <summary>
+	/// Removes a node and its subtree. Remaining nodes keep their relative order. O(n).
+	/// </summary>
+	void TransformSystem::destroy(TransformHandle handle)
+	{
+		if (m_orderDirty) {
+			sortByDepth();
+		}
+		size_t n = m_parent.size();
+		std::vector<uint8_t> removed(n, 0);
+		removed[m_handleToIndex[handle]] = 1;
+		//Parents come first, so one forward pass finds every descendant
+		for (size_t i = m_handleToIndex[handle] + 1; i < n; i++)
+		{
+			if (m_parent[i] != INVALID_TRANSFORM && removed[m_parent[i]]) {
+				removed[i] = 1;
+			}
+		}
+		std::vector<uint32_t> order;
+		std::vector<uint32_t> oldToNew(n, INVALID_TRANSFORM);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (removed[i]) {
+				m_freeHandles.push_back(m_indexToHandle[i]);
+			}
+			else {
+				oldToNew[i] = (uint32_t)order.size();
+				order.push_back((uint32_t)i);
+			}
+		}
+		permute(m_positionX, order);
+		permute(m_positionY, order);
+		permute(m_positionZ, order);
+		permute(m_rotationX, order);
+		permute(m_rotationY, order);
+		permute(m_rotationZ, order);
+		permute(m_rotationW, order);
+		permute(m_scaleX, order);
+		permute(m_scaleY, order);
+		permute(m_scaleZ, order);
+		permute(m_parent, order);
+		permute(m_depth, order);
+		permute(m_dirty, order);
+		permute(m_changed, order);
+		permute(m_world, order);
+		permute(m_indexToHandle, order);
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			if (m_parent[i] != INVALID_TRANSFORM) {
+				m_parent[i] = oldToNew[m_parent[i]];
+			}
+			m_handleToIndex[m_indexToHandle[i]] = (uint32_t)i;
+		}
+		m_levelStart.clear();
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			while (m_levelStart.size() <= m_depth[i]) {
+				m_levelStart.push_back(i);
+			}
+		}
+		if (!order.empty()) {
+			m_levelStart.push_back(order.size());
+		}
+	}
+
+	bool TransformSystem::setParent(TransformHandle handle, TransformHandle parent)
+	{
+		uint32_t index = m_handleToIndex[handle];
+		uint32_t parentIndex = parent == INVALID_TRANSFORM ? INVALID_TRANSFORM : m_handleToIndex[parent];
+		for (uint32_t i = parentIndex; i != INVALID_TRANSFORM; i = m_parent[i])
+		{
+			if (i == index) {
+				return false;
+			}
+		}
+		m_parent[index] = parentIndex;
+		m_dirty[index] = 1;
+		m_orderDirty = true;
+		return true;
+	}
+
+	TransformHandle TransformSystem::getParent(TransformHandle handle) const
+	{
+		uint32_t parentIndex = m_parent[m_handleToIndex[handle]];
+		return parentIndex == INVALID_TRANSFORM ? INVALID_TRANSFORM : m_indexToHandle[parentIndex];
+	}
+
+	void TransformSystem::setLocal(TransformHandle handle, const Transform& local)
+	{
+		setPosition(handle, local.position);
+		setRotation(handle, local.rotation);
+		setScale(handle, local.scale);
+	}
+
+	void TransformSystem::setPosition(TransformHandle handle, const glm::vec3& position)
+	{
+		uint32_t i = m_handleToIndex[handle];
+		m_positionX[i] = position.x;
+		m_positionY[i] = position.y;
+		m_positionZ[i] = position.z;
+		m_dirty[i] = 1;
+	}
+
+	void TransformSystem::setRotation(TransformHandle handle, const glm::quat& rotation)
+	{
+		uint32_t i = m_handleToIndex[handle];
+		m_rotationX[i] = rotation.x;
+		m_rotationY[i] = rotation.y;
+		m_rotationZ[i] = rotation.z;
+		m_rotationW[i] = rotation.w;
+		m_dirty[i] = 1;
+	}
+
+	void TransformSystem::setScale(TransformHandle handle, const glm::vec3& scale)
+	{
+		uint32_t i = m_handleToIndex[handle];
+		m_scaleX[i] = scale.x;
+		m_scaleY[i] = scale.y;
+		m_scaleZ[i] = scale.z;
+		m_dirty[i] = 1;
+	}
+
+	Transform TransformSystem::getLocal(TransformHandle handle) const
+	{
+		uint32_t i = m_handleToIndex[handle];
+		Transform local;
+		local.position = glm::vec3(m_positionX[i], m_positionY[i], m_positionZ[i]);
+		local.rotation = glm::quat(m_rotationW[i], m_rotationX[i], m_rotationY[i], m_rotationZ[i]);
+		local.scale = glm::vec3(m_scaleX[i], m_scaleY[i], m_scaleZ[i]);
+		return local;
+	}
+
+	/// <summary>
+	/// Restores parent-before-child order after reparenting, using a stable counting sort on depth
+	/// </summary>
+	void TransformSystem::sortByDepth()
+	{
+		size_t n = m_parent.size();
+		std::vector<uint32_t> chain;
+		std::fill(m_depth.begin(), m_depth.end(), INVALID_TRANSFORM);
+		for (size_t i = 0; i < n; i++)
+		{
+			//Walk up to the first ancestor with a known depth, then fill in the way back down
+			uint32_t j = (uint32_t)i;
+			while (m_depth[j] == INVALID_TRANSFORM && m_parent[j] != INVALID_TRANSFORM) {
+				chain.push_back(j);
+				j = m_parent[j];
+			}
+			if (m_depth[j] == INVALID_TRANSFORM) {
+				m_depth[j] = 0;
+			}
+			uint32_t depth = m_depth[j];
+			while (!chain.empty()) {
+				m_depth[chain.back()] = ++depth;
+				chain.pop_back();
+			}
+		}
+
+		uint32_t maxDepth = 0;
+		for (size_t i = 0; i < n; i++)
+		{
+			maxDepth = std::max(maxDepth, m_depth[i]);
+		}
+		m_levelStart.assign(n > 0 ? maxDepth + 2 : 0, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			m_levelStart[m_depth[i] + 1]++;
+		}
+		for (size_t i = 1; i < m_levelStart.size(); i++)
+		{
+			m_levelStart[i] += m_levelStart[i - 1];
+		}
+		std::vector<uint32_t> order(n);
+		std::vector<uint32_t> oldToNew(n);
+		std::vector<size_t> next(m_levelStart.begin(), m_levelStart.end());
+		for (size_t i = 0; i < n; i++)
+		{
+			uint32_t newIndex = (uint32_t)next[m_depth[i]]++;
+			order[newIndex] = (uint32_t)i;
+			oldToNew[i] = newIndex;
+		}
+		permute(m_positionX, order);
+		permute(m_positionY, order);
+		permute(m_positionZ, order);
+		permute(m_rotationX, order);
+		permute(m_rotationY, order);
+		permute(m_rotationZ, order);
+		permute(m_rotationW, order);
+		permute(m_scaleX, order);
+		permute(m_scaleY, order);
+		permute(m_scaleZ, order);
+		permute(m_parent, order);
+		permute(m_depth, order);
+		permute(m_dirty, order);
+		permute(m_changed, order);
+		permute(m_world, order);
+		permute(m_indexToHandle, order);
+		for (size_t i = 0; i < n; i++)
+		{
+			if (m_parent[i] != INVALID_TRANSFORM) {
+				m_parent[i] = oldToNew[m_parent[i]];
+			}
+			m_handleToIndex[m_indexToHandle[i]] = (uint32_t)i;
+		}
+		m_orderDirty = false;
+	}
+
+	/// <summary>
+	/// Rebuilds world matrices one depth level at a time. Within a level every parent is already final,
+	/// so the level can be split freely across threads.
+	/// </summary>
+	/// <param name="jobSystem">Optional job system for large levels</param>
+	void TransformSystem::update(JobSystem* jobSystem)
+	{
+		if (m_orderDirty) {
+			sortByDepth();
+		}
+		std::atomic<size_t> numUpdated(0);
+		for (size_t level = 0; level + 1 < m_levelStart.size(); level++)
+		{
+			size_t begin = m_levelStart[level];
+			size_t end = m_levelStart[level + 1];
+			if (jobSystem != nullptr && end - begin >= PARALLEL_LEVEL_SIZE) {
+				//Chunks are whole batches of 4 so SIMD batches never straddle two threads
+				size_t numBatches = (end - begin + 3) / 4;
+				jobSystem->parallelFor(numBatches, [&](size_t first, size_t last) {
+					updateRange(begin + first * 4, std::min(begin + last * 4, end));
+				}, 256);
+			}
+			else {
+				updateRange(begin, end);
+			}
+		}
+		size_t count = 0;
+		for (size_t i = 0; i < m_changed.size(); i++)
+		{
+			count += m_changed[i];
+		}
+		m_numUpdated = count;
+		std::fill(m_dirty.begin(), m_dirty.end(), 0);
+	}
+
+#ifdef EW_TRANSFORM_SSE
+	//out = parent * local, all column major
+	static inline void multiplyMatrix(const float* parent, const __m128 local[4], float* out) {
+		__m128 p0 = _mm_loadu_ps(parent);
+		__m128 p1 = _mm_loadu_ps(parent + 4);
+		__m128 p2 = _mm_loadu_ps(parent + 8);
+		__m128 p3 = _mm_loadu_ps(parent + 12);
+		for (int c = 0; c < 4; c++)
+		{
+			__m128 column = _mm_mul_ps(p0, _mm_shuffle_ps(local[c], local[c], _MM_SHUFFLE(0, 0, 0, 0)));
+			column = _mm_add_ps(column, _mm_mul_ps(p1, _mm_shuffle_ps(local[c], local[c], _MM_SHUFFLE(1, 1, 1, 1))));
+			column = _mm_add_ps(column, _mm_mul_ps(p2, _mm_shuffle_ps(local[c], local[c], _MM_SHUFFLE(2, 2, 2, 2))));
+			column = _mm_add_ps(column, _mm_mul_ps(p3, _mm_shuffle_ps(local[c], local[c], _MM_SHUFFLE(3, 3, 3, 3))));
+			_mm_storeu_ps(out + c * 4, column);
+		}
+	}
+#endif
+
+	void TransformSystem::updateRange(size_t begin, size_t end)
+	{
+		size_t i = begin;
+#ifdef EW_TRANSFORM_SSE
+		for (; i + 4 <= end; i += 4)
+		{
+			bool changed[4];
+			bool anyChanged = false;
+			for (int k = 0; k < 4; k++)
+			{
+				uint32_t parent = m_parent[i + k];
+				changed[k] = m_dirty[i + k] || (parent != INVALID_TRANSFORM && m_changed[parent]);
+				m_changed[i + k] = changed[k];
+				anyChanged |= changed[k];
+			}
+			if (!anyChanged) {
+				continue;
+			}
+			//Build 4 local matrices at once, one node per lane. Same math as glm::mat4_cast.
+			__m128 x = _mm_loadu_ps(&m_rotationX[i]);
+			__m128 y = _mm_loadu_ps(&m_rotationY[i]);
+			__m128 z = _mm_loadu_ps(&m_rotationZ[i]);
+			__m128 w = _mm_loadu_ps(&m_rotationW[i]);
+			__m128 one = _mm_set1_ps(1.0f);
+			__m128 two = _mm_set1_ps(2.0f);
+			__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+			__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+			__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+			__m128 sx = _mm_loadu_ps(&m_scaleX[i]);
+			__m128 sy = _mm_loadu_ps(&m_scaleY[i]);
+			__m128 sz = _mm_loadu_ps(&m_scaleZ[i]);
+
+			__m128 c0x = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+			__m128 c0y = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+			__m128 c0z = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+			__m128 c0w = _mm_setzero_ps();
+			__m128 c1x = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+			__m128 c1y = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+			__m128 c1z = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+			__m128 c1w = _mm_setzero_ps();
+			__m128 c2x = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+			__m128 c2y = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+			__m128 c2z = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+			__m128 c2w = _mm_setzero_ps();
+			__m128 c3x = _mm_loadu_ps(&m_positionX[i]);
+			__m128 c3y = _mm_loadu_ps(&m_positionY[i]);
+			__m128 c3z = _mm_loadu_ps(&m_positionZ[i]);
+			__m128 c3w = one;
+			//Lanes to nodes: after each transpose, register k holds that column of node k
+			_MM_TRANSPOSE4_PS(c0x, c0y, c0z, c0w);
+			_MM_TRANSPOSE4_PS(c1x, c1y, c1z, c1w);
+			_MM_TRANSPOSE4_PS(c2x, c2y, c2z, c2w);
+			_MM_TRANSPOSE4_PS(c3x, c3y, c3z, c3w);
+			__m128 local[4][4] = {
+				{ c0x, c1x, c2x, c3x },
+				{ c0y, c1y, c2y, c3y },
+				{ c0z, c1z, c2z, c3z },
+				{ c0w, c1w, c2w, c3w }
+			};
+			for (int k = 0; k < 4; k++)
+			{
+				if (!changed[k]) {
+					continue;
+				}
+				float* out = &m_world[i + k][0][0];
+				uint32_t parent = m_parent[i + k];
+				if (parent == INVALID_TRANSFORM) {
+					for (int c = 0; c < 4; c++)
+					{
+						_mm_storeu_ps(out + c * 4, local[k][c]);
+					}
+				}
+				else {
+					multiplyMatrix(&m_world[parent][0][0], local[k], out);
+				}
+			}
+		}
+#endif
+		for (; i < end; i++)
+		{
+			updateNode(i);
+		}
+	}
+
+	void TransformSystem::updateNode(size_t i)
+	{
+		uint32_t parent = m_parent[i];
+		bool changed = m_dirty[i] || (parent != INVALID_TRANSFORM && m_changed[parent]);
+		m_changed[i] = changed;
+		if (!changed) {
+			return;
+		}
+		glm::mat4 local = glm::mat4_cast(glm::quat(m_rotationW[i], m_rotationX[i], m_rotationY[i], m_rotationZ[i]));
+		local[0] *= m_scaleX[i];
+		local[1] *= m_scaleY[i];
+		local[2] *= m_scaleZ[i];
+		local[3] = glm::vec4(m_positionX[i], m_positionY[i], m_positionZ[i], 1.0f);
+		m_world[i] = parent == INVALID_TRANSFORM ? local : m_world[parent] * local;
+	}
+}
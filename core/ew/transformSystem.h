@@ -0,0 +1,70 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include "transform.h"
+#include <vector>
+#include <stdint.h>
+
+namespace ew {
+	class JobSystem;
+
+	typedef uint32_t TransformHandle;
+	const TransformHandle INVALID_TRANSFORM = 0xffffffff;
+
+	//Transform hierarchy stored as structure of arrays.
+	//Nodes are kept sorted by depth so every parent is updated before its children, and world
+	//matrices are only rebuilt for nodes whose local transform or ancestors changed since the last update().
+	class TransformSystem {
+	public:
+		TransformHandle create(TransformHandle parent = INVALID_TRANSFORM);
+		TransformHandle create(const Transform& local, TransformHandle parent = INVALID_TRANSFORM);
+		//Destroys the node and all of its descendants
+		void destroy(TransformHandle handle);
+		//Returns false if parent is the node itself or one of its descendants
+		bool setParent(TransformHandle handle, TransformHandle parent);
+		TransformHandle getParent(TransformHandle handle)const;
+
+		void setLocal(TransformHandle handle, const Transform& local);
+		void setPosition(TransformHandle handle, const glm::vec3& position);
+		void setRotation(TransformHandle handle, const glm::quat& rotation);
+		void setScale(TransformHandle handle, const glm::vec3& scale);
+		Transform getLocal(TransformHandle handle)const;
+
+		//Rebuilds world matrices of changed nodes. Pass a job system to split large levels across its workers.
+		void update(JobSystem* jobSystem = nullptr);
+		//World matrix as of the last update()
+		inline const glm::mat4& getWorldMatrix(TransformHandle handle)const { return m_world[m_handleToIndex[handle]]; }
+		//True if the world matrix was rebuilt by the last update()
+		inline bool worldChanged(TransformHandle handle)const { return m_changed[m_handleToIndex[handle]] != 0; }
+
+		inline size_t getNumTransforms()const { return m_parent.size(); }
+		//Number of world matrices rebuilt by the last update()
+		inline size_t getNumUpdated()const { return m_numUpdated; }
+	private:
+		void sortByDepth();
+		void updateRange(size_t begin, size_t end);
+		void updateNode(size_t i);
+
+		//Local transforms, one array per component
+		std::vector<float> m_positionX, m_positionY, m_positionZ;
+		std::vector<float> m_rotationX, m_rotationY, m_rotationZ, m_rotationW;
+		std::vector<float> m_scaleX, m_scaleY, m_scaleZ;
+		std::vector<uint32_t> m_parent; //Index of the parent, or INVALID_TRANSFORM
+		std::vector<uint32_t> m_depth;
+		std::vector<uint8_t> m_dirty; //Local transform changed
+		std::vector<uint8_t> m_changed; //World matrix rebuilt this update
+		std::vector<glm::mat4> m_world;
+
+		//Handles stay valid while nodes move around in the arrays
+		std::vector<uint32_t> m_handleToIndex;
+		std::vector<TransformHandle> m_indexToHandle;
+		std::vector<TransformHandle> m_freeHandles;
+
+		//First index of each depth, plus one past the end
+		std::vector<size_t> m_levelStart;
+		bool m_orderDirty = false;
+		size_t m_numUpdated = 0;
+	};
+}
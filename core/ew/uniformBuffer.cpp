@@ -0,0 +1,72 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "uniformBuffer.h"
+#include "external/glad.h"
+
+namespace ew {
+	UniformBuffer::UniformBuffer(size_t size)
+	{
+		create(size);
+	}
+
+	/// <summary>
+	/// Allocates the buffer. Contents are undefined until update() is called.
+	/// </summary>
+	/// <param name="size">Size in bytes</param>
+	void UniformBuffer::create(size_t size)
+	{
+		if (m_id == 0) {
+			glGenBuffers(1, &m_id);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		m_size = size;
+	}
+
+	void UniformBuffer::update(const void* data, size_t size, size_t offset)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_id);
+		//Whole buffer updates respecify storage so the driver never waits for draws still reading the old contents
+		if (offset == 0 && size == m_size) {
+			glBufferData(GL_UNIFORM_BUFFER, size, data, GL_DYNAMIC_DRAW);
+		}
+		else {
+			glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	void UniformBuffer::bind(unsigned int bindingPoint) const
+	{
+		glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, m_id);
+	}
+
+	void UniformBuffer::bindRange(unsigned int bindingPoint, size_t offset, size_t size) const
+	{
+		glBindBufferRange(GL_UNIFORM_BUFFER, bindingPoint, m_id, offset, size);
+	}
+
+	size_t UniformBuffer::getOffsetAlignment()
+	{
+		static int alignment = 0;
+		if (alignment == 0) {
+			glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+			if (alignment <= 0) {
+				alignment = 256;
+			}
+		}
+		return (size_t)alignment;
+	}
+
+	CameraBlock createCameraBlock(const Camera& camera) {
+		CameraBlock block;
+		block.view = camera.viewMatrix();
+		block.projection = camera.projectionMatrix();
+		block.viewProjection = block.projection * block.view;
+		block.cameraPosition = glm::vec4(camera.position, 1.0f);
+		return block;
+	}
+}
@@ -0,0 +1,75 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <stddef.h>
+#include "camera.h"
+
+namespace ew {
+	//GL uniform buffer for std140 uniform blocks.
+	//Bind to the same binding point passed to Shader::bindUniformBlock.
+	class UniformBuffer {
+	public:
+		UniformBuffer() {};
+		UniformBuffer(size_t size);
+		void create(size_t size);
+		void update(const void* data, size_t size, size_t offset = 0);
+		template<typename T>
+		void update(const T& data) { update(&data, sizeof(T)); }
+		void bind(unsigned int bindingPoint)const;
+		//Binds only [offset, offset + size). offset must be a multiple of getOffsetAlignment().
+		void bindRange(unsigned int bindingPoint, size_t offset, size_t size)const;
+		inline unsigned int getID()const { return m_id; }
+		inline size_t getSize()const { return m_size; }
+		//GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		static size_t getOffsetAlignment();
+	private:
+		unsigned int m_id = 0;
+		size_t m_size = 0;
+	};
+
+	//Array of one uniform block per draw (e.g. per object or per material).
+	//Fill every element, upload() once per frame with a single buffer update, then bind(i) before each draw.
+	template<typename T>
+	class UniformBlockArray {
+	public:
+		UniformBlockArray() {};
+		UniformBlockArray(size_t count) { resize(count); }
+		void resize(size_t count) {
+			size_t alignment = UniformBuffer::getOffsetAlignment();
+			m_stride = (sizeof(T) + alignment - 1) / alignment * alignment;
+			m_count = count;
+			m_staging.resize(m_stride * count);
+			m_buffer.create(m_staging.size());
+		}
+		inline T& operator[](size_t i) { return *(T*)(m_staging.data() + i * m_stride); }
+		inline size_t size()const { return m_count; }
+		void upload() { m_buffer.update(m_staging.data(), m_staging.size()); }
+		void bind(unsigned int bindingPoint, size_t i)const { m_buffer.bindRange(bindingPoint, i * m_stride, sizeof(T)); }
+	private:
+		UniformBuffer m_buffer;
+		std::vector<unsigned char> m_staging;
+		size_t m_stride = 0;
+		size_t m_count = 0;
+	};
+
+	//Per frame camera data. Matches:
+	//layout(std140) uniform Camera {
+	//	mat4 view;
+	//	mat4 projection;
+	//	mat4 viewProjection;
+	//	vec4 cameraPosition;
+	//};
+	struct CameraBlock {
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::mat4 viewProjection;
+		glm::vec4 cameraPosition;
+	};
+	static_assert(sizeof(CameraBlock) == sizeof(float) * 52, "CameraBlock must match std140 layout");
+
+	CameraBlock createCameraBlock(const Camera& camera);
+}
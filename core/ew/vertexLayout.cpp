@@ -0,0 +1,38 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include "vertexLayout.h"
+#include "external/glad.h"
+
+namespace ew {
+	static GLenum getAttributeType(AttributeType type) {
+		switch (type) {
+		default:
+			return GL_FLOAT;
+		case AttributeType::HALF_FLOAT:
+			return GL_HALF_FLOAT;
+		case AttributeType::BYTE:
+			return GL_BYTE;
+		case AttributeType::UNSIGNED_BYTE:
+			return GL_UNSIGNED_BYTE;
+		case AttributeType::SHORT:
+			return GL_SHORT;
+		case AttributeType::UNSIGNED_SHORT:
+			return GL_UNSIGNED_SHORT;
+		}
+	}
+
+	unsigned int setVertexAttributes(const VertexLayout& layout, unsigned int divisor) {
+		unsigned int enabledAttributes = 0;
+		for (size_t i = 0; i < layout.numAttributes; i++)
+		{
+			const VertexAttribute& attribute = layout.attributes[i];
+			glVertexAttribPointer(attribute.location, attribute.components, getAttributeType(attribute.type), attribute.normalized ? GL_TRUE : GL_FALSE, (GLsizei)layout.stride, (const void*)attribute.offset);
+			glVertexAttribDivisor(attribute.location, divisor);
+			glEnableVertexAttribArray(attribute.location);
+			enabledAttributes |= 1u << attribute.location;
+		}
+		return enabledAttributes;
+	}
+}
@@ -0,0 +1,42 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#pragma once
+#include <stddef.h>
+
+namespace ew {
+	enum class AttributeType {
+		FLOAT = 0,
+		HALF_FLOAT = 1,
+		BYTE = 2,
+		UNSIGNED_BYTE = 3,
+		SHORT = 4,
+		UNSIGNED_SHORT = 5
+	};
+
+	struct VertexAttribute {
+		unsigned int location; //Shader attribute location
+		int components; //1-4
+		AttributeType type;
+		bool normalized; //Integer types are mapped to [0,1] or [-1,1] in the shader
+		size_t offset; //Bytes from the start of the vertex
+	};
+
+	//Describes how a vertex struct is laid out for the vertex shader
+	struct VertexLayout {
+		size_t stride;
+		const VertexAttribute* attributes;
+		size_t numAttributes;
+	};
+
+	//Points the bound VAO's attributes at the bound GL_ARRAY_BUFFER and enables them.
+	//divisor 1 makes them per-instance. Returns a bit per location that was enabled.
+	unsigned int setVertexAttributes(const VertexLayout& layout, unsigned int divisor = 0);
+
+	//Specialize for each vertex struct that can be uploaded with Mesh::load. Must provide:
+	//	static VertexLayout layout();
+	//	static glm::vec3 position(const V& vertex);
+	template<typename V>
+	struct VertexTraits;
+}
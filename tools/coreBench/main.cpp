@@ -0,0 +1,1774 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <fstream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <iterator>
+
+#include <ew/procGen.h>
+#include <ew/terrain.h>
+#include <ew/model.h>
+#include <ew/meshCache.h>
+#include <ew/meshOptimizer.h>
+#include <ew/meshSimplifier.h>
+#include <ew/quantize.h>
+#include <ew/transform.h>
+#include <ew/transformSystem.h>
+#include <ew/jobSystem.h>
+#include <ew/camera.h>
+#include <ew/culling.h>
+#include <ew/gpuCulling.h>
+#include <ew/texture.h>
+#include <ew/textureBake.h>
+#include <ew/asyncTextureLoader.h>
+#include <ew/renderQueue.h>
+#include <ew/shader.h>
+#include <ew/shaderCache.h>
+#include <ew/mesh.h>
+#include <ew/dynamicMesh.h>
+#include <ew/staticBatch.h>
+#include <ew/instanceBuffer.h>
+#include <ew/geometryArena.h>
+#include <ew/framebuffer.h>
+#include <ew/headless.h>
+#include <ew/external/glad.h>
+#include <ew/external/stb_image.h>
+
+#ifndef EW_BENCH_ASSETS
+#define EW_BENCH_ASSETS "assets/"
+#endif
+#ifndef EW_BENCH_BUILD_TYPE
+#define EW_BENCH_BUILD_TYPE ""
+#endif
+
+namespace fs = std::filesystem;
+
+//Results are folded into this so the compiler can't drop the work being timed
+static volatile double g_sink = 0.0;
+static void consume(double v) {
+	g_sink = g_sink + v;
+}
+static void consume(const ew::MeshData& mesh) {
+	consume((double)mesh.vertices.size() + (mesh.vertices.empty() ? 0.0 : mesh.vertices.back().pos.x));
+}
+
+struct BenchResult {
+	std::string name;
+	size_t items; //Work per repetition, for throughput
+	std::vector<double> milliseconds;
+	double min, median, mean, stddev, max;
+};
+
+struct BenchOptions {
+	int repetitions = 10;
+	int warmup = 1;
+	std::string filter;
+	bool csv = false;
+	bool list = false;
+	bool gl = false;
+	bool verify = false; //Run correctness checks instead of timings
+	unsigned int threads = 0; //Workers in the global job system, 0 = one per hardware thread minus the main thread
+	std::string outputPath;
+	std::string assetPath = EW_BENCH_ASSETS;
+};
+
+class Bench {
+public:
+	Bench(const BenchOptions& options) : m_options(options) {}
+
+	//True if the named benchmark should run. Use to skip expensive setup.
+	bool enabled(const char* name)const {
+		if (m_options.list) {
+			printf("%s\n", name);
+			return false;
+		}
+		return m_options.filter.empty() || strstr(name, m_options.filter.c_str()) != nullptr;
+	}
+
+	//Times fn over warmup + repetitions runs. items is the work done per run, e.g. vertices generated.
+	template<typename F>
+	void run(const char* name, size_t items, F&& fn) {
+		if (!enabled(name)) {
+			return;
+		}
+		for (int i = 0; i < m_options.warmup; i++)
+		{
+			fn();
+		}
+		BenchResult result;
+		result.name = name;
+		result.items = items;
+		for (int i = 0; i < m_options.repetitions; i++)
+		{
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			auto end = std::chrono::steady_clock::now();
+			result.milliseconds.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+		}
+		computeStats(&result);
+		fprintf(stderr, "%-40s median %10.3f ms  min %10.3f ms  stddev %7.3f ms\n", name, result.median, result.min, result.stddev);
+		m_results.push_back(result);
+	}
+
+	void skip(const char* name, const char* reason) {
+		if (enabled(name)) {
+			fprintf(stderr, "%-40s skipped: %s\n", name, reason);
+		}
+	}
+
+	//Records one --verify check. detail says what was measured, so failures can be read from the log alone.
+	void check(const char* name, bool passed, const char* detailFormat, ...) {
+		char detail[256];
+		va_list args;
+		va_start(args, detailFormat);
+		vsnprintf(detail, sizeof(detail), detailFormat, args);
+		va_end(args);
+		fprintf(stderr, "%-40s %s  %s\n", name, passed ? "ok    " : "FAILED", detail);
+		m_numChecks++;
+		m_numFailures += passed ? 0 : 1;
+	}
+
+	inline const std::vector<BenchResult>& getResults()const { return m_results; }
+	inline const BenchOptions& getOptions()const { return m_options; }
+	inline int getNumChecks()const { return m_numChecks; }
+	inline int getNumFailures()const { return m_numFailures; }
+
+private:
+	static void computeStats(BenchResult* result) {
+		std::vector<double> sorted = result->milliseconds;
+		std::sort(sorted.begin(), sorted.end());
+		size_t n = sorted.size();
+		result->min = sorted.front();
+		result->max = sorted.back();
+		result->median = (n % 2) ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) * 0.5;
+		double sum = 0.0;
+		for (double v : sorted) {
+			sum += v;
+		}
+		result->mean = sum / n;
+		double variance = 0.0;
+		for (double v : sorted) {
+			variance += (v - result->mean) * (v - result->mean);
+		}
+		result->stddev = n > 1 ? sqrt(variance / (n - 1)) : 0.0;
+	}
+
+	BenchOptions m_options;
+	std::vector<BenchResult> m_results;
+	int m_numChecks = 0;
+	int m_numFailures = 0;
+};
+
+static bool readFile(const std::string& path, std::vector<uint8_t>* data) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	data->assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
+
+static void benchProcGen(Bench& bench) {
+	const int sphereSubdivisions = 512;
+	const int planeSubdivisions = 1024;
+	const int cylinderSubdivisions = 65536;
+	bench.run("procGen/createSphere_512", (size_t)(sphereSubdivisions + 1) * (sphereSubdivisions + 1), [&]() {
+		consume(ew::createSphere(1.0f, sphereSubdivisions));
+	});
+	bench.run("procGen/createPlane_1024", (size_t)(planeSubdivisions + 1) * (planeSubdivisions + 1), [&]() {
+		consume(ew::createPlane(10.0f, 10.0f, planeSubdivisions));
+	});
+	bench.run("procGen/createCylinder_65536", (size_t)(cylinderSubdivisions + 1) * 4, [&]() {
+		consume(ew::createCylinder(1.0f, 2.0f, cylinderSubdivisions));
+	});
+	//Into buffers that already exist, as when writing to a mapped GPU buffer
+	if (bench.enabled("procGen/writePlane_4096")) {
+		const int largePlaneSubdivisions = 4096;
+		ew::MeshSize size = ew::getPlaneSize(largePlaneSubdivisions);
+		std::vector<ew::Vertex> vertices(size.numVertices);
+		std::vector<unsigned int> indices(size.numIndices);
+		bench.run("procGen/writePlane_4096", size.numVertices, [&]() {
+			ew::writePlane(10.0f, 10.0f, largePlaneSubdivisions, vertices.data(), indices.data());
+			consume((double)vertices.back().pos.x + indices.back());
+		});
+	}
+}
+
+static void benchTerrain(Bench& bench) {
+	ew::TerrainSettings settings;
+	ew::HeightFunction heights = ew::createNoiseHeights(40.0f, 1.0f / 300.0f, 5);
+	size_t numVertices = (size_t)(settings.chunkResolution + 1) * (settings.chunkResolution + 1);
+	bench.run("terrain/generateChunk_64", numVertices, [&]() {
+		consume(ew::generateTerrainChunk(settings, heights, 3, -2, 0));
+	});
+}
+
+static void benchMeshProcessing(Bench& bench) {
+	ew::MeshData sphere = ew::createSphere(1.0f, 256);
+	bench.run("meshOptimizer/optimizeMesh_sphere256", sphere.indices.size() / 3, [&]() {
+		ew::MeshData mesh = sphere;
+		ew::optimizeMesh(&mesh);
+		consume(mesh);
+	});
+	//Simplification is far slower per triangle, so it gets a smaller mesh
+	ew::MeshData smallSphere = ew::createSphere(1.0f, 96);
+	bench.run("meshSimplifier/generateLODs_sphere96", smallSphere.indices.size() / 3, [&]() {
+		std::vector<ew::LODLevel> levels = ew::generateLODs(smallSphere, { 0.5f, 0.25f });
+		consume((double)levels.size());
+	});
+	bench.run("quantize/quantizeVertices_sphere256", sphere.vertices.size(), [&]() {
+		std::vector<ew::QuantizedVertex> vertices = ew::quantizeVertices(sphere.vertices);
+		consume((double)vertices.back().pos[0]);
+	});
+}
+
+static void benchModel(Bench& bench) {
+	const char* files[] = { "Suzanne.obj", "Suzanne.fbx" };
+	const char* names[] = { "model/import_obj", "model/import_fbx" };
+	for (int f = 0; f < 2; f++)
+	{
+		std::string path = bench.getOptions().assetPath + files[f];
+		if (!bench.enabled(names[f])) {
+			continue;
+		}
+		std::vector<ew::MeshData> meshData;
+		if (!ew::importModel(path, &meshData)) {
+			bench.skip(names[f], "model not found");
+			continue;
+		}
+		size_t numVertices = 0;
+		for (const ew::MeshData& mesh : meshData) {
+			numVertices += mesh.vertices.size();
+		}
+		bench.run(names[f], numVertices, [&]() {
+			std::vector<ew::MeshData> result;
+			ew::importModel(path, &result);
+			consume((double)result.size());
+		});
+	}
+
+	//Warm start through the binary mesh cache, against the Assimp import above
+	const char* cacheName = "model/meshCache_obj";
+	if (!bench.enabled(cacheName)) {
+		return;
+	}
+	std::string sourcePath = bench.getOptions().assetPath + "Suzanne.obj";
+	std::vector<ew::MeshData> meshData;
+	if (!ew::importModel(sourcePath, &meshData)) {
+		bench.skip(cacheName, "model not found");
+		return;
+	}
+	std::string cachePath = (fs::temp_directory_path() / "core_bench_suzanne.ewcache").string();
+	if (!ew::writeMeshCache(cachePath, sourcePath, 0, meshData)) {
+		bench.skip(cacheName, "could not write cache");
+		return;
+	}
+	size_t numVertices = 0;
+	for (const ew::MeshData& mesh : meshData) {
+		numVertices += mesh.vertices.size();
+	}
+	bench.run(cacheName, numVertices, [&]() {
+		ew::MeshCache cache;
+		if (!cache.open(cachePath, sourcePath, 0)) {
+			return;
+		}
+		//Copy out so the result is comparable to an import
+		std::vector<ew::MeshData> result(cache.getNumMeshes());
+		for (size_t i = 0; i < cache.getNumMeshes(); i++)
+		{
+			result[i].vertices.assign(cache.getVertices(i), cache.getVertices(i) + cache.getNumVertices(i));
+			result[i].indices.assign(cache.getIndices(i), cache.getIndices(i) + cache.getNumIndices(i));
+		}
+		consume((double)result.size());
+	});
+	std::error_code ec;
+	fs::remove(cachePath, ec);
+}
+
+static void benchTransforms(Bench& bench) {
+	const size_t count = 100000;
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> random(-1.0f, 1.0f);
+	std::vector<ew::Transform> transforms(count);
+	for (ew::Transform& transform : transforms) {
+		transform.position = glm::vec3(random(rng), random(rng), random(rng)) * 50.0f;
+		transform.rotation = glm::normalize(glm::quat(random(rng), random(rng), random(rng), random(rng)));
+		transform.scale = glm::vec3(1.0f + random(rng) * 0.5f);
+	}
+	bench.run("transform/modelMatrix_100k", count, [&]() {
+		float sum = 0.0f;
+		for (const ew::Transform& transform : transforms) {
+			sum += transform.modelMatrix()[3][0];
+		}
+		consume(sum);
+	});
+
+	//Same transforms as a hierarchy of 1000 roots with 8 children per node, every node dirty
+	ew::TransformSystem system;
+	std::vector<ew::TransformHandle> handles(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		ew::TransformHandle parent = i < 1000 ? ew::INVALID_TRANSFORM : handles[(i - 1000) / 8];
+		handles[i] = system.create(transforms[i], parent);
+	}
+	system.update();
+	bench.run("transformSystem/update_100k", count, [&]() {
+		for (size_t i = 0; i < count; i++)
+		{
+			system.setPosition(handles[i], transforms[i].position);
+		}
+		system.update();
+		consume(system.getWorldMatrix(handles[count - 1])[3][0]);
+	});
+	bench.run("transformSystem/update_100k_threaded", count, [&]() {
+		for (size_t i = 0; i < count; i++)
+		{
+			system.setPosition(handles[i], transforms[i].position);
+		}
+		system.update(&ew::JobSystem::global());
+		consume(system.getWorldMatrix(handles[count - 1])[3][0]);
+	});
+}
+
+static void benchCamera(Bench& bench) {
+	const size_t count = 1000000;
+	ew::Camera camera;
+	bench.run("camera/viewProjection_1M", count, [&]() {
+		float sum = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			camera.position.x = (float)(i & 255);
+			glm::mat4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+			sum += viewProjection[3][2];
+		}
+		consume(sum);
+	});
+	bench.run("camera/extractFrustum_1M", count, [&]() {
+		float sum = 0.0f;
+		for (size_t i = 0; i < count; i++)
+		{
+			camera.position.x = (float)(i & 255);
+			ew::Frustum frustum = ew::extractFrustum(camera);
+			sum += frustum.planes[0].w;
+		}
+		consume(sum);
+	});
+}
+
+static void benchCulling(Bench& bench) {
+	const size_t count = 100000;
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> random(-100.0f, 100.0f);
+	ew::CullingBounds bounds;
+	std::vector<ew::Bounds> objectBounds(count);
+	std::vector<ew::InstanceData> instances(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		ew::Bounds b;
+		b.center = glm::vec3(random(rng), random(rng), random(rng));
+		b.min = b.center - glm::vec3(1.0f);
+		b.max = b.center + glm::vec3(1.0f);
+		b.radius = sqrtf(3.0f);
+		bounds.add(b);
+		objectBounds[i].min = glm::vec3(-1.0f);
+		objectBounds[i].max = glm::vec3(1.0f);
+		objectBounds[i].radius = sqrtf(3.0f);
+		instances[i].modelMatrix = glm::translate(glm::mat4(1.0f), b.center);
+	}
+	ew::Camera camera;
+	camera.position = glm::vec3(0.0f, 0.0f, 120.0f);
+	camera.farPlane = 200.0f;
+	ew::Frustum frustum = ew::extractFrustum(camera);
+	std::vector<uint32_t> visible(count);
+	bench.run("culling/cullSpheres_100k", count, [&]() {
+		consume((double)ew::cullSpheres(frustum, bounds, visible.data()));
+	});
+	bench.run("culling/cullSpheresScalar_100k", count, [&]() {
+		consume((double)ew::cullSpheresScalar(frustum, bounds, visible.data()));
+	});
+	bench.run("culling/cullBoxes_100k", count, [&]() {
+		consume((double)ew::cullBoxes(frustum, bounds, visible.data()));
+	});
+	bench.run("culling/cullBoxesParallel_100k", count, [&]() {
+		consume((double)ew::cullBoxes(frustum, bounds, visible.data(), ew::JobSystem::global()));
+	});
+	bench.run("culling/cullBoxesScalar_100k", count, [&]() {
+		consume((double)ew::cullBoxesScalar(frustum, bounds, visible.data()));
+	});
+	bench.run("culling/cullObjectsReference_100k", count, [&]() {
+		consume((double)ew::cullObjectsReference(frustum, objectBounds.data(), instances.data(), count, visible.data()));
+	});
+}
+
+//Same workloads on job systems of 1 to N threads, counting the calling thread.
+//1 thread runs the work inline and is the baseline the others scale against.
+static void benchJobs(Bench& bench) {
+	unsigned int maxThreads = std::max(2u, std::thread::hardware_concurrency());
+	const int numChunks = 64;
+	ew::TerrainSettings settings;
+	settings.chunkResolution = 32;
+	ew::HeightFunction heights = ew::createNoiseHeights(40.0f, 1.0f / 300.0f, 5);
+
+	const size_t numBounds = 1000000;
+	const size_t numJobs = 100000;
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> random(-100.0f, 100.0f);
+	ew::CullingBounds bounds;
+	ew::Camera camera;
+	camera.position = glm::vec3(0.0f, 0.0f, 120.0f);
+	camera.farPlane = 200.0f;
+	ew::Frustum frustum = ew::extractFrustum(camera);
+	std::vector<uint32_t> visible;
+
+	for (unsigned int threads = 1; threads <= maxThreads; threads++)
+	{
+		std::string terrainName = "jobs/terrainChunks_64_" + std::to_string(threads) + "t";
+		std::string cullName = "jobs/cullBoxes_1M_" + std::to_string(threads) + "t";
+		std::string runName = "jobs/run_100k_" + std::to_string(threads) + "t";
+		if (!bench.enabled(terrainName.c_str()) && !bench.enabled(cullName.c_str()) && !bench.enabled(runName.c_str())) {
+			continue;
+		}
+		std::unique_ptr<ew::JobSystem> jobs;
+		if (threads > 1) {
+			jobs.reset(new ew::JobSystem(threads - 1));
+		}
+		//Uneven tasks: noise cost varies little, but chunks are coarse so stealing has to balance them
+		bench.run(terrainName.c_str(), numChunks, [&]() {
+			std::vector<double> sums(numChunks);
+			auto generate = [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; i++)
+				{
+					ew::MeshData chunk = ew::generateTerrainChunk(settings, heights, (int)(i % 8), (int)(i / 8), 0);
+					sums[i] = chunk.vertices.back().pos.y;
+				}
+			};
+			if (jobs) {
+				jobs->parallelFor(numChunks, generate);
+			}
+			else {
+				generate(0, numChunks);
+			}
+			consume(sums[numChunks - 1]);
+		});
+		if (bench.enabled(cullName.c_str())) {
+			if (bounds.size() != numBounds) {
+				for (size_t i = 0; i < numBounds; i++)
+				{
+					ew::Bounds b;
+					b.center = glm::vec3(random(rng), random(rng), random(rng));
+					b.min = b.center - glm::vec3(1.0f);
+					b.max = b.center + glm::vec3(1.0f);
+					b.radius = sqrtf(3.0f);
+					bounds.add(b);
+				}
+				visible.resize(numBounds);
+			}
+			bench.run(cullName.c_str(), numBounds, [&]() {
+				consume((double)(jobs ? ew::cullBoxes(frustum, bounds, visible.data(), *jobs) : ew::cullBoxes(frustum, bounds, visible.data())));
+			});
+		}
+		//Scheduling overhead: many jobs that do almost nothing
+		bench.run(runName.c_str(), numJobs, [&]() {
+			std::atomic<size_t> sum(0);
+			if (jobs) {
+				ew::JobCounter counter;
+				for (size_t i = 0; i < numJobs; i++)
+				{
+					jobs->run([&sum, i]() { sum.fetch_add(i, std::memory_order_relaxed); }, &counter);
+				}
+				jobs->wait(counter);
+			}
+			else {
+				for (size_t i = 0; i < numJobs; i++)
+				{
+					sum.fetch_add(i, std::memory_order_relaxed);
+				}
+			}
+			consume((double)sum.load());
+		});
+	}
+}
+
+static void benchTextures(Bench& bench) {
+	const char* decodeName = "texture/decode_jpg";
+	if (!bench.enabled(decodeName) && !bench.enabled("textureBake/generateMipChain") && !bench.enabled("textureBake/encodeBC1")) {
+		return;
+	}
+	std::vector<uint8_t> file;
+	if (!readFile(bench.getOptions().assetPath + "brick_color.jpg", &file)) {
+		bench.skip(decodeName, "texture not found");
+		return;
+	}
+	int width, height, numComponents;
+	unsigned char* pixels = stbi_load_from_memory(file.data(), (int)file.size(), &width, &height, &numComponents, 4);
+	if (pixels == NULL) {
+		bench.skip(decodeName, "decode failed");
+		return;
+	}
+	size_t numPixels = (size_t)width * height;
+	bench.run(decodeName, numPixels, [&]() {
+		int w, h, n;
+		unsigned char* data = stbi_load_from_memory(file.data(), (int)file.size(), &w, &h, &n, 0);
+		consume((double)data[0]);
+		stbi_image_free(data);
+	});
+	bench.run("textureBake/generateMipChain", numPixels, [&]() {
+		std::vector<ew::TextureLevel> levels = ew::generateMipChain(pixels, width, height, 4, true);
+		consume((double)levels.size());
+	});
+	ew::TextureLevel level0 = { width, height, std::vector<uint8_t>(pixels, pixels + numPixels * 4) };
+	bench.run("textureBake/encodeBC1", numPixels, [&]() {
+		std::vector<uint8_t> blocks = ew::encodeTextureLevel(level0, 4, ew::TextureEncoding::BC1);
+		consume((double)blocks[0]);
+	});
+	stbi_image_free(pixels);
+}
+
+static void benchRenderQueue(Bench& bench) {
+	const size_t count = 100000;
+	std::mt19937_64 rng(3);
+	std::vector<uint64_t> keys(count);
+	for (uint64_t& key : keys) {
+		//Few passes and shaders, many materials and depths, like a real frame
+		key = ((rng() & 0x3) << 60) | ((rng() & 0xf) << 48) | (rng() & 0xffffffffffffull);
+	}
+	std::vector<uint32_t> order(count);
+	std::vector<uint32_t> scratch(count);
+	bench.run("renderQueue/radixSortKeys_100k", count, [&]() {
+		ew::radixSortKeys(keys.data(), count, order.data(), scratch.data());
+		consume((double)order[0]);
+	});
+	bench.run("renderQueue/stdSort_100k", count, [&]() {
+		for (size_t i = 0; i < count; i++)
+		{
+			order[i] = (uint32_t)i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+		consume((double)order[0]);
+	});
+}
+
+static const char* BENCH_VERTEX_SHADER = R"(#version 450
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec3 vNormal;
+uniform mat4 _Model;
+uniform mat4 _ViewProjection;
+out vec3 Normal;
+void main(){
+	Normal = mat3(_Model) * vNormal;
+	gl_Position = _ViewProjection * _Model * vec4(vPos,1.0);
+}
+)";
+
+static const char* BENCH_INSTANCED_VERTEX_SHADER = R"(#version 450
+layout(location = 0) in vec3 vPos;
+layout(location = 1) in vec3 vNormal;
+layout(location = 3) in mat4 _InstanceModel;
+uniform mat4 _ViewProjection;
+out vec3 Normal;
+void main(){
+	Normal = mat3(_InstanceModel) * vNormal;
+	gl_Position = _ViewProjection * _InstanceModel * vec4(vPos,1.0);
+}
+)";
+
+static const char* BENCH_FRAGMENT_SHADER = R"(#version 450
+in vec3 Normal;
+out vec4 FragColor;
+void main(){
+	FragColor = vec4(normalize(Normal) * 0.5 + 0.5,1.0);
+}
+)";
+
+//Needs a current context, see HeadlessContext. Every timed run ends with glFinish so GPU work is included.
+static void benchGL(Bench& bench) {
+	if (bench.enabled("gl/createShaderProgram_cold") || bench.enabled("gl/createShaderProgram_cached")) {
+		std::string previousDirectory = ew::getShaderCacheDirectory();
+		//A unique comment per run keeps both our cache and the driver's from hiding the compile
+		int runIndex = 0;
+		ew::setShaderCacheDirectory("");
+		bench.run("gl/createShaderProgram_cold", 1, [&]() {
+			std::string vertexSource = std::string(BENCH_VERTEX_SHADER) + "//" + std::to_string(runIndex++) + "\n";
+			unsigned int program = ew::createShaderProgram(vertexSource.c_str(), BENCH_FRAGMENT_SHADER);
+			glDeleteProgram(program);
+			glFinish();
+		});
+		std::string cacheDirectory = (fs::temp_directory_path() / "core_bench_shaderCache").string();
+		ew::setShaderCacheDirectory(cacheDirectory);
+		glDeleteProgram(ew::createShaderProgram(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER));
+		bench.run("gl/createShaderProgram_cached", 1, [&]() {
+			unsigned int program = ew::createShaderProgram(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER);
+			glDeleteProgram(program);
+			glFinish();
+		});
+		ew::setShaderCacheDirectory(previousDirectory);
+		std::error_code error;
+		fs::remove_all(cacheDirectory, error);
+	}
+
+	//The same image from the source file, decoded with mips generated by the driver, and from baked files, uploaded as stored
+	const char* textureNames[] = { "gl/loadTexture_brick", "gl/loadBakedTexture_brick_bc1", "gl/loadBakedTexture_brick_raw" };
+	bool texturesEnabled = false;
+	for (const char* name : textureNames) {
+		texturesEnabled = bench.enabled(name) || texturesEnabled;
+	}
+	if (texturesEnabled) {
+		std::string sourcePath = bench.getOptions().assetPath + "brick_color.jpg";
+		std::string bakedPaths[] = { (fs::temp_directory_path() / "core_bench_brick_bc1.ewtex").string(), (fs::temp_directory_path() / "core_bench_brick_raw.ewtex").string() };
+		ew::TextureBakeSettings settings;
+		settings.encoding = ew::TextureEncoding::BC1;
+		bool baked = ew::bakeTexture(sourcePath, bakedPaths[0], settings);
+		settings.encoding = ew::TextureEncoding::RAW;
+		baked = baked && ew::bakeTexture(sourcePath, bakedPaths[1], settings);
+		if (!baked) {
+			for (const char* name : textureNames) {
+				bench.skip(name, "texture not found");
+			}
+		}
+		else {
+			bench.run(textureNames[0], 1, [&]() {
+				unsigned int texture = ew::loadTexture(sourcePath.c_str());
+				glFinish();
+				glDeleteTextures(1, &texture);
+			});
+			for (int i = 0; i < 2; i++)
+			{
+				bench.run(textureNames[i + 1], 1, [&]() {
+					unsigned int texture = ew::loadBakedTexture(bakedPaths[i].c_str());
+					glFinish();
+					glDeleteTextures(1, &texture);
+				});
+			}
+		}
+		std::error_code error;
+		for (const std::string& path : bakedPaths) {
+			fs::remove(path, error);
+		}
+	}
+
+	const unsigned int numObjects = 4096;
+	if (bench.enabled("gl/drawMesh_4096") || bench.enabled("gl/drawInstanced_4096")) {
+		//Small target so the numbers are about submission, not fill rate
+		ew::Framebuffer framebuffer;
+		framebuffer.create(256, 256);
+		ew::Mesh sphere(ew::createSphere(0.5f, 16));
+		ew::Shader shader(ew::createShaderProgram(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER));
+		ew::Shader instancedShader(ew::createShaderProgram(BENCH_INSTANCED_VERTEX_SHADER, BENCH_FRAGMENT_SHADER));
+		ew::Camera camera;
+		camera.position = glm::vec3(0.0f, 0.0f, 80.0f);
+		camera.aspectRatio = 1.0f;
+		glm::mat4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+		std::vector<glm::mat4> modelMatrices(numObjects);
+		for (unsigned int i = 0; i < numObjects; i++)
+		{
+			modelMatrices[i] = glm::translate(glm::mat4(1.0f), glm::vec3((float)(i % 64) - 31.5f, (float)(i / 64) - 31.5f, 0.0f));
+		}
+		auto beginPass = [&]() {
+			framebuffer.bind();
+			glEnable(GL_DEPTH_TEST);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		};
+		int modelLocation = shader.getUniformLocation("_Model");
+		bench.run("gl/drawMesh_4096", numObjects, [&]() {
+			beginPass();
+			shader.use();
+			shader.setMat4("_ViewProjection", viewProjection);
+			for (unsigned int i = 0; i < numObjects; i++)
+			{
+				shader.setMat4(modelLocation, modelMatrices[i]);
+				sphere.draw();
+			}
+			glFinish();
+		});
+		ew::InstanceBuffer instances;
+		instances.create<ew::InstanceData>(numObjects);
+		bench.run("gl/drawInstanced_4096", numObjects, [&]() {
+			beginPass();
+			instances.beginFrame();
+			unsigned int baseInstance;
+			ew::InstanceData* data = instances.allocate<ew::InstanceData>(numObjects, &baseInstance);
+			for (unsigned int i = 0; i < numObjects; i++)
+			{
+				data[i].modelMatrix = modelMatrices[i];
+			}
+			instancedShader.use();
+			instancedShader.setMat4("_ViewProjection", viewProjection);
+			sphere.drawInstanced(instances, baseInstance, numObjects);
+			instances.endFrame();
+			glFinish();
+		});
+		ew::Framebuffer::unbind();
+	}
+
+	//A 1M vertex plane regenerated every frame, as a deforming mesh would be. The width changes each run so every
+	//upload carries new data. partial rewrites a band of 1% of the rows in place.
+	const int dynamicPlaneSubdivisions = 999;
+	const char* dynamicPlaneNames[] = { "gl/dynamicPlane_1M_reload", "gl/dynamicPlane_1M_persistent", "gl/dynamicPlane_1M_partial_persistent",
+		"gl/dynamicPlane_1M_orphan", "gl/dynamicPlane_1M_partial_orphan", "gl/dynamicPlane_1M_persistentDirect" };
+	bool dynamicPlaneEnabled = false;
+	for (const char* name : dynamicPlaneNames) {
+		dynamicPlaneEnabled = bench.enabled(name) || dynamicPlaneEnabled;
+	}
+	if (dynamicPlaneEnabled) {
+		ew::MeshSize size = ew::getPlaneSize(dynamicPlaneSubdivisions);
+		ew::Framebuffer framebuffer;
+		framebuffer.create(256, 256);
+		ew::Shader shader(ew::createShaderProgram(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER));
+		ew::Camera camera;
+		camera.position = glm::vec3(0.0f, 5.0f, 5.0f);
+		camera.aspectRatio = 1.0f;
+		glm::mat4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+		int frame = 0;
+		auto beginPass = [&]() {
+			framebuffer.bind();
+			glEnable(GL_DEPTH_TEST);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			shader.use();
+			shader.setMat4("_ViewProjection", viewProjection);
+			shader.setMat4("_Model", glm::mat4(1.0f));
+		};
+
+		//What Mesh offers: a new GL_STATIC_DRAW buffer on every load
+		if (bench.enabled("gl/dynamicPlane_1M_reload")) {
+			std::vector<ew::Vertex> vertices(size.numVertices);
+			std::vector<unsigned int> indices(size.numIndices);
+			ew::Mesh mesh;
+			bench.run("gl/dynamicPlane_1M_reload", size.numVertices, [&]() {
+				beginPass();
+				ew::writePlane(10.0f + (frame++ % 64) * 0.01f, 10.0f, dynamicPlaneSubdivisions, vertices.data(), indices.data());
+				mesh.load(vertices.data(), size.numVertices, indices.data(), size.numIndices);
+				mesh.draw();
+				glFinish();
+			});
+			mesh.unload();
+		}
+
+		const char* modeNames[] = { "persistent", "orphan" };
+		const ew::DynamicMeshMode modes[] = { ew::DynamicMeshMode::PERSISTENT, ew::DynamicMeshMode::ORPHAN };
+		for (int i = 0; i < 2; i++)
+		{
+			std::string fullName = std::string("gl/dynamicPlane_1M_") + modeNames[i];
+			std::string partialName = std::string("gl/dynamicPlane_1M_partial_") + modeNames[i];
+			if (!bench.enabled(fullName.c_str()) && !bench.enabled(partialName.c_str())) {
+				continue;
+			}
+			ew::DynamicMesh mesh;
+			mesh.create<ew::Vertex>(size.numVertices, size.numIndices, modes[i]);
+			mesh.resize(size.numVertices, size.numIndices);
+			bench.run(fullName.c_str(), size.numVertices, [&]() {
+				beginPass();
+				mesh.beginFrame();
+				ew::writePlane(10.0f + (frame++ % 64) * 0.01f, 10.0f, dynamicPlaneSubdivisions, mesh.mapVertices<ew::Vertex>(0, size.numVertices), mesh.mapIndices(0, size.numIndices));
+				mesh.draw();
+				mesh.endFrame();
+				glFinish();
+			});
+
+			const unsigned int rowSize = dynamicPlaneSubdivisions + 1;
+			const unsigned int bandRows = rowSize / 100;
+			bench.run(partialName.c_str(), size.numVertices / 100, [&]() {
+				beginPass();
+				mesh.beginFrame();
+				unsigned int firstRow = (frame++ % 100) * bandRows;
+				ew::Vertex* vertices = mesh.mapVertices<ew::Vertex>(firstRow * rowSize, bandRows * rowSize);
+				for (unsigned int j = 0; j < bandRows * rowSize; j++)
+				{
+					vertices[j].pos.y = sinf(frame * 0.1f + j * 0.01f) * 0.1f;
+				}
+				mesh.draw();
+				mesh.endFrame();
+				glFinish();
+			});
+			consume((double)mesh.getStats().bytesUploaded);
+			mesh.unload();
+		}
+
+		//The persistent ring without DynamicMesh's CPU copy: the plane is written straight into the mapped frame.
+		//The difference to gl/dynamicPlane_1M_persistent is the cost of the extra copy.
+		if (bench.enabled("gl/dynamicPlane_1M_persistentDirect")) {
+			const unsigned int numFrames = 3;
+			size_t vertexBytes = sizeof(ew::Vertex) * size.numVertices;
+			size_t indexBytes = sizeof(unsigned int) * size.numIndices;
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			unsigned int vao, buffers[2];
+			glGenVertexArrays(1, &vao);
+			glGenBuffers(2, buffers);
+			glBindVertexArray(vao);
+			glBindBuffer(GL_ARRAY_BUFFER, buffers[0]);
+			glBufferStorage(GL_ARRAY_BUFFER, vertexBytes * numFrames, NULL, flags);
+			unsigned char* mappedVertices = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, vertexBytes * numFrames, flags);
+			ew::setVertexAttributes(ew::VertexTraits<ew::Vertex>::layout());
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers[1]);
+			glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, indexBytes * numFrames, NULL, flags);
+			unsigned char* mappedIndices = (unsigned char*)glMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, indexBytes * numFrames, flags);
+			glBindVertexArray(0);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			GLsync fences[numFrames] = {};
+			unsigned int segment = 0;
+			bench.run("gl/dynamicPlane_1M_persistentDirect", size.numVertices, [&]() {
+				beginPass();
+				segment = (segment + 1) % numFrames;
+				if (fences[segment] != nullptr) {
+					glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+					glDeleteSync(fences[segment]);
+				}
+				ew::writePlane(10.0f + (frame++ % 64) * 0.01f, 10.0f, dynamicPlaneSubdivisions,
+					(ew::Vertex*)(mappedVertices + segment * vertexBytes), (unsigned int*)(mappedIndices + segment * indexBytes));
+				glBindVertexArray(vao);
+				glDrawElementsBaseVertex(GL_TRIANGLES, size.numIndices, GL_UNSIGNED_INT, (const void*)(segment * indexBytes), (GLint)(segment * size.numVertices));
+				fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+				glFinish();
+			});
+			for (GLsync fence : fences) {
+				if (fence != nullptr) {
+					glDeleteSync(fence);
+				}
+			}
+			glBindVertexArray(0);
+			glDeleteBuffers(2, buffers);
+			glDeleteVertexArrays(1, &vao);
+		}
+		ew::Framebuffer::unbind();
+	}
+
+	//4096 static objects on a grid, cycling through Suzanne's sub-meshes and procGen primitives. Drawn one Mesh::draw
+	//per object and sub-mesh, then merged into a StaticBatch: whole, and grouped into cells with a camera that sees part of the grid.
+	const unsigned int numSceneObjects = 4096;
+	const char* staticSceneNames[] = { "gl/staticScene_perObject_4096", "gl/staticScene_build_4096", "gl/staticScene_batched_4096", "gl/staticScene_batchedCulled_4096" };
+	bool staticSceneEnabled = false;
+	for (const char* name : staticSceneNames) {
+		staticSceneEnabled = bench.enabled(name) || staticSceneEnabled;
+	}
+	if (staticSceneEnabled) {
+		std::vector<ew::MeshData> suzanne;
+		ew::importModel(bench.getOptions().assetPath + "Suzanne.obj", &suzanne);
+		std::vector<ew::MeshData> primitives = { ew::createCube(1.0f), ew::createSphere(0.5f, 16), ew::createCylinder(0.5f, 1.0f, 16) };
+		//Each shape is a list of sub-meshes
+		std::vector<std::vector<const ew::MeshData*>> shapes;
+		if (!suzanne.empty()) {
+			shapes.push_back({});
+			for (const ew::MeshData& mesh : suzanne) {
+				shapes.back().push_back(&mesh);
+			}
+		}
+		for (const ew::MeshData& mesh : primitives) {
+			shapes.push_back({ &mesh });
+		}
+		std::vector<ew::Mesh> meshes;
+		std::vector<const ew::MeshData*> meshSources;
+		for (const std::vector<const ew::MeshData*>& shape : shapes) {
+			for (const ew::MeshData* mesh : shape) {
+				meshes.emplace_back(*mesh);
+				meshSources.push_back(mesh);
+			}
+		}
+		std::vector<ew::StaticObject> objects;
+		std::vector<size_t> objectMeshes; //Index into meshes, per object
+		std::vector<glm::mat4> objectMatrices;
+		for (unsigned int i = 0; i < numSceneObjects; i++)
+		{
+			ew::Transform transform;
+			transform.position = glm::vec3((float)(i % 64) * 3.0f - 94.5f, 0.0f, (float)(i / 64) * 3.0f - 94.5f);
+			transform.rotation = glm::angleAxis((float)i, glm::vec3(0.0f, 1.0f, 0.0f));
+			for (const ew::MeshData* mesh : shapes[i % shapes.size()]) {
+				ew::StaticObject object;
+				object.mesh = mesh;
+				object.transform = transform;
+				objects.push_back(object);
+				objectMeshes.push_back(std::find(meshSources.begin(), meshSources.end(), mesh) - meshSources.begin());
+				objectMatrices.push_back(transform.modelMatrix());
+			}
+		}
+
+		ew::Framebuffer framebuffer;
+		framebuffer.create(256, 256);
+		ew::Shader shader(ew::createShaderProgram(BENCH_VERTEX_SHADER, BENCH_FRAGMENT_SHADER));
+		int modelLocation = shader.getUniformLocation("_Model");
+		//Low over one corner of the grid, so most of it is behind or beside the camera
+		ew::Camera camera;
+		camera.position = glm::vec3(-90.0f, 6.0f, -90.0f);
+		camera.target = glm::vec3(-60.0f, 0.0f, -70.0f);
+		camera.aspectRatio = 1.0f;
+		camera.farPlane = 60.0f;
+		glm::mat4 viewProjection = camera.projectionMatrix() * camera.viewMatrix();
+		auto beginPass = [&]() {
+			framebuffer.bind();
+			glEnable(GL_DEPTH_TEST);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			shader.use();
+			shader.setMat4("_ViewProjection", viewProjection);
+		};
+
+		bench.run("gl/staticScene_perObject_4096", objects.size(), [&]() {
+			beginPass();
+			for (size_t i = 0; i < objects.size(); i++)
+			{
+				shader.setMat4(modelLocation, objectMatrices[i]);
+				meshes[objectMeshes[i]].draw();
+			}
+			glFinish();
+		});
+		ew::StaticBatch batch;
+		bench.run("gl/staticScene_build_4096", objects.size(), [&]() {
+			batch.build(objects);
+			glFinish();
+		});
+		batch.build(objects);
+		unsigned int batchedDraws = 0;
+		bench.run("gl/staticScene_batched_4096", objects.size(), [&]() {
+			beginPass();
+			shader.setMat4(modelLocation, glm::mat4(1.0f));
+			batchedDraws = batch.draw();
+			glFinish();
+		});
+		ew::StaticBatchSettings cellSettings;
+		cellSettings.cellSize = 24.0f;
+		batch.build(objects, cellSettings);
+		unsigned int culledDraws = 0;
+		bench.run("gl/staticScene_batchedCulled_4096", objects.size(), [&]() {
+			beginPass();
+			shader.setMat4(modelLocation, glm::mat4(1.0f));
+			culledDraws = batch.draw(camera);
+			glFinish();
+		});
+		if (bench.enabled("gl/staticScene_batchedCulled_4096")) {
+			fprintf(stderr, "gl/staticScene: %zu draws per object, %u batched, %u with %zu cells culled\n", objects.size(), batchedDraws, culledDraws, batch.getNumBatches());
+		}
+		for (ew::Mesh& mesh : meshes) {
+			mesh.unload();
+		}
+		ew::Framebuffer::unbind();
+	}
+
+	const unsigned int numCullObjects = 100000;
+	if (bench.enabled("gl/gpuCull_100k")) {
+		std::mt19937 rng(2);
+		std::uniform_real_distribution<float> random(-100.0f, 100.0f);
+		ew::GeometryArena arena;
+		arena.create<ew::Vertex>(1024, 1024);
+		ew::GeometryHandle cube = arena.allocate(ew::createCube(2.0f));
+		std::vector<ew::GeometryHandle> geometry(numCullObjects, cube);
+		std::vector<ew::Bounds> bounds(numCullObjects);
+		ew::InstanceBuffer instances;
+		instances.create<ew::InstanceData>(numCullObjects, 1);
+		instances.beginFrame();
+		unsigned int baseInstance;
+		ew::InstanceData* data = instances.allocate<ew::InstanceData>(numCullObjects, &baseInstance);
+		for (unsigned int i = 0; i < numCullObjects; i++)
+		{
+			bounds[i].min = glm::vec3(-1.0f);
+			bounds[i].max = glm::vec3(1.0f);
+			bounds[i].radius = sqrtf(3.0f);
+			data[i] = ew::InstanceData();
+			data[i].modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(random(rng), random(rng), random(rng)));
+		}
+		instances.endFrame();
+		ew::GpuCuller culler;
+		culler.create(numCullObjects);
+		culler.setObjects(arena, geometry.data(), bounds.data(), numCullObjects);
+		//Same camera as culling/cullObjectsReference_100k
+		ew::Camera camera;
+		camera.position = glm::vec3(0.0f, 0.0f, 120.0f);
+		camera.farPlane = 200.0f;
+		bench.run("gl/gpuCull_100k", numCullObjects, [&]() {
+			culler.cull(camera, instances, baseInstance);
+			glFinish();
+		});
+	}
+}
+
+//Closest point on triangle abc to p, from Ericson's Real-Time Collision Detection 5.1.5
+static glm::vec3 closestPointOnTriangle(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c) {
+	glm::vec3 ab = b - a, ac = c - a, ap = p - a;
+	float d1 = glm::dot(ab, ap), d2 = glm::dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) return a;
+	glm::vec3 bp = p - b;
+	float d3 = glm::dot(ab, bp), d4 = glm::dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) return b;
+	float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) return a + ab * (d1 / (d1 - d3));
+	glm::vec3 cp = p - c;
+	float d5 = glm::dot(ab, cp), d6 = glm::dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) return c;
+	float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) return a + ac * (d2 / (d2 - d6));
+	float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	float denom = 1.0f / (va + vb + vc);
+	return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+//Furthest any vertex of original lies from the surface of simplified. Brute force, so keep the meshes small.
+static float getMaxSurfaceDistance(const ew::MeshData& original, const ew::MeshData& simplified) {
+	float maxDistance = 0.0f;
+	for (const ew::Vertex& v : original.vertices) {
+		float closest = 1e30f;
+		for (size_t i = 0; i + 2 < simplified.indices.size(); i += 3)
+		{
+			glm::vec3 a = simplified.vertices[simplified.indices[i]].pos;
+			glm::vec3 b = simplified.vertices[simplified.indices[i + 1]].pos;
+			glm::vec3 c = simplified.vertices[simplified.indices[i + 2]].pos;
+			closest = std::min(closest, glm::distance(v.pos, closestPointOnTriangle(v.pos, a, b, c)));
+		}
+		maxDistance = std::max(maxDistance, closest);
+	}
+	return maxDistance;
+}
+
+//Each level must land near its ratio of the original triangle count, and no original vertex may be further from the
+//level's surface than the error it reports
+static void verifyLODs(Bench& bench) {
+	struct NamedMesh {
+		const char* name;
+		ew::MeshData meshData;
+	};
+	const char* names[] = { "verify/lods_suzanne", "verify/lods_sphere", "verify/lods_cylinder", "verify/lods_plane" };
+	bool anyEnabled = false;
+	for (const char* name : names) {
+		anyEnabled = bench.enabled(name) || anyEnabled;
+	}
+	if (!anyEnabled) {
+		return;
+	}
+	std::vector<NamedMesh> meshes;
+	std::vector<ew::MeshData> suzanne;
+	if (ew::importModel(bench.getOptions().assetPath + "Suzanne.obj", &suzanne) && !suzanne.empty()) {
+		meshes.push_back({ names[0], suzanne[0] });
+	}
+	else {
+		bench.check(names[0], false, "could not load %sSuzanne.obj", bench.getOptions().assetPath.c_str());
+	}
+	meshes.push_back({ names[1], ew::createSphere(1.0f, 48) });
+	meshes.push_back({ names[2], ew::createCylinder(1.0f, 2.0f, 64) });
+	meshes.push_back({ names[3], ew::createPlane(10.0f, 10.0f, 48) });
+	const std::vector<float> ratios = { 0.5f, 0.25f, 0.1f };
+	//Collapses remove one or two triangles at a time, and seams and borders can stop a level a little short
+	const float triangleTolerance = 0.05f;
+	//Distances are computed in float, so allow for rounding on meshes a few units across
+	const float distanceEpsilon = 1e-4f;
+	for (const NamedMesh& mesh : meshes) {
+		if (!bench.enabled(mesh.name)) {
+			continue;
+		}
+		size_t numTriangles = mesh.meshData.indices.size() / 3;
+		std::vector<ew::LODLevel> levels = ew::generateLODs(mesh.meshData, ratios);
+		bool passed = levels.size() == ratios.size();
+		std::string detail = std::to_string(numTriangles) + " tris ->";
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			size_t levelTriangles = levels[i].meshData.indices.size() / 3;
+			double target = numTriangles * (double)ratios[i];
+			bool countOk = fabs(levelTriangles - target) <= std::max(target * triangleTolerance, 2.0);
+			float distance = getMaxSurfaceDistance(mesh.meshData, levels[i].meshData);
+			bool errorOk = distance <= levels[i].error + distanceEpsilon;
+			passed = passed && countOk && errorOk;
+			char level[96];
+			snprintf(level, sizeof(level), " %zu%s (dist %.4f%s err %.4f)", levelTriangles, countOk ? "" : "!", distance, errorOk ? " <=" : " >", levels[i].error);
+			detail += level;
+		}
+		bench.check(mesh.name, passed, "%s", detail.c_str());
+	}
+}
+
+//Spacing between neighbouring halves around h
+static double getHalfUlp(uint16_t h) {
+	int exponent = (h >> 10) & 0x1f;
+	return ldexp(1.0, std::max(exponent, 1) - 25);
+}
+
+//encodeHalf must round every float to the nearest half, ties to even, and decodeHalf must be its exact inverse
+static void verifyHalf(Bench& bench) {
+	if (bench.enabled("verify/half_roundTrip")) {
+		//Every bit pattern except NaN, which only has to stay NaN
+		int failures = 0;
+		for (uint32_t h = 0; h <= 0xffff; h++)
+		{
+			bool isNaN = (h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0;
+			uint16_t result = ew::encodeHalf(ew::decodeHalf((uint16_t)h));
+			bool passed = isNaN ? ((result & 0x7c00) == 0x7c00 && (result & 0x3ff) != 0) : result == h;
+			failures += passed ? 0 : 1;
+		}
+		bench.check("verify/half_roundTrip", failures == 0, "%d of 65536 bit patterns changed", failures);
+	}
+	if (bench.enabled("verify/half_rounding")) {
+		//Exhaustive over every positive float that does not round to zero or overflow, with negatives sampled.
+		//Below 2^-25 everything must round to zero, and from 65520 up to infinity.
+		const uint32_t minRounded = 0x33000000; //2^-25
+		const uint32_t overflow = 0x477ff000; //65520
+		int failures = 0;
+		double maxRelative = 0.0;
+		double maxSubnormal = 0.0;
+		auto test = [&](uint32_t bits) {
+			float v;
+			memcpy(&v, &bits, sizeof(v));
+			uint16_t h = ew::encodeHalf(v);
+			bool passed;
+			if (bits >= 0x7f800000) {
+				//Infinity stays infinity and NaN stays NaN
+				passed = bits == 0x7f800000 ? h == 0x7c00 : ((h & 0x7c00) == 0x7c00 && (h & 0x3ff) != 0);
+			}
+			else if (bits >= overflow) {
+				passed = h == 0x7c00;
+			}
+			else if (bits < minRounded) {
+				passed = h == 0;
+			}
+			else {
+				double error = fabs((double)ew::decodeHalf(h) - v);
+				double halfUlp = getHalfUlp(h) * 0.5;
+				//The value just below a power of two may round up into the next binade, whose ulp is twice as large
+				passed = (h & 0x7c00) != 0x7c00 && (error < halfUlp || (error == halfUlp && (h & 1) == 0) || (error <= halfUlp * 0.5 && (h & 0x3ff) == 0));
+				//The relative bound holds for inputs in the normal range, even where one below 2^-14 rounds up into it
+				if (bits >= 0x38800000) {
+					maxRelative = std::max(maxRelative, error / v);
+				}
+				else {
+					maxSubnormal = std::max(maxSubnormal, error);
+				}
+			}
+			if (passed && (bits % 61) == 0 && ew::encodeHalf(-v) != (h | 0x8000)) {
+				passed = false;
+			}
+			failures += passed ? 0 : 1;
+		};
+		for (uint32_t bits = minRounded; bits < overflow; bits++)
+		{
+			test(bits);
+		}
+		//Sampled, with the boundaries either side of each range
+		for (uint32_t bits = 0; bits < minRounded; bits += 4099)
+		{
+			test(bits);
+		}
+		for (uint32_t bits = overflow; bits < 0x7f800000; bits += 4099)
+		{
+			test(bits);
+		}
+		uint32_t edges[] = { minRounded - 1, overflow - 1, overflow, 0x7f7fffff, 0x7f800000, 0x7fc00000, 0x7f800001 };
+		for (uint32_t bits : edges) {
+			test(bits);
+		}
+		bool passed = failures == 0 && maxRelative <= ldexp(1.0, -11) && maxSubnormal <= ldexp(1.0, -25);
+		bench.check("verify/half_rounding", passed, "%d failures, max relative error %.3g (2^-11 = %.3g), max subnormal error %.3g", failures, maxRelative, ldexp(1.0, -11), maxSubnormal);
+	}
+}
+
+//Octahedral normals stored as two snorm16s must come back within 0.04 degrees
+static void verifyOctahedral(Bench& bench) {
+	if (!bench.enabled("verify/octahedral_snorm16")) {
+		return;
+	}
+	std::vector<glm::vec3> normals = {
+		glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1),
+		glm::normalize(glm::vec3(1, 1, 0)), glm::normalize(glm::vec3(-1, 1, 0)), glm::normalize(glm::vec3(1, -1, -1e-6f)),
+		glm::normalize(glm::vec3(1, 1, 1)), glm::normalize(glm::vec3(-1, -1, -1)), glm::normalize(glm::vec3(1e-6f, 0, -1))
+	};
+	//Fibonacci sphere, evenly covering both halves of the octahedron and its folded edges
+	const int numSamples = 1 << 20;
+	const double goldenAngle = 3.14159265358979 * (3.0 - sqrt(5.0));
+	for (int i = 0; i < numSamples; i++)
+	{
+		double z = 1.0 - (2.0 * i + 1.0) / numSamples;
+		double r = sqrt(1.0 - z * z);
+		normals.push_back(glm::vec3((float)(r * cos(goldenAngle * i)), (float)(r * sin(goldenAngle * i)), (float)z));
+	}
+	double maxDegrees = 0.0;
+	for (const glm::vec3& n : normals) {
+		glm::vec2 e = ew::encodeOctahedral(n);
+		glm::vec3 d = ew::decodeOctahedral(glm::vec2(ew::decodeSnorm16(ew::encodeSnorm16(e.x)), ew::decodeSnorm16(ew::encodeSnorm16(e.y))));
+		//atan2 stays accurate for tiny angles, where acos of the dot product does not
+		glm::vec3 c = glm::cross(n, d);
+		double degrees = atan2((double)glm::length(c), (double)glm::dot(n, d)) * 180.0 / 3.14159265358979;
+		maxDegrees = std::max(maxDegrees, degrees);
+	}
+	bool snormEdges = ew::encodeSnorm16(1.0f) == 32767 && ew::encodeSnorm16(-1.0f) == -32767 && ew::encodeSnorm16(2.0f) == 32767
+		&& ew::decodeSnorm16(-32768) == -1.0f && ew::decodeSnorm16(32767) == 1.0f && ew::decodeSnorm16(0) == 0.0f;
+	bench.check("verify/octahedral_snorm16", maxDegrees <= 0.04 && snormEdges, "max error %.5f degrees over %zu normals%s", maxDegrees, normals.size(), snormEdges ? "" : ", snorm16 edges wrong");
+}
+
+//The SIMD culling paths must return exactly the scalar visible lists, for perspective and orthographic cameras
+static void verifyCulling(Bench& bench) {
+	const char* names[] = { "verify/culling_perspective", "verify/culling_orthographic" };
+	//Not a multiple of 8, so the scalar tail after the SIMD loop runs too
+	const size_t count = 100003;
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> random(-100.0f, 100.0f);
+	std::uniform_real_distribution<float> size(0.0f, 4.0f);
+	ew::CullingBounds bounds;
+	for (size_t i = 0; i < count; i++)
+	{
+		ew::Bounds b;
+		b.center = glm::vec3(random(rng), random(rng), random(rng));
+		glm::vec3 extents = glm::vec3(size(rng), size(rng), size(rng));
+		b.min = b.center - extents;
+		b.max = b.center + extents;
+		b.radius = glm::length(extents);
+		bounds.add(b);
+	}
+	//Zero sized, and NaN, which both paths must treat as visible
+	bounds.extentX[7] = bounds.extentY[7] = bounds.extentZ[7] = bounds.radius[7] = 0.0f;
+	bounds.centerX[11] = bounds.radius[13] = bounds.extentY[13] = NAN;
+	std::vector<uint32_t> scalar(count), simd(count);
+	for (int orthographic = 0; orthographic < 2; orthographic++)
+	{
+		const char* name = names[orthographic];
+		if (!bench.enabled(name)) {
+			continue;
+		}
+		ew::Camera camera;
+		camera.position = glm::vec3(10.0f, 20.0f, 120.0f);
+		camera.target = glm::vec3(-5.0f, 0.0f, 0.0f);
+		camera.farPlane = 200.0f;
+		camera.orthographic = orthographic != 0;
+		camera.orthoHeight = 80.0f;
+		ew::Frustum frustum = ew::extractFrustum(camera);
+		bool passed = true;
+		std::string detail;
+		struct Path {
+			const char* label;
+			size_t(*scalar)(const ew::Frustum&, const ew::CullingBounds&, uint32_t*);
+			size_t(*simd)(const ew::Frustum&, const ew::CullingBounds&, uint32_t*);
+			bool parallel;
+		};
+		const Path paths[] = {
+			{ "spheres", ew::cullSpheresScalar, ew::cullSpheres, false },
+			{ "boxes", ew::cullBoxesScalar, ew::cullBoxes, false },
+			{ "spheresParallel", ew::cullSpheresScalar, nullptr, true },
+			{ "boxesParallel", ew::cullBoxesScalar, nullptr, true }
+		};
+		for (int p = 0; p < 4; p++)
+		{
+			const Path& path = paths[p];
+			size_t numScalar = path.scalar(frustum, bounds, scalar.data());
+			size_t numSimd;
+			if (!path.parallel) {
+				numSimd = path.simd(frustum, bounds, simd.data());
+			}
+			else if (p == 2) {
+				numSimd = ew::cullSpheres(frustum, bounds, simd.data(), ew::JobSystem::global());
+			}
+			else {
+				numSimd = ew::cullBoxes(frustum, bounds, simd.data(), ew::JobSystem::global());
+			}
+			bool same = numScalar == numSimd && std::equal(scalar.begin(), scalar.begin() + numScalar, simd.begin());
+			passed = passed && same;
+			detail += std::string(p ? ", " : "") + path.label + " " + std::to_string(numSimd) + (same ? "" : "!=" + std::to_string(numScalar));
+		}
+		bench.check(name, passed, "%s visible", detail.c_str());
+	}
+}
+
+//How close the world space bounds come to deciding a plane test the other way. GPU and CPU arithmetic may round
+//differently, so objects this close to a plane are the only ones allowed to disagree.
+static float getPlaneMargin(const ew::Frustum& frustum, const ew::Bounds& bounds) {
+	float margin = 1e30f;
+	glm::vec3 extents = bounds.extents();
+	for (int i = 0; i < 6; i++)
+	{
+		glm::vec3 normal = glm::vec3(frustum.planes[i]);
+		float distance = glm::dot(normal, bounds.center) + frustum.planes[i].w;
+		float boxRadius = glm::dot(glm::abs(normal), extents);
+		margin = std::min(margin, std::min(fabsf(distance + bounds.radius), fabsf(distance + boxRadius)));
+	}
+	return margin;
+}
+
+//GpuCuller must find the same visible objects as cullObjectsReference, on the gl/gpuCull_100k scene
+static void verifyGpuCulling(Bench& bench) {
+	const char* names[] = { "verify/gl/gpuCull_perspective", "verify/gl/gpuCull_orthographic" };
+	if (!bench.enabled(names[0]) && !bench.enabled(names[1])) {
+		return;
+	}
+	const unsigned int numObjects = 100000;
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> random(-100.0f, 100.0f);
+	ew::GeometryArena arena;
+	arena.create<ew::Vertex>(1024, 1024);
+	ew::GeometryHandle cube = arena.allocate(ew::createCube(2.0f));
+	std::vector<ew::GeometryHandle> geometry(numObjects, cube);
+	std::vector<ew::Bounds> bounds(numObjects);
+	std::vector<ew::InstanceData> instanceData(numObjects);
+	for (unsigned int i = 0; i < numObjects; i++)
+	{
+		bounds[i].min = glm::vec3(-1.0f);
+		bounds[i].max = glm::vec3(1.0f);
+		bounds[i].radius = sqrtf(3.0f);
+		instanceData[i].modelMatrix = glm::translate(glm::mat4(1.0f), glm::vec3(random(rng), random(rng), random(rng)));
+	}
+	ew::InstanceBuffer instances;
+	instances.create<ew::InstanceData>(numObjects, 1);
+	instances.beginFrame();
+	unsigned int baseInstance;
+	ew::InstanceData* data = instances.allocate<ew::InstanceData>(numObjects, &baseInstance);
+	memcpy(data, instanceData.data(), sizeof(ew::InstanceData) * numObjects);
+	instances.endFrame();
+	ew::GpuCuller culler;
+	culler.create(numObjects);
+	culler.setObjects(arena, geometry.data(), bounds.data(), numObjects);
+	std::vector<uint32_t> reference(numObjects);
+	std::vector<uint32_t> visible;
+	for (int orthographic = 0; orthographic < 2; orthographic++)
+	{
+		if (!bench.enabled(names[orthographic])) {
+			continue;
+		}
+		ew::Camera camera;
+		camera.position = glm::vec3(0.0f, 0.0f, 120.0f);
+		camera.farPlane = 200.0f;
+		camera.orthographic = orthographic != 0;
+		camera.orthoHeight = 80.0f;
+		ew::Frustum frustum = ew::extractFrustum(camera);
+		culler.cull(camera, instances, baseInstance);
+		culler.readVisible(visible);
+		size_t numReference = ew::cullObjectsReference(frustum, bounds.data(), instanceData.data(), numObjects, reference.data());
+		reference.resize(numReference);
+		std::vector<uint32_t> different;
+		std::set_symmetric_difference(reference.begin(), reference.end(), visible.begin(), visible.end(), std::back_inserter(different));
+		size_t numRounding = 0;
+		for (uint32_t i : different) {
+			numRounding += getPlaneMargin(frustum, ew::transformBounds(bounds[i], instanceData[i].modelMatrix)) <= 1e-3f ? 1 : 0;
+		}
+		bool passed = different.size() == numRounding;
+		bench.check(names[orthographic], passed, "%zu visible, reference %zu, %zu differ (%zu within rounding of a plane)",
+			visible.size(), numReference, different.size(), numRounding);
+		reference.resize(numObjects);
+	}
+}
+
+static const char* VERIFY_INSTANCED_VERTEX_SHADER = R"(#version 450
+layout(location = 0) in vec3 vPos;
+layout(location = 3) in mat4 _InstanceModel;
+layout(location = 7) in vec4 _InstanceColor;
+out vec4 Color;
+void main(){
+	Color = _InstanceColor;
+	gl_Position = _InstanceModel * vec4(vPos.xz,0.0,1.0);
+}
+)";
+
+static const char* VERIFY_COLOR_FRAGMENT_SHADER = R"(#version 450
+in vec4 Color;
+out vec4 FragColor;
+void main(){
+	FragColor = Color;
+}
+)";
+
+//Recreating an InstanceBuffer usually gets the deleted buffer's name back from GL. Meshes and arenas drawn with the
+//old buffer must still point their instance attributes at the new one.
+static void verifyInstanceBufferRecreate(Bench& bench) {
+	if (!bench.enabled("verify/gl/instanceBufferRecreate")) {
+		return;
+	}
+	ew::Framebuffer framebuffer;
+	framebuffer.create(16, 16);
+	ew::Shader shader(ew::createShaderProgram(VERIFY_INSTANCED_VERTEX_SHADER, VERIFY_COLOR_FRAGMENT_SHADER));
+	ew::Mesh mesh(ew::createPlane(2.0f, 2.0f, 1));
+	ew::GeometryArena arena;
+	arena.create<ew::Vertex>(64, 64);
+	ew::GeometryHandle plane = arena.allocate(ew::createPlane(2.0f, 2.0f, 1));
+	ew::InstanceBuffer instances;
+	const glm::vec4 colors[] = { glm::vec4(1, 0, 0, 1), glm::vec4(0, 0, 1, 1) };
+	bool passed = true;
+	unsigned int ids[2];
+	std::string detail;
+	for (int i = 0; i < 2; i++)
+	{
+		instances.create<ew::InstanceData>(1, 2);
+		ids[i] = instances.getID();
+		for (int useArena = 0; useArena < 2; useArena++)
+		{
+			instances.beginFrame();
+			unsigned int baseInstance;
+			ew::InstanceData* data = instances.allocate<ew::InstanceData>(1, &baseInstance);
+			*data = ew::InstanceData();
+			data->color = colors[i];
+			framebuffer.bind();
+			glClearColor(0, 0, 0, 1);
+			glClear(GL_COLOR_BUFFER_BIT);
+			glDisable(GL_CULL_FACE);
+			shader.use();
+			if (useArena) {
+				arena.bind();
+				arena.setInstanceBuffer(instances);
+				const ew::GeometryRange& range = arena.getRange(plane);
+				glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, range.numIndices, arena.getIndexType(),
+					(const void*)(range.firstIndex * arena.getIndexSize()), 1, range.baseVertex, baseInstance);
+			}
+			else {
+				mesh.drawInstanced(instances, baseInstance, 1);
+			}
+			instances.endFrame();
+			std::vector<unsigned char> rgba;
+			framebuffer.readPixels(rgba);
+			const unsigned char* center = &rgba[(8 * 16 + 8) * 4];
+			bool same = center[0] == (unsigned char)(colors[i].x * 255) && center[2] == (unsigned char)(colors[i].z * 255);
+			passed = passed && same;
+			char result[64];
+			snprintf(result, sizeof(result), "%s%s %s", detail.empty() ? "" : ", ", useArena ? "arena" : "mesh", same ? "ok" : "stale");
+			detail += result;
+		}
+	}
+	ew::Framebuffer::unbind();
+	mesh.unload();
+	bench.check("verify/gl/instanceBufferRecreate", passed, "%s, buffer name %s", detail.c_str(), ids[0] == ids[1] ? "reused" : "not reused");
+}
+
+//A RenderQueue that outgrows its rings mid-session must draw from the new ones, for Mesh and GeometryArena packets
+static void verifyRenderQueueGrow(Bench& bench) {
+	if (!bench.enabled("verify/gl/renderQueueGrow")) {
+		return;
+	}
+	ew::Framebuffer framebuffer;
+	framebuffer.create(16, 16);
+	ew::Shader shader(ew::createShaderProgram(VERIFY_INSTANCED_VERTEX_SHADER, VERIFY_COLOR_FRAGMENT_SHADER));
+	ew::Mesh mesh(ew::createPlane(2.0f, 2.0f, 1));
+	ew::GeometryArena arena;
+	arena.create<ew::Vertex>(64, 64);
+	ew::GeometryHandle plane = arena.allocate(ew::createPlane(2.0f, 2.0f, 1));
+	ew::RenderQueue queue;
+	queue.create(1, 2);
+	const glm::vec4 colors[] = { glm::vec4(1, 0, 0, 1), glm::vec4(0, 0, 1, 1), glm::vec4(0, 1, 0, 1) };
+	const unsigned int numPackets[] = { 1, 3, 9 };
+	bool passed = true;
+	std::string detail;
+	glDisable(GL_CULL_FACE);
+	glDisable(GL_DEPTH_TEST);
+	for (int useArena = 0; useArena < 2; useArena++)
+	{
+		for (int frame = 0; frame < 3; frame++)
+		{
+			framebuffer.bind();
+			glClearColor(0, 0, 0, 1);
+			glClear(GL_COLOR_BUFFER_BIT);
+			for (unsigned int i = 0; i < numPackets[frame]; i++)
+			{
+				ew::DrawPacket packet;
+				packet.shader = shader.getID();
+				if (useArena) {
+					packet.arena = &arena;
+					packet.geometry = plane;
+				}
+				else {
+					packet.mesh = &mesh;
+				}
+				packet.instance.color = colors[frame];
+				queue.submit(packet);
+			}
+			queue.execute();
+			std::vector<unsigned char> rgba;
+			framebuffer.readPixels(rgba);
+			const unsigned char* center = &rgba[(8 * 16 + 8) * 4];
+			bool same = center[0] == (unsigned char)(colors[frame].x * 255) && center[1] == (unsigned char)(colors[frame].y * 255)
+				&& center[2] == (unsigned char)(colors[frame].z * 255);
+			passed = passed && same;
+			if (!same) {
+				detail += std::string(detail.empty() ? "" : ", ") + (useArena ? "arena" : "mesh") + " frame " + std::to_string(frame) + " stale";
+			}
+		}
+	}
+	ew::Framebuffer::unbind();
+	mesh.unload();
+	bench.check("verify/gl/renderQueueGrow", passed, "%s", detail.empty() ? "1, 3 then 9 packets drawn from the grown rings" : detail.c_str());
+}
+
+//AsyncTextureLoader must show the grey placeholder until the whole image is in, then exactly the decoded image
+static void verifyAsyncTexture(Bench& bench) {
+	if (!bench.enabled("verify/gl/asyncTexturePlaceholder")) {
+		return;
+	}
+	std::string path = bench.getOptions().assetPath + "brick_color.jpg";
+	int width, height, numComponents;
+	unsigned char* expected = stbi_load(path.c_str(), &width, &height, &numComponents, 0);
+	if (expected == nullptr) {
+		bench.check("verify/gl/asyncTexturePlaceholder", false, "could not load %s", path.c_str());
+		return;
+	}
+	//Small enough that the image takes several updates
+	ew::AsyncTextureLoader loader((size_t)width * numComponents * (height / 4 + 1));
+	unsigned int texture = loader.load(path.c_str());
+	int numUpdates = 0;
+	int placeholderUpdates = 0;
+	bool placeholderKept = true;
+	while (!loader.isReady(texture) && numUpdates < 100000) {
+		loader.update();
+		numUpdates++;
+		if (loader.isReady(texture) || (loader.getStats(texture) && loader.getStats(texture)->failed)) {
+			break;
+		}
+		int levelWidth = 0;
+		unsigned char texel[4] = {};
+		//update() leaves texture unit bindings at 0
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &levelWidth);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, levelWidth == 1 ? texel : nullptr);
+		placeholderKept = placeholderKept && levelWidth == 1 && texel[0] == 128 && texel[1] == 128 && texel[2] == 128;
+		placeholderUpdates++;
+		std::this_thread::sleep_for(std::chrono::microseconds(200));
+	}
+	bool ready = loader.isReady(texture);
+	bool same = false;
+	if (ready) {
+		std::vector<unsigned char> pixels((size_t)width * height * numComponents);
+		glBindTexture(GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glGetTexImage(GL_TEXTURE_2D, 0, numComponents == 4 ? GL_RGBA : (numComponents == 3 ? GL_RGB : (numComponents == 2 ? GL_RG : GL_RED)), GL_UNSIGNED_BYTE, pixels.data());
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		same = memcmp(pixels.data(), expected, pixels.size()) == 0;
+	}
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glDeleteTextures(1, &texture);
+	stbi_image_free(expected);
+	bench.check("verify/gl/asyncTexturePlaceholder", ready && same && placeholderKept, "%dx%d in %d updates, placeholder %s for %d, image %s",
+		width, height, numUpdates, placeholderKept ? "kept" : "lost", placeholderUpdates, !ready ? "not ready" : (same ? "matches" : "differs"));
+}
+
+//A Mesh loaded without indices must draw its vertices as triangles without raising a GL error
+static void verifyMeshWithoutIndices(Bench& bench) {
+	if (!bench.enabled("verify/gl/meshWithoutIndices")) {
+		return;
+	}
+	ew::Framebuffer framebuffer;
+	framebuffer.create(16, 16);
+	ew::Shader shader(ew::createShaderProgram(VERIFY_INSTANCED_VERTEX_SHADER, VERIFY_COLOR_FRAGMENT_SHADER));
+	//The plane's triangles, unrolled
+	ew::MeshData plane = ew::createPlane(2.0f, 2.0f, 1);
+	std::vector<ew::Vertex> vertices;
+	for (unsigned int index : plane.indices) {
+		vertices.push_back(plane.vertices[index]);
+	}
+	ew::Mesh mesh;
+	mesh.load(vertices, std::vector<unsigned int>());
+	ew::InstanceBuffer instances;
+	instances.create<ew::InstanceData>(1, 1);
+	while (glGetError() != GL_NO_ERROR) {}
+	framebuffer.bind();
+	glClearColor(0, 0, 0, 1);
+	glClear(GL_COLOR_BUFFER_BIT);
+	shader.use();
+	instances.beginFrame();
+	unsigned int baseInstance;
+	*instances.allocate<ew::InstanceData>(1, &baseInstance) = ew::InstanceData();
+	mesh.drawInstanced(instances, baseInstance, 1);
+	instances.endFrame();
+	GLenum error = glGetError();
+	std::vector<unsigned char> rgba;
+	framebuffer.readPixels(rgba);
+	const unsigned char* center = &rgba[(8 * 16 + 8) * 4];
+	bool drawn = center[0] == 255 && center[1] == 255 && center[2] == 255;
+	ew::Framebuffer::unbind();
+	mesh.unload();
+	bench.check("verify/gl/meshWithoutIndices", error == GL_NO_ERROR && drawn, "GL error 0x%x, %zu vertices %s", error, vertices.size(), drawn ? "drawn" : "not drawn");
+}
+
+static const char* VERIFY_UNIFORM_ARRAY_FRAGMENT_SHADER = R"(#version 450
+in vec4 Color;
+uniform int _Index;
+uniform float _Kernel[6];
+uniform vec4 _Colors[3];
+out vec4 FragColor;
+void main(){
+	FragColor = Color * _Colors[_Index % 3] * _Kernel[_Index];
+}
+)";
+
+//Elements after [0] of a uniform array must be found by name, and values set through them must reach the program
+static void verifyUniformArray(Bench& bench) {
+	if (!bench.enabled("verify/gl/uniformArrayElements")) {
+		return;
+	}
+	ew::Shader shader(ew::createShaderProgram(VERIFY_INSTANCED_VERTEX_SHADER, VERIFY_UNIFORM_ARRAY_FRAGMENT_SHADER));
+	shader.use();
+	shader.setFloat("_Kernel[5]", 0.625f);
+	shader.setVec4("_Colors[2]", glm::vec4(0.25f, 0.5f, 0.75f, 1.0f));
+	const char* names[] = { "_Kernel[5]", "_Colors[2]" };
+	bool locationsMatch = true;
+	for (const char* name : names) {
+		locationsMatch &= shader.getUniformLocation(name) >= 0 && shader.getUniformLocation(name) == glGetUniformLocation(shader.getID(), name);
+	}
+	float kernel = 0.0f;
+	float color[4] = {};
+	glGetUniformfv(shader.getID(), glGetUniformLocation(shader.getID(), "_Kernel[5]"), &kernel);
+	glGetUniformfv(shader.getID(), glGetUniformLocation(shader.getID(), "_Colors[2]"), color);
+	bool valuesMatch = kernel == 0.625f && color[0] == 0.25f && color[1] == 0.5f && color[2] == 0.75f && color[3] == 1.0f;
+	glUseProgram(0);
+	glDeleteProgram(shader.getID());
+	bench.check("verify/gl/uniformArrayElements", locationsMatch && valuesMatch, "locations %s, _Kernel[5] = %g, _Colors[2] = (%g, %g, %g, %g)",
+		locationsMatch ? "match" : "differ", kernel, color[0], color[1], color[2], color[3]);
+}
+
+//Checks that need a GL context
+static void verifyGL(Bench& bench) {
+	verifyGpuCulling(bench);
+	verifyInstanceBufferRecreate(bench);
+	verifyRenderQueueGrow(bench);
+	verifyAsyncTexture(bench);
+	verifyMeshWithoutIndices(bench);
+	verifyUniformArray(bench);
+}
+
+static const char* getCompiler() {
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc";
+#else
+	return "unknown";
+#endif
+}
+
+static void writeJson(FILE* file, const Bench& bench) {
+	const BenchOptions& options = bench.getOptions();
+	fprintf(file, "{\n\t\"suite\": \"core_bench\",\n\t\"compiler\": \"%s\",\n\t\"buildType\": \"%s\",\n", getCompiler(), EW_BENCH_BUILD_TYPE);
+	fprintf(file, "\t\"threads\": %u,\n\t\"repetitions\": %d,\n\t\"warmup\": %d,\n\t\"results\": [", ew::JobSystem::global().getNumThreads() + 1, options.repetitions, options.warmup);
+	const std::vector<BenchResult>& results = bench.getResults();
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		fprintf(file, "%s\n\t\t{\"name\": \"%s\", \"items\": %zu, \"unit\": \"ms\", \"min\": %.6f, \"median\": %.6f, \"mean\": %.6f, \"stddev\": %.6f, \"max\": %.6f, \"itemsPerSecond\": %.1f, \"samples\": [",
+			i ? "," : "", r.name.c_str(), r.items, r.min, r.median, r.mean, r.stddev, r.max, r.median > 0.0 ? r.items / (r.median * 1e-3) : 0.0);
+		for (size_t s = 0; s < r.milliseconds.size(); s++)
+		{
+			fprintf(file, "%s%.6f", s ? ", " : "", r.milliseconds[s]);
+		}
+		fprintf(file, "]}");
+	}
+	fprintf(file, "\n\t]\n}\n");
+}
+
+static void writeCsv(FILE* file, const Bench& bench) {
+	fprintf(file, "name,items,repetitions,min_ms,median_ms,mean_ms,stddev_ms,max_ms,items_per_second\n");
+	for (const BenchResult& r : bench.getResults()) {
+		fprintf(file, "%s,%zu,%zu,%.6f,%.6f,%.6f,%.6f,%.6f,%.1f\n", r.name.c_str(), r.items, r.milliseconds.size(),
+			r.min, r.median, r.mean, r.stddev, r.max, r.median > 0.0 ? r.items / (r.median * 1e-3) : 0.0);
+	}
+}
+
+static void printUsage() {
+	printf("Usage: core_bench [options]\n");
+	printf("  --reps <n>       Timed repetitions per benchmark (default 10)\n");
+	printf("  --warmup <n>     Untimed runs before timing (default 1)\n");
+	printf("  --filter <text>  Only run benchmarks whose name contains text\n");
+	printf("  --csv            Write CSV instead of JSON\n");
+	printf("  --out <file>     Write results to a file instead of stdout\n");
+	printf("  --assets <dir>   Directory with Suzanne.obj/.fbx and brick_color.jpg\n");
+	printf("  --gl             Also run GL benchmarks in a headless context (needs EGL)\n");
+	printf("  --threads <n>    Worker threads for the shared job system (default one per core, minus one)\n");
+	printf("  --verify         Run correctness checks instead of benchmarks, exit non-zero if any fail\n");
+	printf("  --list           Print benchmark names and exit\n");
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		bool hasValue = i + 1 < argc;
+		if (strcmp(argv[i], "--reps") == 0 && hasValue) options.repetitions = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--warmup") == 0 && hasValue) options.warmup = std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--filter") == 0 && hasValue) options.filter = argv[++i];
+		else if (strcmp(argv[i], "--out") == 0 && hasValue) options.outputPath = argv[++i];
+		else if (strcmp(argv[i], "--assets") == 0 && hasValue) {
+			options.assetPath = argv[++i];
+			if (!options.assetPath.empty() && options.assetPath.back() != '/' && options.assetPath.back() != '\\') {
+				options.assetPath += '/';
+			}
+		}
+		else if (strcmp(argv[i], "--csv") == 0) options.csv = true;
+		else if (strcmp(argv[i], "--list") == 0) options.list = true;
+		else if (strcmp(argv[i], "--gl") == 0) options.gl = true;
+		else if (strcmp(argv[i], "--verify") == 0) options.verify = true;
+		else if (strcmp(argv[i], "--threads") == 0 && hasValue) options.threads = (unsigned int)std::max(1, atoi(argv[++i]));
+		else {
+			printUsage();
+			return 1;
+		}
+	}
+
+	ew::JobSystem::setGlobalThreadCount(options.threads);
+	Bench bench(options);
+	if (options.verify) {
+		verifyLODs(bench);
+		verifyHalf(bench);
+		verifyOctahedral(bench);
+		verifyCulling(bench);
+		if (options.gl) {
+			ew::HeadlessContext context;
+			if (options.list) {
+				verifyGL(bench);
+			}
+			else if (context.create()) {
+				fprintf(stderr, "GL %s, %s\n", (const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_RENDERER));
+				verifyGL(bench);
+			}
+			else {
+				bench.check("verify/gl/context", false, "no headless context");
+			}
+		}
+		if (options.list) {
+			return 0;
+		}
+		fprintf(stderr, "%d of %d checks failed\n", bench.getNumFailures(), bench.getNumChecks());
+		return bench.getNumFailures() > 0 ? 1 : 0;
+	}
+	benchProcGen(bench);
+	benchTerrain(bench);
+	benchMeshProcessing(bench);
+	benchModel(bench);
+	benchTransforms(bench);
+	benchCamera(bench);
+	benchCulling(bench);
+	benchJobs(bench);
+	benchTextures(bench);
+	benchRenderQueue(bench);
+	if (options.gl) {
+		ew::HeadlessContext context;
+		if (options.list) {
+			benchGL(bench);
+		}
+		else if (context.create()) {
+			fprintf(stderr, "GL %s, %s\n", (const char*)glGetString(GL_VERSION), (const char*)glGetString(GL_RENDERER));
+			benchGL(bench);
+		}
+		else {
+			fprintf(stderr, "GL benchmarks skipped: no headless context\n");
+		}
+	}
+	if (options.list) {
+		return 0;
+	}
+
+	FILE* file = stdout;
+	if (!options.outputPath.empty()) {
+		file = fopen(options.outputPath.c_str(), "w");
+		if (file == NULL) {
+			printf("Failed to open %s\n", options.outputPath.c_str());
+			return 1;
+		}
+	}
+	if (options.csv) {
+		writeCsv(file, bench);
+	}
+	else {
+		writeJson(file, bench);
+	}
+	if (file != stdout) {
+		fclose(file);
+	}
+	return 0;
+}
@@ -0,0 +1,102 @@
+/*
+*	Author: Eric Winebrenner
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <filesystem>
+
+#include <ew/textureBake.h>
+
+namespace fs = std::filesystem;
+
+static bool isImage(const fs::path& path) {
+	std::string extension = path.extension().string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	static const char* imageExtensions[] = { ".jpg", ".jpeg", ".png", ".tga", ".bmp", ".psd", ".gif" };
+	for (const char* imageExtension : imageExtensions) {
+		if (extension == imageExtension) {
+			return true;
+		}
+	}
+	return false;
+}
+
+//Skips images whose baked file is already newer than the source
+static bool isUpToDate(const fs::path& sourcePath, const fs::path& outputPath) {
+	std::error_code ec;
+	fs::file_time_type outputTime = fs::last_write_time(outputPath, ec);
+	if (ec) {
+		return false;
+	}
+	fs::file_time_type sourceTime = fs::last_write_time(sourcePath, ec);
+	return !ec && outputTime >= sourceTime;
+}
+
+static void printUsage() {
+	printf("Usage: textureBaker <input file or directory> [output directory] [options]\n");
+	printf("  --raw | --bc1 | --bc3 | --bc5   Force an encoding (default picks one from the channel count)\n");
+	printf("  --linear                        Data texture, filter mips without gamma correction\n");
+	printf("  --no-mips                       Only store the top level\n");
+	printf("  --force                         Rebake even if the output is up to date\n");
+}
+
+int main(int argc, char** argv) {
+	ew::TextureBakeSettings settings;
+	bool force = false;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--raw") == 0) settings.encoding = ew::TextureEncoding::RAW;
+		else if (strcmp(argv[i], "--bc1") == 0) settings.encoding = ew::TextureEncoding::BC1;
+		else if (strcmp(argv[i], "--bc3") == 0) settings.encoding = ew::TextureEncoding::BC3;
+		else if (strcmp(argv[i], "--bc5") == 0) settings.encoding = ew::TextureEncoding::BC5;
+		else if (strcmp(argv[i], "--linear") == 0) settings.srgb = false;
+		else if (strcmp(argv[i], "--no-mips") == 0) settings.mipmap = false;
+		else if (strcmp(argv[i], "--force") == 0) force = true;
+		else if (argv[i][0] == '-') {
+			printUsage();
+			return 1;
+		}
+		else paths.push_back(argv[i]);
+	}
+	if (paths.empty() || paths.size() > 2) {
+		printUsage();
+		return 1;
+	}
+
+	fs::path input = paths[0];
+	std::vector<fs::path> sources;
+	if (fs::is_directory(input)) {
+		for (const fs::directory_entry& entry : fs::recursive_directory_iterator(input)) {
+			if (entry.is_regular_file() && isImage(entry.path())) {
+				sources.push_back(entry.path());
+			}
+		}
+	}
+	else {
+		sources.push_back(input);
+	}
+	fs::path outputDir = paths.size() > 1 ? fs::path(paths[1]) : (fs::is_directory(input) ? input : input.parent_path());
+
+	int numFailed = 0;
+	for (const fs::path& source : sources) {
+		fs::path relative = fs::is_directory(input) ? fs::relative(source, input) : source.filename();
+		fs::path output = fs::path(ew::getBakedTexturePath((outputDir / relative).string()));
+		if (!force && isUpToDate(source, output)) {
+			continue;
+		}
+		std::error_code ec;
+		fs::create_directories(output.parent_path(), ec);
+		if (ew::bakeTexture(source.string(), output.string(), settings)) {
+			printf("Baked %s -> %s\n", source.string().c_str(), output.string().c_str());
+		}
+		else {
+			numFailed++;
+		}
+	}
+	return numFailed > 0 ? 1 : 0;
+}